@@ -88,6 +88,7 @@ ADF_CreateTable(void)
 {
   ADF_AuthTable result;
   result = MallocNew(struct ADF_AuthTableInst);
+  MEM_SetTag(result, MEM_ADDRESS_FILTERS, 1);
 
   /* Default is that nothing is allowed */
   result->base4.state = DENY;
@@ -132,6 +133,7 @@ open_node(TableNode *node)
   if (node->extended == NULL) {
 
     node->extended = MallocArray(struct _TableNode, TABLE_SIZE);
+    MEM_SetTag(node->extended, MEM_ADDRESS_FILTERS, 1);
 
     for (i=0; i<TABLE_SIZE; i++) {
       child_node = &(node->extended[i]);
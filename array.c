@@ -37,6 +37,8 @@ struct ARR_Instance_Record {
   unsigned int elem_size;
   unsigned int used;
   unsigned int allocated;
+  MEM_Tag tag;
+  int count_elements;
 };
 
 ARR_Instance
@@ -52,6 +54,8 @@ ARR_CreateInstance(unsigned int elem_size)
   array->elem_size = elem_size;
   array->used = 0;
   array->allocated = 0;
+  array->tag = MEM_OTHER;
+  array->count_elements = 0;
 
   return array;
 }
@@ -80,11 +84,19 @@ realloc_array(ARR_Instance array, unsigned int min_size)
   array->data = Realloc2(array->data, array->allocated, array->elem_size);
 }
 
+static void
+update_tag(ARR_Instance array)
+{
+  if (array->tag != MEM_OTHER)
+    MEM_SetTag(array->data, array->tag, array->count_elements ? array->used : 0);
+}
+
 void *
 ARR_GetNewElement(ARR_Instance array)
 {
   array->used++;
   realloc_array(array, array->used);
+  update_tag(array);
   return ARR_GetElement(array, array->used - 1);
 }
 
@@ -121,6 +133,7 @@ ARR_SetSize(ARR_Instance array, unsigned int size)
 {
   realloc_array(array, size);
   array->used = size;
+  update_tag(array);
 }
 
 unsigned int
@@ -128,3 +141,12 @@ ARR_GetSize(ARR_Instance array)
 {
   return array->used;
 }
+
+void
+ARR_SetTag(ARR_Instance array, MEM_Tag tag, int count_elements)
+{
+  array->tag = tag;
+  array->count_elements = count_elements;
+  MEM_SetTag(array, tag, 0);
+  update_tag(array);
+}
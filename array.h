@@ -27,6 +27,8 @@
 #ifndef GOT_ARRAY_H
 #define GOT_ARRAY_H
 
+#include "memory.h"
+
 typedef struct ARR_Instance_Record *ARR_Instance;
 
 /* Create a new array with given element size */
@@ -53,4 +55,8 @@ extern void ARR_SetSize(ARR_Instance array, unsigned int size);
 /* Return current size of the array */
 extern unsigned int ARR_GetSize(ARR_Instance array);
 
+/* Account memory of the array to a subsystem and optionally count each
+   element as one object */
+extern void ARR_SetTag(ARR_Instance array, MEM_Tag tag, int count_elements);
+
 #endif
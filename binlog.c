@@ -0,0 +1,702 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Encoder and reader of binary log files
+  */
+
+#include "config.h"
+
+#include "sysincl.h"
+
+#include "binlog.h"
+
+#define BYTE_ORDER_MARK 0x01020304U
+
+/* Length of the record header */
+#define HEADER_LENGTH 4
+
+/* Conversion specification parsed from a format */
+typedef struct {
+  char spec[16];
+  char modifier;                /* 0, 'l' (long), 'q' (long long), 'z' (size_t) */
+  BLG_FieldType type;
+} Conversion;
+
+typedef struct {
+  unsigned char *data;
+  int size;
+  int length;
+} Buffer;
+
+/* ================================================== */
+/* Parse the conversion specification at the start of the format and
+   return its length, or 0 if it is not supported */
+
+static int
+parse_conversion(const char *format, Conversion *conv)
+{
+  int i, modifier;
+
+  if (format[0] != '%')
+    return 0;
+
+  i = 1;
+  i += strspn(format + i, "-+ #0");
+  i += strspn(format + i, "0123456789");
+  if (format[i] == '.') {
+    i++;
+    i += strspn(format + i, "0123456789");
+  }
+
+  conv->modifier = 0;
+  modifier = 0;
+
+  if (format[i] == 'h') {
+    modifier = 1;
+    i += format[i + 1] == 'h' ? 2 : 1;
+  } else if (format[i] == 'l') {
+    modifier = 1;
+    conv->modifier = format[i + 1] == 'l' ? 'q' : 'l';
+    i += format[i + 1] == 'l' ? 2 : 1;
+  } else if (format[i] == 'z') {
+    modifier = 1;
+    conv->modifier = 'z';
+    i++;
+  }
+
+  switch (format[i]) {
+    case 'd':
+    case 'i':
+      conv->type = BLG_INTEGER;
+      break;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+      conv->type = BLG_UNSIGNED;
+      break;
+    case 'c':
+      conv->type = BLG_CHAR;
+      break;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      conv->type = BLG_DOUBLE;
+      break;
+    case 's':
+      conv->type = BLG_STRING;
+      break;
+    default:
+      return 0;
+  }
+
+  if (modifier && conv->type != BLG_INTEGER && conv->type != BLG_UNSIGNED)
+    return 0;
+
+  i++;
+
+  if (i >= sizeof (conv->spec))
+    return 0;
+
+  memcpy(conv->spec, format, i);
+  conv->spec[i] = '\0';
+
+  return i;
+}
+
+/* ================================================== */
+/* Find the next conversion in the format, skipping literal text and %%.
+   Return the pointer to the conversion, NULL at the end of the format,
+   or set the length to 0 if the conversion is not supported. */
+
+static const char *
+find_conversion(const char *format, Conversion *conv, int *length)
+{
+  for (; (format = strchr(format, '%')); format += 2) {
+    if (format[1] == '%')
+      continue;
+    *length = parse_conversion(format, conv);
+    return format;
+  }
+
+  return NULL;
+}
+
+/* ================================================== */
+
+int
+BLG_GetFields(const char *format, va_list ap, BLG_Field *fields, int max_fields)
+{
+  Conversion conv;
+  int n, length;
+  va_list args;
+
+  va_copy(args, ap);
+
+  for (n = 0; (format = find_conversion(format, &conv, &length)); n++, format += length) {
+    if (length == 0 || n >= max_fields) {
+      n = -1;
+      break;
+    }
+
+    fields[n].type = conv.type;
+
+    switch (conv.type) {
+      case BLG_CHAR:
+        fields[n].value.character = va_arg(args, int);
+        break;
+      case BLG_INTEGER:
+        if (conv.modifier == 'l')
+          fields[n].value.integer = va_arg(args, long);
+        else if (conv.modifier == 'q')
+          fields[n].value.integer = va_arg(args, long long);
+        else if (conv.modifier == 'z')
+          fields[n].value.integer = (long long)va_arg(args, size_t);
+        else
+          fields[n].value.integer = va_arg(args, int);
+        break;
+      case BLG_UNSIGNED:
+        if (conv.modifier == 'l')
+          fields[n].value.unsigned_integer = va_arg(args, unsigned long);
+        else if (conv.modifier == 'q')
+          fields[n].value.unsigned_integer = va_arg(args, unsigned long long);
+        else if (conv.modifier == 'z')
+          fields[n].value.unsigned_integer = va_arg(args, size_t);
+        else
+          fields[n].value.unsigned_integer = va_arg(args, unsigned int);
+        break;
+      case BLG_DOUBLE:
+        fields[n].value.number = va_arg(args, double);
+        break;
+      case BLG_STRING:
+        fields[n].value.string = va_arg(args, const char *);
+        break;
+    }
+  }
+
+  va_end(args);
+
+  return n;
+}
+
+/* ================================================== */
+
+static int
+put_bytes(Buffer *buf, const void *data, int length)
+{
+  if (length > buf->size - buf->length)
+    return 0;
+  memcpy(buf->data + buf->length, data, length);
+  buf->length += length;
+  return 1;
+}
+
+/* ================================================== */
+
+static int
+put_varint(Buffer *buf, unsigned long long x)
+{
+  unsigned char byte;
+
+  do {
+    byte = (x & 0x7f) | (x >= 0x80 ? 0x80 : 0);
+    if (!put_bytes(buf, &byte, 1))
+      return 0;
+    x >>= 7;
+  } while (x);
+
+  return 1;
+}
+
+/* ================================================== */
+
+static int
+put_zigzag(Buffer *buf, long long x)
+{
+  return put_varint(buf, ((unsigned long long)x << 1) ^ (x < 0 ? ~0ULL : 0ULL));
+}
+
+/* ================================================== */
+
+static int
+put_header(Buffer *buf, BLG_RecordType type, int index)
+{
+  unsigned char bytes[2] = { type, index };
+  uint16_t length = 0;
+
+  if (index < 0 || index >= BLG_MAX_FORMATS)
+    return 0;
+
+  buf->length = 0;
+
+  return put_bytes(buf, &length, sizeof (length)) && put_bytes(buf, bytes, sizeof (bytes));
+}
+
+/* ================================================== */
+
+static int
+finish_record(Buffer *buf)
+{
+  uint16_t length = buf->length;
+
+  if (buf->length > BLG_MAX_RECORD_LENGTH)
+    return 0;
+
+  memcpy(buf->data, &length, sizeof (length));
+
+  return buf->length;
+}
+
+/* ================================================== */
+
+int
+BLG_EncodeStartRecord(void *buf, int size, const char *name, const char *banner,
+                      int banner_interval)
+{
+  uint32_t byte_order = BYTE_ORDER_MARK, interval = banner_interval;
+  uint16_t version = BLG_VERSION;
+  Buffer b = { buf, size, 0 };
+
+  if (strlen(name) >= BLG_MAX_NAME_LENGTH || strlen(banner) >= BLG_MAX_BANNER_LENGTH)
+    return 0;
+
+  if (!put_header(&b, BLG_RECORD_START, 0) ||
+      !put_bytes(&b, BLG_MAGIC, 8) ||
+      !put_bytes(&b, &byte_order, sizeof (byte_order)) ||
+      !put_bytes(&b, &version, sizeof (version)) ||
+      !put_bytes(&b, &interval, sizeof (interval)) ||
+      !put_bytes(&b, name, strlen(name) + 1) ||
+      !put_bytes(&b, banner, strlen(banner) + 1))
+    return 0;
+
+  return finish_record(&b);
+}
+
+/* ================================================== */
+
+int
+BLG_EncodeFormatRecord(void *buf, int size, int index, const char *format)
+{
+  Buffer b = { buf, size, 0 };
+
+  if (strlen(format) >= BLG_MAX_FORMAT_LENGTH)
+    return 0;
+
+  if (!put_header(&b, BLG_RECORD_FORMAT, index) ||
+      !put_bytes(&b, format, strlen(format) + 1))
+    return 0;
+
+  return finish_record(&b);
+}
+
+/* ================================================== */
+
+int
+BLG_EncodeDataRecord(void *buf, int size, int index, const struct timespec *time,
+                     const BLG_Field *fields, int n_fields)
+{
+  Buffer b = { buf, size, 0 };
+  const BLG_Field *field;
+  unsigned char byte;
+  double number;
+  int i, r;
+
+  if (!put_header(&b, BLG_RECORD_DATA, index) ||
+      !put_zigzag(&b, time->tv_sec) || !put_varint(&b, time->tv_nsec))
+    return 0;
+
+  for (i = 0; i < n_fields; i++) {
+    field = &fields[i];
+
+    switch (field->type) {
+      case BLG_CHAR:
+        byte = field->value.character;
+        r = put_bytes(&b, &byte, 1);
+        break;
+      case BLG_INTEGER:
+        r = put_zigzag(&b, field->value.integer);
+        break;
+      case BLG_UNSIGNED:
+        r = put_varint(&b, field->value.unsigned_integer);
+        break;
+      case BLG_DOUBLE:
+        number = field->value.number;
+        r = put_bytes(&b, &number, sizeof (number));
+        break;
+      case BLG_STRING:
+        r = put_varint(&b, strlen(field->value.string)) &&
+            put_bytes(&b, field->value.string, strlen(field->value.string));
+        break;
+      default:
+        r = 0;
+    }
+
+    if (!r)
+      return 0;
+  }
+
+  return finish_record(&b);
+}
+
+/* ================================================== */
+
+void
+BLG_InitReader(BLG_Reader *reader, FILE *file)
+{
+  reader->file = file;
+  reader->started = 0;
+}
+
+/* ================================================== */
+
+static int
+get_bytes(Buffer *buf, void *data, int length)
+{
+  if (length > buf->size - buf->length)
+    return 0;
+  memcpy(data, buf->data + buf->length, length);
+  buf->length += length;
+  return 1;
+}
+
+/* ================================================== */
+
+static int
+get_varint(Buffer *buf, unsigned long long *x)
+{
+  unsigned char byte;
+  int shift;
+
+  for (*x = 0, shift = 0; shift < 64; shift += 7) {
+    if (!get_bytes(buf, &byte, 1))
+      return 0;
+    *x |= (unsigned long long)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return 1;
+  }
+
+  return 0;
+}
+
+/* ================================================== */
+
+static int
+get_zigzag(Buffer *buf, long long *x)
+{
+  unsigned long long y;
+
+  if (!get_varint(buf, &y))
+    return 0;
+
+  *x = (long long)(y >> 1) ^ -(long long)(y & 1);
+
+  return 1;
+}
+
+/* ================================================== */
+/* Get a NUL-terminated string and copy it to a buffer of the given size */
+
+static int
+get_string(Buffer *buf, char *s, int size)
+{
+  const char *end;
+  int length;
+
+  end = memchr(buf->data + buf->length, '\0', buf->size - buf->length);
+  if (!end)
+    return 0;
+
+  length = end - (const char *)buf->data - buf->length;
+  if (length >= size)
+    return 0;
+
+  return get_bytes(buf, s, length + 1);
+}
+
+/* ================================================== */
+
+static int
+read_start(BLG_Reader *reader, Buffer *buf)
+{
+  uint32_t byte_order, interval;
+  uint16_t version;
+  char magic[8];
+  int i;
+
+  if (!get_bytes(buf, magic, sizeof (magic)) || memcmp(magic, BLG_MAGIC, sizeof (magic)) != 0 ||
+      !get_bytes(buf, &byte_order, sizeof (byte_order)) || byte_order != BYTE_ORDER_MARK ||
+      !get_bytes(buf, &version, sizeof (version)) || version != BLG_VERSION ||
+      !get_bytes(buf, &interval, sizeof (interval)) ||
+      !get_string(buf, reader->name, sizeof (reader->name)) ||
+      !get_string(buf, reader->banner, sizeof (reader->banner)))
+    return 0;
+
+  reader->banner_interval = interval;
+  reader->records = 0;
+  reader->started = 1;
+
+  for (i = 0; i < BLG_MAX_FORMATS; i++)
+    reader->formats[i][0] = '\0';
+
+  return 1;
+}
+
+/* ================================================== */
+
+static int
+read_data(BLG_Reader *reader, Buffer *buf, int index, BLG_Record *record)
+{
+  unsigned long long x;
+  unsigned char byte;
+  const char *format;
+  BLG_Field *field;
+  Conversion conv;
+  int n, length, strings;
+  long long sec;
+
+  format = reader->formats[index];
+  if (!reader->started || format[0] == '\0')
+    return 0;
+
+  if (!get_zigzag(buf, &sec) || !get_varint(buf, &x) || x >= 1000000000)
+    return 0;
+
+  record->name = reader->name;
+  record->index = reader->records;
+  record->time.tv_sec = sec;
+  record->time.tv_nsec = x;
+  record->format = format;
+
+  strings = 0;
+
+  for (n = 0; (format = find_conversion(format, &conv, &length)); n++, format += length) {
+    if (length == 0 || n >= BLG_MAX_FIELDS)
+      return 0;
+
+    field = &record->fields[n];
+    field->type = conv.type;
+
+    switch (conv.type) {
+      case BLG_CHAR:
+        if (!get_bytes(buf, &byte, 1))
+          return 0;
+        field->value.character = byte;
+        break;
+      case BLG_INTEGER:
+        if (!get_zigzag(buf, &field->value.integer))
+          return 0;
+        break;
+      case BLG_UNSIGNED:
+        if (!get_varint(buf, &field->value.unsigned_integer))
+          return 0;
+        break;
+      case BLG_DOUBLE:
+        if (!get_bytes(buf, &field->value.number, sizeof (field->value.number)))
+          return 0;
+        break;
+      case BLG_STRING:
+        /* The strings cannot be longer than the record */
+        if (!get_varint(buf, &x) || x >= sizeof (reader->strings) - strings ||
+            !get_bytes(buf, reader->strings + strings, x))
+          return 0;
+        reader->strings[strings + x] = '\0';
+        field->value.string = reader->strings + strings;
+        strings += x + 1;
+        break;
+    }
+  }
+
+  record->n_fields = n;
+  reader->records++;
+
+  return 1;
+}
+
+/* ================================================== */
+
+BLG_Status
+BLG_ReadRecord(BLG_Reader *reader, BLG_Record *record)
+{
+  Buffer buf;
+  uint16_t length;
+  int type, index;
+  size_t r;
+
+  while (1) {
+    r = fread(reader->data, 1, HEADER_LENGTH, reader->file);
+    if (r == 0 && feof(reader->file))
+      return BLG_END;
+    if (r != HEADER_LENGTH)
+      return BLG_INVALID;
+
+    memcpy(&length, reader->data, sizeof (length));
+    type = reader->data[2];
+    index = reader->data[3];
+
+    if (length < HEADER_LENGTH || length > sizeof (reader->data) || index >= BLG_MAX_FORMATS ||
+        fread(reader->data + HEADER_LENGTH, 1, length - HEADER_LENGTH,
+              reader->file) != length - HEADER_LENGTH)
+      return BLG_INVALID;
+
+    buf.data = reader->data;
+    buf.size = length;
+    buf.length = HEADER_LENGTH;
+
+    switch (type) {
+      case BLG_RECORD_START:
+        if (!read_start(reader, &buf))
+          return BLG_INVALID;
+        break;
+      case BLG_RECORD_FORMAT:
+        if (!reader->started ||
+            !get_string(&buf, reader->formats[index], sizeof (reader->formats[index])))
+          return BLG_INVALID;
+        break;
+      case BLG_RECORD_DATA:
+        if (!read_data(reader, &buf, index, record))
+          return BLG_INVALID;
+        return BLG_OK;
+      default:
+        /* Ignore records of unknown types */
+        break;
+    }
+  }
+}
+
+/* ================================================== */
+
+static int
+print_field(char *buf, int size, const Conversion *conv, const BLG_Field *field)
+{
+  if (field->type != conv->type)
+    return -1;
+
+  switch (conv->type) {
+    case BLG_CHAR:
+      return snprintf(buf, size, conv->spec, field->value.character);
+    case BLG_INTEGER:
+      if (conv->modifier == 'l')
+        return snprintf(buf, size, conv->spec, (long)field->value.integer);
+      else if (conv->modifier == 'q')
+        return snprintf(buf, size, conv->spec, field->value.integer);
+      else if (conv->modifier == 'z')
+        return snprintf(buf, size, conv->spec, (size_t)field->value.integer);
+      return snprintf(buf, size, conv->spec, (int)field->value.integer);
+    case BLG_UNSIGNED:
+      if (conv->modifier == 'l')
+        return snprintf(buf, size, conv->spec, (unsigned long)field->value.unsigned_integer);
+      else if (conv->modifier == 'q')
+        return snprintf(buf, size, conv->spec, field->value.unsigned_integer);
+      else if (conv->modifier == 'z')
+        return snprintf(buf, size, conv->spec, (size_t)field->value.unsigned_integer);
+      return snprintf(buf, size, conv->spec, (unsigned int)field->value.unsigned_integer);
+    case BLG_DOUBLE:
+      return snprintf(buf, size, conv->spec, field->value.number);
+    case BLG_STRING:
+      return snprintf(buf, size, conv->spec, field->value.string);
+    default:
+      return -1;
+  }
+}
+
+/* ================================================== */
+
+int
+BLG_PrintRecord(const BLG_Record *record, char *buf, int size)
+{
+  const char *format, *conversion;
+  time_t sec = record->time.tv_sec;
+  Conversion conv;
+  struct tm *stm;
+  int n, r, length, conv_length;
+
+  if (size < 1)
+    return -1;
+
+  /* Format the time in the same way as UTI_TimeToLogForm() */
+  stm = gmtime(&sec);
+  if (stm)
+    length = strftime(buf, size, "%Y-%m-%d %H:%M:%S", stm);
+  else
+    length = snprintf(buf, size, "INVALID    INVALID ");
+  length = length < 0 ? 0 : length < size ? length : size - 1;
+
+  for (format = record->format, n = 0; ; n++, format = conversion + conv_length) {
+    conversion = find_conversion(format, &conv, &conv_length);
+
+    /* Copy the literal text before the conversion */
+    for (; *format && format != conversion; format++) {
+      if (format[0] == '%' && format[1] == '%')
+        format++;
+      if (length < size - 1)
+        buf[length++] = *format;
+    }
+
+    if (!conversion)
+      break;
+
+    if (conv_length == 0 || n >= record->n_fields)
+      return -1;
+
+    r = print_field(buf + length, size - length, &conv, &record->fields[n]);
+    if (r < 0)
+      return -1;
+    length += r < size - length ? r : size - length - 1;
+  }
+
+  buf[length] = '\0';
+
+  return n == record->n_fields ? length : -1;
+}
+
+/* ================================================== */
+
+int
+BLG_WriteText(BLG_Reader *reader, const BLG_Record *record, FILE *out)
+{
+  char line[BLG_MAX_LINE_LENGTH];
+  int i, length;
+
+  length = BLG_PrintRecord(record, line, sizeof (line) - 1);
+  if (length < 0)
+    return 0;
+
+  if (reader->banner_interval > 0 && record->index % reader->banner_interval == 0) {
+    length = strlen(reader->banner);
+
+    for (i = 0; i < length; i++)
+      fputc('=', out);
+    fprintf(out, "\n%s\n", reader->banner);
+    for (i = 0; i < length; i++)
+      fputc('=', out);
+    fputc('\n', out);
+  }
+
+  fprintf(out, "%s\n", line);
+
+  return !ferror(out);
+}
@@ -0,0 +1,140 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Header file for the binary format of the log files.  The encoder is
+  used by chronyd and the reader can convert the records back to the
+  lines which chronyd would write to the text log.
+
+  A binary log is a sequence of records in the native byte order.  Each
+  record starts with a 16-bit length of the whole record, an 8-bit type,
+  and an 8-bit index of the format.  A start record, written each time
+  chronyd opens the file, contains a magic string, a byte-order mark,
+  the version, the banner and its interval, and the name of the log.
+  Format records define the printf-style format of the data records
+  with the given index.  Data records contain the time of the entry as
+  a zigzag-encoded varint of seconds and a varint of nanoseconds,
+  followed by the fields specified by the format, with integers encoded
+  as (zigzag) varints, characters as single bytes, floating-point
+  values as native doubles, and strings as a varint length followed by
+  the characters.
+  */
+
+#ifndef GOT_BINLOG_H
+#define GOT_BINLOG_H
+
+#define BLG_MAGIC "CHRONYBL"
+#define BLG_VERSION 1
+
+typedef enum {
+  BLG_RECORD_START = 1,
+  BLG_RECORD_FORMAT = 2,
+  BLG_RECORD_DATA = 3,
+} BLG_RecordType;
+
+#define BLG_MAX_RECORD_LENGTH 4096
+#define BLG_MAX_NAME_LENGTH 64
+#define BLG_MAX_BANNER_LENGTH 256
+#define BLG_MAX_FORMATS 16
+#define BLG_MAX_FORMAT_LENGTH 512
+#define BLG_MAX_FIELDS 32
+
+/* Maximum length of a line of text including the newline character */
+#define BLG_MAX_LINE_LENGTH 2048
+
+typedef enum {
+  BLG_CHAR,
+  BLG_INTEGER,
+  BLG_UNSIGNED,
+  BLG_DOUBLE,
+  BLG_STRING,
+} BLG_FieldType;
+
+typedef struct {
+  BLG_FieldType type;
+  union {
+    int character;
+    long long integer;
+    unsigned long long unsigned_integer;
+    double number;
+    const char *string;
+  } value;
+} BLG_Field;
+
+/* Get the arguments of a printf-style format as fields.  Supported are
+   the c, d, i, u, o, x, X, e, E, f, F, g, G, a, A, and s conversions
+   with the h, hh, l, ll, and z length modifiers.  Return the number of
+   fields, or -1 if the format is not supported. */
+extern int BLG_GetFields(const char *format, va_list ap, BLG_Field *fields, int max_fields);
+
+/* Encode records into a buffer and return their length, or 0 if the
+   buffer is too small */
+extern int BLG_EncodeStartRecord(void *buf, int size, const char *name, const char *banner,
+                                 int banner_interval);
+extern int BLG_EncodeFormatRecord(void *buf, int size, int index, const char *format);
+extern int BLG_EncodeDataRecord(void *buf, int size, int index, const struct timespec *time,
+                                const BLG_Field *fields, int n_fields);
+
+typedef struct {
+  FILE *file;
+  int started;
+  char name[BLG_MAX_NAME_LENGTH];
+  char banner[BLG_MAX_BANNER_LENGTH];
+  int banner_interval;
+  unsigned long records;
+  char formats[BLG_MAX_FORMATS][BLG_MAX_FORMAT_LENGTH];
+  unsigned char data[BLG_MAX_RECORD_LENGTH];
+  char strings[BLG_MAX_RECORD_LENGTH];
+} BLG_Reader;
+
+typedef struct {
+  const char *name;
+  unsigned long index;          /* Number of the record since the start */
+  struct timespec time;
+  const char *format;
+  int n_fields;
+  BLG_Field fields[BLG_MAX_FIELDS];
+} BLG_Record;
+
+/* Return values of the reader functions */
+typedef enum {
+  BLG_OK,
+  BLG_END,              /* No more records in the file */
+  BLG_INVALID,          /* The file could not be read or has an invalid record */
+} BLG_Status;
+
+/* Initialise a reader of a binary log in an opened file */
+extern void BLG_InitReader(BLG_Reader *reader, FILE *file);
+
+/* Read the next data record.  The strings in the record are valid until
+   the next read. */
+extern BLG_Status BLG_ReadRecord(BLG_Reader *reader, BLG_Record *record);
+
+/* Print the record as a line of the text log without the newline
+   character.  Return the length of the line, or -1 if the record does
+   not match its format. */
+extern int BLG_PrintRecord(const BLG_Record *record, char *buf, int size);
+
+/* Write the record to a file exactly as chronyd would write it to the
+   text log, including the periodic banner */
+extern int BLG_WriteText(BLG_Reader *reader, const BLG_Record *record, FILE *out);
+
+#endif
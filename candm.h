@@ -109,7 +109,14 @@
 #define REQ_SELECT_DATA 69
 #define REQ_RELOAD_SOURCES 70
 #define REQ_DOFFSET2 71
-#define N_REQUEST_TYPES 72
+#define REQ_CLIENT_ACCESSES_BY_INDEX4 72
+#define REQ_SUBSCRIBE 73
+#define REQ_PROFILE_DATA 74
+#define REQ_RESET_PROFILE 75
+#define REQ_MEMORY_DATA 76
+#define REQ_TRACKING2 77
+#define REQ_SERVER_STATS2 78
+#define N_REQUEST_TYPES 79
 
 /* Structure used to exchange timespecs independent of time_t size */
 typedef struct {
@@ -333,6 +340,33 @@ typedef struct {
   int32_t EOR;
 } REQ_ClientAccessesByIndex;
 
+/* Request for a page of a snapshot of the client log, which is created
+   when the snapshot field is zero (the filters are used only at that time) */
+typedef struct {
+  uint32_t first_index;
+  uint32_t n_clients;
+  uint32_t min_hits;
+  uint32_t reset;
+  IPAddr ip;
+  int32_t subnet_bits;
+  uint32_t max_last_ago;
+  uint32_t snapshot;
+  int32_t EOR;
+} REQ_ClientAccessesByIndex4;
+
+/* Types of records which can be pushed to subscribers */
+#define REC_NTP_SAMPLE 0
+#define REC_REFCLOCK_SAMPLE 1
+#define REC_SOURCESTATS 2
+#define REC_SELECTION 3
+#define REC_TRACKING 4
+#define N_RECORD_TYPES 5
+
+typedef struct {
+  uint32_t records; /* Mask of (1 << REC_*), zero cancels the subscription */
+  int32_t EOR;
+} REQ_Subscribe;
+
 typedef struct {
   int32_t index;
   int32_t EOR;
@@ -371,10 +405,21 @@ typedef struct {
   int32_t EOR;
 } REQ_SelectData;
 
+typedef struct {
+  uint32_t index;
+  int32_t EOR;
+} REQ_ProfileData;
+
+typedef struct {
+  uint32_t index;
+  int32_t EOR;
+} REQ_MemoryData;
+
 /* ================================================== */
 
 #define PKT_TYPE_CMD_REQUEST 1
 #define PKT_TYPE_CMD_REPLY 2
+#define PKT_TYPE_CMD_RECORD 3
 
 /* This version number needs to be incremented whenever the packet
    size and/or the format of any of the existing messages is changed.
@@ -410,7 +455,8 @@ typedef struct {
    (two times), delta offset, and manual timestamp, added new fields and
    flags to NTP source request and report, made length of manual list constant,
    added new commands: authdata, ntpdata, onoffline, refresh, reset,
-   selectdata, serverstats, shutdown, sourcename
+   selectdata, serverstats, shutdown, sourcename, bulk client accesses by index,
+   subscribe, profiledata, resetprofile, memorydata
  */
 
 #define PROTO_VERSION_NUMBER 6
@@ -470,6 +516,7 @@ typedef struct {
     REQ_Doffset doffset;
     REQ_Sourcestats sourcestats;
     REQ_ClientAccessesByIndex client_accesses_by_index;
+    REQ_ClientAccessesByIndex4 client_accesses_by_index4;
     REQ_ManualDelete manual_delete;
     REQ_ReselectDistance reselect_distance;
     REQ_SmoothTime smoothtime;
@@ -477,6 +524,9 @@ typedef struct {
     REQ_NTPSourceName ntp_source_name;
     REQ_AuthData auth_data;
     REQ_SelectData select_data;
+    REQ_Subscribe subscribe;
+    REQ_ProfileData profile_data;
+    REQ_MemoryData memory_data;
   } data; /* Command specific parameters */
 
   /* Padding used to prevent traffic amplification.  It only defines the
@@ -519,7 +569,12 @@ typedef struct {
 #define RPY_SERVER_STATS2 22
 #define RPY_SELECT_DATA 23
 #define RPY_SERVER_STATS3 24
-#define N_REPLY_TYPES 25
+#define RPY_CLIENT_ACCESSES_BY_INDEX4 25
+#define RPY_SERVER_STATS4 26
+#define RPY_PROFILE_DATA 27
+#define RPY_MEMORY_DATA 28
+#define RPY_TRACKING2 29
+#define N_REPLY_TYPES 30
 
 /* Status codes */
 #define STT_SUCCESS 0
@@ -543,6 +598,8 @@ typedef struct {
 #define STT_BADPKTVERSION 18
 #define STT_BADPKTLENGTH 19
 #define STT_INVALIDNAME 21
+#define STT_NOSUCHSNAPSHOT 22
+#define STT_TOOMANYSUBSCRIBERS 23
 
 typedef struct {
   int32_t EOR;
@@ -594,6 +651,9 @@ typedef struct {
   Float root_delay;
   Float root_dispersion;
   Float last_update_interval;
+  /* Fields following are included only in RPY_TRACKING2 */
+  Float first_update_delay; /* Time from start to first clock update, or
+                               negative if the clock was not updated yet */
   int32_t EOR;
 } RPY_Tracking;
 
@@ -653,6 +713,19 @@ typedef struct {
   int32_t EOR;
 } RPY_ClientAccessesByIndex;
 
+/* The bulk reply is allowed only on the Unix domain socket, which doesn't
+   need to limit the length of replies to the length of requests */
+#define MAX_CLIENT_ACCESSES_BULK 1024
+
+typedef struct {
+  uint32_t n_indices;      /* how many clients there are in the snapshot */
+  uint32_t next_index;     /* the index 1 beyond those processed on this call */
+  uint32_t n_clients;      /* the number of valid entries in the following array */
+  uint32_t snapshot;       /* identifier of the snapshot */
+  RPY_ClientAccesses_Client clients[MAX_CLIENT_ACCESSES_BULK];
+  int32_t EOR;
+} RPY_ClientAccessesByIndex4;
+
 typedef struct {
   uint32_t ntp_hits;
   uint32_t nke_hits;
@@ -665,6 +738,13 @@ typedef struct {
   uint32_t ntp_interleaved_hits;
   uint32_t ntp_timestamps;
   uint32_t ntp_span_seconds;
+  /* Fields following are included only in RPY_SERVER_STATS4 */
+  uint32_t signd_requests;
+  uint32_t signd_drops;
+  uint32_t signd_timeouts;
+  uint32_t signd_max_queue;
+  Float signd_mean_delay;
+  Float signd_max_delay;
   int32_t EOR;
 } RPY_ServerStats;
 
@@ -734,7 +814,8 @@ typedef struct {
   uint32_t total_tx_count;
   uint32_t total_rx_count;
   uint32_t total_valid_count;
-  uint32_t reserved[4];
+  uint32_t memory_size;
+  uint32_t reserved[3];
   int32_t EOR;
 } RPY_NTPData;
 
@@ -782,6 +863,37 @@ typedef struct {
   int32_t EOR;
 } RPY_SelectData;
 
+#define RPY_PD_TYPE_FILE_HANDLER 0
+#define RPY_PD_TYPE_TIMEOUT_HANDLER 1
+#define RPY_PD_TYPE_WAIT 2
+#define RPY_PD_TYPE_COUNTER 3
+
+typedef struct {
+  uint32_t n_entries;
+  uint32_t interval;
+  int8_t name[64];
+  uint16_t type;
+  uint16_t pad;
+  uint32_t count;
+  Float total_wall_time;
+  Float max_wall_time;
+  Float total_cpu_time;
+  Float max_cpu_time;
+  int32_t EOR;
+} RPY_ProfileData;
+
+typedef struct {
+  uint32_t n_entries;
+  int8_t name[32];
+  uint32_t current_bytes_high;
+  uint32_t current_bytes_low;
+  uint32_t peak_bytes_high;
+  uint32_t peak_bytes_low;
+  uint32_t current_objects;
+  uint32_t peak_objects;
+  int32_t EOR;
+} RPY_MemoryData;
+
 typedef struct {
   uint8_t version;
   uint8_t pkt_type;
@@ -814,10 +926,121 @@ typedef struct {
     RPY_NTPSourceName ntp_source_name;
     RPY_AuthData auth_data;
     RPY_SelectData select_data;
+    RPY_ProfileData profile_data;
+    RPY_MemoryData memory_data;
   } data; /* Reply specific parameters */
 
 } CMD_Reply;
 
+/* Reply which is too long to be included in CMD_Reply.  The header is the
+   same. */
+typedef struct {
+  uint8_t version;
+  uint8_t pkt_type;
+  uint8_t res1;
+  uint8_t res2;
+  uint16_t command;
+  uint16_t reply;
+  uint16_t status;
+  uint16_t pad1;
+  uint16_t pad2;
+  uint16_t pad3;
+  uint32_t sequence;
+  uint32_t pad4;
+  uint32_t pad5;
+
+  union {
+    RPY_ClientAccessesByIndex4 client_accesses_by_index4;
+  } data;
+
+} CMD_BulkReply;
+
+/* ================================================== */
+
+/* Records pushed to subscribers.  They are sent from the Unix domain command
+   socket to the socket from which the SUBSCRIBE request was received, until
+   the subscription is cancelled or the socket is closed.  Records which
+   cannot be sent immediately are dropped, which can be detected from gaps
+   in the sequence numbers. */
+
+typedef struct {
+  uint32_t ref_id;
+  IPAddr ip_addr;
+  int32_t EOR;
+} REC_Selection;
+
+#define REC_RS_FLAG_FILTERED 0x1
+
+typedef struct {
+  uint32_t ref_id;
+  Float raw_offset;
+  Float cooked_offset;
+  Float dispersion;
+  uint8_t leap;
+  int8_t pulse;
+  uint8_t flags;
+  uint8_t pad;
+  int32_t EOR;
+} REC_RefclockSample;
+
+typedef struct {
+  uint8_t version;
+  uint8_t pkt_type;
+  uint8_t res1;
+  uint8_t res2;
+  uint16_t record; /* Which type of record this is */
+  uint16_t pad1;
+  uint32_t sequence; /* Number of records generated for the subscriber */
+  Timespec time; /* Time of the sample or update */
+
+  union {
+    RPY_NTPData ntp_sample;
+    REC_RefclockSample refclock_sample;
+    RPY_Sourcestats sourcestats;
+    REC_Selection selection;
+    RPY_Tracking tracking;
+  } data;
+
+} CMD_Record;
+
+/* ================================================== */
+
+/* Layout of the status page, which chronyd can publish in a file (specified
+   by the statusfile directive) for monitoring without sending requests.
+   The page starts with CMD_StatusPage, followed by an array of max_sources
+   CMD_StatusPageSource records, n_sources of which are valid.  The header
+   fields are in the host byte order, the data fields have the same format
+   as in the replies.
+
+   The sequence number is odd while the page is being updated.  A reader has
+   to copy the data and check that the sequence number was even and did not
+   change in the meantime.  When the STALE flag is set, the file was replaced
+   (or removed) and it needs to be opened again. */
+
+#define STATUS_PAGE_MAGIC 0x43505453
+#define STATUS_PAGE_VERSION 3
+
+#define STATUS_PAGE_FLAG_STALE 0x1
+
+typedef struct {
+  RPY_Source_Data source_data;
+  RPY_Sourcestats sourcestats;
+} CMD_StatusPageSource;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t sequence;
+  uint32_t flags;
+  uint32_t size;
+  uint32_t max_sources;
+  uint32_t n_sources;
+  Float first_update_delay; /* Time from start to first clock update, or
+                               negative if the clock was not updated yet */
+  RPY_Tracking tracking;
+  RPY_ServerStats server_stats;
+} CMD_StatusPage;
+
 /* ================================================== */
 
 #endif /* GOT_CANDM_H */
@@ -32,6 +32,7 @@
 #include "sysincl.h"
 
 #include "array.h"
+#include "binlog.h"
 #include "candm.h"
 #include "cmac.h"
 #include "logging.h"
@@ -41,6 +42,7 @@
 #include "cmdparse.h"
 #include "pktlength.h"
 #include "socket.h"
+#include "statuspage.h"
 #include "util.h"
 
 #ifdef FEAT_READLINE
@@ -71,6 +73,10 @@ static int source_names = 0;
 
 static int csv_mode = 0;
 
+/* Path to the status page published by chronyd and its reader */
+static const char *status_file = NULL;
+static STP_Reader status_reader;
+
 /* ================================================== */
 /* Log a message. This is a minimalistic replacement of the logging.c
    implementation to avoid linking with it and other modules. */
@@ -124,7 +130,7 @@ read_line(void)
       line[sizeof(line) - 1] = '\0';
       add_history(cmd);
       /* free the buffer allocated by readline */
-      Free(cmd);
+      free(cmd);
     } else {
       /* simulate the user has entered an empty line */
       *line = '\0';
@@ -1048,8 +1054,11 @@ give_help(void)
     "\0(e.g. Sep 25, 2015 16:30:05 or 16:30:05)\0"
     "\0\0NTP access:\0\0"
     "accheck <address>\0Check whether address is allowed\0"
-    "clients [-p <packets>] [-k] [-r]\0Report on clients that accessed the server\0"
+    "clients [-p <packets>] [-k] [-r] [-a <subnet>] [-t <seconds>]\0"
+                          "Report on clients that accessed the server\0"
     "serverstats\0Display statistics of the server\0"
+    "profile [-r]\0Display profile of the main loop\0"
+    "memory\0Display memory usage of the server\0"
     "allow [<subnet>]\0Allow access to subnet as a default\0"
     "allow all [<subnet>]\0Allow access to subnet and all children\0"
     "deny [<subnet>]\0Deny access to subnet as a default\0"
@@ -1074,6 +1083,7 @@ give_help(void)
     "Other daemon commands:\0\0"
     "cyclelogs\0Close and re-open log files\0"
     "dump\0Dump measurements and NTS keys/cookies\0"
+    "monitor [<record>...]\0Print records pushed by daemon\0"
     "rekey\0Re-read keys\0"
     "reset sources\0Drop all measurements\0"
     "shutdown\0Stop daemon\0"
@@ -1084,6 +1094,7 @@ give_help(void)
     "timeout <milliseconds>\0Set initial response timeout\0"
     "retries <retries>\0Set maximum number of retries\0"
     "keygen [<id> [<type> [<bits>]]]\0Generate key for key file\0"
+    "printlog <file>\0Print binary log file as text\0"
     "exit|quit\0Leave the program\0"
     "help\0Generate this help\0"
     "\0";
@@ -1125,9 +1136,10 @@ command_name_generator(const char *text, int state)
     "clients", "cmdaccheck", "cmdallow", "cmddeny", "cyclelogs", "delete",
     "deny", "dns", "dump", "exit", "help", "keygen", "local", "makestep",
     "manual", "maxdelay", "maxdelaydevratio", "maxdelayratio", "maxpoll",
-    "maxupdateskew", "minpoll", "minstratum", "ntpdata", "offline", "online", "onoffline",
-    "polltarget", "quit", "refresh", "rekey", "reload", "reselect", "reselectdist", "reset",
-    "retries", "rtcdata", "selectdata", "serverstats", "settime", "shutdown", "smoothing",
+    "maxupdateskew", "memory", "minpoll", "minstratum", "monitor", "ntpdata", "offline", "online",
+    "onoffline",
+    "polltarget", "printlog", "profile", "quit", "refresh", "rekey", "reload", "reselect", "reselectdist",
+    "reset", "retries", "rtcdata", "selectdata", "serverstats", "settime", "shutdown", "smoothing",
     "smoothtime", "sourcename", "sources", "sourcestats",
     "timeout", "tracking", "trimrtc", "waitsync", "writertc",
     NULL
@@ -1205,84 +1217,135 @@ static int max_retries = 2;
 static int initial_timeout = 1000;
 static int proto_version = PROTO_VERSION_NUMBER;
 
-/* This is the core protocol module.  Complete particular fields in
-   the outgoing packet, send it, wait for a response, handle retries,
-   etc.  Returns a Boolean indicating whether the protocol was
-   successful or not.*/
+/* Maximum number of requests sent to the daemon before waiting for their
+   replies.  It corresponds to the default burst of the cmdratelimit
+   directive to not get the requests dropped by the daemon. */
+#define MAX_REQUESTS_IN_FLIGHT 8
+
+/* Current number of requests which can be sent at the same time.  It is
+   halved when a request has to be resent (e.g. it was dropped by the rate
+   limiting in the daemon) and increased when all requests were answered on
+   the first attempt. */
+static int request_window = MAX_REQUESTS_IN_FLIGHT;
+
+/* Complete particular fields in the outgoing packet and send it.  A new
+   sequence number is used in each attempt. */
 
 static int
-submit_request(CMD_Request *request, CMD_Reply *reply)
+send_request(CMD_Request *request, int *n_attempts, struct timespec *ts_start)
+{
+  int command_length, padding_length;
+  struct timeval tv;
+
+  if (*n_attempts > max_retries)
+    return 0;
+
+  if (gettimeofday(&tv, NULL))
+    return 0;
+
+  UTI_TimevalToTimespec(&tv, ts_start);
+
+  UTI_GetRandomBytes(&request->sequence, sizeof (request->sequence));
+  request->attempt = htons(*n_attempts);
+  request->version = proto_version;
+  command_length = PKL_CommandLength(request);
+  padding_length = PKL_CommandPaddingLength(request);
+  assert(command_length > 0 && command_length > padding_length);
+
+  (*n_attempts)++;
+
+  /* Zero the padding to not send any uninitialized data */
+  memset(((char *)request) + command_length - padding_length, 0, padding_length);
+
+  if (sock_fd < 0) {
+    DEBUG_LOG("No socket to send request");
+    return 0;
+  }
+
+  if (SCK_Send(sock_fd, (void *)request, command_length, 0) < 0)
+    return 0;
+
+  return 1;
+}
+
+/* ================================================== */
+
+/* This is the core protocol module.  Send the requests, wait for responses
+   matching their sequence numbers, handle retries, etc.  All requests are
+   in flight at the same time.  Returns a Boolean indicating whether the
+   protocol was successful or not.*/
+
+static int
+submit_requests(CMD_Request **requests, CMD_Reply **replies, int n, int reply_length)
 {
   int select_status;
   int recv_status;
   int read_length;
-  int command_length;
-  int padding_length;
-  struct timespec ts_now, ts_start;
+  struct timespec ts_now, ts_start[MAX_REQUESTS_IN_FLIGHT];
   struct timeval tv;
-  int n_attempts, new_attempt;
-  double timeout;
+  int i, j, n_done, resent, n_attempts[MAX_REQUESTS_IN_FLIGHT], done[MAX_REQUESTS_IN_FLIGHT];
+  double timeout, min_timeout;
+  CMD_Reply *reply;
   fd_set rdfd;
 
-  request->pkt_type = PKT_TYPE_CMD_REQUEST;
-  request->res1 = 0;
-  request->res2 = 0;
-  request->pad1 = 0;
-  request->pad2 = 0;
+  /* Replies can be received in any order, only a single reply can be
+     longer than CMD_Reply */
+  assert(n > 0 && n <= MAX_REQUESTS_IN_FLIGHT);
+  assert(n == 1 || reply_length == sizeof (CMD_Reply));
 
-  n_attempts = 0;
-  new_attempt = 1;
+  for (i = 0; i < n; i++) {
+    requests[i]->pkt_type = PKT_TYPE_CMD_REQUEST;
+    requests[i]->res1 = 0;
+    requests[i]->res2 = 0;
+    requests[i]->pad1 = 0;
+    requests[i]->pad2 = 0;
 
-  do {
-    if (gettimeofday(&tv, NULL))
+    n_attempts[i] = 0;
+    done[i] = 0;
+
+    if (!send_request(requests[i], &n_attempts[i], &ts_start[i]))
       return 0;
+  }
 
-    if (new_attempt) {
-      new_attempt = 0;
+  n_done = 0;
 
-      if (n_attempts > max_retries)
-        return 0;
+  while (n_done < n) {
+    if (gettimeofday(&tv, NULL))
+      return 0;
 
-      UTI_TimevalToTimespec(&tv, &ts_start);
+    UTI_TimevalToTimespec(&tv, &ts_now);
 
-      UTI_GetRandomBytes(&request->sequence, sizeof (request->sequence));
-      request->attempt = htons(n_attempts);
-      request->version = proto_version;
-      command_length = PKL_CommandLength(request);
-      padding_length = PKL_CommandPaddingLength(request);
-      assert(command_length > 0 && command_length > padding_length);
+    /* Find the request which will time out first and resend requests
+       which already timed out */
+    for (i = 0, min_timeout = 0.0, reply = NULL; i < n; i++) {
+      if (done[i])
+        continue;
 
-      n_attempts++;
+      /* Check if the clock wasn't stepped back */
+      if (UTI_CompareTimespecs(&ts_now, &ts_start[i]) < 0)
+        ts_start[i] = ts_now;
 
-      /* Zero the padding to not send any uninitialized data */
-      memset(((char *)request) + command_length - padding_length, 0, padding_length);
+      timeout = initial_timeout / 1000.0 * (1U << (n_attempts[i] - 1)) -
+                UTI_DiffTimespecsToDouble(&ts_now, &ts_start[i]);
 
-      if (sock_fd < 0) {
-        DEBUG_LOG("No socket to send request");
-        return 0;
+      /* Avoid calling select() with an invalid timeout */
+      if (timeout <= 0.0) {
+        if (!send_request(requests[i], &n_attempts[i], &ts_start[i]))
+          return 0;
+        timeout = initial_timeout / 1000.0 * (1U << (n_attempts[i] - 1));
       }
 
-      if (SCK_Send(sock_fd, (void *)request, command_length, 0) < 0)
-        return 0;
-    }
-
-    UTI_TimevalToTimespec(&tv, &ts_now);
-
-    /* Check if the clock wasn't stepped back */
-    if (UTI_CompareTimespecs(&ts_now, &ts_start) < 0)
-      ts_start = ts_now;
+      if (!reply || timeout < min_timeout)
+        min_timeout = timeout;
 
-    timeout = initial_timeout / 1000.0 * (1U << (n_attempts - 1)) -
-              UTI_DiffTimespecsToDouble(&ts_now, &ts_start);
-    DEBUG_LOG("Timeout %f seconds", timeout);
-
-    /* Avoid calling select() with an invalid timeout */
-    if (timeout <= 0.0) {
-      new_attempt = 1;
-      continue;
+      /* Receive the next reply to the buffer of a pending request */
+      if (!reply)
+        reply = replies[i];
     }
 
-    UTI_DoubleToTimeval_updated(timeout, &tv);
+    DEBUG_LOG("Timeout %f seconds", min_timeout);
+
+    UTI_DoubleToTimeval_updated(min_timeout, &tv);
 
     FD_ZERO(&rdfd);
     FD_SET(sock_fd, &rdfd);
@@ -1296,61 +1359,89 @@ submit_request(CMD_Request *request, CMD_Reply *reply)
       DEBUG_LOG("select failed : %s", strerror(errno));
       return 0;
     } else if (select_status == 0) {
-      /* Timeout must have elapsed, try a resend? */
-      new_attempt = 1;
-    } else {
-      recv_status = SCK_Receive(sock_fd, reply, sizeof (*reply), 0);
-      
-      if (recv_status < 0) {
-        new_attempt = 1;
-      } else {
-        read_length = recv_status;
-        
-        /* Check if the header is valid */
-        if (read_length < offsetof(CMD_Reply, data) ||
-            (reply->version != proto_version &&
-             !(reply->version >= PROTO_VERSION_MISMATCH_COMPAT_CLIENT &&
-               ntohs(reply->status) == STT_BADPKTVERSION)) ||
-            reply->pkt_type != PKT_TYPE_CMD_REPLY ||
-            reply->res1 != 0 ||
-            reply->res2 != 0 ||
-            reply->command != request->command ||
-            reply->sequence != request->sequence) {
-          DEBUG_LOG("Invalid reply");
-          continue;
-        }
-        
+      /* Timeout must have elapsed, the request will be resent */
+      continue;
+    }
+
+    recv_status = SCK_Receive(sock_fd, reply, reply_length, 0);
+
+    if (recv_status < 0) {
+      /* Try a resend of all pending requests */
+      for (i = 0; i < n; i++) {
+        if (!done[i] && !send_request(requests[i], &n_attempts[i], &ts_start[i]))
+          return 0;
+      }
+      continue;
+    }
+
+    read_length = recv_status;
+
+    /* Find the request to which the reply belongs */
+    for (j = 0; j < n; j++) {
+      if (!done[j] && read_length >= offsetof(CMD_Reply, data) &&
+          reply->command == requests[j]->command &&
+          reply->sequence == requests[j]->sequence)
+        break;
+    }
+
+    /* Check if the header is valid */
+    if (j >= n ||
+        (reply->version != proto_version &&
+         !(reply->version >= PROTO_VERSION_MISMATCH_COMPAT_CLIENT &&
+           ntohs(reply->status) == STT_BADPKTVERSION)) ||
+        reply->pkt_type != PKT_TYPE_CMD_REPLY ||
+        reply->res1 != 0 ||
+        reply->res2 != 0) {
+      DEBUG_LOG("Invalid reply");
+      continue;
+    }
+
 #if PROTO_VERSION_NUMBER == 6
-        /* Protocol version 5 is similar to 6 except there is no padding.
-           If a version 5 reply with STT_BADPKTVERSION is received,
-           switch our version and try again. */
-        if (proto_version == PROTO_VERSION_NUMBER &&
-            reply->version == PROTO_VERSION_NUMBER - 1) {
-          proto_version = PROTO_VERSION_NUMBER - 1;
-          n_attempts--;
-          new_attempt = 1;
-          continue;
-        }
+    /* Protocol version 5 is similar to 6 except there is no padding.
+       If a version 5 reply with STT_BADPKTVERSION is received,
+       switch our version and try again. */
+    if (requests[j]->version == PROTO_VERSION_NUMBER &&
+        reply->version == PROTO_VERSION_NUMBER - 1) {
+      proto_version = PROTO_VERSION_NUMBER - 1;
+      n_attempts[j]--;
+      if (!send_request(requests[j], &n_attempts[j], &ts_start[j]))
+        return 0;
+      continue;
+    }
 #else
 #error unknown compatibility with PROTO_VERSION - 1
 #endif
 
-        /* Check that the packet contains all data it is supposed to have.
-           Unknown responses will always pass this test as their expected
-           length is zero. */
-        if (read_length < PKL_ReplyLength(reply)) {
-          DEBUG_LOG("Reply too short");
-          new_attempt = 1;
-          continue;
-        }
-
-        /* Good packet received, print out results */
-        DEBUG_LOG("Reply cmd=%d reply=%d stat=%d",
-                  ntohs(reply->command), ntohs(reply->reply), ntohs(reply->status));
-        break;
-      }
+    /* Check that the packet contains all data it is supposed to have.
+       Unknown responses will always pass this test as their expected
+       length is zero. */
+    if (read_length < PKL_ReplyLength(reply)) {
+      DEBUG_LOG("Reply too short");
+      if (!send_request(requests[j], &n_attempts[j], &ts_start[j]))
+        return 0;
+      continue;
     }
-  } while (1);
+
+    /* Good packet received, print out results */
+    DEBUG_LOG("Reply cmd=%d reply=%d stat=%d",
+              ntohs(reply->command), ntohs(reply->reply), ntohs(reply->status));
+
+    if (reply != replies[j])
+      memcpy(replies[j], reply, read_length);
+
+    done[j] = 1;
+    n_done++;
+  }
+
+  for (i = resent = 0; i < n; i++) {
+    if (n_attempts[i] > 1)
+      resent = 1;
+  }
+
+  if (resent)
+    request_window = MAX(request_window / 2, 1);
+  else if (request_window < MAX_REQUESTS_IN_FLIGHT)
+    request_window++;
 
   return 1;
 }
@@ -1358,11 +1449,98 @@ submit_request(CMD_Request *request, CMD_Reply *reply)
 /* ================================================== */
 
 static int
-request_reply(CMD_Request *request, CMD_Reply *reply, int requested_reply, int verbose)
+submit_request(CMD_Request *request, CMD_Reply *reply, int reply_length)
 {
-  int status;
+  return submit_requests(&request, &reply, 1, reply_length);
+}
+
+/* ================================================== */
+
+/* Get a reply to a monitoring request from the status page instead of
+   the daemon.  Returns 0 if the request cannot be handled this way. */
+
+static int
+read_status_page(CMD_Request *request, CMD_Reply *reply)
+{
+  CMD_StatusPageSource source;
+  STP_Status status;
+  uint32_t n_sources;
+  int command;
+
+  command = ntohs(request->command);
+
+  memset(reply, 0, sizeof (*reply));
+  reply->command = request->command;
+
+  switch (command) {
+    case REQ_N_SOURCES:
+      reply->reply = htons(RPY_N_SOURCES);
+      status = STP_ReadNumberOfSources(&status_reader, &n_sources);
+      reply->data.n_sources.n_sources = htonl(n_sources);
+      break;
+    case REQ_SOURCE_DATA:
+      reply->reply = htons(RPY_SOURCE_DATA);
+      status = STP_ReadSource(&status_reader, ntohl(request->data.source_data.index),
+                              &source);
+      reply->data.source_data = source.source_data;
+      break;
+    case REQ_SOURCESTATS:
+      reply->reply = htons(RPY_SOURCESTATS);
+      status = STP_ReadSource(&status_reader, ntohl(request->data.sourcestats.index),
+                              &source);
+      reply->data.sourcestats = source.sourcestats;
+      break;
+    case REQ_TRACKING:
+    case REQ_TRACKING2:
+      reply->reply = htons(command == REQ_TRACKING2 ? RPY_TRACKING2 : RPY_TRACKING);
+      status = STP_ReadTracking(&status_reader, &reply->data.tracking);
+      break;
+    case REQ_SERVER_STATS:
+    case REQ_SERVER_STATS2:
+      reply->reply = htons(command == REQ_SERVER_STATS2 ?
+                           RPY_SERVER_STATS4 : RPY_SERVER_STATS3);
+      status = STP_ReadServerStats(&status_reader, &reply->data.server_stats);
+      break;
+    default:
+      return 0;
+  }
+
+  switch (status) {
+    case STP_OK:
+      reply->status = htons(STT_SUCCESS);
+      return 1;
+    case STP_NO_SUCH_SOURCE:
+      reply->reply = htons(RPY_NULL);
+      reply->status = htons(STT_NOSUCHSOURCE);
+      memset(&reply->data, 0, sizeof (reply->data));
+      return 1;
+    default:
+      DEBUG_LOG("Could not read status page %s", status_file);
+      return 0;
+  }
+}
+
+/* ================================================== */
+
+/* Get replies to the requests from the status page, or the daemon */
+
+static int
+get_replies(CMD_Request **requests, CMD_Reply **replies, int n, int reply_length)
+{
+  CMD_Request *pending_requests[MAX_REQUESTS_IN_FLIGHT];
+  CMD_Reply *pending_replies[MAX_REQUESTS_IN_FLIGHT];
+  int i, n_pending;
+
+  for (i = n_pending = 0; i < n; i++) {
+    if (status_file && read_status_page(requests[i], replies[i]))
+      continue;
+    pending_requests[n_pending] = requests[i];
+    pending_replies[n_pending] = replies[i];
+    n_pending++;
+  }
 
-  while (!submit_request(request, reply)) {
+  while (n_pending > 0 &&
+         !submit_requests(pending_requests, pending_replies, n_pending, reply_length)) {
     /* Try connecting to other addresses before giving up */
     if (open_io())
       continue;
@@ -1370,6 +1548,16 @@ request_reply(CMD_Request *request, CMD_Reply *reply, int requested_reply, int v
     return 0;
   }
 
+  return 1;
+}
+
+/* ================================================== */
+
+static int
+check_reply(CMD_Reply *reply, int requested_reply, int verbose)
+{
+  int status;
+
   status = ntohs(reply->status);
         
   if (verbose || status != STT_SUCCESS) {
@@ -1437,6 +1625,12 @@ request_reply(CMD_Request *request, CMD_Reply *reply, int requested_reply, int v
       case STT_INVALIDNAME:
         printf("521 Invalid name");
         break;
+      case STT_NOSUCHSNAPSHOT:
+        printf("522 Snapshot expired");
+        break;
+      case STT_TOOMANYSUBSCRIBERS:
+        printf("523 Too many subscribers");
+        break;
       default:
         printf("520 Got unexpected error from daemon");
     }
@@ -1461,6 +1655,117 @@ request_reply(CMD_Request *request, CMD_Reply *reply, int requested_reply, int v
 
 /* ================================================== */
 
+static int
+request_reply(CMD_Request *request, CMD_Reply *reply, int requested_reply, int verbose)
+{
+  int reply_length;
+
+  /* Only the bulk reply doesn't fit in CMD_Reply */
+  reply_length = requested_reply == RPY_CLIENT_ACCESSES_BY_INDEX4 ?
+                 sizeof (CMD_BulkReply) : sizeof (*reply);
+
+  if (!get_replies(&request, &reply, 1, reply_length))
+    return 0;
+
+  return check_reply(reply, requested_reply, verbose);
+}
+
+/* ================================================== */
+
+/* Get a reply to a request for a newer version of a report, or the older
+   version if the daemon doesn't support the request */
+
+static int
+request_reply_compat(CMD_Request *request, CMD_Reply *reply, int requested_reply,
+                     int old_command, int old_reply)
+{
+  if (!get_replies(&request, &reply, 1, sizeof (*reply)))
+    return 0;
+
+  if (ntohs(reply->status) == STT_INVALID) {
+    DEBUG_LOG("Falling back to command %d", old_command);
+    request->command = htons(old_command);
+    return request_reply(request, reply, old_reply, 0);
+  }
+
+  return check_reply(reply, requested_reply, 0);
+}
+
+/* ================================================== */
+
+/* Set the index of an entry selected by a request */
+
+static void
+set_request_index(CMD_Request *request, uint32_t index)
+{
+  switch (ntohs(request->command)) {
+    case REQ_SOURCE_DATA:
+      request->data.source_data.index = htonl(index);
+      break;
+    case REQ_SOURCESTATS:
+      request->data.sourcestats.index = htonl(index);
+      break;
+    case REQ_SELECT_DATA:
+      request->data.select_data.index = htonl(index);
+      break;
+    case REQ_PROFILE_DATA:
+      request->data.profile_data.index = htonl(index);
+      break;
+    case REQ_MEMORY_DATA:
+      request->data.memory_data.index = htonl(index);
+      break;
+    default:
+      assert(0);
+  }
+}
+
+/* ================================================== */
+
+/* Get a reply to a request selecting an entry (e.g. a source) by its index.
+   The entries are expected to be requested in order from index 0 to
+   n_indices - 1.  Requests for the following entries are sent in advance,
+   so that multiple requests are waiting for a reply at the same time. */
+
+static int
+request_reply_by_index(CMD_Request *request, uint32_t index, uint32_t n_indices,
+                       CMD_Reply *reply, int requested_reply)
+{
+  static CMD_Request requests[MAX_REQUESTS_IN_FLIGHT];
+  static CMD_Reply replies[MAX_REQUESTS_IN_FLIGHT];
+  static uint32_t first_index = 0, next_index = 0, n_replies = 0;
+  CMD_Request *request_ptrs[MAX_REQUESTS_IN_FLIGHT];
+  CMD_Reply *reply_ptrs[MAX_REQUESTS_IN_FLIGHT];
+  uint32_t i;
+
+  assert(index < n_indices);
+
+  /* Send new requests if the reply was not received in advance */
+  if (index != next_index || index >= first_index + n_replies ||
+      request->command != requests[0].command) {
+    first_index = index;
+    n_replies = MIN(n_indices - index, request_window);
+
+    for (i = 0; i < n_replies; i++) {
+      requests[i] = *request;
+      set_request_index(&requests[i], first_index + i);
+      request_ptrs[i] = &requests[i];
+      reply_ptrs[i] = &replies[i];
+    }
+
+    if (!get_replies(request_ptrs, reply_ptrs, n_replies, sizeof (CMD_Reply))) {
+      n_replies = 0;
+      return 0;
+    }
+  }
+
+  *reply = replies[index - first_index];
+  next_index = index + 1;
+
+  return check_reply(reply, requested_reply, 0);
+}
+
+/* ================================================== */
+
 static void
 print_seconds_updated(unsigned long s)
 {
@@ -1991,8 +2296,7 @@ process_cmd_sources(char *line)
 
   for (i = 0; i < n_sources; i++) {
     request.command = htons(REQ_SOURCE_DATA);
-    request.data.source_data.index = htonl(i);
-    if (!request_reply(&request, &reply, RPY_SOURCE_DATA, 0))
+    if (!request_reply_by_index(&request, i, n_sources, &reply, RPY_SOURCE_DATA))
       return 0;
 
     mode = ntohs(reply.data.source_data.mode);
@@ -2099,8 +2403,7 @@ process_cmd_sourcestats(char *line)
 
   for (i = 0; i < n_sources; i++) {
     request.command = htons(REQ_SOURCESTATS);
-    request.data.source_data.index = htonl(i);
-    if (!request_reply(&request, &reply, RPY_SOURCESTATS, 0))
+    if (!request_reply_by_index(&request, i, n_sources, &reply, RPY_SOURCESTATS))
       return 0;
 
     UTI_IPNetworkToHost(&reply.data.sourcestats.ip_addr, &ip_addr);
@@ -2136,9 +2439,11 @@ process_cmd_tracking(char *line)
   uint32_t ref_id;
   char name[256];
   struct timespec ref_time;
+  char sync_time[32];
+  double first_update_delay;
   
-  request.command = htons(REQ_TRACKING);
-  if (!request_reply(&request, &reply, RPY_TRACKING, 0))
+  request.command = htons(REQ_TRACKING2);
+  if (!request_reply_compat(&request, &reply, RPY_TRACKING2, REQ_TRACKING, RPY_TRACKING))
     return 0;
 
   ref_id = ntohl(reply.data.tracking.ref_id);
@@ -2149,6 +2454,17 @@ process_cmd_tracking(char *line)
 
   UTI_TimespecNetworkToHost(&reply.data.tracking.ref_time, &ref_time);
 
+  /* Older daemons don't report the time to the first update */
+  if (ntohs(reply.reply) == RPY_TRACKING2)
+    first_update_delay = UTI_FloatNetworkToHost(reply.data.tracking.first_update_delay);
+  else
+    first_update_delay = -1.0;
+
+  if (first_update_delay >= 0.0)
+    snprintf(sync_time, sizeof (sync_time), "%.1f seconds", first_update_delay);
+  else
+    snprintf(sync_time, sizeof (sync_time), "-");
+
   print_report("Reference ID    : %R (%s)\n"
                "Stratum         : %u\n"
                "Ref time (UTC)  : %T\n"
@@ -2161,7 +2477,8 @@ process_cmd_tracking(char *line)
                "Root delay      : %.9f seconds\n"
                "Root dispersion : %.9f seconds\n"
                "Update interval : %.1f seconds\n"
-               "Leap status     : %L\n",
+               "Leap status     : %L\n"
+               "Time to sync    : %s\n",
                (unsigned long)ref_id, name,
                ntohs(reply.data.tracking.stratum),
                &ref_time,
@@ -2174,7 +2491,7 @@ process_cmd_tracking(char *line)
                UTI_FloatNetworkToHost(reply.data.tracking.root_delay),
                UTI_FloatNetworkToHost(reply.data.tracking.root_dispersion),
                UTI_FloatNetworkToHost(reply.data.tracking.last_update_interval),
-               ntohs(reply.data.tracking.leap_status), REPORT_END);
+               ntohs(reply.data.tracking.leap_status), sync_time, REPORT_END);
 
   return 1;
 }
@@ -2214,8 +2531,7 @@ process_cmd_authdata(char *line)
 
   for (i = 0; i < n_sources; i++) {
     request.command = htons(REQ_SOURCE_DATA);
-    request.data.source_data.index = htonl(i);
-    if (!request_reply(&request, &reply, RPY_SOURCE_DATA, 0))
+    if (!request_reply_by_index(&request, i, n_sources, &reply, RPY_SOURCE_DATA))
       return 0;
 
     source_mode = ntohs(reply.data.source_data.mode);
@@ -2266,118 +2582,170 @@ process_cmd_authdata(char *line)
 
 /* ================================================== */
 
+static int
+print_ntpdata_reports(IPAddr *addrs, uint32_t n_addrs, int separate)
+{
+  static CMD_Request requests[MAX_REQUESTS_IN_FLIGHT];
+  static CMD_Reply replies[MAX_REQUESTS_IN_FLIGHT];
+  CMD_Request *request_ptrs[MAX_REQUESTS_IN_FLIGHT];
+  CMD_Reply *reply_ptrs[MAX_REQUESTS_IN_FLIGHT];
+  IPAddr remote_addr, local_addr;
+  struct timespec ref_time;
+  uint32_t i, j, n, memory_size;
+  char memory[32];
+  CMD_Reply *reply;
+
+  for (i = 0; i < n_addrs; i += n) {
+    /* Send a group of requests before waiting for the replies */
+    n = MIN(n_addrs - i, request_window);
+
+    for (j = 0; j < n; j++) {
+      memset(&requests[j], 0, sizeof (requests[j]));
+      requests[j].command = htons(REQ_NTP_DATA);
+      UTI_IPHostToNetwork(&addrs[i + j], &requests[j].data.ntp_data.ip_addr);
+      request_ptrs[j] = &requests[j];
+      reply_ptrs[j] = &replies[j];
+    }
+
+    if (!get_replies(request_ptrs, reply_ptrs, n, sizeof (CMD_Reply)))
+      return 0;
+
+    for (j = 0; j < n; j++) {
+      reply = &replies[j];
+      if (!check_reply(reply, RPY_NTP_DATA, 0))
+        return 0;
+
+      UTI_IPNetworkToHost(&reply->data.ntp_data.remote_addr, &remote_addr);
+      UTI_IPNetworkToHost(&reply->data.ntp_data.local_addr, &local_addr);
+      UTI_TimespecNetworkToHost(&reply->data.ntp_data.ref_time, &ref_time);
+
+      /* Older daemons don't report the memory usage (the field is filled
+         with 0xff) */
+      memory_size = ntohl(reply->data.ntp_data.memory_size);
+      if (memory_size != 0xffffffff)
+        snprintf(memory, sizeof (memory), csv_mode ? "%"PRIu32 : "%"PRIu32" bytes",
+                 memory_size);
+      else
+        snprintf(memory, sizeof (memory), "-");
+
+      if (separate)
+        printf("\n");
+
+      print_report("Remote address  : %s (%R)\n"
+                   "Remote port     : %u\n"
+                   "Local address   : %s (%R)\n"
+                   "Leap status     : %L\n"
+                   "Version         : %u\n"
+                   "Mode            : %M\n"
+                   "Stratum         : %u\n"
+                   "Poll interval   : %d (%.0f seconds)\n"
+                   "Precision       : %d (%.9f seconds)\n"
+                   "Root delay      : %.6f seconds\n"
+                   "Root dispersion : %.6f seconds\n"
+                   "Reference ID    : %R (%s)\n"
+                   "Reference time  : %T\n"
+                   "Offset          : %+.9f seconds\n"
+                   "Peer delay      : %.9f seconds\n"
+                   "Peer dispersion : %.9f seconds\n"
+                   "Response time   : %.9f seconds\n"
+                   "Jitter asymmetry: %+.2f\n"
+                   "NTP tests       : %.3b %.3b %.4b\n"
+                   "Interleaved     : %B\n"
+                   "Authenticated   : %B\n"
+                   "TX timestamping : %N\n"
+                   "RX timestamping : %N\n"
+                   "Total TX        : %U\n"
+                   "Total RX        : %U\n"
+                   "Total valid RX  : %U\n"
+                   "Memory usage    : %s\n",
+                   UTI_IPToString(&remote_addr), (unsigned long)UTI_IPToRefid(&remote_addr),
+                   ntohs(reply->data.ntp_data.remote_port),
+                   UTI_IPToString(&local_addr), (unsigned long)UTI_IPToRefid(&local_addr),
+                   reply->data.ntp_data.leap, reply->data.ntp_data.version,
+                   reply->data.ntp_data.mode, reply->data.ntp_data.stratum,
+                   reply->data.ntp_data.poll, UTI_Log2ToDouble(reply->data.ntp_data.poll),
+                   reply->data.ntp_data.precision,
+                   UTI_Log2ToDouble(reply->data.ntp_data.precision),
+                   UTI_FloatNetworkToHost(reply->data.ntp_data.root_delay),
+                   UTI_FloatNetworkToHost(reply->data.ntp_data.root_dispersion),
+                   (unsigned long)ntohl(reply->data.ntp_data.ref_id),
+                   reply->data.ntp_data.stratum <= 1 ?
+                     UTI_RefidToString(ntohl(reply->data.ntp_data.ref_id)) : "",
+                   &ref_time,
+                   UTI_FloatNetworkToHost(reply->data.ntp_data.offset),
+                   UTI_FloatNetworkToHost(reply->data.ntp_data.peer_delay),
+                   UTI_FloatNetworkToHost(reply->data.ntp_data.peer_dispersion),
+                   UTI_FloatNetworkToHost(reply->data.ntp_data.response_time),
+                   UTI_FloatNetworkToHost(reply->data.ntp_data.jitter_asymmetry),
+                   ntohs(reply->data.ntp_data.flags) >> 7,
+                   ntohs(reply->data.ntp_data.flags) >> 4,
+                   ntohs(reply->data.ntp_data.flags),
+                   ntohs(reply->data.ntp_data.flags) & RPY_NTP_FLAG_INTERLEAVED,
+                   ntohs(reply->data.ntp_data.flags) & RPY_NTP_FLAG_AUTHENTICATED,
+                   reply->data.ntp_data.tx_tss_char, reply->data.ntp_data.rx_tss_char,
+                   (unsigned long)ntohl(reply->data.ntp_data.total_tx_count),
+                   (unsigned long)ntohl(reply->data.ntp_data.total_rx_count),
+                   (unsigned long)ntohl(reply->data.ntp_data.total_valid_count),
+                   memory, REPORT_END);
+    }
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
 static int
 process_cmd_ntpdata(char *line)
 {
   CMD_Request request;
   CMD_Reply reply;
-  IPAddr remote_addr, local_addr;
-  struct timespec ref_time;
+  ARR_Instance addrs;
+  IPAddr remote_addr;
   uint32_t i, n_sources;
   uint16_t mode;
-  int specified_addr;
+  int ret;
 
   if (*line) {
-    specified_addr = 1;
-    n_sources = 1;
-  } else {
-    specified_addr = 0;
-    request.command = htons(REQ_N_SOURCES);
-    if (!request_reply(&request, &reply, RPY_N_SOURCES, 0))
+    if (!parse_source_address(line, &remote_addr)) {
+      LOG(LOGS_ERR, "Could not get address for hostname");
       return 0;
-    n_sources = ntohl(reply.data.n_sources.n_sources);
+    }
+    return print_ntpdata_reports(&remote_addr, 1, 0);
   }
 
-  for (i = 0; i < n_sources; i++) {
-    if (specified_addr) {
-      if (!parse_source_address(line, &remote_addr)) {
-        LOG(LOGS_ERR, "Could not get address for hostname");
-        return 0;
-      }
-    } else {
-      request.command = htons(REQ_SOURCE_DATA);
-      request.data.source_data.index = htonl(i);
-      if (!request_reply(&request, &reply, RPY_SOURCE_DATA, 0))
-        return 0;
+  request.command = htons(REQ_N_SOURCES);
+  if (!request_reply(&request, &reply, RPY_N_SOURCES, 0))
+    return 0;
+  n_sources = ntohl(reply.data.n_sources.n_sources);
 
-      mode = ntohs(reply.data.source_data.mode);
-      if (mode != RPY_SD_MD_CLIENT && mode != RPY_SD_MD_PEER)
-        continue;
+  addrs = ARR_CreateInstance(sizeof (IPAddr));
 
-      UTI_IPNetworkToHost(&reply.data.source_data.ip_addr, &remote_addr);
-      if (!UTI_IsIPReal(&remote_addr))
-        continue;
+  /* Get addresses of all NTP sources first to pipeline also the requests
+     for their NTP data */
+  for (i = 0; i < n_sources; i++) {
+    request.command = htons(REQ_SOURCE_DATA);
+    if (!request_reply_by_index(&request, i, n_sources, &reply, RPY_SOURCE_DATA)) {
+      ARR_DestroyInstance(addrs);
+      return 0;
     }
 
-    request.command = htons(REQ_NTP_DATA);
-    UTI_IPHostToNetwork(&remote_addr, &request.data.ntp_data.ip_addr);
-    if (!request_reply(&request, &reply, RPY_NTP_DATA, 0))
-      return 0;
+    mode = ntohs(reply.data.source_data.mode);
+    if (mode != RPY_SD_MD_CLIENT && mode != RPY_SD_MD_PEER)
+      continue;
 
-    UTI_IPNetworkToHost(&reply.data.ntp_data.remote_addr, &remote_addr);
-    UTI_IPNetworkToHost(&reply.data.ntp_data.local_addr, &local_addr);
-    UTI_TimespecNetworkToHost(&reply.data.ntp_data.ref_time, &ref_time);
-
-    if (!specified_addr && !csv_mode)
-      printf("\n");
-
-    print_report("Remote address  : %s (%R)\n"
-                 "Remote port     : %u\n"
-                 "Local address   : %s (%R)\n"
-                 "Leap status     : %L\n"
-                 "Version         : %u\n"
-                 "Mode            : %M\n"
-                 "Stratum         : %u\n"
-                 "Poll interval   : %d (%.0f seconds)\n"
-                 "Precision       : %d (%.9f seconds)\n"
-                 "Root delay      : %.6f seconds\n"
-                 "Root dispersion : %.6f seconds\n"
-                 "Reference ID    : %R (%s)\n"
-                 "Reference time  : %T\n"
-                 "Offset          : %+.9f seconds\n"
-                 "Peer delay      : %.9f seconds\n"
-                 "Peer dispersion : %.9f seconds\n"
-                 "Response time   : %.9f seconds\n"
-                 "Jitter asymmetry: %+.2f\n"
-                 "NTP tests       : %.3b %.3b %.4b\n"
-                 "Interleaved     : %B\n"
-                 "Authenticated   : %B\n"
-                 "TX timestamping : %N\n"
-                 "RX timestamping : %N\n"
-                 "Total TX        : %U\n"
-                 "Total RX        : %U\n"
-                 "Total valid RX  : %U\n",
-                 UTI_IPToString(&remote_addr), (unsigned long)UTI_IPToRefid(&remote_addr),
-                 ntohs(reply.data.ntp_data.remote_port),
-                 UTI_IPToString(&local_addr), (unsigned long)UTI_IPToRefid(&local_addr),
-                 reply.data.ntp_data.leap, reply.data.ntp_data.version,
-                 reply.data.ntp_data.mode, reply.data.ntp_data.stratum,
-                 reply.data.ntp_data.poll, UTI_Log2ToDouble(reply.data.ntp_data.poll),
-                 reply.data.ntp_data.precision, UTI_Log2ToDouble(reply.data.ntp_data.precision),
-                 UTI_FloatNetworkToHost(reply.data.ntp_data.root_delay),
-                 UTI_FloatNetworkToHost(reply.data.ntp_data.root_dispersion),
-                 (unsigned long)ntohl(reply.data.ntp_data.ref_id),
-                 reply.data.ntp_data.stratum <= 1 ?
-                   UTI_RefidToString(ntohl(reply.data.ntp_data.ref_id)) : "",
-                 &ref_time,
-                 UTI_FloatNetworkToHost(reply.data.ntp_data.offset),
-                 UTI_FloatNetworkToHost(reply.data.ntp_data.peer_delay),
-                 UTI_FloatNetworkToHost(reply.data.ntp_data.peer_dispersion),
-                 UTI_FloatNetworkToHost(reply.data.ntp_data.response_time),
-                 UTI_FloatNetworkToHost(reply.data.ntp_data.jitter_asymmetry),
-                 ntohs(reply.data.ntp_data.flags) >> 7,
-                 ntohs(reply.data.ntp_data.flags) >> 4,
-                 ntohs(reply.data.ntp_data.flags),
-                 ntohs(reply.data.ntp_data.flags) & RPY_NTP_FLAG_INTERLEAVED,
-                 ntohs(reply.data.ntp_data.flags) & RPY_NTP_FLAG_AUTHENTICATED,
-                 reply.data.ntp_data.tx_tss_char, reply.data.ntp_data.rx_tss_char,
-                 (unsigned long)ntohl(reply.data.ntp_data.total_tx_count),
-                 (unsigned long)ntohl(reply.data.ntp_data.total_rx_count),
-                 (unsigned long)ntohl(reply.data.ntp_data.total_valid_count),
-                 REPORT_END);
+    UTI_IPNetworkToHost(&reply.data.source_data.ip_addr, &remote_addr);
+    if (!UTI_IsIPReal(&remote_addr))
+      continue;
+
+    *(IPAddr *)ARR_GetNewElement(addrs) = remote_addr;
   }
 
-  return 1;
+  ret = print_ntpdata_reports(ARR_GetElements(addrs), ARR_GetSize(addrs), !csv_mode);
+
+  ARR_DestroyInstance(addrs);
+
+  return ret;
 }
 
 /* ================================================== */
@@ -2417,8 +2785,7 @@ process_cmd_selectdata(char *line)
 
   for (i = 0; i < n_sources; i++) {
     request.command = htons(REQ_SELECT_DATA);
-    request.data.source_data.index = htonl(i);
-    if (!request_reply(&request, &reply, RPY_SELECT_DATA, 0))
+    if (!request_reply_by_index(&request, i, n_sources, &reply, RPY_SELECT_DATA))
       return 0;
 
     UTI_IPNetworkToHost(&reply.data.select_data.ip_addr, &ip_addr);
@@ -2458,16 +2825,168 @@ process_cmd_selectdata(char *line)
 
 /* ================================================== */
 
+static int
+process_cmd_profile(char *line)
+{
+  CMD_Request request;
+  CMD_Reply reply;
+  uint32_t i, n_entries, interval;
+  int reset, type;
+  char name[sizeof (reply.data.profile_data.name) + 1], *opt;
+
+  reset = 0;
+
+  while (*line) {
+    opt = line;
+    line = CPS_SplitWord(line);
+    if (strcmp(opt, "-r") == 0) {
+      reset = 1;
+    } else {
+      LOG(LOGS_ERR, "Invalid syntax for profile command");
+      return 0;
+    }
+  }
+
+  print_header("Name                           T      Count   Wall    Max    CPU    Max");
+
+  /*           "NNNNNNNNNNNNNNNNNNNNNNNNNNNNNN T CCCCCCCCCC WWWWWW MMMMMM CCCCCC MMMMMM" */
+
+  for (i = n_entries = 0; i == 0 || i < n_entries; i++) {
+    request.command = htons(REQ_PROFILE_DATA);
+    if (!request_reply_by_index(&request, i, i == 0 ? 1 : n_entries, &reply,
+                                RPY_PROFILE_DATA))
+      return 0;
+
+    n_entries = ntohl(reply.data.profile_data.n_entries);
+    interval = ntohl(reply.data.profile_data.interval);
+    type = ntohs(reply.data.profile_data.type);
+
+    memcpy(name, reply.data.profile_data.name, sizeof (reply.data.profile_data.name));
+    name[sizeof (name) - 1] = '\0';
+
+    print_report("%-30s %c %10U %S %S %S %S\n",
+                 name,
+                 type == RPY_PD_TYPE_FILE_HANDLER ? 'F' :
+                 type == RPY_PD_TYPE_TIMEOUT_HANDLER ? 'T' :
+                 type == RPY_PD_TYPE_WAIT ? 'W' :
+                 type == RPY_PD_TYPE_COUNTER ? 'C' : '?',
+                 (unsigned long)ntohl(reply.data.profile_data.count),
+                 UTI_FloatNetworkToHost(reply.data.profile_data.total_wall_time),
+                 UTI_FloatNetworkToHost(reply.data.profile_data.max_wall_time),
+                 UTI_FloatNetworkToHost(reply.data.profile_data.total_cpu_time),
+                 UTI_FloatNetworkToHost(reply.data.profile_data.max_cpu_time),
+                 REPORT_END);
+  }
+
+  if (!csv_mode)
+    print_report("\nInterval since reset: %I\n", (unsigned long)interval, REPORT_END);
+
+  if (reset) {
+    request.command = htons(REQ_RESET_PROFILE);
+    if (!request_reply(&request, &reply, RPY_NULL, 0))
+      return 0;
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
+static unsigned long
+get_memory_bytes(uint32_t high, uint32_t low)
+{
+  uint64_t bytes;
+
+  bytes = (uint64_t)ntohl(high) << 32 | ntohl(low);
+
+  return bytes < ULONG_MAX ? bytes : ULONG_MAX;
+}
+
+/* ================================================== */
+
+static int
+process_cmd_memory(char *line)
+{
+  CMD_Request request;
+  CMD_Reply reply;
+  uint32_t i, n_entries;
+  char name[sizeof (reply.data.memory_data.name) + 1];
+
+  if (*line) {
+    LOG(LOGS_ERR, "Invalid syntax for memory command");
+    return 0;
+  }
+
+  print_header("Subsystem              Bytes  Peak bytes    Objects Peak objects");
+
+  /*           "SSSSSSSSSSSSSSSS BBBBBBBBBBB BBBBBBBBBBB OOOOOOOOOO   OOOOOOOOOO" */
+
+  for (i = n_entries = 0; i == 0 || i < n_entries; i++) {
+    request.command = htons(REQ_MEMORY_DATA);
+    if (!request_reply_by_index(&request, i, i == 0 ? 1 : n_entries, &reply,
+                                RPY_MEMORY_DATA))
+      return 0;
+
+    n_entries = ntohl(reply.data.memory_data.n_entries);
+
+    memcpy(name, reply.data.memory_data.name, sizeof (reply.data.memory_data.name));
+    name[sizeof (name) - 1] = '\0';
+
+    print_report("%-16s %11U %11U %10U   %10U\n",
+                 name,
+                 get_memory_bytes(reply.data.memory_data.current_bytes_high,
+                                  reply.data.memory_data.current_bytes_low),
+                 get_memory_bytes(reply.data.memory_data.peak_bytes_high,
+                                  reply.data.memory_data.peak_bytes_low),
+                 (unsigned long)ntohl(reply.data.memory_data.current_objects),
+                 (unsigned long)ntohl(reply.data.memory_data.peak_objects),
+                 REPORT_END);
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
 static int
 process_cmd_serverstats(char *line)
 {
   CMD_Request request;
   CMD_Reply reply;
 
-  request.command = htons(REQ_SERVER_STATS);
-  if (!request_reply(&request, &reply, RPY_SERVER_STATS3, 0))
+  request.command = htons(REQ_SERVER_STATS2);
+  if (!request_reply_compat(&request, &reply, RPY_SERVER_STATS4,
+                            REQ_SERVER_STATS, RPY_SERVER_STATS3))
     return 0;
 
+  /* Older daemons don't report the MS-SNTP statistics */
+  if (ntohs(reply.reply) != RPY_SERVER_STATS4) {
+    print_report("NTP packets received       : %U\n"
+                 "NTP packets dropped        : %U\n"
+                 "Command packets received   : %U\n"
+                 "Command packets dropped    : %U\n"
+                 "Client log records dropped : %U\n"
+                 "NTS-KE connections accepted: %U\n"
+                 "NTS-KE connections dropped : %U\n"
+                 "Authenticated NTP packets  : %U\n"
+                 "Interleaved NTP packets    : %U\n"
+                 "NTP timestamps held        : %U\n"
+                 "NTP timestamp span         : %U\n",
+                 (unsigned long)ntohl(reply.data.server_stats.ntp_hits),
+                 (unsigned long)ntohl(reply.data.server_stats.ntp_drops),
+                 (unsigned long)ntohl(reply.data.server_stats.cmd_hits),
+                 (unsigned long)ntohl(reply.data.server_stats.cmd_drops),
+                 (unsigned long)ntohl(reply.data.server_stats.log_drops),
+                 (unsigned long)ntohl(reply.data.server_stats.nke_hits),
+                 (unsigned long)ntohl(reply.data.server_stats.nke_drops),
+                 (unsigned long)ntohl(reply.data.server_stats.ntp_auth_hits),
+                 (unsigned long)ntohl(reply.data.server_stats.ntp_interleaved_hits),
+                 (unsigned long)ntohl(reply.data.server_stats.ntp_timestamps),
+                 (unsigned long)ntohl(reply.data.server_stats.ntp_span_seconds),
+                 REPORT_END);
+    return 1;
+  }
+
   print_report("NTP packets received       : %U\n"
                "NTP packets dropped        : %U\n"
                "Command packets received   : %U\n"
@@ -2478,7 +2997,13 @@ process_cmd_serverstats(char *line)
                "Authenticated NTP packets  : %U\n"
                "Interleaved NTP packets    : %U\n"
                "NTP timestamps held        : %U\n"
-               "NTP timestamp span         : %U\n",
+               "NTP timestamp span         : %U\n"
+               "MS-SNTP requests queued    : %U\n"
+               "MS-SNTP requests dropped   : %U\n"
+               "MS-SNTP requests timed out : %U\n"
+               "MS-SNTP maximum queue      : %U\n"
+               "MS-SNTP mean signing delay : %.6f seconds\n"
+               "MS-SNTP max signing delay  : %.6f seconds\n",
                (unsigned long)ntohl(reply.data.server_stats.ntp_hits),
                (unsigned long)ntohl(reply.data.server_stats.ntp_drops),
                (unsigned long)ntohl(reply.data.server_stats.cmd_hits),
@@ -2490,6 +3015,12 @@ process_cmd_serverstats(char *line)
                (unsigned long)ntohl(reply.data.server_stats.ntp_interleaved_hits),
                (unsigned long)ntohl(reply.data.server_stats.ntp_timestamps),
                (unsigned long)ntohl(reply.data.server_stats.ntp_span_seconds),
+               (unsigned long)ntohl(reply.data.server_stats.signd_requests),
+               (unsigned long)ntohl(reply.data.server_stats.signd_drops),
+               (unsigned long)ntohl(reply.data.server_stats.signd_timeouts),
+               (unsigned long)ntohl(reply.data.server_stats.signd_max_queue),
+               UTI_FloatNetworkToHost(reply.data.server_stats.signd_mean_delay),
+               UTI_FloatNetworkToHost(reply.data.server_stats.signd_max_delay),
                REPORT_END);
 
   return 1;
@@ -2581,21 +3112,100 @@ process_cmd_rtcreport(char *line)
 
 /* ================================================== */
 
+static void
+print_client(RPY_ClientAccesses_Client *client, int nke)
+{
+  char name[50];
+  IPAddr ip;
+
+  UTI_IPNetworkToHost(&client->ip, &ip);
+
+  /* UNSPEC means the record could not be found in the daemon's tables.
+     We shouldn't ever generate this case, but ignore it if we do. */
+  if (ip.family == IPADDR_UNSPEC)
+    return;
+
+  format_name(name, sizeof (name), 25, 0, 0, 0, &ip);
+
+  print_report("%-25s  %6U  %5U  %C  %C  %I  %6U  %5U  %C  %I\n",
+               name,
+               (unsigned long)ntohl(client->ntp_hits),
+               (unsigned long)ntohl(client->ntp_drops),
+               client->ntp_interval,
+               client->ntp_timeout_interval,
+               (unsigned long)ntohl(client->last_ntp_hit_ago),
+               (unsigned long)ntohl(nke ? client->nke_hits : client->cmd_hits),
+               (unsigned long)ntohl(nke ? client->nke_drops : client->cmd_drops),
+               nke ? client->nke_interval : client->cmd_interval,
+               (unsigned long)ntohl(nke ? client->last_nke_hit_ago :
+                                          client->last_cmd_hit_ago),
+               REPORT_END);
+}
+
+/* ================================================== */
+/* Print clients from a snapshot of the client log, which is transferred in
+   large pages.  Return -1 if the daemon doesn't support the request. */
+
+static int
+print_clients_bulk(CMD_Request *request, int nke)
+{
+  static CMD_BulkReply reply;
+  RPY_ClientAccessesByIndex4 *data = &reply.data.client_accesses_by_index4;
+  uint32_t i, n_clients, next_index, n_indices;
+
+  request->command = htons(REQ_CLIENT_ACCESSES_BY_INDEX4);
+  request->data.client_accesses_by_index4.first_index = htonl(0);
+  request->data.client_accesses_by_index4.n_clients = htonl(MAX_CLIENT_ACCESSES_BULK);
+  request->data.client_accesses_by_index4.snapshot = htonl(0);
+
+  /* Check the first reply silently to not report errors to requests
+     which are not supported by older daemons */
+  if (!submit_request(request, (CMD_Reply *)&reply, sizeof (reply)) ||
+      ntohs(reply.status) != STT_SUCCESS ||
+      ntohs(reply.reply) != RPY_CLIENT_ACCESSES_BY_INDEX4)
+    return -1;
+
+  while (1) {
+    n_clients = ntohl(data->n_clients);
+    n_indices = ntohl(data->n_indices);
+    next_index = ntohl(data->next_index);
+
+    for (i = 0; i < n_clients && i < MAX_CLIENT_ACCESSES_BULK; i++)
+      print_client(&data->clients[i], nke);
+
+    if (next_index >= n_indices || n_clients == 0)
+      break;
+
+    /* Following requests select the same snapshot */
+    request->data.client_accesses_by_index4.first_index = htonl(next_index);
+    request->data.client_accesses_by_index4.snapshot = data->snapshot;
+
+    if (!request_reply(request, (CMD_Reply *)&reply, RPY_CLIENT_ACCESSES_BY_INDEX4, 0))
+      return 0;
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
 static int
 process_cmd_clients(char *line)
 {
   CMD_Request request;
   CMD_Reply reply;
-  IPAddr ip;
-  uint32_t i, n_clients, next_index, n_indices, min_hits, reset;
-  RPY_ClientAccesses_Client *client;
-  char header[80], name[50], *opt, *arg;
-  int nke;
+  IPAddr subnet;
+  uint32_t i, n_clients, next_index, n_indices, min_hits, reset, max_last_ago;
+  char header[80], *opt, *arg;
+  int nke, all, subnet_bits, r;
 
   next_index = 0;
   min_hits = 0;
   reset = 0;
   nke = 0;
+  subnet.family = IPADDR_UNSPEC;
+  subnet_bits = 0;
+  max_last_ago = -1;
 
   while (*line) {
     opt = line;
@@ -2611,6 +3221,20 @@ process_cmd_clients(char *line)
       }
     } else if (strcmp(opt, "-r") == 0) {
       reset = 1;
+    } else if (strcmp(opt, "-a") == 0) {
+      arg = line;
+      line = CPS_SplitWord(line);
+      if (!CPS_ParseAllowDeny(arg, &all, &subnet, &subnet_bits) || all) {
+        LOG(LOGS_ERR, "Invalid syntax for clients command");
+        return 0;
+      }
+    } else if (strcmp(opt, "-t") == 0) {
+      arg = line;
+      line = CPS_SplitWord(line);
+      if (sscanf(arg, "%"SCNu32, &max_last_ago) != 1) {
+        LOG(LOGS_ERR, "Invalid syntax for clients command");
+        return 0;
+      }
     }
   }
 
@@ -2619,6 +3243,24 @@ process_cmd_clients(char *line)
            nke ? "NTS-KE" : "Cmd");
   print_header(header);
 
+  memset(&request.data.client_accesses_by_index4, 0,
+         sizeof (request.data.client_accesses_by_index4));
+  request.data.client_accesses_by_index4.min_hits = htonl(min_hits);
+  request.data.client_accesses_by_index4.reset = htonl(reset);
+  UTI_IPHostToNetwork(&subnet, &request.data.client_accesses_by_index4.ip);
+  request.data.client_accesses_by_index4.subnet_bits = htonl(subnet_bits);
+  request.data.client_accesses_by_index4.max_last_ago = htonl(max_last_ago);
+
+  r = print_clients_bulk(&request, nke);
+  if (r >= 0)
+    return r;
+
+  /* Filtering by address and time is not supported with older daemons */
+  if (subnet.family != IPADDR_UNSPEC || max_last_ago != (uint32_t)-1) {
+    LOG(LOGS_ERR, "Could not get filtered list of clients");
+    return 0;
+  }
+
   while (1) {
     request.command = htons(REQ_CLIENT_ACCESSES_BY_INDEX3);
     request.data.client_accesses_by_index.first_index = htonl(next_index);
@@ -2632,32 +3274,8 @@ process_cmd_clients(char *line)
     n_clients = ntohl(reply.data.client_accesses_by_index.n_clients);
     n_indices = ntohl(reply.data.client_accesses_by_index.n_indices);
 
-    for (i = 0; i < n_clients && i < MAX_CLIENT_ACCESSES; i++) {
-      client = &reply.data.client_accesses_by_index.clients[i];
-
-      UTI_IPNetworkToHost(&client->ip, &ip);
-
-      /* UNSPEC means the record could not be found in the daemon's tables.
-         We shouldn't ever generate this case, but ignore it if we do. */
-      if (ip.family == IPADDR_UNSPEC)
-        continue;
-
-      format_name(name, sizeof (name), 25, 0, 0, 0, &ip);
-
-      print_report("%-25s  %6U  %5U  %C  %C  %I  %6U  %5U  %C  %I\n",
-                   name,
-                   (unsigned long)ntohl(client->ntp_hits),
-                   (unsigned long)ntohl(client->ntp_drops),
-                   client->ntp_interval,
-                   client->ntp_timeout_interval,
-                   (unsigned long)ntohl(client->last_ntp_hit_ago),
-                   (unsigned long)ntohl(nke ? client->nke_hits : client->cmd_hits),
-                   (unsigned long)ntohl(nke ? client->nke_drops : client->cmd_drops),
-                   nke ? client->nke_interval : client->cmd_interval,
-                   (unsigned long)ntohl(nke ? client->last_nke_hit_ago :
-                                              client->last_cmd_hit_ago),
-                   REPORT_END);
-    }
+    for (i = 0; i < n_clients && i < MAX_CLIENT_ACCESSES; i++)
+      print_client(&reply.data.client_accesses_by_index.clients[i], nke);
 
     /* Set the next index to probe based on what the server tells us */
     next_index = ntohl(reply.data.client_accesses_by_index.next_index);
@@ -2670,6 +3288,183 @@ process_cmd_clients(char *line)
 }
 
 
+/* ================================================== */
+
+static const char *
+format_record_source(uint32_t ref_id, IPAddr *ip_addr)
+{
+  IPAddr ip;
+
+  UTI_IPNetworkToHost(ip_addr, &ip);
+
+  /* Avoid DNS lookups, which could delay processing of the records */
+  if (ip.family == IPADDR_UNSPEC || ip.family == IPADDR_ID)
+    return UTI_RefidToString(ref_id);
+
+  return UTI_IPToString(&ip);
+}
+
+/* ================================================== */
+
+static void
+print_record(CMD_Record *record)
+{
+  struct timespec time;
+  IPAddr ip;
+  int flags;
+
+  UTI_TimespecNetworkToHost(&record->time, &time);
+
+  switch (ntohs(record->record)) {
+    case REC_NTP_SAMPLE:
+      UTI_IPNetworkToHost(&record->data.ntp_sample.remote_addr, &ip);
+      flags = ntohs(record->data.ntp_sample.flags);
+      print_report("%V %-12s %-25s %1L %2d %+S %S %S %.10b\n",
+                   &time, "measurement", UTI_IPToString(&ip),
+                   record->data.ntp_sample.leap,
+                   record->data.ntp_sample.stratum,
+                   UTI_FloatNetworkToHost(record->data.ntp_sample.offset),
+                   UTI_FloatNetworkToHost(record->data.ntp_sample.peer_delay),
+                   UTI_FloatNetworkToHost(record->data.ntp_sample.peer_dispersion),
+                   flags & RPY_NTP_FLAGS_TESTS,
+                   REPORT_END);
+      break;
+    case REC_REFCLOCK_SAMPLE:
+      flags = record->data.refclock_sample.flags;
+      print_report("%V %-12s %-25s %1L %2d %+S %+S %S %c\n",
+                   &time, "refclock",
+                   UTI_RefidToString(ntohl(record->data.refclock_sample.ref_id)),
+                   record->data.refclock_sample.leap,
+                   record->data.refclock_sample.pulse,
+                   UTI_FloatNetworkToHost(record->data.refclock_sample.raw_offset),
+                   UTI_FloatNetworkToHost(record->data.refclock_sample.cooked_offset),
+                   UTI_FloatNetworkToHost(record->data.refclock_sample.dispersion),
+                   flags & REC_RS_FLAG_FILTERED ? 'F' : '-',
+                   REPORT_END);
+      break;
+    case REC_SOURCESTATS:
+      print_report("%V %-12s %-25s %3U %3U %I %+P %P %+S %S\n",
+                   &time, "statistics",
+                   format_record_source(ntohl(record->data.sourcestats.ref_id),
+                                        &record->data.sourcestats.ip_addr),
+                   (unsigned long)ntohl(record->data.sourcestats.n_samples),
+                   (unsigned long)ntohl(record->data.sourcestats.n_runs),
+                   (unsigned long)ntohl(record->data.sourcestats.span_seconds),
+                   UTI_FloatNetworkToHost(record->data.sourcestats.resid_freq_ppm),
+                   UTI_FloatNetworkToHost(record->data.sourcestats.skew_ppm),
+                   UTI_FloatNetworkToHost(record->data.sourcestats.est_offset),
+                   UTI_FloatNetworkToHost(record->data.sourcestats.sd),
+                   REPORT_END);
+      break;
+    case REC_SELECTION:
+      print_report("%V %-12s %-25s %R\n",
+                   &time, "selection",
+                   format_record_source(ntohl(record->data.selection.ref_id),
+                                        &record->data.selection.ip_addr),
+                   (unsigned long)ntohl(record->data.selection.ref_id),
+                   REPORT_END);
+      break;
+    case REC_TRACKING:
+      print_report("%V %-12s %-25s %1L %2d %+S %+S %+P %P %S %S\n",
+                   &time, "tracking",
+                   format_record_source(ntohl(record->data.tracking.ref_id),
+                                        &record->data.tracking.ip_addr),
+                   ntohs(record->data.tracking.leap_status),
+                   ntohs(record->data.tracking.stratum),
+                   UTI_FloatNetworkToHost(record->data.tracking.current_correction),
+                   UTI_FloatNetworkToHost(record->data.tracking.last_offset),
+                   UTI_FloatNetworkToHost(record->data.tracking.freq_ppm),
+                   UTI_FloatNetworkToHost(record->data.tracking.skew_ppm),
+                   UTI_FloatNetworkToHost(record->data.tracking.root_delay),
+                   UTI_FloatNetworkToHost(record->data.tracking.root_dispersion),
+                   REPORT_END);
+      break;
+  }
+}
+
+/* ================================================== */
+
+static int
+process_cmd_monitor(char *line)
+{
+  const char *names[N_RECORD_TYPES] = {
+    "measurements", "refclocks", "statistics", "selection", "tracking"
+  };
+  CMD_Request request;
+  CMD_Reply reply;
+  CMD_Record record;
+  uint32_t records, sequence;
+  struct timeval tv;
+  fd_set rdfd;
+  char *word;
+  int i, length, status;
+
+  for (records = 0; *line; ) {
+    word = line;
+    line = CPS_SplitWord(line);
+
+    for (i = 0; i < N_RECORD_TYPES; i++) {
+      if (strcmp(word, names[i]) == 0)
+        break;
+    }
+
+    if (i >= N_RECORD_TYPES) {
+      LOG(LOGS_ERR, "Invalid syntax for monitor command");
+      return 0;
+    }
+
+    records |= 1U << i;
+  }
+
+  if (records == 0)
+    records = (1U << N_RECORD_TYPES) - 1;
+
+  request.command = htons(REQ_SUBSCRIBE);
+  request.data.subscribe.records = htonl(records);
+  if (!request_reply(&request, &reply, RPY_NULL, 0))
+    return 0;
+
+  /* The subscription is cancelled in the daemon when the records cannot be
+     delivered to our socket after it is closed */
+  for (sequence = 0; !quit; ) {
+    FD_ZERO(&rdfd);
+    FD_SET(sock_fd, &rdfd);
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+
+    status = select(sock_fd + 1, &rdfd, NULL, NULL, &tv);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      DEBUG_LOG("select failed : %s", strerror(errno));
+      return 0;
+    } else if (status == 0) {
+      continue;
+    }
+
+    length = SCK_Receive(sock_fd, &record, sizeof (record), 0);
+    if (length < 0)
+      return 0;
+
+    if (length < offsetof(CMD_Record, data) ||
+        record.version != PROTO_VERSION_NUMBER ||
+        record.pkt_type != PKT_TYPE_CMD_RECORD ||
+        length < PKL_RecordLength(&record)) {
+      DEBUG_LOG("Invalid record");
+      continue;
+    }
+
+    if (sequence != 0 && ntohl(record.sequence) != sequence + 1)
+      LOG(LOGS_WARN, "Missed %"PRIu32" records", ntohl(record.sequence) - sequence - 1);
+    sequence = ntohl(record.sequence);
+
+    print_record(&record);
+    fflush(stdout);
+  }
+
+  return 1;
+}
+
 /* ================================================== */
 /* Process the manual list command */
 static int
@@ -3055,6 +3850,46 @@ process_cmd_keygen(char *line)
 
 /* ================================================== */
 
+static int
+process_cmd_printlog(char *line)
+{
+  static BLG_Reader reader;
+  BLG_Record record;
+  BLG_Status status;
+  FILE *file;
+
+  if (!*line) {
+    LOG(LOGS_ERR, "Missing file name");
+    return 0;
+  }
+
+  file = fopen(line, "r");
+  if (!file) {
+    LOG(LOGS_ERR, "Could not open %s : %s", line, strerror(errno));
+    return 0;
+  }
+
+  BLG_InitReader(&reader, file);
+
+  while ((status = BLG_ReadRecord(&reader, &record)) == BLG_OK) {
+    if (!BLG_WriteText(&reader, &record, stdout)) {
+      status = BLG_INVALID;
+      break;
+    }
+  }
+
+  fclose(file);
+
+  if (status != BLG_END) {
+    LOG(LOGS_ERR, "Invalid binary log %s", line);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
 static int
 process_line(char *line)
 {
@@ -3153,8 +3988,14 @@ process_line(char *line)
     do_normal_submit = process_cmd_maxupdateskew(&tx_message, line);
   } else if (!strcmp(command, "minpoll")) {
     do_normal_submit = process_cmd_minpoll(&tx_message, line);
+  } else if (!strcmp(command, "memory")) {
+    do_normal_submit = 0;
+    ret = process_cmd_memory(line);
   } else if (!strcmp(command, "minstratum")) {
     do_normal_submit = process_cmd_minstratum(&tx_message, line);
+  } else if (!strcmp(command, "monitor")) {
+    do_normal_submit = 0;
+    ret = process_cmd_monitor(line);
   } else if (!strcmp(command, "ntpdata")) {
     do_normal_submit = 0;
     ret = process_cmd_ntpdata(line);
@@ -3166,6 +4007,12 @@ process_line(char *line)
     process_cmd_onoffline(&tx_message, line);
   } else if (!strcmp(command, "polltarget")) {
     do_normal_submit = process_cmd_polltarget(&tx_message, line);
+  } else if (!strcmp(command, "printlog")) {
+    do_normal_submit = 0;
+    ret = process_cmd_printlog(line);
+  } else if (!strcmp(command, "profile")) {
+    do_normal_submit = 0;
+    ret = process_cmd_profile(line);
   } else if (!strcmp(command, "quit")) {
     do_normal_submit = 0;
     quit = 1;
@@ -3323,6 +4170,7 @@ print_help(const char *progname)
              "  -m\t\tAccept multiple commands\n"
              "  -h HOST\tSpecify server (%s)\n"
              "  -p PORT\tSpecify UDP port (%d)\n"
+             "  -s FILE\tRead reports from status file\n"
              "  -v, --version\tPrint version and exit\n"
              "      --help\tPrint usage and exit\n",
              progname, DEFAULT_COMMAND_SOCKET",127.0.0.1,::1", DEFAULT_CANDM_PORT);
@@ -3361,7 +4209,7 @@ main(int argc, char **argv)
   optind = 1;
 
   /* Parse short command-line options */
-  while ((opt = getopt(argc, argv, "+46acdf:h:mnNp:v")) != -1) {
+  while ((opt = getopt(argc, argv, "+46acdf:h:mnNp:s:v")) != -1) {
     switch (opt) {
       case '4':
       case '6':
@@ -3394,6 +4242,10 @@ main(int argc, char **argv)
       case 'p':
         port = atoi(optarg);
         break;
+      case 's':
+        status_file = optarg;
+        STP_InitReader(&status_reader, status_file);
+        break;
       case 'v':
         print_version();
         return 0;
@@ -3422,7 +4274,7 @@ main(int argc, char **argv)
   SCK_Initialise(IPADDR_UNSPEC);
   server_addresses = get_addresses(hostnames, port);
 
-  if (!open_io())
+  if (!open_io() && !status_file)
     LOG_FATAL("Could not open connection to daemon");
 
   if (optind < argc) {
@@ -3440,6 +4292,7 @@ main(int argc, char **argv)
   }
 
   close_io();
+  STP_FinaliseReader(&status_reader);
   free_addresses(server_addresses);
   SCK_Finalise();
 
@@ -282,6 +282,7 @@ expand_hashtable(void)
     return 0;
 
   records = ARR_CreateInstance(sizeof (Record));
+  ARR_SetTag(records, MEM_CLIENTLOG, 1);
 
   slots = MAX(MIN_SLOTS, 2 * slots);
   assert(slots <= max_slots);
@@ -831,6 +832,7 @@ CLG_SaveNtpTimestamps(NTP_int64 *rx_ts, struct timespec *tx_ts)
   /* Allocate the array on first use */
   if (!ntp_ts_map.timestamps) {
     ntp_ts_map.timestamps = ARR_CreateInstance(sizeof (NtpTimestamps));
+    ARR_SetTag(ntp_ts_map.timestamps, MEM_NTP_TIMESTAMPS, 1);
     ARR_SetSize(ntp_ts_map.timestamps, ntp_ts_map.max_size);
   }
 
@@ -29,6 +29,11 @@
 
 #include "sysincl.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "array.h"
 #include "cmdmon.h"
 #include "candm.h"
 #include "sched.h"
@@ -37,6 +42,7 @@
 #include "keys.h"
 #include "ntp_sources.h"
 #include "ntp_core.h"
+#include "ntp_signd.h"
 #include "smooth.h"
 #include "socket.h"
 #include "sources.h"
@@ -68,6 +74,126 @@ static int bound_sock_fd4;
 /* Flag indicating whether this module has been initialised or not */
 static int initialised = 0;
 
+/* Minimum number of sources in a new status page */
+#define MIN_STATUS_PAGE_SOURCES 16
+
+/* Interval of status page updates due to changes in server statistics */
+#define STATUS_PAGE_STATS_INTERVAL 1.0
+
+/* Minimum interval between updates of the status page, limiting the cost
+   of rewriting all sources when selections are frequent */
+#define STATUS_PAGE_MIN_INTERVAL 0.5
+
+/* Mapped status page and its size */
+static CMD_StatusPage *status_page;
+static size_t status_page_size;
+
+/* Timeout of a pending update of the status page, flag indicating the
+   update was requested by a change of state, and time of the last update */
+static SCH_TimeoutID status_page_timeout;
+static int status_page_update_pending;
+static double status_page_last_update;
+
+/* Sum of hits in the server statistics published in the page */
+static uint32_t status_page_hits;
+
+/* Time after which an unfinished snapshot of the client log is dropped */
+#define CLIENT_SNAPSHOT_TIMEOUT 10.0
+
+/* Maximum number of snapshots of the client log kept at the same time,
+   allowing multiple clients to read their snapshots concurrently */
+#define MAX_CLIENT_SNAPSHOTS 4
+
+typedef struct {
+  /* Clients in the reply format, identifier of the snapshot (zero if
+     unused), timeout of its removal, and time of the last request */
+  ARR_Instance clients;
+  uint32_t id;
+  SCH_TimeoutID timeout;
+  double last_use;
+  /* Sequence number and data of the request which created the snapshot,
+     to not create another snapshot (and reset the counters again) when
+     the request is retransmitted */
+  uint32_t sequence;
+  REQ_ClientAccessesByIndex4 request;
+} ClientSnapshot;
+
+static ClientSnapshot client_snapshots[MAX_CLIENT_SNAPSHOTS];
+
+/* Buffer for replies which don't fit in CMD_Reply */
+static CMD_BulkReply bulk_reply;
+
+/* Maximum number of subscribers receiving records */
+#define MAX_SUBSCRIBERS 8
+
+typedef struct {
+  char *path;
+  uint32_t records;
+  uint32_t sequence;
+} Subscriber;
+
+static Subscriber subscribers[MAX_SUBSCRIBERS];
+static int n_subscribers;
+
+/* Mask of records requested by all subscribers */
+static uint32_t subscribed_records;
+
+#ifdef HAVE_PTHREAD
+/* With the cmdthread directive, the requests for reports which are used for
+   monitoring are answered by a separate thread from snapshots of the
+   reports.  The main thread still receives and checks all requests, but it
+   refreshes a snapshot only if it is older than this interval. */
+#define SNAPSHOT_INTERVAL 0.5
+
+/* Maximum number of requests waiting for the thread.  If the queue is full,
+   the requests are handled by the main thread. */
+#define MAX_QUEUED_REQUESTS 64
+
+typedef struct {
+  IPAddr ip_addr;
+  uint16_t source_data_status;
+  uint16_t sourcestats_status;
+  uint16_t select_data_status;
+  uint16_t ntp_data_status;
+  RPY_Source_Data source_data;
+  RPY_Sourcestats sourcestats;
+  RPY_SelectData select_data;
+  RPY_NTPData ntp_data;
+} SnapshotSource;
+
+typedef struct {
+  int sock_fd;
+  int request_length;
+  SCK_Message message;
+  char path[sizeof (((struct sockaddr_un *)NULL)->sun_path)];
+  CMD_Request request;
+} QueuedRequest;
+
+/* Lock protecting the queue, the snapshots, and the quit flag */
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Condition signalling the thread a request was queued */
+static pthread_cond_t thread_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t request_thread;
+static int thread_running;
+static int thread_quit;
+
+/* Circular queue of requests waiting for the thread */
+static QueuedRequest queued_requests[MAX_QUEUED_REQUESTS];
+static unsigned int queue_first;
+static unsigned int queue_length;
+
+/* Snapshots of the tracking, server statistics, and activity reports, and
+   of the reports of sources, with the monotonic time of their update */
+static RPY_Tracking snapshot_tracking;
+static RPY_ServerStats snapshot_server_stats;
+static RPY_Activity snapshot_activity;
+static double snapshot_global_time;
+static ARR_Instance snapshot_sources;
+static double snapshot_sources_time;
+#endif
+
 /* ================================================== */
 /* Array of permission levels for command types */
 
@@ -144,6 +270,13 @@ static const char permissions[] = {
   PERMIT_AUTH, /* SELECT_DATA */
   PERMIT_AUTH, /* RELOAD_SOURCES */
   PERMIT_AUTH, /* DOFFSET2 */
+  PERMIT_AUTH, /* CLIENT_ACCESSES_BY_INDEX4 */
+  PERMIT_AUTH, /* SUBSCRIBE */
+  PERMIT_AUTH, /* PROFILE_DATA */
+  PERMIT_AUTH, /* RESET_PROFILE */
+  PERMIT_AUTH, /* MEMORY_DATA */
+  PERMIT_OPEN, /* TRACKING2 */
+  PERMIT_AUTH, /* SERVER_STATS2 */
 };
 
 /* ================================================== */
@@ -155,6 +288,10 @@ static ADF_AuthTable access_auth_table;
 /* ================================================== */
 /* Forward prototypes */
 static void read_from_cmd_socket(int sock_fd, int event, void *anything);
+static void close_status_page(int remove);
+static void drop_client_snapshot(ClientSnapshot *snapshot);
+static void remove_subscriber(int index);
+static void stop_thread(void);
 
 /* ================================================== */
 
@@ -235,7 +372,8 @@ do_size_checks_updated(void)
     reply.status = STT_SUCCESS;
     reply_length = PKL_ReplyLength(&reply);
     if ((reply_length && reply_length < offsetof(CMD_Reply, data)) ||
-        reply_length > sizeof (CMD_Reply))
+        reply_length > (i == RPY_CLIENT_ACCESSES_BY_INDEX4 ?
+                        sizeof (CMD_BulkReply) : sizeof (CMD_Reply)))
       assert(0);
   }
 }
@@ -245,6 +383,8 @@ do_size_checks_updated(void)
 void
 CAM_Initialise(void)
 {
+  int i;
+
   assert(!initialised);
   assert(sizeof (permissions) / sizeof (permissions[0]) == N_REQUEST_TYPES);
   do_size_checks_updated();
@@ -258,6 +398,40 @@ CAM_Initialise(void)
   sock_fd6 = open_socket(IPADDR_INET6);
 
   access_auth_table = ADF_CreateTable();
+
+  status_page = NULL;
+  status_page_size = 0;
+  status_page_timeout = 0;
+  status_page_update_pending = 0;
+  status_page_last_update = 0.0;
+  status_page_hits = 0;
+
+#ifndef HAVE_SYNC_SYNCHRONIZE
+  if (CNF_GetStatusFile())
+    LOG(LOGS_WARN, "statusfile not supported (compiled without memory barriers)");
+#endif
+
+  for (i = 0; i < MAX_CLIENT_SNAPSHOTS; i++) {
+    client_snapshots[i].clients = ARR_CreateInstance(sizeof (RPY_ClientAccesses_Client));
+    client_snapshots[i].id = 0;
+    client_snapshots[i].timeout = 0;
+  }
+
+  n_subscribers = 0;
+  subscribed_records = 0;
+
+#ifdef HAVE_PTHREAD
+  thread_running = 0;
+  thread_quit = 0;
+  queue_first = 0;
+  queue_length = 0;
+  snapshot_sources = ARR_CreateInstance(sizeof (SnapshotSource));
+  /* Make sure the first request refreshes the snapshots */
+  snapshot_global_time = snapshot_sources_time = -SNAPSHOT_INTERVAL;
+#else
+  if (CNF_GetCommandThread())
+    LOG(LOGS_WARN, "cmdthread not supported (compiled without threads)");
+#endif
 }
 
 /* ================================================== */
@@ -265,6 +439,11 @@ CAM_Initialise(void)
 void
 CAM_Finalise(void)
 {
+  int i;
+
+  /* Stop the thread before closing the sockets it may be using */
+  stop_thread();
+
   if (sock_fdu != INVALID_SOCK_FD) {
     SCH_RemoveFileHandler(sock_fdu);
     SCK_RemoveSocket(sock_fdu);
@@ -286,6 +465,21 @@ CAM_Finalise(void)
 
   ADF_DestroyTable(access_auth_table);
 
+  SCH_RemoveTimeout(status_page_timeout);
+  close_status_page(1);
+
+  for (i = 0; i < MAX_CLIENT_SNAPSHOTS; i++) {
+    drop_client_snapshot(&client_snapshots[i]);
+    ARR_DestroyInstance(client_snapshots[i].clients);
+  }
+
+  while (n_subscribers > 0)
+    remove_subscriber(0);
+
+#ifdef HAVE_PTHREAD
+  ARR_DestroyInstance(snapshot_sources);
+#endif
+
   initialised = 0;
 }
 
@@ -298,6 +492,9 @@ CAM_OpenUnixSocket(void)
      the process has already dropped the root privileges */
   if (CNF_GetBindCommandPath())
     sock_fdu = open_socket(IPADDR_UNSPEC);
+
+  /* Create also the status page as the unprivileged user */
+  CAM_UpdateStatusPage();
 }
 
 /* ================================================== */
@@ -307,7 +504,8 @@ transmit_reply(int sock_fd, int request_length, SCK_Message *message)
 {
   message->length = PKL_ReplyLength((CMD_Reply *)message->data);
 
-  if (request_length < message->length) {
+  /* Replies on the Unix domain socket cannot be used for amplification */
+  if (request_length < message->length && message->addr_type != SCK_ADDR_UNIX) {
     DEBUG_LOG("Response longer than request req_len=%d res_len=%d",
               request_length, message->length);
     return;
@@ -881,7 +1079,8 @@ handle_tracking(CMD_Request *rx_message, CMD_Reply *tx_message)
   RPT_TrackingReport rpt;
 
   REF_GetTrackingReport(&rpt);
-  tx_message->reply  = htons(RPY_TRACKING);
+  tx_message->reply  = htons(ntohs(rx_message->command) == REQ_TRACKING2 ?
+                             RPY_TRACKING2 : RPY_TRACKING);
   tx_message->data.tracking.ref_id = htonl(rpt.ref_id);
   UTI_IPHostToNetwork(&rpt.ip_addr, &tx_message->data.tracking.ip_addr);
   tx_message->data.tracking.stratum = htons(rpt.stratum);
@@ -896,6 +1095,8 @@ handle_tracking(CMD_Request *rx_message, CMD_Reply *tx_message)
   tx_message->data.tracking.root_delay = UTI_FloatHostToNetwork(rpt.root_delay);
   tx_message->data.tracking.root_dispersion = UTI_FloatHostToNetwork(rpt.root_dispersion);
   tx_message->data.tracking.last_update_interval = UTI_FloatHostToNetwork(rpt.last_update_interval);
+  tx_message->data.tracking.first_update_delay =
+    UTI_FloatHostToNetwork(REF_GetFirstUpdateDelay());
 }
 
 /* ================================================== */
@@ -954,6 +1155,23 @@ handle_smoothtime(CMD_Request *rx_message, CMD_Reply *tx_message)
 
 /* ================================================== */
 
+static void
+convert_sourcestats_report(RPT_SourcestatsReport *report, RPY_Sourcestats *data)
+{
+  data->ref_id = htonl(report->ref_id);
+  UTI_IPHostToNetwork(&report->ip_addr, &data->ip_addr);
+  data->n_samples = htonl(report->n_samples);
+  data->n_runs = htonl(report->n_runs);
+  data->span_seconds = htonl(report->span_seconds);
+  data->resid_freq_ppm = UTI_FloatHostToNetwork(report->resid_freq_ppm);
+  data->skew_ppm = UTI_FloatHostToNetwork(report->skew_ppm);
+  data->sd = UTI_FloatHostToNetwork(report->sd);
+  data->est_offset = UTI_FloatHostToNetwork(report->est_offset);
+  data->est_offset_err = UTI_FloatHostToNetwork(report->est_offset_err);
+}
+
+/* ================================================== */
+
 static void
 handle_sourcestats(CMD_Request *rx_message, CMD_Reply *tx_message)
 {
@@ -967,16 +1185,7 @@ handle_sourcestats(CMD_Request *rx_message, CMD_Reply *tx_message)
 
   if (status) {
     tx_message->reply = htons(RPY_SOURCESTATS);
-    tx_message->data.sourcestats.ref_id = htonl(report.ref_id);
-    UTI_IPHostToNetwork(&report.ip_addr, &tx_message->data.sourcestats.ip_addr);
-    tx_message->data.sourcestats.n_samples = htonl(report.n_samples);
-    tx_message->data.sourcestats.n_runs = htonl(report.n_runs);
-    tx_message->data.sourcestats.span_seconds = htonl(report.span_seconds);
-    tx_message->data.sourcestats.resid_freq_ppm = UTI_FloatHostToNetwork(report.resid_freq_ppm);
-    tx_message->data.sourcestats.skew_ppm = UTI_FloatHostToNetwork(report.skew_ppm);
-    tx_message->data.sourcestats.sd = UTI_FloatHostToNetwork(report.sd);
-    tx_message->data.sourcestats.est_offset = UTI_FloatHostToNetwork(report.est_offset);
-    tx_message->data.sourcestats.est_offset_err = UTI_FloatHostToNetwork(report.est_offset_err);
+    convert_sourcestats_report(&report, &tx_message->data.sourcestats);
   } else {
     tx_message->status = htons(STT_NOSUCHSOURCE);
   }
@@ -1022,11 +1231,32 @@ handle_cyclelogs(CMD_Request *rx_message, CMD_Reply *tx_message)
 
 /* ================================================== */
 
+static void
+convert_client_report(RPT_ClientAccessByIndex_Report *report,
+                      RPY_ClientAccesses_Client *client)
+{
+  UTI_IPHostToNetwork(&report->ip_addr, &client->ip);
+  client->ntp_hits = htonl(report->ntp_hits);
+  client->nke_hits = htonl(report->nke_hits);
+  client->cmd_hits = htonl(report->cmd_hits);
+  client->ntp_drops = htonl(report->ntp_drops);
+  client->nke_drops = htonl(report->nke_drops);
+  client->cmd_drops = htonl(report->cmd_drops);
+  client->ntp_interval = report->ntp_interval;
+  client->nke_interval = report->nke_interval;
+  client->cmd_interval = report->cmd_interval;
+  client->ntp_timeout_interval = report->ntp_timeout_interval;
+  client->last_ntp_hit_ago = htonl(report->last_ntp_hit_ago);
+  client->last_nke_hit_ago = htonl(report->last_nke_hit_ago);
+  client->last_cmd_hit_ago = htonl(report->last_cmd_hit_ago);
+}
+
+/* ================================================== */
+
 static void
 handle_client_accesses_by_index(CMD_Request *rx_message, CMD_Reply *tx_message)
 {
   RPT_ClientAccessByIndex_Report report;
-  RPY_ClientAccesses_Client *client;
   int n_indices;
   uint32_t i, j, req_first_index, req_n_clients, req_min_hits, req_reset;
   struct timespec now;
@@ -1053,22 +1283,7 @@ handle_client_accesses_by_index(CMD_Request *rx_message, CMD_Reply *tx_message)
     if (!CLG_GetClientAccessReportByIndex(i, req_reset, req_min_hits, &report, &now))
       continue;
 
-    client = &tx_message->data.client_accesses_by_index.clients[j++];
-
-    UTI_IPHostToNetwork(&report.ip_addr, &client->ip);
-    client->ntp_hits = htonl(report.ntp_hits);
-    client->nke_hits = htonl(report.nke_hits);
-    client->cmd_hits = htonl(report.cmd_hits);
-    client->ntp_drops = htonl(report.ntp_drops);
-    client->nke_drops = htonl(report.nke_drops);
-    client->cmd_drops = htonl(report.cmd_drops);
-    client->ntp_interval = report.ntp_interval;
-    client->nke_interval = report.nke_interval;
-    client->cmd_interval = report.cmd_interval;
-    client->ntp_timeout_interval = report.ntp_timeout_interval;
-    client->last_ntp_hit_ago = htonl(report.last_ntp_hit_ago);
-    client->last_nke_hit_ago = htonl(report.last_nke_hit_ago);
-    client->last_cmd_hit_ago = htonl(report.last_cmd_hit_ago);
+    convert_client_report(&report, &tx_message->data.client_accesses_by_index.clients[j++]);
   }
 
   tx_message->data.client_accesses_by_index.next_index = htonl(i);
@@ -1077,6 +1292,211 @@ handle_client_accesses_by_index(CMD_Request *rx_message, CMD_Reply *tx_message)
 
 /* ================================================== */
 
+static void
+drop_client_snapshot(ClientSnapshot *snapshot)
+{
+  SCH_RemoveTimeout(snapshot->timeout);
+  snapshot->timeout = 0;
+  snapshot->id = 0;
+  snapshot->sequence = 0;
+  memset(&snapshot->request, 0, sizeof (snapshot->request));
+  ARR_SetSize(snapshot->clients, 0);
+}
+
+/* ================================================== */
+
+static void
+handle_client_snapshot_timeout(void *arg)
+{
+  ClientSnapshot *snapshot = arg;
+
+  snapshot->timeout = 0;
+  drop_client_snapshot(snapshot);
+}
+
+/* ================================================== */
+
+static ClientSnapshot *
+find_client_snapshot(uint32_t id)
+{
+  int i;
+
+  for (i = 0; i < MAX_CLIENT_SNAPSHOTS; i++) {
+    if (id != 0 && client_snapshots[i].id == id)
+      return &client_snapshots[i];
+  }
+
+  return NULL;
+}
+
+/* ================================================== */
+
+static ClientSnapshot *
+find_retransmitted_snapshot(uint32_t sequence, REQ_ClientAccessesByIndex4 *request)
+{
+  int i;
+
+  for (i = 0; i < MAX_CLIENT_SNAPSHOTS; i++) {
+    if (client_snapshots[i].id != 0 && client_snapshots[i].sequence == sequence &&
+        memcmp(&client_snapshots[i].request, request, sizeof (*request)) == 0)
+      return &client_snapshots[i];
+  }
+
+  return NULL;
+}
+
+/* ================================================== */
+
+static int
+match_subnet(IPAddr *ip, IPAddr *subnet, int subnet_bits)
+{
+  IPAddr mask;
+  int i, bits;
+
+  if (subnet->family == IPADDR_UNSPEC)
+    return 1;
+
+  mask.family = subnet->family;
+
+  switch (subnet->family) {
+    case IPADDR_INET4:
+      bits = CLAMP(0, subnet_bits, 32);
+      mask.addr.in4 = bits > 0 ? 0xffffffffU << (32 - bits) : 0;
+      break;
+    case IPADDR_INET6:
+      for (i = 0; i < 16; i++) {
+        bits = CLAMP(0, subnet_bits - 8 * i, 8);
+        mask.addr.in6[i] = 0xff00U >> bits;
+      }
+      break;
+    default:
+      return 0;
+  }
+
+  return ip->family == subnet->family && UTI_CompareIPs(ip, subnet, &mask) == 0;
+}
+
+/* ================================================== */
+
+static ClientSnapshot *
+create_client_snapshot(uint32_t sequence, REQ_ClientAccessesByIndex4 *request)
+{
+  RPT_ClientAccessByIndex_Report report;
+  ClientSnapshot *snapshot;
+  uint32_t min_hits, max_last_ago;
+  int i, n_indices, reset, subnet_bits;
+  struct timespec now;
+  IPAddr subnet;
+
+  n_indices = CLG_GetNumberOfIndices();
+  if (n_indices < 0)
+    return NULL;
+
+  /* Use a free slot, or replace the least recently used snapshot */
+  for (i = 0, snapshot = &client_snapshots[0]; i < MAX_CLIENT_SNAPSHOTS; i++) {
+    if (client_snapshots[i].id == 0) {
+      snapshot = &client_snapshots[i];
+      break;
+    }
+    if (client_snapshots[i].last_use < snapshot->last_use)
+      snapshot = &client_snapshots[i];
+  }
+
+  drop_client_snapshot(snapshot);
+
+  SCH_GetLastEventTime(&now, NULL, NULL);
+
+  min_hits = ntohl(request->min_hits);
+  reset = ntohl(request->reset);
+  UTI_IPNetworkToHost(&request->ip, &subnet);
+  subnet_bits = ntohl(request->subnet_bits);
+  max_last_ago = ntohl(request->max_last_ago);
+
+  /* Collect the selected records at once to get a consistent view of
+     the log, which is not affected by changes in the hash table */
+  for (i = 0; i < n_indices; i++) {
+    if (!CLG_GetClientAccessReportByIndex(i, reset, min_hits, &report, &now))
+      continue;
+
+    if (!match_subnet(&report.ip_addr, &subnet, subnet_bits))
+      continue;
+
+    if (report.last_ntp_hit_ago > max_last_ago && report.last_nke_hit_ago > max_last_ago &&
+        report.last_cmd_hit_ago > max_last_ago)
+      continue;
+
+    convert_client_report(&report, ARR_GetNewElement(snapshot->clients));
+  }
+
+  do {
+    UTI_GetRandomBytes(&snapshot->id, sizeof (snapshot->id));
+  } while (snapshot->id == 0 || find_client_snapshot(snapshot->id) != snapshot);
+
+  snapshot->sequence = sequence;
+  snapshot->request = *request;
+
+  return snapshot;
+}
+
+/* ================================================== */
+
+static void
+handle_client_accesses_by_index4(CMD_Request *rx_message, CMD_Reply *tx_message,
+                                 SCK_Message *message)
+{
+  REQ_ClientAccessesByIndex4 *request = &rx_message->data.client_accesses_by_index4;
+  RPY_ClientAccessesByIndex4 *reply = &bulk_reply.data.client_accesses_by_index4;
+  uint32_t n_indices, first_index, n_clients;
+  ClientSnapshot *snapshot;
+
+  if (ntohl(request->snapshot) == 0) {
+    /* Reuse the snapshot if this is a retransmission of the request that
+       created it */
+    snapshot = find_retransmitted_snapshot(rx_message->sequence, request);
+    if (!snapshot) {
+      snapshot = create_client_snapshot(rx_message->sequence, request);
+      if (!snapshot) {
+        tx_message->status = htons(STT_INACTIVE);
+        return;
+      }
+    }
+  } else {
+    snapshot = find_client_snapshot(ntohl(request->snapshot));
+    if (!snapshot) {
+      tx_message->status = htons(STT_NOSUCHSNAPSHOT);
+      return;
+    }
+  }
+
+  /* Keep the snapshot while it is being read */
+  snapshot->last_use = SCH_GetLastEventMonoTime();
+  SCH_RemoveTimeout(snapshot->timeout);
+  snapshot->timeout = SCH_AddTimeoutByDelay(CLIENT_SNAPSHOT_TIMEOUT,
+                                            handle_client_snapshot_timeout, snapshot);
+
+  n_indices = ARR_GetSize(snapshot->clients);
+  first_index = MIN(ntohl(request->first_index), n_indices);
+  n_clients = MIN(ntohl(request->n_clients), MAX_CLIENT_ACCESSES_BULK);
+  n_clients = MIN(n_clients, n_indices - first_index);
+
+  memcpy(&bulk_reply, tx_message, offsetof(CMD_Reply, data));
+  memset(&bulk_reply.data, 0, sizeof (bulk_reply.data));
+  bulk_reply.reply = htons(RPY_CLIENT_ACCESSES_BY_INDEX4);
+
+  reply->n_indices = htonl(n_indices);
+  reply->next_index = htonl(first_index + n_clients);
+  reply->n_clients = htonl(n_clients);
+  reply->snapshot = htonl(snapshot->id);
+
+  if (n_clients > 0)
+    memcpy(reply->clients, ARR_GetElement(snapshot->clients, first_index),
+           n_clients * sizeof (reply->clients[0]));
+
+  message->data = &bulk_reply;
+}
+
+/* ================================================== */
+
 static void
 handle_manual_list(CMD_Request *rx_message, CMD_Reply *tx_message)
 {
@@ -1169,7 +1589,9 @@ handle_server_stats(CMD_Request *rx_message, CMD_Reply *tx_message)
   RPT_ServerStatsReport report;
 
   CLG_GetServerStatsReport(&report);
-  tx_message->reply = htons(RPY_SERVER_STATS3);
+  NSD_GetServerStatsReport(&report);
+  tx_message->reply = htons(ntohs(rx_message->command) == REQ_SERVER_STATS2 ?
+                            RPY_SERVER_STATS4 : RPY_SERVER_STATS3);
   tx_message->data.server_stats.ntp_hits = htonl(report.ntp_hits);
   tx_message->data.server_stats.nke_hits = htonl(report.nke_hits);
   tx_message->data.server_stats.cmd_hits = htonl(report.cmd_hits);
@@ -1181,6 +1603,49 @@ handle_server_stats(CMD_Request *rx_message, CMD_Reply *tx_message)
   tx_message->data.server_stats.ntp_interleaved_hits = htonl(report.ntp_interleaved_hits);
   tx_message->data.server_stats.ntp_timestamps = htonl(report.ntp_timestamps);
   tx_message->data.server_stats.ntp_span_seconds = htonl(report.ntp_span_seconds);
+  tx_message->data.server_stats.signd_requests = htonl(report.signd_requests);
+  tx_message->data.server_stats.signd_drops = htonl(report.signd_drops);
+  tx_message->data.server_stats.signd_timeouts = htonl(report.signd_timeouts);
+  tx_message->data.server_stats.signd_max_queue = htonl(report.signd_max_queue);
+  tx_message->data.server_stats.signd_mean_delay =
+    UTI_FloatHostToNetwork(report.signd_mean_delay);
+  tx_message->data.server_stats.signd_max_delay =
+    UTI_FloatHostToNetwork(report.signd_max_delay);
+}
+
+/* ================================================== */
+
+static void
+convert_ntp_report(RPT_NTPReport *report, RPY_NTPData *data)
+{
+  UTI_IPHostToNetwork(&report->remote_addr, &data->remote_addr);
+  UTI_IPHostToNetwork(&report->local_addr, &data->local_addr);
+  data->remote_port = htons(report->remote_port);
+  data->leap = report->leap;
+  data->version = report->version;
+  data->mode = report->mode;
+  data->stratum = report->stratum;
+  data->poll = report->poll;
+  data->precision = report->precision;
+  data->root_delay = UTI_FloatHostToNetwork(report->root_delay);
+  data->root_dispersion = UTI_FloatHostToNetwork(report->root_dispersion);
+  data->ref_id = htonl(report->ref_id);
+  UTI_TimespecHostToNetwork(&report->ref_time, &data->ref_time);
+  data->offset = UTI_FloatHostToNetwork(report->offset);
+  data->peer_delay = UTI_FloatHostToNetwork(report->peer_delay);
+  data->peer_dispersion = UTI_FloatHostToNetwork(report->peer_dispersion);
+  data->response_time = UTI_FloatHostToNetwork(report->response_time);
+  data->jitter_asymmetry = UTI_FloatHostToNetwork(report->jitter_asymmetry);
+  data->flags = htons((report->tests & RPY_NTP_FLAGS_TESTS) |
+                      (report->interleaved ? RPY_NTP_FLAG_INTERLEAVED : 0) |
+                      (report->authenticated ? RPY_NTP_FLAG_AUTHENTICATED : 0));
+  data->tx_tss_char = report->tx_tss_char;
+  data->rx_tss_char = report->rx_tss_char;
+  data->total_tx_count = htonl(report->total_tx_count);
+  data->total_rx_count = htonl(report->total_rx_count);
+  data->total_valid_count = htonl(report->total_valid_count);
+  data->memory_size = htonl(report->memory_size);
+  memset(data->reserved, 0xff, sizeof (data->reserved));
 }
 
 /* ================================================== */
@@ -1198,33 +1663,7 @@ handle_ntp_data(CMD_Request *rx_message, CMD_Reply *tx_message)
   }
 
   tx_message->reply = htons(RPY_NTP_DATA);
-  UTI_IPHostToNetwork(&report.remote_addr, &tx_message->data.ntp_data.remote_addr);
-  UTI_IPHostToNetwork(&report.local_addr, &tx_message->data.ntp_data.local_addr);
-  tx_message->data.ntp_data.remote_port = htons(report.remote_port);
-  tx_message->data.ntp_data.leap = report.leap;
-  tx_message->data.ntp_data.version = report.version;
-  tx_message->data.ntp_data.mode = report.mode;
-  tx_message->data.ntp_data.stratum = report.stratum;
-  tx_message->data.ntp_data.poll = report.poll;
-  tx_message->data.ntp_data.precision = report.precision;
-  tx_message->data.ntp_data.root_delay = UTI_FloatHostToNetwork(report.root_delay);
-  tx_message->data.ntp_data.root_dispersion = UTI_FloatHostToNetwork(report.root_dispersion);
-  tx_message->data.ntp_data.ref_id = htonl(report.ref_id);
-  UTI_TimespecHostToNetwork(&report.ref_time, &tx_message->data.ntp_data.ref_time);
-  tx_message->data.ntp_data.offset = UTI_FloatHostToNetwork(report.offset);
-  tx_message->data.ntp_data.peer_delay = UTI_FloatHostToNetwork(report.peer_delay);
-  tx_message->data.ntp_data.peer_dispersion = UTI_FloatHostToNetwork(report.peer_dispersion);
-  tx_message->data.ntp_data.response_time = UTI_FloatHostToNetwork(report.response_time);
-  tx_message->data.ntp_data.jitter_asymmetry = UTI_FloatHostToNetwork(report.jitter_asymmetry);
-  tx_message->data.ntp_data.flags = htons((report.tests & RPY_NTP_FLAGS_TESTS) |
-                                          (report.interleaved ? RPY_NTP_FLAG_INTERLEAVED : 0) |
-                                          (report.authenticated ? RPY_NTP_FLAG_AUTHENTICATED : 0));
-  tx_message->data.ntp_data.tx_tss_char = report.tx_tss_char;
-  tx_message->data.ntp_data.rx_tss_char = report.rx_tss_char;
-  tx_message->data.ntp_data.total_tx_count = htonl(report.total_tx_count);
-  tx_message->data.ntp_data.total_rx_count = htonl(report.total_rx_count);
-  tx_message->data.ntp_data.total_valid_count = htonl(report.total_valid_count);
-  memset(tx_message->data.ntp_data.reserved, 0xff, sizeof (tx_message->data.ntp_data.reserved));
+  convert_ntp_report(&report, &tx_message->data.ntp_data);
 }
 
 /* ================================================== */
@@ -1265,6 +1704,82 @@ handle_ntp_source_name(CMD_Request *rx_message, CMD_Reply *tx_message)
 
 /* ================================================== */
 
+static void
+handle_profile_data(CMD_Request *rx_message, CMD_Reply *tx_message)
+{
+  RPT_ProfileReport report;
+
+  if (!SCH_GetProfileReport(ntohl(rx_message->data.profile_data.index), &report)) {
+    tx_message->status = htons(STT_INVALID);
+    return;
+  }
+
+  tx_message->reply = htons(RPY_PROFILE_DATA);
+
+  tx_message->data.profile_data.n_entries = htonl(SCH_GetNumberOfProfileEntries());
+  tx_message->data.profile_data.interval = htonl(report.interval);
+  strncpy((char *)tx_message->data.profile_data.name, report.name,
+          sizeof (tx_message->data.profile_data.name));
+
+  switch (report.type) {
+    case RPT_PROFILE_FILE_HANDLER:
+      tx_message->data.profile_data.type = htons(RPY_PD_TYPE_FILE_HANDLER);
+      break;
+    case RPT_PROFILE_TIMEOUT_HANDLER:
+      tx_message->data.profile_data.type = htons(RPY_PD_TYPE_TIMEOUT_HANDLER);
+      break;
+    case RPT_PROFILE_WAIT:
+      tx_message->data.profile_data.type = htons(RPY_PD_TYPE_WAIT);
+      break;
+    case RPT_PROFILE_COUNTER:
+      tx_message->data.profile_data.type = htons(RPY_PD_TYPE_COUNTER);
+      break;
+    default:
+      assert(0);
+  }
+
+  tx_message->data.profile_data.count = htonl(report.count);
+  tx_message->data.profile_data.total_wall_time = UTI_FloatHostToNetwork(report.total_wall_time);
+  tx_message->data.profile_data.max_wall_time = UTI_FloatHostToNetwork(report.max_wall_time);
+  tx_message->data.profile_data.total_cpu_time = UTI_FloatHostToNetwork(report.total_cpu_time);
+  tx_message->data.profile_data.max_cpu_time = UTI_FloatHostToNetwork(report.max_cpu_time);
+}
+
+/* ================================================== */
+
+static void
+handle_reset_profile(CMD_Request *rx_message, CMD_Reply *tx_message)
+{
+  SCH_ResetProfile();
+}
+
+/* ================================================== */
+
+static void
+handle_memory_data(CMD_Request *rx_message, CMD_Reply *tx_message)
+{
+  RPT_MemoryReport report;
+
+  if (!MEM_GetReport(ntohl(rx_message->data.memory_data.index), &report)) {
+    tx_message->status = htons(STT_INVALID);
+    return;
+  }
+
+  tx_message->reply = htons(RPY_MEMORY_DATA);
+
+  tx_message->data.memory_data.n_entries = htonl(MEM_TAGS + 1);
+  strncpy((char *)tx_message->data.memory_data.name, report.name,
+          sizeof (tx_message->data.memory_data.name));
+  tx_message->data.memory_data.current_bytes_high = htonl((uint64_t)report.current_bytes >> 32);
+  tx_message->data.memory_data.current_bytes_low = htonl(report.current_bytes);
+  tx_message->data.memory_data.peak_bytes_high = htonl((uint64_t)report.peak_bytes >> 32);
+  tx_message->data.memory_data.peak_bytes_low = htonl(report.peak_bytes);
+  tx_message->data.memory_data.current_objects = htonl(MIN(report.current_objects, UINT32_MAX));
+  tx_message->data.memory_data.peak_objects = htonl(MIN(report.peak_objects, UINT32_MAX));
+}
+
+/* ================================================== */
+
 static void
 handle_reload_sources(CMD_Request *rx_message, CMD_Reply *tx_message)
 {
@@ -1363,95 +1878,844 @@ handle_select_data(CMD_Request *rx_message, CMD_Reply *tx_message)
 }
 
 /* ================================================== */
-/* Read a packet and process it */
 
 static void
-read_from_cmd_socket(int sock_fd, int event, void *anything)
+close_status_page(int remove)
 {
-  SCK_Message *sck_message;
-  CMD_Request rx_message;
-  CMD_Reply tx_message;
-  IPAddr loopback_addr, remote_ip;
-  int read_length, expected_length;
-  int localhost, allowed, log_index;
-  uint16_t rx_command;
-  struct timespec now, cooked_now;
-
-  sck_message = SCK_ReceiveMessage(sock_fd, 0);
-  if (!sck_message)
+  if (!status_page)
     return;
 
-  read_length = sck_message->length;
+  /* Let readers know they need to open the file again */
+  status_page->flags |= STATUS_PAGE_FLAG_STALE;
 
-  /* Get current time cheaply */
-  SCH_GetLastEventTime(&cooked_now, NULL, &now);
+  if (munmap(status_page, status_page_size) < 0)
+    LOG(LOGS_ERR, "Could not unmap %s : %s", "status page", strerror(errno));
 
-  /* Check if it's from localhost (127.0.0.1, ::1, or Unix domain),
-     or an authorised address */
-  switch (sck_message->addr_type) {
-    case SCK_ADDR_IP:
-      assert(sock_fd == sock_fd4 || sock_fd == sock_fd6);
-      remote_ip = sck_message->remote_addr.ip.ip_addr;
-      SCK_GetLoopbackIPAddress(remote_ip.family, &loopback_addr);
-      localhost = UTI_CompareIPs(&remote_ip, &loopback_addr, NULL) == 0;
+  if (remove)
+    UTI_RemoveFile(NULL, CNF_GetStatusFile(), NULL);
 
-      if (!localhost && !ADF_IsAllowed(access_auth_table, &remote_ip)) {
-        DEBUG_LOG("Unauthorised host %s",
-                  UTI_IPSockAddrToString(&sck_message->remote_addr.ip));
-        return;
-      }
+  status_page = NULL;
+  status_page_size = 0;
+}
 
-      assert(remote_ip.family != IPADDR_UNSPEC);
+/* ================================================== */
 
-      break;
-    case SCK_ADDR_UNIX:
-      assert(sock_fd == sock_fdu);
-      remote_ip.family = IPADDR_UNSPEC;
-      localhost = 1;
-      break;
-    default:
-      DEBUG_LOG("Unexpected address type");
-      return;
+static int
+open_status_page(unsigned int max_sources)
+{
+  const char *path = CNF_GetStatusFile();
+  char tmp_path[PATH_MAX];
+  CMD_StatusPage *page;
+  size_t size;
+  int fd;
+
+  size = sizeof (CMD_StatusPage) + max_sources * sizeof (CMD_StatusPageSource);
+
+  /* Prepare the new page in a temporary file and replace the old one.  The
+     file needs to be opened for reading and writing in order to map it. */
+  if (snprintf(tmp_path, sizeof (tmp_path), "%s.tmp", path) >= sizeof (tmp_path))
+    return 0;
+
+  if (unlink(tmp_path) < 0 && errno != ENOENT)
+    DEBUG_LOG("Could not remove %s : %s", tmp_path, strerror(errno));
+
+  fd = open(tmp_path, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    LOG(LOGS_ERR, "Could not open %s : %s", tmp_path, strerror(errno));
+    return 0;
   }
 
-  if (read_length < offsetof(CMD_Request, data) ||
-      read_length < offsetof(CMD_Reply, data) ||
-      read_length > sizeof (CMD_Request)) {
-    /* We don't know how to process anything like this or an error reply
-       would be larger than the request */
-    DEBUG_LOG("Unexpected length");
-    return;
+  if (ftruncate(fd, size) < 0) {
+    LOG(LOGS_ERR, "Could not resize %s : %s", tmp_path, strerror(errno));
+    close(fd);
+    UTI_RemoveFile(NULL, tmp_path, NULL);
+    return 0;
   }
 
-  memcpy(&rx_message, sck_message->data, read_length);
+  page = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
 
-  if (rx_message.pkt_type != PKT_TYPE_CMD_REQUEST ||
-      rx_message.res1 != 0 ||
-      rx_message.res2 != 0) {
-    DEBUG_LOG("Command packet dropped");
-    return;
+  if (page == MAP_FAILED) {
+    LOG(LOGS_ERR, "Could not map %s : %s", tmp_path, strerror(errno));
+    UTI_RemoveFile(NULL, tmp_path, NULL);
+    return 0;
   }
 
-  log_index = CLG_LogServiceAccess(CLG_CMDMON, &remote_ip, &cooked_now);
+  page->magic = STATUS_PAGE_MAGIC;
+  page->version = STATUS_PAGE_VERSION;
+  page->size = size;
+  page->max_sources = max_sources;
 
-  /* Don't reply to all requests from hosts other than localhost if the rate
-     is excessive */
-  if (!localhost && log_index >= 0 && CLG_LimitServiceRate(CLG_CMDMON, log_index)) {
-      DEBUG_LOG("Command packet discarded to limit response rate");
-      return;
+  if (!UTI_RenameTempFile(NULL, path, ".tmp", NULL)) {
+    munmap(page, size);
+    return 0;
   }
 
-  expected_length = PKL_CommandLength(&rx_message);
-  rx_command = ntohs(rx_message.command);
+  close_status_page(0);
 
-  memset(&tx_message, 0, sizeof (tx_message));
-  sck_message->data = &tx_message;
-  sck_message->length = 0;
+  status_page = page;
+  status_page_size = size;
 
-  tx_message.version = PROTO_VERSION_NUMBER;
-  tx_message.pkt_type = PKT_TYPE_CMD_REPLY;
-  tx_message.command = rx_message.command;
-  tx_message.reply = htons(RPY_NULL);
+  DEBUG_LOG("Opened status page %s size=%zu", path, size);
+
+  return 1;
+}
+
+/* ================================================== */
+
+static void
+update_status_page(void *arg)
+{
+  RPT_ServerStatsReport stats;
+  CMD_StatusPageSource *sources;
+  CMD_Request request;
+  CMD_Reply reply;
+  unsigned int i, n_sources;
+  uint32_t hits;
+
+  status_page_timeout = 0;
+  status_page_update_pending = 0;
+  status_page_last_update = SCH_GetLastEventMonoTime();
+
+  n_sources = SRC_ReadNumberOfSources();
+
+  if (!status_page || n_sources > status_page->max_sources) {
+    if (!open_status_page(MAX(2 * n_sources, MIN_STATUS_PAGE_SOURCES)))
+      return;
+  }
+
+  sources = (CMD_StatusPageSource *)(status_page + 1);
+
+  status_page->sequence++;
+  UTI_MemoryBarrier();
+
+  memset(&request, 0, sizeof (request));
+
+  handle_tracking(&request, &reply);
+  status_page->tracking = reply.data.tracking;
+  status_page->first_update_delay = UTI_FloatHostToNetwork(REF_GetFirstUpdateDelay());
+
+  handle_server_stats(&request, &reply);
+  status_page->server_stats = reply.data.server_stats;
+
+  for (i = 0; i < n_sources; i++) {
+    memset(&reply.data, 0, sizeof (reply.data));
+    request.data.source_data.index = htonl(i);
+    handle_source_data(&request, &reply);
+    sources[i].source_data = reply.data.source_data;
+
+    memset(&reply.data, 0, sizeof (reply.data));
+    request.data.sourcestats.index = htonl(i);
+    handle_sourcestats(&request, &reply);
+    sources[i].sourcestats = reply.data.sourcestats;
+  }
+
+  status_page->n_sources = n_sources;
+
+  UTI_MemoryBarrier();
+  status_page->sequence++;
+
+  /* Keep the server statistics up to date while the server is active */
+  CLG_GetServerStatsReport(&stats);
+  hits = stats.ntp_hits + stats.nke_hits + stats.cmd_hits;
+  if (hits != status_page_hits) {
+    status_page_hits = hits;
+    status_page_timeout = SCH_AddTimeoutByDelay(STATUS_PAGE_STATS_INTERVAL,
+                                                update_status_page, NULL);
+  }
+}
+
+/* ================================================== */
+
+void
+CAM_UpdateStatusPage(void)
+{
+  double delay;
+
+  if (!initialised || !CNF_GetStatusFile() || status_page_update_pending)
+    return;
+
+#ifndef HAVE_SYNC_SYNCHRONIZE
+  /* Readers could not get a consistent copy without memory barriers */
+  return;
+#endif
+
+  /* Update the page when the currently processed event is finished in order
+     to collect all changes (e.g. source selection and reference update),
+     but not more frequently than the minimum interval */
+  delay = status_page_last_update + STATUS_PAGE_MIN_INTERVAL - SCH_GetLastEventMonoTime();
+  delay = CLAMP(0.0, delay, STATUS_PAGE_MIN_INTERVAL);
+
+  SCH_RemoveTimeout(status_page_timeout);
+  status_page_timeout = SCH_AddTimeoutByDelay(delay, update_status_page, NULL);
+  status_page_update_pending = 1;
+}
+
+/* ================================================== */
+
+#ifdef HAVE_PTHREAD
+
+static uint16_t
+get_snapshot_reply(void (*handler)(CMD_Request *, CMD_Reply *), CMD_Request *request,
+                   CMD_Reply *reply)
+{
+  memset(reply, 0, sizeof (*reply));
+  reply->status = htons(STT_SUCCESS);
+  handler(request, reply);
+  return reply->status;
+}
+
+/* ================================================== */
+
+static void
+refresh_global_snapshot(void)
+{
+  CMD_Request request;
+  CMD_Reply tracking, server_stats, activity;
+
+  if (SCH_GetLastEventMonoTime() - snapshot_global_time < SNAPSHOT_INTERVAL)
+    return;
+
+  snapshot_global_time = SCH_GetLastEventMonoTime();
+
+  memset(&request, 0, sizeof (request));
+  get_snapshot_reply(handle_tracking, &request, &tracking);
+  get_snapshot_reply(handle_server_stats, &request, &server_stats);
+  get_snapshot_reply(handle_activity, &request, &activity);
+
+  pthread_mutex_lock(&thread_lock);
+  snapshot_tracking = tracking.data.tracking;
+  snapshot_server_stats = server_stats.data.server_stats;
+  snapshot_activity = activity.data.activity;
+  pthread_mutex_unlock(&thread_lock);
+}
+
+/* ================================================== */
+
+static void
+refresh_sources_snapshot(void)
+{
+  ARR_Instance sources, old_sources;
+  SnapshotSource *source;
+  unsigned int i, n_sources;
+  CMD_Request request;
+  CMD_Reply reply;
+
+  if (SCH_GetLastEventMonoTime() - snapshot_sources_time < SNAPSHOT_INTERVAL)
+    return;
+
+  snapshot_sources_time = SCH_GetLastEventMonoTime();
+
+  /* Prepare a new snapshot and replace the old one, which cannot be
+     modified while the thread may be reading it */
+  sources = ARR_CreateInstance(sizeof (SnapshotSource));
+  n_sources = SRC_ReadNumberOfSources();
+
+  memset(&request, 0, sizeof (request));
+
+  for (i = 0; i < n_sources; i++) {
+    source = ARR_GetNewElement(sources);
+
+    request.data.source_data.index = htonl(i);
+    source->source_data_status = get_snapshot_reply(handle_source_data, &request, &reply);
+    source->source_data = reply.data.source_data;
+    UTI_IPNetworkToHost(&reply.data.source_data.ip_addr, &source->ip_addr);
+
+    request.data.sourcestats.index = htonl(i);
+    source->sourcestats_status = get_snapshot_reply(handle_sourcestats, &request, &reply);
+    source->sourcestats = reply.data.sourcestats;
+
+    request.data.select_data.index = htonl(i);
+    source->select_data_status = get_snapshot_reply(handle_select_data, &request, &reply);
+    source->select_data = reply.data.select_data;
+
+    request.data.ntp_data.ip_addr = source->source_data.ip_addr;
+    source->ntp_data_status = get_snapshot_reply(handle_ntp_data, &request, &reply);
+    source->ntp_data = reply.data.ntp_data;
+  }
+
+  pthread_mutex_lock(&thread_lock);
+  old_sources = snapshot_sources;
+  snapshot_sources = sources;
+  pthread_mutex_unlock(&thread_lock);
+
+  ARR_DestroyInstance(old_sources);
+}
+
+/* ================================================== */
+
+static SnapshotSource *
+find_snapshot_source(CMD_Request *request)
+{
+  SnapshotSource *sources;
+  unsigned int i, n_sources;
+  IPAddr ip_addr;
+
+  sources = ARR_GetElements(snapshot_sources);
+  n_sources = ARR_GetSize(snapshot_sources);
+
+  switch (ntohs(request->command)) {
+    case REQ_SOURCE_DATA:
+      i = ntohl(request->data.source_data.index);
+      break;
+    case REQ_SOURCESTATS:
+      i = ntohl(request->data.sourcestats.index);
+      break;
+    case REQ_SELECT_DATA:
+      i = ntohl(request->data.select_data.index);
+      break;
+    case REQ_NTP_DATA:
+      UTI_IPNetworkToHost(&request->data.ntp_data.ip_addr, &ip_addr);
+      for (i = 0; i < n_sources; i++) {
+        if (UTI_CompareIPs(&sources[i].ip_addr, &ip_addr, NULL) == 0 &&
+            sources[i].ntp_data_status == htons(STT_SUCCESS))
+          break;
+      }
+      break;
+    default:
+      assert(0);
+      return NULL;
+  }
+
+  return i < n_sources ? &sources[i] : NULL;
+}
+
+/* ================================================== */
+/* Make a reply from the snapshots (with the lock held by the caller) */
+
+static void
+handle_snapshot_request(CMD_Request *rx_message, CMD_Reply *tx_message)
+{
+  SnapshotSource *source;
+  uint16_t command;
+
+  command = ntohs(rx_message->command);
+
+  switch (command) {
+    case REQ_N_SOURCES:
+      tx_message->reply = htons(RPY_N_SOURCES);
+      tx_message->data.n_sources.n_sources = htonl(ARR_GetSize(snapshot_sources));
+      return;
+    case REQ_TRACKING:
+    case REQ_TRACKING2:
+      tx_message->reply = htons(command == REQ_TRACKING2 ? RPY_TRACKING2 : RPY_TRACKING);
+      tx_message->data.tracking = snapshot_tracking;
+      return;
+    case REQ_SERVER_STATS:
+    case REQ_SERVER_STATS2:
+      tx_message->reply = htons(command == REQ_SERVER_STATS2 ?
+                                RPY_SERVER_STATS4 : RPY_SERVER_STATS3);
+      tx_message->data.server_stats = snapshot_server_stats;
+      return;
+    case REQ_ACTIVITY:
+      tx_message->reply = htons(RPY_ACTIVITY);
+      tx_message->data.activity = snapshot_activity;
+      return;
+    default:
+      break;
+  }
+
+  source = find_snapshot_source(rx_message);
+  if (!source) {
+    tx_message->status = htons(STT_NOSUCHSOURCE);
+    return;
+  }
+
+  switch (command) {
+    case REQ_SOURCE_DATA:
+      tx_message->status = source->source_data_status;
+      tx_message->reply = htons(RPY_SOURCE_DATA);
+      tx_message->data.source_data = source->source_data;
+      break;
+    case REQ_SOURCESTATS:
+      tx_message->status = source->sourcestats_status;
+      tx_message->reply = htons(RPY_SOURCESTATS);
+      tx_message->data.sourcestats = source->sourcestats;
+      break;
+    case REQ_SELECT_DATA:
+      tx_message->status = source->select_data_status;
+      tx_message->reply = htons(RPY_SELECT_DATA);
+      tx_message->data.select_data = source->select_data;
+      break;
+    case REQ_NTP_DATA:
+      tx_message->status = source->ntp_data_status;
+      tx_message->reply = htons(RPY_NTP_DATA);
+      tx_message->data.ntp_data = source->ntp_data;
+      break;
+    default:
+      assert(0);
+  }
+
+  if (tx_message->status != htons(STT_SUCCESS)) {
+    tx_message->reply = htons(RPY_NULL);
+    memset(&tx_message->data, 0, sizeof (tx_message->data));
+  }
+}
+
+/* ================================================== */
+
+static void *
+run_thread(void *arg)
+{
+  QueuedRequest entry;
+  CMD_Reply tx_message;
+
+  pthread_mutex_lock(&thread_lock);
+
+  while (1) {
+    while (queue_length == 0 && !thread_quit)
+      pthread_cond_wait(&thread_cond, &thread_lock);
+
+    if (thread_quit)
+      break;
+
+    entry = queued_requests[queue_first];
+    queue_first = (queue_first + 1) % MAX_QUEUED_REQUESTS;
+    queue_length--;
+
+    memset(&tx_message, 0, sizeof (tx_message));
+    tx_message.version = PROTO_VERSION_NUMBER;
+    tx_message.pkt_type = PKT_TYPE_CMD_REPLY;
+    tx_message.command = entry.request.command;
+    tx_message.reply = htons(RPY_NULL);
+    tx_message.status = htons(STT_SUCCESS);
+    tx_message.sequence = entry.request.sequence;
+
+    handle_snapshot_request(&entry.request, &tx_message);
+
+    pthread_mutex_unlock(&thread_lock);
+
+    entry.message.data = &tx_message;
+    entry.message.length = 0;
+    if (entry.message.addr_type == SCK_ADDR_UNIX)
+      entry.message.remote_addr.path = entry.path;
+
+    transmit_reply(entry.sock_fd, entry.request_length, &entry.message);
+
+    pthread_mutex_lock(&thread_lock);
+  }
+
+  pthread_mutex_unlock(&thread_lock);
+
+  return NULL;
+}
+
+/* ================================================== */
+
+static void
+start_thread(void)
+{
+  sigset_t mask, old_mask;
+
+  /* Leave the handling of signals to the main thread */
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+
+  if (pthread_create(&request_thread, NULL, run_thread, NULL))
+    LOG_FATAL("pthread_create() failed");
+
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+  thread_running = 1;
+}
+
+#endif
+
+/* ================================================== */
+
+static void
+stop_thread(void)
+{
+#ifdef HAVE_PTHREAD
+  if (!thread_running)
+    return;
+
+  pthread_mutex_lock(&thread_lock);
+  thread_quit = 1;
+  pthread_cond_signal(&thread_cond);
+  pthread_mutex_unlock(&thread_lock);
+
+  pthread_join(request_thread, NULL);
+  thread_running = 0;
+  thread_quit = 0;
+  queue_length = 0;
+#endif
+}
+
+/* ================================================== */
+/* Pass a request to the thread if it can be answered from the snapshots.
+   Return 1 if the request was queued. */
+
+static int
+queue_request(int sock_fd, int request_length, SCK_Message *message, CMD_Request *request)
+{
+#ifdef HAVE_PTHREAD
+  QueuedRequest *entry;
+  int queued;
+
+  /* Debug messages are not thread-safe */
+  if (!CNF_GetCommandThread() || LOG_GetMinSeverity() <= LOGS_DEBUG)
+    return 0;
+
+  switch (ntohs(request->command)) {
+    case REQ_N_SOURCES:
+    case REQ_SOURCE_DATA:
+    case REQ_SOURCESTATS:
+    case REQ_SELECT_DATA:
+    case REQ_NTP_DATA:
+      refresh_sources_snapshot();
+      break;
+    case REQ_TRACKING:
+    case REQ_TRACKING2:
+    case REQ_SERVER_STATS:
+    case REQ_SERVER_STATS2:
+    case REQ_ACTIVITY:
+      refresh_global_snapshot();
+      break;
+    default:
+      return 0;
+  }
+
+  if (message->addr_type == SCK_ADDR_UNIX &&
+      (!message->remote_addr.path ||
+       strlen(message->remote_addr.path) >= sizeof (entry->path)))
+    return 0;
+
+  if (!thread_running)
+    start_thread();
+
+  pthread_mutex_lock(&thread_lock);
+
+  queued = queue_length < MAX_QUEUED_REQUESTS;
+  if (queued) {
+    entry = &queued_requests[(queue_first + queue_length) % MAX_QUEUED_REQUESTS];
+    entry->sock_fd = sock_fd;
+    entry->request_length = request_length;
+    entry->message = *message;
+    if (message->addr_type == SCK_ADDR_UNIX)
+      snprintf(entry->path, sizeof (entry->path), "%s", message->remote_addr.path);
+    entry->request = *request;
+    queue_length++;
+    pthread_cond_signal(&thread_cond);
+  }
+
+  pthread_mutex_unlock(&thread_lock);
+
+  return queued;
+#else
+  return 0;
+#endif
+}
+
+/* ================================================== */
+
+static int
+find_subscriber(const char *path)
+{
+  int i;
+
+  for (i = 0; i < n_subscribers; i++) {
+    if (strcmp(subscribers[i].path, path) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+/* ================================================== */
+
+static void
+update_subscribed_records(void)
+{
+  int i;
+
+  for (i = 0, subscribed_records = 0; i < n_subscribers; i++)
+    subscribed_records |= subscribers[i].records;
+}
+
+/* ================================================== */
+
+static void
+remove_subscriber(int index)
+{
+  assert(index >= 0 && index < n_subscribers);
+
+  Free(subscribers[index].path);
+  subscribers[index] = subscribers[--n_subscribers];
+  update_subscribed_records();
+}
+
+/* ================================================== */
+
+static void
+handle_subscribe(CMD_Request *rx_message, CMD_Reply *tx_message, SCK_Message *message)
+{
+  uint32_t records;
+  int index;
+
+  /* Records can be sent only to a bound socket */
+  if (message->addr_type != SCK_ADDR_UNIX || !message->remote_addr.path ||
+      message->remote_addr.path[0] == '\0') {
+    tx_message->status = htons(STT_INVALID);
+    return;
+  }
+
+  records = ntohl(rx_message->data.subscribe.records) & ((1U << N_RECORD_TYPES) - 1);
+  index = find_subscriber(message->remote_addr.path);
+
+  if (index < 0) {
+    if (records == 0)
+      return;
+
+    if (n_subscribers >= MAX_SUBSCRIBERS) {
+      tx_message->status = htons(STT_TOOMANYSUBSCRIBERS);
+      return;
+    }
+
+    index = n_subscribers++;
+    subscribers[index].path = Strdup(message->remote_addr.path);
+    subscribers[index].sequence = 0;
+  } else if (records == 0) {
+    remove_subscriber(index);
+    return;
+  }
+
+  subscribers[index].records = records;
+  update_subscribed_records();
+}
+
+/* ================================================== */
+
+static void
+publish_record(int type, struct timespec *time, CMD_Record *record)
+{
+  SCK_Message message;
+  int i;
+
+  record->version = PROTO_VERSION_NUMBER;
+  record->pkt_type = PKT_TYPE_CMD_RECORD;
+  record->res1 = 0;
+  record->res2 = 0;
+  record->record = htons(type);
+  record->pad1 = 0;
+  UTI_TimespecHostToNetwork(time, &record->time);
+
+  for (i = 0; i < n_subscribers; ) {
+    if (!(subscribers[i].records & (1U << type))) {
+      i++;
+      continue;
+    }
+
+    record->sequence = htonl(subscribers[i].sequence++);
+
+    SCK_InitMessage(&message, SCK_ADDR_UNIX);
+    message.data = record;
+    message.length = PKL_RecordLength(record);
+    message.remote_addr.path = subscribers[i].path;
+
+    /* Don't wait for slow subscribers, drop the record if their socket
+       is full, and forget subscribers whose socket was closed */
+    if (!SCK_SendMessage(sock_fdu, &message, 0) &&
+        errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+      DEBUG_LOG("Removing subscriber %s", subscribers[i].path);
+      remove_subscriber(i);
+      continue;
+    }
+
+    i++;
+  }
+}
+
+/* ================================================== */
+
+int
+CAM_IsSubscribed(int record_type)
+{
+  return (subscribed_records & (1U << record_type)) != 0;
+}
+
+/* ================================================== */
+
+void
+CAM_PublishNTPSample(struct timespec *time, RPT_NTPReport *report)
+{
+  CMD_Record record;
+
+  if (!(subscribed_records & (1U << REC_NTP_SAMPLE)))
+    return;
+
+  memset(&record, 0, sizeof (record));
+  convert_ntp_report(report, &record.data.ntp_sample);
+  publish_record(REC_NTP_SAMPLE, time, &record);
+}
+
+/* ================================================== */
+
+void
+CAM_PublishRefclockSample(struct timespec *time, uint32_t ref_id, int filtered,
+                          NTP_Leap leap, int pulse, double raw_offset,
+                          double cooked_offset, double dispersion)
+{
+  REC_RefclockSample *data;
+  CMD_Record record;
+
+  if (!(subscribed_records & (1U << REC_REFCLOCK_SAMPLE)))
+    return;
+
+  memset(&record, 0, sizeof (record));
+  data = &record.data.refclock_sample;
+  data->ref_id = htonl(ref_id);
+  data->raw_offset = UTI_FloatHostToNetwork(raw_offset);
+  data->cooked_offset = UTI_FloatHostToNetwork(cooked_offset);
+  data->dispersion = UTI_FloatHostToNetwork(dispersion);
+  data->leap = leap;
+  data->pulse = pulse;
+  data->flags = filtered ? REC_RS_FLAG_FILTERED : 0;
+  publish_record(REC_REFCLOCK_SAMPLE, time, &record);
+}
+
+/* ================================================== */
+
+void
+CAM_PublishSourcestats(struct timespec *time, RPT_SourcestatsReport *report)
+{
+  CMD_Record record;
+
+  if (!(subscribed_records & (1U << REC_SOURCESTATS)))
+    return;
+
+  memset(&record, 0, sizeof (record));
+  convert_sourcestats_report(report, &record.data.sourcestats);
+  publish_record(REC_SOURCESTATS, time, &record);
+}
+
+/* ================================================== */
+
+void
+CAM_PublishSelection(struct timespec *time, uint32_t ref_id, IPAddr *ip_addr)
+{
+  CMD_Record record;
+
+  if (!(subscribed_records & (1U << REC_SELECTION)))
+    return;
+
+  memset(&record, 0, sizeof (record));
+  record.data.selection.ref_id = htonl(ref_id);
+  UTI_IPHostToNetwork(ip_addr, &record.data.selection.ip_addr);
+  publish_record(REC_SELECTION, time, &record);
+}
+
+/* ================================================== */
+
+void
+CAM_PublishTracking(struct timespec *time)
+{
+  CMD_Request request;
+  CMD_Reply reply;
+  CMD_Record record;
+
+  if (!(subscribed_records & (1U << REC_TRACKING)))
+    return;
+
+  memset(&request, 0, sizeof (request));
+  memset(&reply, 0, sizeof (reply));
+  handle_tracking(&request, &reply);
+
+  memset(&record, 0, sizeof (record));
+  record.data.tracking = reply.data.tracking;
+  publish_record(REC_TRACKING, time, &record);
+}
+
+/* ================================================== */
+/* Read a packet and process it */
+
+static void
+read_from_cmd_socket(int sock_fd, int event, void *anything)
+{
+  SCK_Message *sck_message;
+  CMD_Request rx_message;
+  CMD_Reply tx_message;
+  IPAddr loopback_addr, remote_ip;
+  int read_length, expected_length;
+  int localhost, allowed, log_index;
+  uint16_t rx_command;
+  struct timespec now, cooked_now;
+
+  sck_message = SCK_ReceiveMessage(sock_fd, 0);
+  if (!sck_message)
+    return;
+
+  read_length = sck_message->length;
+
+  /* Get current time cheaply */
+  SCH_GetLastEventTime(&cooked_now, NULL, &now);
+
+  /* Check if it's from localhost (127.0.0.1, ::1, or Unix domain),
+     or an authorised address */
+  switch (sck_message->addr_type) {
+    case SCK_ADDR_IP:
+      assert(sock_fd == sock_fd4 || sock_fd == sock_fd6);
+      remote_ip = sck_message->remote_addr.ip.ip_addr;
+      SCK_GetLoopbackIPAddress(remote_ip.family, &loopback_addr);
+      localhost = UTI_CompareIPs(&remote_ip, &loopback_addr, NULL) == 0;
+
+      if (!localhost && !ADF_IsAllowed(access_auth_table, &remote_ip)) {
+        DEBUG_LOG("Unauthorised host %s",
+                  UTI_IPSockAddrToString(&sck_message->remote_addr.ip));
+        return;
+      }
+
+      assert(remote_ip.family != IPADDR_UNSPEC);
+
+      break;
+    case SCK_ADDR_UNIX:
+      assert(sock_fd == sock_fdu);
+      remote_ip.family = IPADDR_UNSPEC;
+      localhost = 1;
+      break;
+    default:
+      DEBUG_LOG("Unexpected address type");
+      return;
+  }
+
+  if (read_length < offsetof(CMD_Request, data) ||
+      read_length < offsetof(CMD_Reply, data) ||
+      read_length > sizeof (CMD_Request)) {
+    /* We don't know how to process anything like this or an error reply
+       would be larger than the request */
+    DEBUG_LOG("Unexpected length");
+    return;
+  }
+
+  memcpy(&rx_message, sck_message->data, read_length);
+
+  if (rx_message.pkt_type != PKT_TYPE_CMD_REQUEST ||
+      rx_message.res1 != 0 ||
+      rx_message.res2 != 0) {
+    DEBUG_LOG("Command packet dropped");
+    return;
+  }
+
+  log_index = CLG_LogServiceAccess(CLG_CMDMON, &remote_ip, &cooked_now);
+
+  /* Don't reply to all requests from hosts other than localhost if the rate
+     is excessive */
+  if (!localhost && log_index >= 0 && CLG_LimitServiceRate(CLG_CMDMON, log_index)) {
+      DEBUG_LOG("Command packet discarded to limit response rate");
+      return;
+  }
+
+  expected_length = PKL_CommandLength(&rx_message);
+  rx_command = ntohs(rx_message.command);
+
+  memset(&tx_message, 0, sizeof (tx_message));
+  sck_message->data = &tx_message;
+  sck_message->length = 0;
+
+  tx_message.version = PROTO_VERSION_NUMBER;
+  tx_message.pkt_type = PKT_TYPE_CMD_REPLY;
+  tx_message.command = rx_message.command;
+  tx_message.reply = htons(RPY_NULL);
   tx_message.status = htons(STT_SUCCESS);
   tx_message.sequence = rx_message.sequence;
 
@@ -1513,6 +2777,10 @@ read_from_cmd_socket(int sock_fd, int event, void *anything)
       }
     }
 
+    /* Let the thread answer requests for monitored reports */
+    if (allowed && queue_request(sock_fd, read_length, sck_message, &rx_message))
+      return;
+
     if (allowed) {
       switch(rx_command) {
         case REQ_NULL:
@@ -1653,6 +2921,7 @@ read_from_cmd_socket(int sock_fd, int event, void *anything)
           break;
 
         case REQ_TRACKING:
+        case REQ_TRACKING2:
           handle_tracking(&rx_message, &tx_message);
           break;
 
@@ -1721,6 +2990,7 @@ read_from_cmd_socket(int sock_fd, int event, void *anything)
           break;
 
         case REQ_SERVER_STATS:
+        case REQ_SERVER_STATS2:
           handle_server_stats(&rx_message, &tx_message);
           break;
 
@@ -1756,6 +3026,26 @@ read_from_cmd_socket(int sock_fd, int event, void *anything)
           handle_reload_sources(&rx_message, &tx_message);
           break;
 
+        case REQ_CLIENT_ACCESSES_BY_INDEX4:
+          handle_client_accesses_by_index4(&rx_message, &tx_message, sck_message);
+          break;
+
+        case REQ_SUBSCRIBE:
+          handle_subscribe(&rx_message, &tx_message, sck_message);
+          break;
+
+        case REQ_PROFILE_DATA:
+          handle_profile_data(&rx_message, &tx_message);
+          break;
+
+        case REQ_RESET_PROFILE:
+          handle_reset_profile(&rx_message, &tx_message);
+          break;
+
+        case REQ_MEMORY_DATA:
+          handle_memory_data(&rx_message, &tx_message);
+          break;
+
         default:
           DEBUG_LOG("Unhandled command %d", rx_command);
           tx_message.status = htons(STT_FAILED);
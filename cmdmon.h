@@ -28,12 +28,29 @@
 #define GOT_CMDMON_H
 
 #include "addressing.h"
+#include "reports.h"
 
 extern void CAM_Initialise(void);
 
 extern void CAM_Finalise(void);
 
 extern void CAM_OpenUnixSocket(void);
+
+/* Schedule an update of the status page */
+extern void CAM_UpdateStatusPage(void);
+
+/* Check if any subscriber requested records of the type (REC_*) */
+extern int CAM_IsSubscribed(int record_type);
+
+/* Functions pushing records to subscribers */
+extern void CAM_PublishNTPSample(struct timespec *time, RPT_NTPReport *report);
+extern void CAM_PublishRefclockSample(struct timespec *time, uint32_t ref_id, int filtered,
+                                      NTP_Leap leap, int pulse, double raw_offset,
+                                      double cooked_offset, double dispersion);
+extern void CAM_PublishSourcestats(struct timespec *time, RPT_SourcestatsReport *report);
+extern void CAM_PublishSelection(struct timespec *time, uint32_t ref_id, IPAddr *ip_addr);
+extern void CAM_PublishTracking(struct timespec *time);
+
 extern int CAM_AddAccessRestriction(IPAddr *ip_addr, int subnet_bits, int allow, int all);
 extern int CAM_CheckAccessRestriction(IPAddr *ip_addr);
 
@@ -42,6 +42,7 @@
 #include "nameserv.h"
 #include "memory.h"
 #include "cmdparse.h"
+#include "sched.h"
 #include "util.h"
 
 /* ================================================== */
@@ -50,6 +51,10 @@
 #define MAX_CONF_DIRS 10
 #define MAX_INCLUDE_LEVEL 10
 
+/* Delay (in seconds) collecting changes in sourcedirs before the
+   modified files are loaded */
+#define SOURCEDIR_RELOAD_DELAY 1.0
+
 /* ================================================== */
 /* Forward prototypes */
 
@@ -60,9 +65,11 @@ static int parse_null(char *line);
 
 static void parse_allow_deny(char *line, ARR_Instance restrictions, int allow);
 static void parse_authselectmode(char *);
+static void parse_dumpformat(char *);
 static void parse_bindacqaddress(char *);
 static void parse_bindaddress(char *);
 static void parse_bindcmdaddress(char *);
+static void parse_bindmetricsaddress(char *);
 static void parse_broadcast(char *);
 static void parse_clientloglimit(char *);
 static void parse_confdir(char *);
@@ -77,6 +84,7 @@ static void parse_mailonchange(char *);
 static void parse_makestep(char *);
 static void parse_maxchange(char *);
 static void parse_ntsserver(char *, ARR_Instance files);
+static void parse_ntpsigndsocket(char *);
 static void parse_ntstrustedcerts(char *);
 static void parse_ratelimit(char *line, int *enabled, int *interval,
                             int *burst, int *leak);
@@ -93,6 +101,7 @@ static int print_config = 0;
 static int restarted = 0;
 static char *rtc_device;
 static int acquisition_port = -1;
+static int acquisition_sockets = 0;
 static int ntp_port = NTP_PORT;
 static char *keys_file = NULL;
 static char *drift_file = NULL;
@@ -103,6 +112,7 @@ static double max_clock_error = 1.0; /* in ppm */
 static double max_drift = 500000.0; /* in ppm */
 static double max_slew_rate = 1e6 / 12.0; /* in ppm */
 static double clock_precision = 0.0; /* in seconds */
+static int no_precision_cache = 0;
 
 static SRC_AuthSelectMode authselect_mode = SRC_AUTHSELECT_MIX;
 static double max_distance = 3.0;
@@ -112,6 +122,7 @@ static double stratum_weight = 1e-3;
 static double combine_limit = 3.0;
 
 static int cmd_port = DEFAULT_CANDM_PORT;
+static int cmd_thread = 0;
 
 static int raw_measurements = 0;
 static int do_log_measurements = 0;
@@ -121,9 +132,12 @@ static int do_log_tracking = 0;
 static int do_log_rtc = 0;
 static int do_log_refclocks = 0;
 static int do_log_tempcomp = 0;
+static int do_log_phc_stats = 0;
 static int log_banner = 32;
+static int log_binary = 0;
 static char *logdir = NULL;
 static char *dumpdir = NULL;
+static SRC_DumpFormat dump_format = SRC_DUMP_TEXT;
 
 static int enable_local=0;
 static int local_stratum;
@@ -151,6 +165,7 @@ static int rtc_sync = 0;
 /* Limit and threshold for clock stepping */
 static int make_step_limit = 0;
 static double make_step_threshold = 0.0;
+static double fast_start_threshold = -1.0;
 
 /* Threshold for automatic RTC trimming */
 static double rtc_autotrim_threshold = 0.0;
@@ -205,16 +220,32 @@ static char *bind_cmd_iface = NULL;
 /* Path to the Unix domain command socket. */
 static char *bind_cmd_path = NULL;
 
+/* Port, addresses, and path of the Unix domain socket of the metrics
+   endpoint, and the minimum interval between updates of the metrics */
+static int metrics_port = 0;
+static IPAddr bind_metrics_address4, bind_metrics_address6;
+static char *bind_metrics_path = NULL;
+static double metrics_interval = 1.0;
+
 /* Differentiated Services Code Point (DSCP) in transmitted NTP packets */
 static int ntp_dscp = 0;
 
 /* Path to Samba (ntp_signd) socket. */
 static char *ntp_signd_socket = NULL;
 
+/* Maximum number of queued MS-SNTP requests, maximum number of requests
+   waiting for a response from ntp_signd, and timeout of requests */
+static int ntp_signd_queue = 1024;
+static int ntp_signd_pipeline = 16;
+static double ntp_signd_timeout = 1.0;
+
 /* Filename to use for storing pid of running chronyd, to prevent multiple
  * chronyds being started. */
 static char *pidfile = NULL;
 
+/* Path to the status page for monitoring without command requests */
+static char *status_file = NULL;
+
 /* Rate limiting parameters */
 static int ntp_ratelimit_enabled = 0;
 static int ntp_ratelimit_interval = 3;
@@ -277,6 +308,9 @@ static ARR_Instance hwts_interfaces;
 /* PTP event port (disabled by default) */
 static int ptp_port = 0;
 
+/* Maximum number of threads resolving names concurrently */
+static int resolver_threads = 4;
+
 typedef struct {
   NTP_Source_Type type;
   int pool;
@@ -287,8 +321,57 @@ typedef struct {
 static ARR_Instance ntp_sources;
 /* Array of (char *) */
 static ARR_Instance ntp_source_dirs;
-/* Array of uint32_t corresponding to ntp_sources (for sourcedirs reload) */
-static ARR_Instance ntp_source_ids;
+
+typedef struct {
+  /* Index of the sourcedir directive and name of the file */
+  unsigned int dir_set;
+  char *name;
+  /* Identity of the loaded file to detect modifications */
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t mtime;
+  time_t ctime;
+  /* Flag forcing the file to be loaded again in the next reload */
+  int modified;
+  /* Flag marking files found in the current reload */
+  int present;
+  /* Array of NTP_Source sorted by compare_sources() */
+  ARR_Instance sources;
+  /* Array of uint32_t with configuration IDs of the sources */
+  ARR_Instance ids;
+} SourceFile;
+
+/* Array of SourceFile loaded from sourcedirs */
+static ARR_Instance source_files;
+
+typedef struct {
+  unsigned int dir_set;
+  char *name;
+} ModifiedSourceFile;
+
+/* Array of ModifiedSourceFile waiting for a reload */
+static ARR_Instance modified_source_files;
+
+/* Flag requiring all sourcedirs to be reloaded */
+static int full_reload_pending;
+
+/* Timeout collecting changes in sourcedirs */
+static SCH_TimeoutID reload_timeout_id;
+
+static void free_source_file(SourceFile *file);
+static void clear_modified_source_files(void);
+
+#ifdef HAVE_INOTIFY
+typedef struct {
+  int wd;
+  unsigned int dir_set;
+} SourceDirWatch;
+
+/* Inotify descriptor and array of SourceDirWatch */
+static int inotify_fd;
+static ARR_Instance source_dir_watches;
+#endif
 
 /* Array of RefclockParameters */
 static ARR_Instance refclock_sources;
@@ -388,7 +471,12 @@ CNF_Initialise(int r, int client_only)
   init_sources = ARR_CreateInstance(sizeof (IPAddr));
   ntp_sources = ARR_CreateInstance(sizeof (NTP_Source));
   ntp_source_dirs = ARR_CreateInstance(sizeof (char *));
-  ntp_source_ids = ARR_CreateInstance(sizeof (uint32_t));
+  source_files = ARR_CreateInstance(sizeof (SourceFile));
+  modified_source_files = ARR_CreateInstance(sizeof (ModifiedSourceFile));
+#ifdef HAVE_INOTIFY
+  inotify_fd = -1;
+  source_dir_watches = ARR_CreateInstance(sizeof (SourceDirWatch));
+#endif
   refclock_sources = ARR_CreateInstance(sizeof (RefclockParameters));
   broadcasts = ARR_CreateInstance(sizeof (NTP_Broadcast_Destination));
 
@@ -417,6 +505,8 @@ CNF_Initialise(int r, int client_only)
   SCK_GetAnyLocalIPAddress(IPADDR_INET6, &bind_acq_address6);
   SCK_GetLoopbackIPAddress(IPADDR_INET4, &bind_cmd_address4);
   SCK_GetLoopbackIPAddress(IPADDR_INET6, &bind_cmd_address6);
+  SCK_GetLoopbackIPAddress(IPADDR_INET4, &bind_metrics_address4);
+  SCK_GetLoopbackIPAddress(IPADDR_INET6, &bind_metrics_address6);
 }
 
 /* ================================================== */
@@ -434,6 +524,9 @@ CNF_Finalise(void)
     Free(((NTP_Source *)ARR_GetElement(ntp_sources, i))->params.name);
   for (i = 0; i < ARR_GetSize(ntp_source_dirs); i++)
     Free(*(char **)ARR_GetElement(ntp_source_dirs, i));
+  for (i = 0; i < ARR_GetSize(source_files); i++)
+    free_source_file(ARR_GetElement(source_files, i));
+  clear_modified_source_files();
   for (i = 0; i < ARR_GetSize(refclock_sources); i++) {
     Free(((RefclockParameters *)ARR_GetElement(refclock_sources, i))->driver_name);
     Free(((RefclockParameters *)ARR_GetElement(refclock_sources, i))->driver_parameter);
@@ -448,7 +541,14 @@ CNF_Finalise(void)
   ARR_DestroyInstance(init_sources);
   ARR_DestroyInstance(ntp_sources);
   ARR_DestroyInstance(ntp_source_dirs);
-  ARR_DestroyInstance(ntp_source_ids);
+  ARR_DestroyInstance(source_files);
+  ARR_DestroyInstance(modified_source_files);
+#ifdef HAVE_INOTIFY
+  /* The scheduler was already finalised */
+  if (inotify_fd >= 0)
+    close(inotify_fd);
+  ARR_DestroyInstance(source_dir_watches);
+#endif
   ARR_DestroyInstance(refclock_sources);
   ARR_DestroyInstance(broadcasts);
 
@@ -470,8 +570,10 @@ CNF_Finalise(void)
   Free(bind_acq_iface);
   Free(bind_cmd_iface);
   Free(bind_cmd_path);
+  Free(bind_metrics_path);
   Free(ntp_signd_socket);
   Free(pidfile);
+  Free(status_file);
   Free(rtc_device);
   Free(rtc_file);
   Free(user);
@@ -549,6 +651,8 @@ CNF_ParseLine(const char *filename, int number, char *line)
 
   if (!strcasecmp(command, "acquisitionport")) {
     parse_int(p, &acquisition_port);
+  } else if (!strcasecmp(command, "acquisitionsockets")) {
+    parse_int(p, &acquisition_sockets);
   } else if (!strcasecmp(command, "allow")) {
     parse_allow_deny(p, ntp_restrictions, 1);
   } else if (!strcasecmp(command, "authselectmode")) {
@@ -565,6 +669,8 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_string(p, &bind_cmd_iface);
   } else if (!strcasecmp(command, "binddevice")) {
     parse_string(p, &bind_ntp_iface);
+  } else if (!strcasecmp(command, "bindmetricsaddress")) {
+    parse_bindmetricsaddress(p);
   } else if (!strcasecmp(command, "broadcast")) {
     parse_broadcast(p);
   } else if (!strcasecmp(command, "clientloglimit")) {
@@ -580,6 +686,8 @@ CNF_ParseLine(const char *filename, int number, char *line)
   } else if (!strcasecmp(command, "cmdratelimit")) {
     parse_ratelimit(p, &cmd_ratelimit_enabled, &cmd_ratelimit_interval,
                     &cmd_ratelimit_burst, &cmd_ratelimit_leak);
+  } else if (!strcasecmp(command, "cmdthread")) {
+    cmd_thread = parse_null(p);
   } else if (!strcasecmp(command, "combinelimit")) {
     parse_double(p, &combine_limit);
   } else if (!strcasecmp(command, "confdir")) {
@@ -594,10 +702,14 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_int(p, &ntp_dscp);
   } else if (!strcasecmp(command, "dumpdir")) {
     parse_string(p, &dumpdir);
+  } else if (!strcasecmp(command, "dumpformat")) {
+    parse_dumpformat(p);
   } else if (!strcasecmp(command, "dumponexit")) {
     /* Silently ignored */
   } else if (!strcasecmp(command, "fallbackdrift")) {
     parse_fallbackdrift(p);
+  } else if (!strcasecmp(command, "faststart")) {
+    parse_double(p, &fast_start_threshold);
   } else if (!strcasecmp(command, "hwclockfile")) {
     parse_string(p, &hwclock_file);
   } else if (!strcasecmp(command, "hwtimestamp")) {
@@ -648,6 +760,10 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_double(p, &max_slew_rate);
   } else if (!strcasecmp(command, "maxupdateskew")) {
     parse_double(p, &max_update_skew);
+  } else if (!strcasecmp(command, "metricsinterval")) {
+    parse_double(p, &metrics_interval);
+  } else if (!strcasecmp(command, "metricsport")) {
+    parse_int(p, &metrics_port);
   } else if (!strcasecmp(command, "minsamples")) {
     parse_int(p, &min_samples);
   } else if (!strcasecmp(command, "minsources")) {
@@ -656,10 +772,12 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_int(p, &no_cert_time_check);
   } else if (!strcasecmp(command, "noclientlog")) {
     no_client_log = parse_null(p);
+  } else if (!strcasecmp(command, "noprecisioncache")) {
+    no_precision_cache = parse_null(p);
   } else if (!strcasecmp(command, "nosystemcert")) {
     no_system_cert = parse_null(p);
   } else if (!strcasecmp(command, "ntpsigndsocket")) {
-    parse_string(p, &ntp_signd_socket);
+    parse_ntpsigndsocket(p);
   } else if (!strcasecmp(command, "ntsratelimit")) {
     parse_ratelimit(p, &nts_ratelimit_enabled, &nts_ratelimit_interval,
                     &nts_ratelimit_burst, &nts_ratelimit_leak);
@@ -699,6 +817,8 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_refclock(p);
   } else if (!strcasecmp(command, "reselectdist")) {
     parse_double(p, &reselect_distance);
+  } else if (!strcasecmp(command, "resolverthreads")) {
+    parse_int(p, &resolver_threads);
   } else if (!strcasecmp(command, "rtcautotrim")) {
     parse_double(p, &rtc_autotrim_threshold);
   } else if (!strcasecmp(command, "rtcdevice")) {
@@ -717,6 +837,8 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_smoothtime(p);
   } else if (!strcasecmp(command, "sourcedir")) {
     parse_sourcedir(p);
+  } else if (!strcasecmp(command, "statusfile")) {
+    parse_string(p, &status_file);
   } else if (!strcasecmp(command, "stratumweight")) {
     parse_double(p, &stratum_weight);
   } else if (!strcasecmp(command, "tempcomp")) {
@@ -1028,7 +1150,9 @@ parse_log(char *line)
     log_name = line;
     line = CPS_SplitWord(line);
     if (*log_name) {
-      if (!strcmp(log_name, "rawmeasurements")) {
+      if (!strcmp(log_name, "binary")) {
+        log_binary = 1;
+      } else if (!strcmp(log_name, "rawmeasurements")) {
         do_log_measurements = 1;
         raw_measurements = 1;
       } else if (!strcmp(log_name, "measurements")) {
@@ -1045,6 +1169,8 @@ parse_log(char *line)
         do_log_refclocks = 1;
       } else if (!strcmp(log_name, "tempcomp")) {
         do_log_tempcomp = 1;
+      } else if (!strcmp(log_name, "phcstats")) {
+        do_log_phc_stats = 1;
       } else {
         other_parse_error("Invalid log parameter");
         break;
@@ -1198,6 +1324,52 @@ parse_ntsserver(char *line, ARR_Instance files)
 
 /* ================================================== */
 
+static void
+parse_ntpsigndsocket(char *line)
+{
+  char *dir, *opt;
+  double timeout;
+  int n, val;
+
+  dir = line;
+  line = CPS_SplitWord(line);
+  if (*dir == '\0') {
+    command_parse_error();
+    return;
+  }
+
+  while (*line) {
+    opt = line;
+    line = CPS_SplitWord(line);
+    if (!strcasecmp(opt, "timeout")) {
+      if (sscanf(line, "%lf%n", &timeout, &n) != 1 || timeout <= 0.0) {
+        command_parse_error();
+        return;
+      }
+      ntp_signd_timeout = timeout;
+    } else {
+      if (sscanf(line, "%d%n", &val, &n) != 1) {
+        command_parse_error();
+        return;
+      }
+      if (!strcasecmp(opt, "queue") && val >= 1 && val <= 65536)
+        ntp_signd_queue = val;
+      else if (!strcasecmp(opt, "pipeline") && val >= 1 && val <= 1024)
+        ntp_signd_pipeline = val;
+      else {
+        command_parse_error();
+        return;
+      }
+    }
+    line += n;
+  }
+
+  Free(ntp_signd_socket);
+  ntp_signd_socket = Strdup(dir);
+}
+
+/* ================================================== */
+
 static void
 parse_ntstrustedcerts(char *line)
 {
@@ -1258,6 +1430,19 @@ parse_authselectmode(char *line)
 
 /* ================================================== */
 
+static void
+parse_dumpformat(char *line)
+{
+  if (!strcasecmp(line, "text"))
+    dump_format = SRC_DUMP_TEXT;
+  else if (!strcasecmp(line, "binary"))
+    dump_format = SRC_DUMP_BINARY;
+  else
+    command_parse_error();
+}
+
+/* ================================================== */
+
 static void
 parse_bindacqaddress(char *line)
 {
@@ -1321,6 +1506,28 @@ parse_bindcmdaddress(char *line)
 
 /* ================================================== */
 
+static void
+parse_bindmetricsaddress(char *line)
+{
+  IPAddr ip;
+
+  check_number_of_args(line, 1);
+
+  /* Address starting with / is for the Unix domain socket */
+  if (line[0] == '/') {
+    parse_string(line, &bind_metrics_path);
+  } else if (UTI_StringToIP(line, &ip)) {
+    if (ip.family == IPADDR_INET4)
+      bind_metrics_address4 = ip;
+    else if (ip.family == IPADDR_INET6)
+      bind_metrics_address6 = ip;
+  } else {
+    command_parse_error();
+  }
+}
+
+/* ================================================== */
+
 static void
 parse_broadcast(char *line)
 {
@@ -1667,45 +1874,197 @@ compare_sources(const void *a, const void *b)
 /* ================================================== */
 
 static void
-reload_source_dirs(void)
+free_source_file(SourceFile *file)
+{
+  unsigned int i;
+
+  for (i = 0; i < ARR_GetSize(file->sources); i++)
+    Free(((NTP_Source *)ARR_GetElement(file->sources, i))->params.name);
+  ARR_DestroyInstance(file->sources);
+  ARR_DestroyInstance(file->ids);
+  Free(file->name);
+}
+
+/* ================================================== */
+
+static int
+find_source_file(unsigned int dir_set, const char *name, int create)
+{
+  SourceFile *file;
+  unsigned int i;
+
+  for (i = 0; i < ARR_GetSize(source_files); i++) {
+    file = ARR_GetElement(source_files, i);
+    if (file->dir_set == dir_set && strcmp(file->name, name) == 0)
+      return i;
+  }
+
+  if (!create)
+    return -1;
+
+  file = ARR_GetNewElement(source_files);
+  memset(file, 0, sizeof (*file));
+  file->dir_set = dir_set;
+  file->name = Strdup(name);
+  file->modified = 1;
+  file->sources = ARR_CreateInstance(sizeof (NTP_Source));
+  file->ids = ARR_CreateInstance(sizeof (uint32_t));
+
+  return i;
+}
+
+/* ================================================== */
+
+static void
+remove_file_source(SourceFile *file, NTP_Source *source, uint32_t id)
+{
+  SourceFile *other;
+  NTP_Source *other_source;
+  unsigned int i, j;
+  uint32_t *other_id;
+
+  if (source->params.name[0] == '\0' || id == 0)
+    return;
+
+  /* If the same source is specified in another file, where it could not be
+     added as it was already in use, transfer the source to that file
+     instead of removing it (e.g. a source moved from one file to another) */
+  for (i = 0; i < ARR_GetSize(source_files); i++) {
+    other = ARR_GetElement(source_files, i);
+    if (other == file)
+      continue;
+
+    for (j = 0; j < ARR_GetSize(other->sources); j++) {
+      other_source = ARR_GetElement(other->sources, j);
+      other_id = ARR_GetElement(other->ids, j);
+      if (other_source->params.name[0] == '\0' || *other_id != 0 ||
+          compare_sources(other_source, source) != 0)
+        continue;
+
+      *other_id = id;
+      return;
+    }
+  }
+
+  NSR_RemoveSourcesById(id);
+}
+
+/* ================================================== */
+
+static unsigned int
+add_conflicting_sources(void)
+{
+  SourceFile *file;
+  NTP_Source *source;
+  unsigned int i, j, unresolved;
+  uint32_t *id;
+  NSR_Status s;
+
+  /* Try again to add sources which were in use by other files */
+  for (i = unresolved = 0; i < ARR_GetSize(source_files); i++) {
+    file = ARR_GetElement(source_files, i);
+
+    for (j = 0; j < ARR_GetSize(file->sources); j++) {
+      source = ARR_GetElement(file->sources, j);
+      id = ARR_GetElement(file->ids, j);
+      if (source->params.name[0] == '\0' || *id != 0)
+        continue;
+
+      s = NSR_AddSourceByName(source->params.name, source->params.port, source->pool,
+                              source->type, &source->params.params, id);
+
+      if (s == NSR_UnresolvedName) {
+        unresolved++;
+      } else if (s == NSR_AlreadyInUse) {
+        *id = 0;
+      } else if (s != NSR_Success) {
+        LOG(LOGS_ERR, "Could not add source %s", source->params.name);
+        source->params.name[0] = '\0';
+      }
+    }
+  }
+
+  return unresolved;
+}
+
+/* ================================================== */
+
+static void
+remove_source_file(unsigned int index)
+{
+  SourceFile *file;
+  unsigned int i, last;
+
+  file = ARR_GetElement(source_files, index);
+
+  for (i = 0; i < ARR_GetSize(file->sources); i++)
+    remove_file_source(file, ARR_GetElement(file->sources, i),
+                       *(uint32_t *)ARR_GetElement(file->ids, i));
+
+  DEBUG_LOG("Removed %u sources of %s", ARR_GetSize(file->sources), file->name);
+
+  free_source_file(file);
+
+  /* Move the last file to the free slot */
+  last = ARR_GetSize(source_files) - 1;
+  if (index < last)
+    *file = *(SourceFile *)ARR_GetElement(source_files, last);
+  ARR_SetSize(source_files, last);
+}
+
+/* ================================================== */
+
+static int
+is_source_file_modified(SourceFile *file, struct stat *st)
+{
+  return file->modified || file->dev != st->st_dev || file->ino != st->st_ino ||
+         file->size != st->st_size || file->mtime != st->st_mtime ||
+         file->ctime != st->st_ctime;
+}
+
+/* ================================================== */
+
+static unsigned int
+update_source_file(SourceFile *file, const char *path, struct stat *st)
 {
+  ARR_Instance prev_sources_arr, new_ids_arr;
   NTP_Source *prev_sources, *new_sources, *source;
   unsigned int i, j, prev_size, new_size, unresolved;
   uint32_t *prev_ids, *new_ids;
-  char buf[MAX_LINE_LENGTH];
   NSR_Status s;
   int d;
 
-  prev_size = ARR_GetSize(ntp_source_ids);
-  if (prev_size > 0 && ARR_GetSize(ntp_sources) != prev_size)
-    assert(0);
+  assert(ARR_GetSize(ntp_sources) == 0);
 
-  /* Save the current sources and their configuration IDs */
-  prev_ids = MallocArray(uint32_t, prev_size);
-  memcpy(prev_ids, ARR_GetElements(ntp_source_ids), prev_size * sizeof (prev_ids[0]));
-  prev_sources = MallocArray(NTP_Source, prev_size);
-  memcpy(prev_sources, ARR_GetElements(ntp_sources), prev_size * sizeof (prev_sources[0]));
+  file->dev = st->st_dev;
+  file->ino = st->st_ino;
+  file->size = st->st_size;
+  file->mtime = st->st_mtime;
+  file->ctime = st->st_ctime;
 
-  /* Load the sources again */
-  ARR_SetSize(ntp_sources, 0);
-  for (i = 0; i < ARR_GetSize(ntp_source_dirs); i++) {
-    if (snprintf(buf, sizeof (buf), "%s",
-                 *(char **)ARR_GetElement(ntp_source_dirs, i)) >= sizeof (buf))
-      assert(0);
-    search_dirs(buf, ".sources", load_source_file);
-  }
+  /* If the file was modified in the current second, another modification
+     might not be detectable by the timestamps.  Load it again next time. */
+  file->modified = st->st_mtime >= time(NULL) || st->st_ctime >= time(NULL);
 
-  /* Add new and remove existing sources according to the new configuration.
-     Avoid removing and adding the same source again to keep its state. */
+  load_source_file(path);
+
+  prev_size = ARR_GetSize(file->sources);
+  prev_sources = ARR_GetElements(file->sources);
+  prev_ids = ARR_GetElements(file->ids);
 
   new_size = ARR_GetSize(ntp_sources);
   new_sources = ARR_GetElements(ntp_sources);
-  ARR_SetSize(ntp_source_ids, new_size);
-  new_ids = ARR_GetElements(ntp_source_ids);
+  new_ids_arr = ARR_CreateInstance(sizeof (uint32_t));
+  ARR_SetSize(new_ids_arr, new_size);
+  new_ids = ARR_GetElements(new_ids_arr);
   unresolved = 0;
 
   qsort(new_sources, new_size, sizeof (new_sources[0]), compare_sources);
 
+  /* Add new and remove existing sources according to the new content of
+     the file.  Avoid removing and adding the same source again to keep
+     its state. */
+
   for (i = j = 0; i < prev_size || j < new_size; ) {
     if (i < prev_size && j < new_size)
       d = compare_sources(&prev_sources[i], &new_sources[j]);
@@ -1714,8 +2073,7 @@ reload_source_dirs(void)
 
     if (d < 0) {
       /* Remove the missing source */
-      if (prev_sources[i].params.name[0] != '\0')
-        NSR_RemoveSourcesById(prev_ids[i]);
+      remove_file_source(file, &prev_sources[i], prev_ids[i]);
       i++;
     } else if (d > 0) {
       /* Add a newly configured source */
@@ -1725,6 +2083,10 @@ reload_source_dirs(void)
 
       if (s == NSR_UnresolvedName) {
         unresolved++;
+      } else if (s == NSR_AlreadyInUse) {
+        /* Keep the source without an ID to be added or transferred from
+           the other file when it is removed there */
+        new_ids[j] = 0;
       } else if (s != NSR_Success) {
         LOG(LOGS_ERR, "Could not add source %s", source->params.name);
 
@@ -1739,10 +2101,225 @@ reload_source_dirs(void)
     }
   }
 
+  DEBUG_LOG("Loaded %u sources from %s", new_size, path);
+
+  /* Exchange the arrays to reuse the memory */
   for (i = 0; i < prev_size; i++)
     Free(prev_sources[i].params.name);
-  Free(prev_sources);
-  Free(prev_ids);
+  prev_sources_arr = file->sources;
+  ARR_SetSize(prev_sources_arr, 0);
+  file->sources = ntp_sources;
+  ntp_sources = prev_sources_arr;
+
+  ARR_DestroyInstance(file->ids);
+  file->ids = new_ids_arr;
+
+  return unresolved;
+}
+
+/* ================================================== */
+
+static unsigned int scan_dir_set;
+static unsigned int scan_unresolved;
+
+static void
+scan_source_file(const char *path)
+{
+  SourceFile *file;
+  struct stat st;
+
+  file = ARR_GetElement(source_files, find_source_file(scan_dir_set, get_basename(path), 1));
+  file->present = 1;
+
+  if (stat(path, &st) < 0)
+    memset(&st, 0, sizeof (st));
+  else if (!is_source_file_modified(file, &st))
+    return;
+
+  scan_unresolved += update_source_file(file, path, &st);
+}
+
+/* ================================================== */
+
+static void
+clear_modified_source_files(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < ARR_GetSize(modified_source_files); i++)
+    Free(((ModifiedSourceFile *)ARR_GetElement(modified_source_files, i))->name);
+  ARR_SetSize(modified_source_files, 0);
+}
+
+/* ================================================== */
+
+static void
+cancel_reload(void)
+{
+  SCH_RemoveTimeout(reload_timeout_id);
+  reload_timeout_id = 0;
+  full_reload_pending = 0;
+  clear_modified_source_files();
+}
+
+/* ================================================== */
+
+#ifdef HAVE_INOTIFY
+static void read_inotify_events(int fd, int event, void *anything);
+
+static void
+watch_source_dirs(unsigned int dir_set)
+{
+  char *dirs[MAX_CONF_DIRS], buf[MAX_LINE_LENGTH];
+  SourceDirWatch *watch;
+  unsigned int i, j, n_dirs;
+  int wd;
+
+  if (inotify_fd < 0) {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+      DEBUG_LOG("Could not initialise inotify : %s", strerror(errno));
+      return;
+    }
+    SCH_AddFileHandler(inotify_fd, SCH_FILE_INPUT, read_inotify_events, NULL);
+  }
+
+  if (snprintf(buf, sizeof (buf), "%s",
+               *(char **)ARR_GetElement(ntp_source_dirs, dir_set)) >= sizeof (buf))
+    assert(0);
+  n_dirs = UTI_SplitString(buf, dirs, MAX_CONF_DIRS);
+
+  /* Directories which didn't exist before are picked up here */
+  for (i = 0; i < n_dirs && i < MAX_CONF_DIRS; i++) {
+    wd = inotify_add_watch(inotify_fd, dirs[i], IN_CLOSE_WRITE | IN_MOVED_TO |
+                           IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR);
+    if (wd < 0) {
+      DEBUG_LOG("Could not watch %s : %s", dirs[i], strerror(errno));
+      continue;
+    }
+
+    for (j = 0; j < ARR_GetSize(source_dir_watches); j++) {
+      watch = ARR_GetElement(source_dir_watches, j);
+      if (watch->wd == wd && watch->dir_set == dir_set)
+        break;
+    }
+    if (j < ARR_GetSize(source_dir_watches))
+      continue;
+
+    watch = ARR_GetNewElement(source_dir_watches);
+    watch->wd = wd;
+    watch->dir_set = dir_set;
+  }
+}
+#endif
+
+/* ================================================== */
+
+static void
+reload_source_dirs(void)
+{
+  ModifiedSourceFile *modified;
+  char buf[MAX_LINE_LENGTH];
+  SourceFile *file;
+  unsigned int i;
+  int index;
+
+  /* Make sure files reported as modified are loaded again even if they
+     have the same timestamps */
+  for (i = 0; i < ARR_GetSize(modified_source_files); i++) {
+    modified = ARR_GetElement(modified_source_files, i);
+    index = find_source_file(modified->dir_set, modified->name, 0);
+    if (index >= 0)
+      ((SourceFile *)ARR_GetElement(source_files, index))->modified = 1;
+  }
+  cancel_reload();
+
+  for (i = 0; i < ARR_GetSize(source_files); i++)
+    ((SourceFile *)ARR_GetElement(source_files, i))->present = 0;
+
+  scan_unresolved = 0;
+
+  /* Load only new and modified files */
+  for (i = 0; i < ARR_GetSize(ntp_source_dirs); i++) {
+#ifdef HAVE_INOTIFY
+    watch_source_dirs(i);
+#endif
+    if (snprintf(buf, sizeof (buf), "%s",
+                 *(char **)ARR_GetElement(ntp_source_dirs, i)) >= sizeof (buf))
+      assert(0);
+    scan_dir_set = i;
+    search_dirs(buf, ".sources", scan_source_file);
+  }
+
+  /* Remove sources of the files which disappeared */
+  for (i = ARR_GetSize(source_files); i-- > 0; ) {
+    file = ARR_GetElement(source_files, i);
+    if (!file->present)
+      remove_source_file(i);
+  }
+
+  scan_unresolved += add_conflicting_sources();
+
+  if (scan_unresolved > 0)
+    NSR_ResolveSources();
+}
+
+/* ================================================== */
+
+#ifdef HAVE_INOTIFY
+static int
+find_source_file_path(unsigned int dir_set, const char *name, char *path,
+                      size_t path_len, struct stat *st)
+{
+  char *dirs[MAX_CONF_DIRS], buf[MAX_LINE_LENGTH];
+  unsigned int i, n_dirs;
+
+  if (snprintf(buf, sizeof (buf), "%s",
+               *(char **)ARR_GetElement(ntp_source_dirs, dir_set)) >= sizeof (buf))
+    assert(0);
+  n_dirs = UTI_SplitString(buf, dirs, MAX_CONF_DIRS);
+
+  /* Find the first file of this name in the order of the directive */
+  for (i = 0; i < n_dirs && i < MAX_CONF_DIRS; i++) {
+    if (snprintf(path, path_len, "%s/%s", dirs[i], name) >= path_len)
+      continue;
+    if (stat(path, st) == 0 && !S_ISDIR(st->st_mode))
+      return 1;
+  }
+
+  return 0;
+}
+
+/* ================================================== */
+
+static void
+reload_modified_source_files(void)
+{
+  ModifiedSourceFile *modified;
+  char path[MAX_LINE_LENGTH];
+  unsigned int i, unresolved;
+  struct stat st;
+  int index, found;
+
+  for (i = unresolved = 0; i < ARR_GetSize(modified_source_files); i++) {
+    modified = ARR_GetElement(modified_source_files, i);
+
+    found = find_source_file_path(modified->dir_set, modified->name,
+                                  path, sizeof (path), &st);
+    index = find_source_file(modified->dir_set, modified->name, found);
+
+    if (!found) {
+      if (index >= 0)
+        remove_source_file(index);
+      continue;
+    }
+
+    unresolved += update_source_file(ARR_GetElement(source_files, index), path, &st);
+  }
+
+  clear_modified_source_files();
+
+  unresolved += add_conflicting_sources();
 
   if (unresolved > 0)
     NSR_ResolveSources();
@@ -1750,6 +2327,93 @@ reload_source_dirs(void)
 
 /* ================================================== */
 
+static void
+reload_timeout(void *arg)
+{
+  reload_timeout_id = 0;
+
+  if (full_reload_pending)
+    reload_source_dirs();
+  else
+    reload_modified_source_files();
+}
+
+/* ================================================== */
+
+static void
+add_modified_source_file(unsigned int dir_set, const char *name)
+{
+  ModifiedSourceFile *modified;
+  size_t len = strlen(name);
+  unsigned int i;
+
+  /* Ignore files which would not be loaded by search_dirs() */
+  if (name[0] == '.' || len < 8 || strcmp(name + len - 8, ".sources") != 0)
+    return;
+
+  for (i = 0; i < ARR_GetSize(modified_source_files); i++) {
+    modified = ARR_GetElement(modified_source_files, i);
+    if (modified->dir_set == dir_set && strcmp(modified->name, name) == 0)
+      return;
+  }
+
+  modified = ARR_GetNewElement(modified_source_files);
+  modified->dir_set = dir_set;
+  modified->name = Strdup(name);
+}
+
+/* ================================================== */
+
+static void
+read_inotify_events(int fd, int event, void *anything)
+{
+  union {
+    struct inotify_event event;
+    char buf[4096];
+  } events;
+  struct inotify_event *ev;
+  SourceDirWatch *watch;
+  unsigned int j;
+  ssize_t len, i;
+
+  len = read(fd, &events, sizeof (events));
+  if (len <= 0)
+    return;
+
+  for (i = 0; i + sizeof (*ev) <= len; i += sizeof (*ev) + ev->len) {
+    ev = (struct inotify_event *)(events.buf + i);
+
+    if (ev->mask & IN_Q_OVERFLOW) {
+      full_reload_pending = 1;
+      continue;
+    }
+
+    for (j = ARR_GetSize(source_dir_watches); j-- > 0; ) {
+      watch = ARR_GetElement(source_dir_watches, j);
+      if (watch->wd != ev->wd)
+        continue;
+
+      if (ev->mask & IN_IGNORED) {
+        /* The directory was removed, forget the watch */
+        *watch = *(SourceDirWatch *)ARR_GetElement(source_dir_watches,
+                                                   ARR_GetSize(source_dir_watches) - 1);
+        ARR_SetSize(source_dir_watches, ARR_GetSize(source_dir_watches) - 1);
+        full_reload_pending = 1;
+      } else if (ev->len > 0) {
+        add_modified_source_file(watch->dir_set, ev->name);
+      }
+    }
+  }
+
+  /* Collect a burst of changes before loading the files */
+  if (reload_timeout_id == 0 &&
+      (full_reload_pending || ARR_GetSize(modified_source_files) > 0))
+    reload_timeout_id = SCH_AddTimeoutByDelay(SOURCEDIR_RELOAD_DELAY, reload_timeout, NULL);
+}
+#endif
+
+/* ================================================== */
+
 void
 CNF_CreateDirs(uid_t uid, gid_t gid)
 {
@@ -1772,6 +2436,13 @@ CNF_CreateDirs(uid_t uid, gid_t gid)
     Free(dir);
   }
 
+  /* Readers of the status page don't need to be in the chrony group */
+  if (status_file) {
+    dir = UTI_PathToDir(status_file);
+    UTI_CreateDirAndParents(dir, 0755, uid, gid);
+    Free(dir);
+  }
+
   if (logdir)
     UTI_CreateDirAndParents(logdir, 0750, uid, gid);
   if (dumpdir)
@@ -1891,6 +2562,14 @@ CNF_GetAcquisitionPort(void)
 
 /* ================================================== */
 
+int
+CNF_GetAcquisitionSockets(void)
+{
+  return acquisition_sockets;
+}
+
+/* ================================================== */
+
 char *
 CNF_GetDriftFile(void)
 {
@@ -1907,6 +2586,14 @@ CNF_GetLogBanner(void)
 
 /* ================================================== */
 
+int
+CNF_GetLogBinary(void)
+{
+  return log_binary;
+}
+
+/* ================================================== */
+
 char *
 CNF_GetLogDir(void)
 {
@@ -1923,6 +2610,14 @@ CNF_GetDumpDir(void)
 
 /* ================================================== */
 
+SRC_DumpFormat
+CNF_GetDumpFormat(void)
+{
+  return dump_format;
+}
+
+/* ================================================== */
+
 int
 CNF_GetLogMeasurements(int *raw)
 {
@@ -1980,6 +2675,14 @@ CNF_GetLogTempComp(void)
 
 /* ================================================== */
 
+int
+CNF_GetLogPHCStats(void)
+{
+  return do_log_phc_stats;
+}
+
+/* ================================================== */
+
 char *
 CNF_GetKeysFile(void)
 {
@@ -2068,6 +2771,14 @@ CNF_GetClockPrecision(void)
 
 /* ================================================== */
 
+int
+CNF_GetNoPrecisionCache(void)
+{
+  return no_precision_cache;
+}
+
+/* ================================================== */
+
 double
 CNF_GetMaxDistance(void)
 {
@@ -2123,6 +2834,14 @@ CNF_GetCommandPort(void) {
 
 /* ================================================== */
 
+int
+CNF_GetCommandThread(void)
+{
+  return cmd_thread;
+}
+
+/* ================================================== */
+
 int
 CNF_AllowLocalReference(int *stratum, int *orphan, double *distance)
 {
@@ -2163,6 +2882,16 @@ CNF_GetMakeStep(int *limit, double *threshold)
 
 /* ================================================== */
 
+int
+CNF_GetFastStart(double *threshold)
+{
+  if (threshold)
+    *threshold = fast_start_threshold;
+  return fast_start_threshold >= 0.0;
+}
+
+/* ================================================== */
+
 void
 CNF_GetMaxChange(int *delay, int *ignore, double *offset)
 {
@@ -2338,6 +3067,16 @@ CNF_GetNtpSigndSocket(void)
 
 /* ================================================== */
 
+void
+CNF_GetNtpSigndQueue(int *length, int *pipeline, double *timeout)
+{
+  *length = ntp_signd_queue;
+  *pipeline = ntp_signd_pipeline;
+  *timeout = ntp_signd_timeout;
+}
+
+/* ================================================== */
+
 char *
 CNF_GetPidFile(void)
 {
@@ -2346,6 +3085,51 @@ CNF_GetPidFile(void)
 
 /* ================================================== */
 
+char *
+CNF_GetStatusFile(void)
+{
+  return status_file;
+}
+
+/* ================================================== */
+
+int
+CNF_GetMetricsPort(void)
+{
+  return metrics_port;
+}
+
+/* ================================================== */
+
+void
+CNF_GetBindMetricsAddress(int family, IPAddr *addr)
+{
+  if (family == IPADDR_INET4)
+    *addr = bind_metrics_address4;
+  else if (family == IPADDR_INET6)
+    *addr = bind_metrics_address6;
+  else
+    addr->family = IPADDR_UNSPEC;
+}
+
+/* ================================================== */
+
+char *
+CNF_GetBindMetricsPath(void)
+{
+  return bind_metrics_path;
+}
+
+/* ================================================== */
+
+double
+CNF_GetMetricsInterval(void)
+{
+  return metrics_interval;
+}
+
+/* ================================================== */
+
 REF_LeapMode
 CNF_GetLeapSecMode(void)
 {
@@ -2605,3 +3389,11 @@ CNF_GetNoCertTimeCheck(void)
 {
   return no_cert_time_check;
 }
+
+/* ================================================== */
+
+int
+CNF_GetResolverThreads(void)
+{
+  return resolver_threads;
+}
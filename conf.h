@@ -52,11 +52,14 @@ extern void CNF_AddRefclocks(void);
 extern void CNF_ReloadSources(void);
 
 extern int CNF_GetAcquisitionPort(void);
+extern int CNF_GetAcquisitionSockets(void);
 extern int CNF_GetNTPPort(void);
 extern char *CNF_GetDriftFile(void);
 extern char *CNF_GetLogDir(void);
 extern char *CNF_GetDumpDir(void);
+extern SRC_DumpFormat CNF_GetDumpFormat(void);
 extern int CNF_GetLogBanner(void);
+extern int CNF_GetLogBinary(void);
 extern int CNF_GetLogMeasurements(int *raw);
 extern int CNF_GetLogSelection(void);
 extern int CNF_GetLogStatistics(void);
@@ -64,13 +67,16 @@ extern int CNF_GetLogTracking(void);
 extern int CNF_GetLogRtc(void);
 extern int CNF_GetLogRefclocks(void);
 extern int CNF_GetLogTempComp(void);
+extern int CNF_GetLogPHCStats(void);
 extern char *CNF_GetKeysFile(void);
 extern char *CNF_GetRtcFile(void);
 extern int CNF_GetManualEnabled(void);
 extern int CNF_GetCommandPort(void);
+extern int CNF_GetCommandThread(void);
 extern int CNF_GetRtcOnUtc(void);
 extern int CNF_GetRtcSync(void);
 extern void CNF_GetMakeStep(int *limit, double *threshold);
+extern int CNF_GetFastStart(double *threshold);
 extern void CNF_GetMaxChange(int *delay, int *ignore, double *offset);
 extern double CNF_GetLogChange(void);
 extern void CNF_GetMailOnChange(int *enabled, double *threshold, char **user);
@@ -86,7 +92,13 @@ extern char *CNF_GetBindCommandInterface(void);
 extern char *CNF_GetBindCommandPath(void);
 extern int CNF_GetNtpDscp(void);
 extern char *CNF_GetNtpSigndSocket(void);
+extern void CNF_GetNtpSigndQueue(int *length, int *pipeline, double *timeout);
 extern char *CNF_GetPidFile(void);
+extern char *CNF_GetStatusFile(void);
+extern int CNF_GetMetricsPort(void);
+extern void CNF_GetBindMetricsAddress(int family, IPAddr *addr);
+extern char *CNF_GetBindMetricsPath(void);
+extern double CNF_GetMetricsInterval(void);
 extern REF_LeapMode CNF_GetLeapSecMode(void);
 extern char *CNF_GetLeapSecTimezone(void);
 
@@ -97,6 +109,7 @@ extern double CNF_GetMaxDrift(void);
 extern double CNF_GetCorrectionTimeRatio(void);
 extern double CNF_GetMaxSlewRate(void);
 extern double CNF_GetClockPrecision(void);
+extern int CNF_GetNoPrecisionCache(void);
 
 extern SRC_AuthSelectMode CNF_GetAuthSelectMode(void);
 extern double CNF_GetMaxDistance(void);
@@ -167,4 +180,6 @@ extern int CNF_GetNtsTrustedCertsPaths(const char ***paths, uint32_t **ids);
 extern int CNF_GetNoSystemCert(void);
 extern int CNF_GetNoCertTimeCheck(void);
 
+extern int CNF_GetResolverThreads(void);
+
 #endif /* GOT_CONF_H */
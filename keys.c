@@ -64,9 +64,12 @@ typedef struct {
 
 static ARR_Instance keys;
 
-static int cache_valid;
-static uint32_t cache_key_id;
-static int cache_key_pos;
+/* Hash table mapping key IDs to indices in the keys array (shifted by one
+   to allow zero to mark an empty slot).  Its size is a power of two. */
+static ARR_Instance key_slots;
+
+/* Random seed to make collisions in the table unpredictable */
+static uint32_t slot_seed;
 
 /* ================================================== */
 
@@ -91,7 +94,7 @@ free_keys(void)
   }
 
   ARR_SetSize(keys, 0);
-  cache_valid = 0;
+  ARR_SetSize(key_slots, 0);
 }
 
 /* ================================================== */
@@ -100,7 +103,9 @@ void
 KEY_Initialise(void)
 {
   keys = ARR_CreateInstance(sizeof (Key));
-  cache_valid = 0;
+  ARR_SetTag(keys, MEM_KEYS, 1);
+  key_slots = ARR_CreateInstance(sizeof (uint32_t));
+  ARR_SetTag(key_slots, MEM_KEYS, 0);
   KEY_Reload();
 }
 
@@ -111,6 +116,7 @@ KEY_Finalise(void)
 {
   free_keys();
   ARR_DestroyInstance(keys);
+  ARR_DestroyInstance(key_slots);
 }
 
 /* ================================================== */
@@ -162,6 +168,87 @@ compare_keys_by_id(const void *a, const void *b)
 
 /* ================================================== */
 
+static uint32_t
+hash_key_id(uint32_t id)
+{
+  uint32_t hash;
+
+  /* Mix the bits of the ID, which may be controlled by an attacker */
+  hash = (id ^ slot_seed) * 0x9e3779b1U;
+  return hash ^ (hash >> 16);
+}
+
+/* ================================================== */
+/* Find a slot in the hash table matching a key ID.  If the key is not
+   present, an empty slot is returned. */
+
+static int
+find_slot(uint32_t id, unsigned int *slot)
+{
+  unsigned int i, size, index;
+  uint32_t hash;
+
+  size = ARR_GetSize(key_slots);
+  if (size == 0)
+    return 0;
+
+  hash = hash_key_id(id);
+
+  for (i = 0; i < size; i++) {
+    /* Use quadratic probing (triangular numbers visit all slots) */
+    *slot = (hash + (i + i * i) / 2) % size;
+    index = *(uint32_t *)ARR_GetElement(key_slots, *slot);
+
+    if (index == 0)
+      return 0;
+
+    if (get_key(index - 1)->id == id)
+      return 1;
+  }
+
+  return 0;
+}
+
+/* ================================================== */
+
+static void
+index_keys(void)
+{
+  unsigned int i, size, slot;
+
+  /* Keep the table at most half full */
+  for (size = 1; size < 2 * ARR_GetSize(keys); size *= 2)
+    ;
+
+  ARR_SetSize(key_slots, size);
+  memset(ARR_GetElements(key_slots), 0, size * sizeof (uint32_t));
+
+  UTI_GetRandomBytes(&slot_seed, sizeof (slot_seed));
+
+  for (i = 0; i < ARR_GetSize(keys); i++) {
+    /* If the ID is duplicated, use the first key */
+    if (find_slot(get_key(i)->id, &slot))
+      continue;
+
+    *(uint32_t *)ARR_GetElement(key_slots, slot) = i + 1;
+  }
+}
+
+/* ================================================== */
+
+static Key *
+get_key_by_id(uint32_t key_id)
+{
+  unsigned int slot;
+
+  if (!find_slot(key_id, &slot))
+    return NULL;
+
+  return get_key(*(uint32_t *)ARR_GetElement(key_slots, slot) - 1);
+}
+
+/* ================================================== */
+
 void
 KEY_Reload(void)
 {
@@ -221,6 +308,7 @@ KEY_Reload(void)
       key.type = hash_algorithm;
       key.length = key_length;
       key.data.ntp_mac.value = MallocArray(unsigned char, key_length);
+      MEM_SetTag(key.data.ntp_mac.value, MEM_KEYS, 0);
       memcpy(key.data.ntp_mac.value, key_value, key_length);
       key.data.ntp_mac.hash_id = hash_id;
     } else if (cmac_algorithm != 0) {
@@ -261,55 +349,14 @@ KEY_Reload(void)
       LOG(LOGS_WARN, "Detected duplicate key %"PRIu32, get_key(i - 1)->id);
   }
 
+  index_keys();
+
   /* Erase any passwords from stack */
   memset(line, 0, sizeof (line));
 }
 
 /* ================================================== */
 
-static int
-lookup_key(uint32_t id)
-{
-  Key specimen, *where, *keys_ptr;
-  int pos;
-
-  keys_ptr = ARR_GetElements(keys);
-  specimen.id = id;
-  where = (Key *)bsearch((void *)&specimen, keys_ptr, ARR_GetSize(keys),
-                         sizeof (Key), compare_keys_by_id);
-  if (!where) {
-    return -1;
-  } else {
-    pos = where - keys_ptr;
-    return pos;
-  }
-}
-
-/* ================================================== */
-
-static Key *
-get_key_by_id(uint32_t key_id)
-{
-  int position;
-
-  if (cache_valid && key_id == cache_key_id)
-    return get_key(cache_key_pos);
-
-  position = lookup_key(key_id);
-
-  if (position >= 0) {
-    cache_valid = 1;
-    cache_key_pos = position;
-    cache_key_id = key_id;
-
-    return get_key(position);
-  }
-
-  return NULL;
-}
-
-/* ================================================== */
-
 int
 KEY_KeyKnown(uint32_t key_id)
 {
@@ -32,14 +32,18 @@
 
 #include "sysincl.h"
 
+#include "array.h"
 #include "conf.h"
 #include "local.h"
 #include "localp.h"
 #include "memory.h"
+#include "sched.h"
 #include "smooth.h"
 #include "util.h"
 #include "logging.h"
 
+#include <sys/utsname.h>
+
 /* ================================================== */
 
 /* Variable to store the current frequency, in ppm */
@@ -65,16 +69,54 @@ static lcl_SetSyncStatusDriver drv_set_sync_status;
 /* ================================================== */
 
 /* Types and variables associated with handling the parameter change
-   list */
+   handlers.  The handlers are kept in a flat array in the order of their
+   registration. */
 
-typedef struct _ChangeListEntry {
-  struct _ChangeListEntry *next;
-  struct _ChangeListEntry *prev;
+typedef struct {
   LCL_ParameterChangeHandler handler;
   void *anything;
-} ChangeListEntry;
+} ChangeHandler;
+
+static ARR_Instance change_handlers;
+
+/* Flag disabling the parameter change handlers */
+static int change_handlers_disabled;
+
+/* ================================================== */
+
+/* Cumulative correction of timestamps for all slews and steps of the clock
+   (except unknown steps) dispatched to the parameter change handlers.  A
+   timestamp t taken before the first change in the current base is
+   corrected by slew_freq * (t - slew_reference) + slew_offset. */
+
+static unsigned long slew_id;
+static double slew_freq;
+static double slew_offset;
+static struct timespec slew_reference;
+
+/* Cooked time of the last change */
+static struct timespec slew_last;
+
+/* Maximum offset accumulated in one base.  Steps and changes which would
+   exceed the offset start a new base, so the cumulative offsets don't lose
+   precision in their differences. */
+#define MAX_SLEW_BASE_OFFSET 1.0
+
+typedef struct {
+  /* Final state of the correction in the base */
+  unsigned long last_id;
+  double freq;
+  double offset;
+  struct timespec reference;
+  struct timespec last;
+  /* Change which started the next base */
+  struct timespec when;
+  double dfreq;
+  double doffset;
+} SlewBase;
 
-static ChangeListEntry change_list;
+/* Array of SlewBase of the previous bases */
+static ARR_Instance slew_bases;
 
 /* ================================================== */
 
@@ -95,6 +137,9 @@ static DispersionNotifyListEntry dispersion_notify_list;
 static int precision_log;
 static double precision_quantum;
 
+/* Flag indicating the precision was loaded from the cache file */
+static int cached_precision;
+
 static double max_clock_error;
 
 /* ================================================== */
@@ -106,18 +151,30 @@ static double max_clock_error;
    under 1s of busy waiting. */
 #define NITERS 100
 
+/* Name of the file in the dump directory caching the measured precision */
+#define PRECISION_FILE "clockprecision"
+
+/* Delay of the new measurement of a cached precision after start */
+#define PRECISION_REFRESH_DELAY 10.0
+
+/* Number of increments measured in one step of the refresh and interval
+   between the steps, to avoid blocking the main loop for long */
+#define PRECISION_REFRESH_ITERS 4
+#define PRECISION_REFRESH_INTERVAL 0.1
+
 #define NSEC_PER_SEC 1000000000
 
-static double
-measure_clock_precision(void)
+/* State of the refresh of a cached precision */
+static int refresh_iters;
+static int refresh_best;
+
+static int
+measure_clock_increment(int niters, int best)
 {
   struct timespec ts, old_ts;
-  int iters, diff, best;
+  int iters, diff;
 
   LCL_ReadRawTime(&old_ts);
-
-  /* Assume we must be better than a second */
-  best = NSEC_PER_SEC;
   iters = 0;
 
   do {
@@ -131,11 +188,147 @@ measure_clock_precision(void)
         best = diff;
       iters++;
     }
-  } while (iters < NITERS);
+  } while (iters < niters);
 
   assert(best > 0);
 
-  return 1.0e-9 * best;
+  return best;
+}
+
+/* ================================================== */
+
+static double
+measure_clock_precision(void)
+{
+  /* Assume we must be better than a second */
+  return 1.0e-9 * measure_clock_increment(NITERS, NSEC_PER_SEC);
+}
+
+/* ================================================== */
+/* Get a string identifying the system clock, so that a cached precision
+   is not used after changing the kernel or clocksource */
+
+static void
+get_precision_key(char *key, size_t len)
+{
+  char clocksource[64];
+  struct utsname uts;
+  FILE *f;
+
+  if (uname(&uts) < 0)
+    snprintf(uts.release, sizeof (uts.release), "unknown");
+
+  snprintf(clocksource, sizeof (clocksource), "unknown");
+
+  f = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+  if (f) {
+    if (fscanf(f, "%63s", clocksource) != 1)
+      snprintf(clocksource, sizeof (clocksource), "unknown");
+    fclose(f);
+  }
+
+  snprintf(key, len, "%s/%s", uts.release, clocksource);
+}
+
+/* ================================================== */
+
+static int
+load_precision(double *precision)
+{
+  char line[256], key[256], file_key[256], *dumpdir;
+  FILE *f;
+
+  dumpdir = CNF_GetDumpDir();
+  if (!dumpdir || CNF_GetNoPrecisionCache())
+    return 0;
+
+  f = UTI_OpenFile(dumpdir, PRECISION_FILE, NULL, 'r', 0);
+  if (!f)
+    return 0;
+
+  get_precision_key(key, sizeof (key));
+
+  if (!fgets(line, sizeof (line), f) ||
+      sscanf(line, "%255s %lf", file_key, precision) != 2 ||
+      strcmp(key, file_key) != 0 || !(*precision > 0.0 && *precision <= 1.0)) {
+    DEBUG_LOG("Ignoring cached clock precision");
+    fclose(f);
+    return 0;
+  }
+
+  fclose(f);
+
+  return 1;
+}
+
+/* ================================================== */
+
+static void
+save_precision(double precision)
+{
+  char key[256], *dumpdir;
+  FILE *f;
+
+  dumpdir = CNF_GetDumpDir();
+  if (!dumpdir || CNF_GetNoPrecisionCache())
+    return;
+
+  f = UTI_OpenFile(dumpdir, PRECISION_FILE, ".tmp", 'w', 0644);
+  if (!f)
+    return;
+
+  get_precision_key(key, sizeof (key));
+
+  if (fprintf(f, "%s %.9e\n", key, precision) < 0) {
+    fclose(f);
+    UTI_RemoveFile(dumpdir, PRECISION_FILE, ".tmp");
+    return;
+  }
+
+  fclose(f);
+
+  UTI_RenameTempFile(dumpdir, PRECISION_FILE, ".tmp", NULL);
+}
+
+/* ================================================== */
+
+static void
+set_precision(double precision)
+{
+  precision_quantum = CLAMP(1.0e-9, precision, 1.0);
+  precision_log = round(log(precision_quantum) / log(2.0));
+  /* NTP code doesn't support smaller log than -30 */
+  assert(precision_log >= -30);
+
+  DEBUG_LOG("Clock precision %.9f (%d)", precision_quantum, precision_log);
+}
+
+/* ================================================== */
+
+/* Measure the precision again in short steps spread over multiple
+   timeouts instead of busy waiting for all increments at once */
+
+static void
+refresh_precision(void *arg)
+{
+  double precision;
+
+  refresh_best = measure_clock_increment(PRECISION_REFRESH_ITERS, refresh_best);
+  refresh_iters += PRECISION_REFRESH_ITERS;
+
+  if (refresh_iters < NITERS) {
+    SCH_AddTimeoutByDelay(PRECISION_REFRESH_INTERVAL, refresh_precision, NULL);
+    return;
+  }
+
+  precision = 1.0e-9 * refresh_best;
+
+  if (precision != precision_quantum) {
+    DEBUG_LOG("Clock precision changed from %.9f to %.9f",
+              precision_quantum, precision);
+    set_precision(precision);
+    save_precision(precision);
+  }
 }
 
 /* ================================================== */
@@ -143,7 +336,16 @@ measure_clock_precision(void)
 void
 LCL_Initialise(void)
 {
-  change_list.next = change_list.prev = &change_list;
+  double precision;
+
+  change_handlers = ARR_CreateInstance(sizeof (ChangeHandler));
+  change_handlers_disabled = 0;
+
+  slew_id = 0;
+  slew_freq = slew_offset = 0.0;
+  UTI_ZeroTimespec(&slew_reference);
+  UTI_ZeroTimespec(&slew_last);
+  slew_bases = ARR_CreateInstance(sizeof (SlewBase));
 
   dispersion_notify_list.next = dispersion_notify_list.prev = &dispersion_notify_list;
 
@@ -159,16 +361,21 @@ LCL_Initialise(void)
   current_freq_ppm = 0.0;
   temp_comp_ppm = 0.0;
 
-  precision_quantum = CNF_GetClockPrecision();
-  if (precision_quantum <= 0.0)
-    precision_quantum = measure_clock_precision();
+  /* Use the configured precision, or the precision measured by a previous
+     instance on the same system, or measure it now */
+  precision = CNF_GetClockPrecision();
+  cached_precision = 0;
+
+  if (precision <= 0.0) {
+    if (load_precision(&precision)) {
+      cached_precision = 1;
+    } else {
+      precision = measure_clock_precision();
+      save_precision(precision);
+    }
+  }
 
-  precision_quantum = CLAMP(1.0e-9, precision_quantum, 1.0);
-  precision_log = round(log(precision_quantum) / log(2.0));
-  /* NTP code doesn't support smaller log than -30 */
-  assert(precision_log >= -30);
-
-  DEBUG_LOG("Clock precision %.9f (%d)", precision_quantum, precision_log);
+  set_precision(precision);
 
   /* This is the maximum allowed frequency offset in ppm, the time must
      never stop or run backwards */
@@ -184,10 +391,28 @@ void
 LCL_Finalise(void)
 {
   /* Make sure all handlers have been removed */
-  if (change_list.next != &change_list)
+  if (ARR_GetSize(change_handlers) > 0)
     assert(0);
   if (dispersion_notify_list.next != &dispersion_notify_list)
     assert(0);
+
+  ARR_DestroyInstance(slew_bases);
+  ARR_DestroyInstance(change_handlers);
+}
+
+/* ================================================== */
+
+void
+LCL_StartPrecisionRefresh(void)
+{
+  /* Measure the precision again after start if it was loaded from
+     the cache, in case it changed on the same system */
+  if (cached_precision) {
+    refresh_iters = 0;
+    refresh_best = NSEC_PER_SEC;
+    SCH_AddTimeoutByDelay(PRECISION_REFRESH_DELAY, refresh_precision, NULL);
+    cached_precision = 0;
+  }
 }
 
 /* ================================================== */
@@ -221,25 +446,20 @@ LCL_GetMaxClockError(void)
 void
 LCL_AddParameterChangeHandler(LCL_ParameterChangeHandler handler, void *anything)
 {
-  ChangeListEntry *ptr, *new_entry;
+  ChangeHandler *entry;
+  unsigned int i;
 
   /* Check that the handler is not already registered */
-  for (ptr = change_list.next; ptr != &change_list; ptr = ptr->next) {
-    if (!(ptr->handler != handler || ptr->anything != anything)) {
+  for (i = 0; i < ARR_GetSize(change_handlers); i++) {
+    entry = ARR_GetElement(change_handlers, i);
+    if (!(entry->handler != handler || entry->anything != anything)) {
       assert(0);
     }
   }
 
-  new_entry = MallocNew(ChangeListEntry);
-
-  new_entry->handler = handler;
-  new_entry->anything = anything;
-
-  /* Chain it into the list */
-  new_entry->next = &change_list;
-  new_entry->prev = change_list.prev;
-  change_list.prev->next = new_entry;
-  change_list.prev = new_entry;
+  entry = ARR_GetNewElement(change_handlers);
+  entry->handler = handler;
+  entry->anything = anything;
 }
 
 /* ================================================== */
@@ -247,27 +467,22 @@ LCL_AddParameterChangeHandler(LCL_ParameterChangeHandler handler, void *anything
 /* Remove a handler */
 void LCL_RemoveParameterChangeHandler(LCL_ParameterChangeHandler handler, void *anything)
 {
+  ChangeHandler *entries;
+  unsigned int i, n;
 
-  ChangeListEntry *ptr;
-  int ok;
-
-  ptr = NULL;
-  ok = 0;
+  entries = ARR_GetElements(change_handlers);
+  n = ARR_GetSize(change_handlers);
 
-  for (ptr = change_list.next; ptr != &change_list; ptr = ptr->next) {
-    if (ptr->handler == handler && ptr->anything == anything) {
-      ok = 1;
+  for (i = 0; i < n; i++) {
+    if (entries[i].handler == handler && entries[i].anything == anything)
       break;
-    }
   }
 
-  assert(ok);
-
-  /* Unlink entry from the list */
-  ptr->next->prev = ptr->prev;
-  ptr->prev->next = ptr->next;
+  assert(i < n);
 
-  Free(ptr);
+  /* Keep the order of the remaining handlers */
+  memmove(&entries[i], &entries[i + 1], (n - i - 1) * sizeof (entries[i]));
+  ARR_SetSize(change_handlers, n - 1);
 }
 
 /* ================================================== */
@@ -275,7 +490,120 @@ void LCL_RemoveParameterChangeHandler(LCL_ParameterChangeHandler handler, void *
 int
 LCL_IsFirstParameterChangeHandler(LCL_ParameterChangeHandler handler)
 {
-  return change_list.next->handler == handler;
+  return ARR_GetSize(change_handlers) > 0 &&
+         ((ChangeHandler *)ARR_GetElement(change_handlers, 0))->handler == handler;
+}
+
+/* ================================================== */
+
+static void
+update_slew_epoch(struct timespec *cooked, double dfreq, double doffset,
+                  LCL_ChangeType change_type)
+{
+  SlewBase *base;
+  double offset;
+
+  if (UTI_IsZeroTimespec(&slew_reference))
+    slew_reference = *cooked;
+
+  /* Compose the correction with the new slew, which moves a timestamp t
+     by (cooked - t) * dfreq - doffset */
+  offset = (1.0 - dfreq) * slew_offset +
+           UTI_DiffTimespecsToDouble(cooked, &slew_reference) * dfreq - doffset;
+
+  if (change_type == LCL_ChangeStep || fabs(offset) > MAX_SLEW_BASE_OFFSET) {
+    /* Save the final state and start a new base with this change */
+    base = ARR_GetNewElement(slew_bases);
+    base->last_id = slew_id;
+    base->freq = slew_freq;
+    base->offset = slew_offset;
+    base->reference = slew_reference;
+    base->last = slew_last;
+    base->when = *cooked;
+    base->dfreq = dfreq;
+    base->doffset = doffset;
+
+    slew_freq = slew_offset = 0.0;
+    slew_reference = *cooked;
+  } else {
+    slew_offset = offset;
+    slew_freq = (1.0 - dfreq) * slew_freq - dfreq;
+  }
+
+  slew_last = *cooked;
+  slew_id++;
+}
+
+/* ================================================== */
+
+void
+LCL_GetSlewEpoch(LCL_SlewEpoch *epoch)
+{
+  epoch->id = slew_id;
+  epoch->base = ARR_GetSize(slew_bases);
+  epoch->freq = slew_freq;
+  epoch->offset = slew_offset;
+}
+
+/* ================================================== */
+
+/* Find a single slew at the time of the last change which has the same
+   effect on timestamps as all changes made in a base since the epoch */
+
+static void
+get_base_slew(LCL_SlewEpoch *epoch, double freq, double offset,
+              struct timespec *reference, struct timespec *last,
+              struct timespec *when, double *dfreq, double *doffset)
+{
+  double f;
+
+  f = -(freq - epoch->freq) / (1.0 + epoch->freq);
+
+  *when = *last;
+  *dfreq = f;
+  *doffset = -(offset - epoch->offset) - f * epoch->offset +
+             f * UTI_DiffTimespecsToDouble(last, reference);
+}
+
+/* ================================================== */
+
+int
+LCL_GetSlewSinceEpoch(LCL_SlewEpoch *epoch, struct timespec *when,
+                      double *dfreq, double *doffset)
+{
+  SlewBase *base;
+
+  if (epoch->id == slew_id)
+    return 0;
+
+  if (epoch->base < ARR_GetSize(slew_bases)) {
+    base = ARR_GetElement(slew_bases, epoch->base);
+
+    /* Return the remaining changes in the epoch's base and the change
+       starting the next base as separate slews */
+    if (epoch->id != base->last_id) {
+      get_base_slew(epoch, base->freq, base->offset, &base->reference, &base->last,
+                    when, dfreq, doffset);
+      epoch->id = base->last_id;
+      epoch->freq = base->freq;
+      epoch->offset = base->offset;
+    } else {
+      *when = base->when;
+      *dfreq = base->dfreq;
+      *doffset = base->doffset;
+      epoch->id = base->last_id + 1;
+      epoch->base++;
+      epoch->freq = epoch->offset = 0.0;
+    }
+
+    return 1;
+  }
+
+  get_base_slew(epoch, slew_freq, slew_offset, &slew_reference, &slew_last,
+                when, dfreq, doffset);
+  LCL_GetSlewEpoch(epoch);
+
+  return 1;
 }
 
 /* ================================================== */
@@ -285,10 +613,19 @@ invoke_parameter_change_handlers(struct timespec *raw, struct timespec *cooked,
                                  double dfreq, double doffset,
                                  LCL_ChangeType change_type)
 {
-  ChangeListEntry *ptr;
+  ChangeHandler *entry;
+  unsigned int i;
+
+  if (change_handlers_disabled)
+    return;
+
+  if (change_type != LCL_ChangeUnknownStep)
+    update_slew_epoch(cooked, dfreq, doffset, change_type);
 
-  for (ptr = change_list.next; ptr != &change_list; ptr = ptr->next) {
-    (ptr->handler)(raw, cooked, dfreq, doffset, change_type, ptr->anything);
+  /* The array may be reallocated if a handler registers another handler */
+  for (i = 0; i < ARR_GetSize(change_handlers); i++) {
+    entry = ARR_GetElement(change_handlers, i);
+    (entry->handler)(raw, cooked, dfreq, doffset, change_type, entry->anything);
   }
 }
 
@@ -633,15 +970,11 @@ LCL_AccumulateFrequencyAndOffset(double dfreq, double doffset, double corr_rate)
 int
 LCL_AccumulateFrequencyAndOffsetNoHandlers(double dfreq, double doffset, double corr_rate)
 {
-  ChangeListEntry *first_handler;
   int r;
 
-  first_handler = change_list.next;
-  change_list.next = &change_list;
-
+  change_handlers_disabled = 1;
   r = LCL_AccumulateFrequencyAndOffset(dfreq, doffset, corr_rate);
-
-  change_list.next = first_handler;
+  change_handlers_disabled = 0;
 
   return r;
 }
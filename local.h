@@ -94,6 +94,27 @@ extern void LCL_RemoveParameterChangeHandler(LCL_ParameterChangeHandler, void *a
 /* Check if a handler is invoked first when dispatching */
 extern int LCL_IsFirstParameterChangeHandler(LCL_ParameterChangeHandler handler);
 
+/* State of the cumulative correction of timestamps for the slews and
+   steps dispatched to the parameter change handlers (unknown steps are
+   not included).  It allows modules keeping many timestamps to correct
+   them lazily on next access instead of in every handler call. */
+typedef struct {
+  unsigned long id;
+  unsigned int base;
+  double freq;
+  double offset;
+} LCL_SlewEpoch;
+
+/* Get the current slew epoch */
+extern void LCL_GetSlewEpoch(LCL_SlewEpoch *epoch);
+
+/* Get a slew which has the same effect on timestamps as changes made since
+   the specified epoch and update the epoch.  Large changes (e.g. steps) are
+   returned as separate slews.  The function should be called until it
+   returns 0, i.e. the epoch is current. */
+extern int LCL_GetSlewSinceEpoch(LCL_SlewEpoch *epoch, struct timespec *when,
+                                 double *dfreq, double *doffset);
+
 /* Function type for handlers to be called back when an indeterminate
    offset is introduced into the local time.  This situation occurs
    when the frequency must be adjusted to effect a clock slew and
@@ -178,6 +199,10 @@ extern int LCL_AccumulateFrequencyAndOffset(double dfreq, double doffset, double
 extern int LCL_AccumulateFrequencyAndOffsetNoHandlers(double dfreq, double doffset,
                                                       double corr_rate);
 
+/* Schedule a new measurement of the precision if it was loaded from
+   the cache.  To be called after the scheduler is initialised. */
+extern void LCL_StartPrecisionRefresh(void);
+
 /* Routine to read the system precision as a log to base 2 value. */
 extern int LCL_GetSysPrecisionAsLog(void);
 
@@ -31,9 +31,15 @@
 
 #include <syslog.h>
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "binlog.h"
 #include "conf.h"
 #include "logging.h"
 #include "memory.h"
+#include "sched.h"
 #include "util.h"
 
 /* This is used by DEBUG_LOG macro */
@@ -53,15 +59,70 @@ struct LogFile {
   const char *banner;
   FILE *file;
   unsigned long writes;
+  unsigned long dropped_lines;
+  /* Lines dropped when the buffer was full */
+  unsigned long full_buffer_lines;
+  int last_write_ok;
+  int drop_reported;
+  int binary;
+  int binary_started;
+  /* Formats recorded in the opened binary log */
+  const char *formats[BLG_MAX_FORMATS];
+  int n_formats;
 };
 
 static int n_filelogs = 0;
 
 /* Increase this when adding a new logfile */
-#define MAX_FILELOGS 6
+#define MAX_FILELOGS 8
 
 static struct LogFile logfiles[MAX_FILELOGS];
 
+/* Lines waiting to be written to the log files are saved in a buffer of
+   a fixed size, each line preceded by a header with the ID of the file
+   and length of the line.  The writer swaps the buffers and writes the
+   lines in a batch.  With threads, the writing is done in a separate
+   thread and lines which don't fit in the buffer are dropped.  Without
+   threads, the lines are written from a timeout, or immediately when
+   the buffer is full. */
+
+typedef struct {
+  LOG_FileID id;
+  unsigned int length;
+} LineHeader;
+
+#define LOGFILE_BUFFER_SIZE 65536
+
+/* Maximum length of a line in the log files */
+#define MAX_LINE_LENGTH 2048
+
+static char line_buffers[2][LOGFILE_BUFFER_SIZE];
+static char *queue_buffer = line_buffers[0];
+static char *write_buffer = line_buffers[1];
+static unsigned int queue_length = 0;
+
+#ifdef HAVE_PTHREAD
+/* Lock protecting the queue, the state of the writer, and the file
+   pointers and flags of the log files */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Conditions signalling the writer that lines were queued, and the main
+   thread that the writer has finished its batch */
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t writer_thread;
+static int writer_running = 0;
+static int writer_busy = 0;
+static int writer_quit = 0;
+#else
+/* Maximum delay of queued lines */
+#define LOGFILE_FLUSH_INTERVAL 1.0
+
+/* Timeout writing the queued lines */
+static SCH_TimeoutID flush_timeout = 0;
+#endif
+
 /* Global prefix for debug messages */
 static char *debug_prefix;
 
@@ -90,6 +151,19 @@ LOG_Finalise(void)
 
   LOG_CycleLogFiles();
 
+#ifdef HAVE_PTHREAD
+  if (writer_running) {
+    pthread_mutex_lock(&queue_lock);
+    writer_quit = 1;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+
+    pthread_join(writer_thread, NULL);
+    writer_running = 0;
+    writer_quit = 0;
+  }
+#endif
+
   Free(debug_prefix);
 
   initialised = 0;
@@ -278,17 +352,328 @@ LOG_FileOpen(const char *name, const char *banner)
   logfiles[n_filelogs].banner = banner;
   logfiles[n_filelogs].file = NULL;
   logfiles[n_filelogs].writes = 0;
+  logfiles[n_filelogs].dropped_lines = 0;
+  logfiles[n_filelogs].full_buffer_lines = 0;
+  logfiles[n_filelogs].last_write_ok = 1;
+  logfiles[n_filelogs].drop_reported = 0;
+  logfiles[n_filelogs].binary = 0;
+  logfiles[n_filelogs].binary_started = 0;
+  logfiles[n_filelogs].n_formats = 0;
 
   return n_filelogs++;
 }
 
 /* ================================================== */
 
+static void
+lock_queue(void)
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&queue_lock);
+#endif
+}
+
+/* ================================================== */
+
+static void
+unlock_queue(void)
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&queue_lock);
+#endif
+}
+
+/* ================================================== */
+/* Write a batch of lines to the log files.  With threads, this function
+   is called by the writer thread without holding the lock, using the
+   file pointers copied with the lock held.  The files cannot be closed
+   before the writer finishes the batch. */
+
+static void
+write_lines(const char *buffer, unsigned int length, FILE **files, unsigned long *lines,
+            unsigned long *failed_lines)
+{
+  unsigned int offset;
+  LineHeader header;
+  LOG_FileID i;
+  FILE *file;
+
+  for (offset = 0; offset + sizeof (header) <= length;
+       offset += sizeof (header) + header.length) {
+    memcpy(&header, buffer + offset, sizeof (header));
+    assert(header.id >= 0 && header.id < n_filelogs);
+
+    lines[header.id]++;
+    file = files[header.id];
+
+    if (!file || fwrite(buffer + offset + sizeof (header), header.length, 1, file) != 1)
+      failed_lines[header.id]++;
+  }
+
+  for (i = 0; i < n_filelogs; i++) {
+    file = files[i];
+    if (lines[i] == 0 || !file)
+      continue;
+
+    /* Count all lines in the batch as lost if they could not be flushed */
+    if (fflush(file) != 0 || ferror(file)) {
+      failed_lines[i] = lines[i];
+      clearerr(file);
+    }
+  }
+}
+
+/* ================================================== */
+/* Write the queued lines with the lock held.  With threads, the lock is
+   released while writing. */
+
+static void
+write_queued_lines(void)
+{
+  unsigned long lines[MAX_FILELOGS], failed_lines[MAX_FILELOGS];
+  FILE *files[MAX_FILELOGS];
+  unsigned int length;
+  LOG_FileID i;
+  char *buffer;
+
+  buffer = queue_buffer;
+  length = queue_length;
+  queue_buffer = write_buffer;
+  write_buffer = buffer;
+  queue_length = 0;
+
+  memset(lines, 0, sizeof (lines));
+  memset(failed_lines, 0, sizeof (failed_lines));
+
+  for (i = 0; i < n_filelogs; i++)
+    files[i] = logfiles[i].file;
+
+#ifdef HAVE_PTHREAD
+  writer_busy = 1;
+  pthread_mutex_unlock(&queue_lock);
+#endif
+
+  write_lines(buffer, length, files, lines, failed_lines);
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&queue_lock);
+  writer_busy = 0;
+  pthread_cond_broadcast(&idle_cond);
+#endif
+
+  for (i = 0; i < n_filelogs; i++) {
+    if (lines[i] == 0)
+      continue;
+    logfiles[i].dropped_lines += failed_lines[i];
+    logfiles[i].last_write_ok = failed_lines[i] == 0;
+  }
+}
+
+/* ================================================== */
+
+#ifdef HAVE_PTHREAD
+static void *
+run_writer(void *arg)
+{
+  pthread_mutex_lock(&queue_lock);
+
+  while (1) {
+    while (queue_length == 0 && !writer_quit)
+      pthread_cond_wait(&queue_cond, &queue_lock);
+
+    if (queue_length == 0)
+      break;
+
+    write_queued_lines();
+  }
+
+  pthread_mutex_unlock(&queue_lock);
+
+  return NULL;
+}
+
+/* ================================================== */
+
+static void
+start_writer(void)
+{
+  sigset_t mask, old_mask;
+
+  /* Leave the handling of signals to the main thread */
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+
+  if (pthread_create(&writer_thread, NULL, run_writer, NULL))
+    LOG_FATAL("pthread_create() failed");
+
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+  writer_running = 1;
+}
+
+/* ================================================== */
+
+#else
+static void
+handle_flush_timeout(void *arg)
+{
+  flush_timeout = 0;
+  write_queued_lines();
+}
+#endif
+
+/* ================================================== */
+/* Wait for the writer to write all queued lines and return with the
+   queue locked */
+
+static void
+drain_queue(void)
+{
+  lock_queue();
+
+#ifdef HAVE_PTHREAD
+  while (writer_running && (queue_length > 0 || writer_busy))
+    pthread_cond_wait(&idle_cond, &queue_lock);
+#else
+  SCH_RemoveTimeout(flush_timeout);
+  flush_timeout = 0;
+#endif
+
+  if (queue_length > 0)
+    write_queued_lines();
+}
+
+/* ================================================== */
+
+static int
+queue_line(LOG_FileID id, const char *line, unsigned int length)
+{
+  LineHeader header;
+
+  if (queue_length + sizeof (header) + length > LOGFILE_BUFFER_SIZE) {
+#ifdef HAVE_PTHREAD
+    /* Don't wait for the writer */
+    logfiles[id].full_buffer_lines++;
+    return 0;
+#else
+    write_queued_lines();
+#endif
+  }
+
+  header.id = id;
+  header.length = length;
+  memcpy(queue_buffer + queue_length, &header, sizeof (header));
+  memcpy(queue_buffer + queue_length + sizeof (header), line, length);
+
+#ifdef HAVE_PTHREAD
+  if (queue_length == 0)
+    pthread_cond_signal(&queue_cond);
+#else
+  if (!flush_timeout)
+    flush_timeout = SCH_AddTimeoutByDelay(LOGFILE_FLUSH_INTERVAL, handle_flush_timeout, NULL);
+#endif
+
+  queue_length += sizeof (header) + length;
+
+  return 1;
+}
+
+/* ================================================== */
+
+static void
+report_dropped_lines(struct LogFile *logfile)
+{
+  /* Report lines dropped due to a full buffer when there is space again */
+  if (logfile->full_buffer_lines > 0 &&
+      queue_length + sizeof (LineHeader) + MAX_LINE_LENGTH <= LOGFILE_BUFFER_SIZE) {
+    LOG(LOGS_WARN, "Log buffer full, %lu lines dropped in %s%s",
+        logfile->full_buffer_lines, logfile->name, logfile->binary ? ".bin" : ".log");
+    logfile->full_buffer_lines = 0;
+  }
+
+  /* Report only the start of dropping and the number of dropped lines
+     when the writes succeed again */
+  if (logfile->dropped_lines > 0 && !logfile->drop_reported) {
+    LOG(LOGS_WARN, "Could not write to %s%s", logfile->name, logfile->binary ? ".bin" : ".log");
+    logfile->drop_reported = 1;
+  } else if (logfile->drop_reported && logfile->last_write_ok) {
+    LOG(LOGS_WARN, "Dropped %lu lines in %s%s", logfile->dropped_lines, logfile->name,
+        logfile->binary ? ".bin" : ".log");
+    logfile->dropped_lines = 0;
+    logfile->drop_reported = 0;
+  }
+}
+
+/* ================================================== */
+
+/* Find the format in the binary log, or queue a record defining it */
+
+static int
+get_format_index(LOG_FileID id, const char *format)
+{
+  struct LogFile *logfile = &logfiles[id];
+  char record[BLG_MAX_RECORD_LENGTH];
+  int i, length;
+
+  for (i = 0; i < logfile->n_formats; i++) {
+    if (logfile->formats[i] == format || strcmp(logfile->formats[i], format) == 0)
+      return i;
+  }
+
+  if (logfile->n_formats >= BLG_MAX_FORMATS)
+    return -1;
+
+  length = BLG_EncodeFormatRecord(record, sizeof (record), logfile->n_formats, format);
+  if (length <= 0 || !queue_line(id, record, length))
+    return -1;
+
+  logfile->formats[logfile->n_formats] = format;
+
+  return logfile->n_formats++;
+}
+
+/* ================================================== */
+
+static int
+format_binary(LOG_FileID id, const struct timespec *time, char *record, int size,
+              const char *format, va_list ap)
+{
+  BLG_Field fields[BLG_MAX_FIELDS];
+  int index, length, n_fields;
+
+  /* Start each opening of the file with a description of the log, which
+     allows the reader to reproduce the banners */
+  if (!logfiles[id].binary_started) {
+    length = BLG_EncodeStartRecord(record, size, logfiles[id].name, logfiles[id].banner,
+                                   CNF_GetLogBanner());
+    assert(length > 0);
+    if (!queue_line(id, record, length))
+      return -1;
+    logfiles[id].binary_started = 1;
+  }
+
+  n_fields = BLG_GetFields(format, ap, fields, BLG_MAX_FIELDS);
+  if (n_fields < 0) {
+    LOG(LOGS_ERR, "Unsupported format in %s.bin", logfiles[id].name);
+    return -1;
+  }
+
+  index = get_format_index(id, format);
+  if (index < 0)
+    return -1;
+
+  return BLG_EncodeDataRecord(record, size, index, time, fields, n_fields);
+}
+
+/* ================================================== */
+
 void
-LOG_FileWrite(LOG_FileID id, const char *format, ...)
+LOG_FileWrite(LOG_FileID id, const struct timespec *time, const char *format, ...)
 {
+  char line[MAX_LINE_LENGTH];
   va_list other_args;
-  int banner;
+  int banner, length, binary, r;
+  FILE *file;
 
   if (id < 0 || id >= n_filelogs || !logfiles[id].name)
     return;
@@ -302,17 +687,62 @@ LOG_FileWrite(LOG_FileID id, const char *format, ...)
       return;
     }
 
-    logfiles[id].file = UTI_OpenFile(logdir, logfiles[id].name, ".log", 'a', 0644);
-    if (!logfiles[id].file) {
+    binary = CNF_GetLogBinary();
+
+    file = UTI_OpenFile(logdir, logfiles[id].name, binary ? ".bin" : ".log", 'a', 0644);
+    if (!file) {
       /* Disable the log */
       logfiles[id].name = NULL;
       return;
     }
+
+#ifdef HAVE_PTHREAD
+    if (!writer_running)
+      start_writer();
+#endif
+
+    lock_queue();
+    logfiles[id].file = file;
+    logfiles[id].binary = binary;
+    logfiles[id].binary_started = 0;
+    logfiles[id].n_formats = 0;
+    unlock_queue();
+  }
+
+  if (logfiles[id].binary) {
+    lock_queue();
+
+    va_start(other_args, format);
+    length = format_binary(id, time, line, sizeof (line), format, other_args);
+    va_end(other_args);
+
+    if (length > 0)
+      queue_line(id, line, length);
+
+    report_dropped_lines(&logfiles[id]);
+
+    unlock_queue();
+    return;
   }
 
+  length = snprintf(line, sizeof (line) - 1, "%s", UTI_TimeToLogForm(time->tv_sec));
+  if (length < 0 || length >= sizeof (line) - 1)
+    return;
+
+  va_start(other_args, format);
+  r = vsnprintf(line + length, sizeof (line) - 1 - length, format, other_args);
+  va_end(other_args);
+
+  if (r < 0)
+    return;
+  length = MIN(length + r, sizeof (line) - 2);
+  line[length++] = '\n';
+
+  lock_queue();
+
   banner = CNF_GetLogBanner();
   if (banner && logfiles[id].writes++ % banner == 0) {
-    char bannerline[256];
+    char bannerline[256], bannerlines[2 * sizeof (bannerline) + 256];
     int i, bannerlen;
 
     bannerlen = MIN(strlen(logfiles[id].banner), sizeof (bannerline) - 1);
@@ -321,17 +751,16 @@ LOG_FileWrite(LOG_FileID id, const char *format, ...)
       bannerline[i] = '=';
     bannerline[i] = '\0';
 
-    fprintf(logfiles[id].file, "%s\n", bannerline);
-    fprintf(logfiles[id].file, "%s\n", logfiles[id].banner);
-    fprintf(logfiles[id].file, "%s\n", bannerline);
+    bannerlen = snprintf(bannerlines, sizeof (bannerlines), "%s\n%s\n%s\n",
+                         bannerline, logfiles[id].banner, bannerline);
+    queue_line(id, bannerlines, MIN(bannerlen, sizeof (bannerlines) - 1));
   }
 
-  va_start(other_args, format);
-  vfprintf(logfiles[id].file, format, other_args);
-  va_end(other_args);
-  fprintf(logfiles[id].file, "\n");
+  queue_line(id, line, length);
+
+  report_dropped_lines(&logfiles[id]);
 
-  fflush(logfiles[id].file);
+  unlock_queue();
 }
 
 /* ================================================== */
@@ -341,12 +770,16 @@ LOG_CycleLogFiles(void)
 {
   LOG_FileID i;
 
+  drain_queue();
+
   for (i = 0; i < n_filelogs; i++) {
     if (logfiles[i].file)
       fclose(logfiles[i].file);
     logfiles[i].file = NULL;
     logfiles[i].writes = 0;
   }
+
+  unlock_queue();
 }
 
 /* ================================================== */
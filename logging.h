@@ -121,8 +121,12 @@ typedef int LOG_FileID;
 
 extern LOG_FileID LOG_FileOpen(const char *name, const char *banner);
 
-FORMAT_ATTRIBUTE_PRINTF(2, 3)
-extern void LOG_FileWrite(LOG_FileID id, const char *format, ...);
+/* Write an entry to the log file.  The line starts with the time in the
+   log form, which is followed by the formatted text.  In the binary
+   format, the format is recorded in the file only once and the time and
+   arguments are saved in their native form. */
+FORMAT_ATTRIBUTE_PRINTF(3, 4)
+extern void LOG_FileWrite(LOG_FileID id, const struct timespec *time, const char *format, ...);
 
 extern void LOG_CycleLogFiles(void);
 
@@ -49,6 +49,7 @@
 #include "cmdmon.h"
 #include "keys.h"
 #include "manual.h"
+#include "metrics.h"
 #include "rtc.h"
 #include "refclock.h"
 #include "clientlog.h"
@@ -117,6 +118,7 @@ MAI_CleanupAndExit(void)
   /* Don't update clock when removing sources */
   REF_SetMode(REF_ModeIgnore);
 
+  MET_Finalise();
   SMT_Finalise();
   TMC_Finalise();
   MNL_Finalise();
@@ -607,6 +609,7 @@ int main
   PRV_Initialise();
   LCL_Initialise();
   SCH_Initialise();
+  LCL_StartPrecisionRefresh();
   SCK_Initialise(address_family);
 
   /* Start helper processes if needed */
@@ -653,6 +656,7 @@ int main
   MNL_Initialise();
   TMC_Initialise();
   SMT_Initialise();
+  MET_Initialise();
 
   /* From now on, it is safe to do finalisation on exit */
   initialised = 1;
@@ -30,28 +30,100 @@
 #include "logging.h"
 #include "memory.h"
 
+/* Header preceding each allocation made by the wrappers */
+typedef union {
+  struct {
+    size_t size;
+    unsigned int objects;
+    MEM_Tag tag;
+  } info;
+  /* Make sure the memory following the header is aligned */
+  long double x;
+  long long y;
+  void *z;
+} AllocHeader;
+
+/* Usage of memory per subsystem, the last entry is the sum of all */
+typedef struct {
+  size_t bytes;
+  size_t peak_bytes;
+  unsigned long objects;
+  unsigned long peak_objects;
+} MemoryUsage;
+
+static MemoryUsage usage[MEM_TAGS + 1];
+
+static const char *tag_names[MEM_TAGS + 1] = {
+  "other", "clientlog", "ntp-timestamps", "sources", "sourcestats", "nts-keys",
+  "nts-ke-sessions", "address-filters", "keys", "total"
+};
+
+static void
+update_usage(MemoryUsage *u, long bytes, long objects)
+{
+  u->bytes += bytes;
+  u->objects += objects;
+  if (u->peak_bytes < u->bytes)
+    u->peak_bytes = u->bytes;
+  if (u->peak_objects < u->objects)
+    u->peak_objects = u->objects;
+}
+
+static void
+account(MEM_Tag tag, long bytes, long objects)
+{
+  update_usage(&usage[tag], bytes, objects);
+  update_usage(&usage[MEM_TAGS], bytes, objects);
+}
+
+static AllocHeader *
+get_header(void *ptr)
+{
+  return (AllocHeader *)ptr - 1;
+}
+
 void *
 Malloc(size_t size)
 {
-  void *r;
+  AllocHeader *r;
 
-  r = malloc(size);
-  if (!r && size)
+  if (size > SIZE_MAX - sizeof (*r))
     LOG_FATAL("Could not allocate memory");
 
-  return r;
+  r = malloc(sizeof (*r) + size);
+  if (!r)
+    LOG_FATAL("Could not allocate memory");
+
+  r->info.size = sizeof (*r) + size;
+  r->info.objects = 1;
+  r->info.tag = MEM_OTHER;
+  account(r->info.tag, r->info.size, r->info.objects);
+
+  return r + 1;
 }
 
 void *
 Realloc(void *ptr, size_t size)
 {
-  void *r;
+  AllocHeader *r;
+
+  if (!ptr)
+    return Malloc(size);
 
-  r = realloc(ptr, size);
-  if (!r && size)
+  if (size > SIZE_MAX - sizeof (*r))
     LOG_FATAL("Could not allocate memory");
 
-  return r;
+  r = get_header(ptr);
+  account(r->info.tag, -(long)r->info.size, 0);
+
+  r = realloc(r, sizeof (*r) + size);
+  if (!r)
+    LOG_FATAL("Could not allocate memory");
+
+  r->info.size = sizeof (*r) + size;
+  account(r->info.tag, r->info.size, 0);
+
+  return r + 1;
 }
 
 static size_t
@@ -83,11 +155,145 @@ Realloc2(void *ptr, size_t nmemb, size_t size)
 char *
 Strdup(const char *s)
 {
+  size_t length;
+  char *r;
+
+  length = strlen(s) + 1;
+  r = Malloc(length);
+  memcpy(r, s, length);
+
+  return r;
+}
+
+void
+Free(void *ptr)
+{
+  AllocHeader *r;
+
+  if (!ptr)
+    return;
+
+  r = get_header(ptr);
+  account(r->info.tag, -(long)r->info.size, -(long)r->info.objects);
+  free(r);
+}
+
+void
+MEM_SetTag(void *ptr, MEM_Tag tag, unsigned int objects)
+{
+  AllocHeader *r;
+
+  if (!ptr)
+    return;
+
+  assert(tag >= 0 && tag < MEM_TAGS);
+
+  r = get_header(ptr);
+  account(r->info.tag, -(long)r->info.size, -(long)r->info.objects);
+  r->info.tag = tag;
+  r->info.objects = objects;
+  account(r->info.tag, r->info.size, r->info.objects);
+}
+
+int
+MEM_GetReport(int index, RPT_MemoryReport *report)
+{
+  if (index < 0 || index > MEM_TAGS)
+    return 0;
+
+  snprintf(report->name, sizeof (report->name), "%s", tag_names[index]);
+  report->current_bytes = usage[index].bytes;
+  report->peak_bytes = usage[index].peak_bytes;
+  report->current_objects = usage[index].objects;
+  report->peak_objects = usage[index].peak_objects;
+
+  return 1;
+}
+
+/* Header of a block of cached objects */
+typedef union ObjectBlock {
+  union ObjectBlock *next;
+  /* Make sure the objects following the header are aligned */
+  long double x;
+  long long y;
+  void *z;
+} ObjectBlock;
+
+static size_t
+get_object_size(ObjectCache *cache)
+{
+  size_t size;
+
+  size = cache->object_size > sizeof (void *) ? cache->object_size : sizeof (void *);
+
+  /* Round up to keep all objects in the block aligned */
+  return (size + sizeof (ObjectBlock) - 1) / sizeof (ObjectBlock) * sizeof (ObjectBlock);
+}
+
+void *
+MallocObject(ObjectCache *cache)
+{
+  ObjectBlock *block;
+  size_t object_size;
+  unsigned int i;
+  char *objects;
   void *r;
 
-  r = strdup(s);
-  if (!r)
-    LOG_FATAL("Could not allocate memory");
+  if (!cache->free_objects) {
+    object_size = get_object_size(cache);
+    block = Malloc(sizeof (*block) + get_array_size(cache->objects_per_block, object_size));
+    MEM_SetTag(block, cache->tag, 0);
+    block->next = cache->block_list;
+    cache->block_list = block;
+    cache->blocks++;
+
+    /* Chain the new objects into the list of free objects */
+    objects = (char *)(block + 1);
+    for (i = 0; i < cache->objects_per_block; i++)
+      *(void **)(objects + i * object_size) =
+        i + 1 < cache->objects_per_block ? objects + (i + 1) * object_size : NULL;
+    cache->free_objects = objects;
+  }
+
+  r = cache->free_objects;
+  cache->free_objects = *(void **)r;
+  cache->objects++;
+  account(cache->tag, 0, 1);
 
   return r;
 }
+
+void
+FreeObject(ObjectCache *cache, void *object)
+{
+  ObjectBlock *block, *next;
+
+  if (!object)
+    return;
+
+  assert(cache->objects > 0);
+
+  *(void **)object = cache->free_objects;
+  cache->free_objects = object;
+  account(cache->tag, 0, -1);
+
+  if (--cache->objects > 0)
+    return;
+
+  /* Free all blocks when the last object is returned */
+  for (block = cache->block_list; block; block = next) {
+    next = block->next;
+    Free(block);
+  }
+
+  cache->block_list = NULL;
+  cache->free_objects = NULL;
+  cache->blocks = 0;
+}
+
+size_t
+GetObjectCacheSize(ObjectCache *cache)
+{
+  return cache->blocks * (sizeof (ObjectBlock) +
+                          cache->objects_per_block * get_object_size(cache));
+}
@@ -29,17 +29,64 @@
 
 #include "sysincl.h"
 
+#include "reports.h"
+
+/* Subsystems to which allocated memory is accounted */
+typedef enum {
+  MEM_OTHER,
+  MEM_CLIENTLOG,
+  MEM_NTP_TIMESTAMPS,
+  MEM_SOURCES,
+  MEM_SOURCESTATS,
+  MEM_NTS_KEYS,
+  MEM_NTS_KE_SESSIONS,
+  MEM_ADDRESS_FILTERS,
+  MEM_KEYS,
+  MEM_TAGS
+} MEM_Tag;
+
 /* Wrappers checking for errors */
 extern void *Malloc(size_t size);
 extern void *Realloc(void *ptr, size_t size);
 extern void *Malloc2(size_t nmemb, size_t size);
 extern void *Realloc2(void *ptr, size_t nmemb, size_t size);
 extern char *Strdup(const char *s);
+extern void Free(void *ptr);
 
 /* Convenient macros */
 #define MallocNew(T) ((T *) Malloc(sizeof(T)))
 #define MallocArray(T, n) ((T *) Malloc2(n, sizeof(T)))
 #define ReallocArray(T, n, x) ((T *) Realloc2((void *)(x), n, sizeof(T)))
-#define Free(x) free(x)
+
+/* Account memory allocated by the wrappers to a subsystem and set the
+   number of objects it holds (new allocations have MEM_OTHER and 1).
+   Reallocated memory keeps its tag and number of objects. */
+extern void MEM_SetTag(void *ptr, MEM_Tag tag, unsigned int objects);
+
+/* Get the current and peak usage of a subsystem, or all memory if the
+   index is equal to MEM_TAGS.  Return 0 if the index is invalid. */
+extern int MEM_GetReport(int index, RPT_MemoryReport *report);
+
+/* Cache of objects of one size, which are allocated in larger blocks to
+   keep them close to each other in memory and avoid frequent allocations
+   when objects are repeatedly created and destroyed.  The blocks are freed
+   when all objects are returned to the cache. */
+typedef struct {
+  size_t object_size;
+  MEM_Tag tag;
+  unsigned int objects_per_block;
+  unsigned int objects;
+  unsigned int blocks;
+  void *free_objects;
+  void *block_list;
+} ObjectCache;
+
+#define OBJECT_CACHE_INITIALISER(T, n, tag) { sizeof (T), (tag), (n), 0, 0, NULL, NULL }
+
+extern void *MallocObject(ObjectCache *cache);
+extern void FreeObject(ObjectCache *cache, void *object);
+
+/* Get the number of bytes allocated for objects of a cache */
+extern size_t GetObjectCacheSize(ObjectCache *cache);
 
 #endif /* GOT_MEMORY_H */
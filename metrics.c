@@ -0,0 +1,887 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  OpenMetrics endpoint serving reports of chronyd over HTTP.  The metrics
+  are rendered from the same reports as the responses to command requests
+  and the text is cached for the configured interval, which makes frequent
+  scrapes cheap.
+  */
+
+#include "config.h"
+
+#include "sysincl.h"
+
+#include "metrics.h"
+#include "clientlog.h"
+#include "conf.h"
+#include "logging.h"
+#include "memory.h"
+#include "ntp_signd.h"
+#include "ntp_sources.h"
+#include "refclock.h"
+#include "reference.h"
+#include "sched.h"
+#include "socket.h"
+#include "sources.h"
+#include "util.h"
+
+#define INVALID_SOCK_FD (-1)
+
+/* Maximum number of concurrent connections */
+#define MAX_CONNECTIONS 8
+
+/* Maximum length of a request including the headers */
+#define MAX_REQUEST_LENGTH 2048
+
+/* Maximum length of the header of a response */
+#define MAX_RESPONSE_HEADER_LENGTH 256
+
+/* Time after which an unfinished connection is closed */
+#define CONNECTION_TIMEOUT 5.0
+
+#define CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* Rendered metrics, which can be shared by multiple connections */
+typedef struct {
+  int refs;
+  size_t length;
+  size_t allocated;
+  char *data;
+} Page;
+
+typedef struct {
+  int sock_fd;
+  SCH_TimeoutID timeout_id;
+  char request[MAX_REQUEST_LENGTH];
+  unsigned int request_length;
+  char header[MAX_RESPONSE_HEADER_LENGTH];
+  unsigned int header_length;
+  Page *body;
+  size_t sent;
+} Connection;
+
+static Connection connections[MAX_CONNECTIONS];
+static int n_connections;
+
+/* Listening sockets */
+static int sock_fd4;
+static int sock_fd6;
+static int sock_fdu;
+
+/* Cached page and time when it was rendered */
+static Page *page;
+static double page_time;
+
+static int initialised = 0;
+
+/* ================================================== */
+
+static void accept_connection(int listening_fd, int event, void *arg);
+
+/* ================================================== */
+
+static int
+open_socket(int family)
+{
+  IPSockAddr local_addr;
+  const char *path;
+  int sock_fd;
+
+  switch (family) {
+    case IPADDR_INET4:
+    case IPADDR_INET6:
+      if (CNF_GetMetricsPort() == 0 || !SCK_IsIpFamilyEnabled(family))
+        return INVALID_SOCK_FD;
+
+      CNF_GetBindMetricsAddress(family, &local_addr.ip_addr);
+      local_addr.port = CNF_GetMetricsPort();
+
+      sock_fd = SCK_OpenTcpSocket(NULL, &local_addr, NULL, 0);
+      if (sock_fd < 0) {
+        LOG(LOGS_ERR, "Could not open metrics socket on %s",
+            UTI_IPSockAddrToString(&local_addr));
+        return INVALID_SOCK_FD;
+      }
+      break;
+    case IPADDR_UNSPEC:
+      path = CNF_GetBindMetricsPath();
+      if (!path)
+        return INVALID_SOCK_FD;
+
+      sock_fd = SCK_OpenUnixStreamSocket(NULL, path, SCK_FLAG_ALL_PERMISSIONS);
+      if (sock_fd < 0) {
+        LOG(LOGS_ERR, "Could not open metrics socket on %s", path);
+        return INVALID_SOCK_FD;
+      }
+      break;
+    default:
+      assert(0);
+  }
+
+  if (!SCK_ListenOnSocket(sock_fd, MAX_CONNECTIONS)) {
+    if (family == IPADDR_UNSPEC)
+      SCK_RemoveSocket(sock_fd);
+    SCK_CloseSocket(sock_fd);
+    return INVALID_SOCK_FD;
+  }
+
+  SCH_AddFileHandler(sock_fd, SCH_FILE_INPUT, accept_connection, NULL);
+
+  return sock_fd;
+}
+
+/* ================================================== */
+
+static void
+close_socket(int sock_fd, int remove)
+{
+  if (sock_fd == INVALID_SOCK_FD)
+    return;
+
+  SCH_RemoveFileHandler(sock_fd);
+  if (remove)
+    SCK_RemoveSocket(sock_fd);
+  SCK_CloseSocket(sock_fd);
+}
+
+/* ================================================== */
+
+static void
+release_page(Page *p)
+{
+  if (!p || --p->refs > 0)
+    return;
+
+  Free(p->data);
+  Free(p);
+}
+
+/* ================================================== */
+
+static void
+add_text(const char *format, ...)
+{
+  va_list ap;
+  int r;
+
+  while (1) {
+    va_start(ap, format);
+    r = vsnprintf(page->data + page->length, page->allocated - page->length, format, ap);
+    va_end(ap);
+
+    assert(r >= 0);
+
+    if (r < page->allocated - page->length) {
+      page->length += r;
+      return;
+    }
+
+    page->allocated = 2 * page->allocated + r;
+    page->data = Realloc(page->data, page->allocated);
+  }
+}
+
+/* ================================================== */
+
+static void
+add_family(const char *name, const char *type, const char *help)
+{
+  add_text("# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+/* ================================================== */
+
+/* Copy a string to be used as a label value and escape the special
+   characters */
+
+static void
+escape_label_value(const char *value, char *buf, size_t len)
+{
+  size_t i, j;
+
+  assert(len > 0);
+
+  for (i = j = 0; value[i] != '\0' && j + 2 < len; i++) {
+    switch (value[i]) {
+      case '"':
+      case '\\':
+        buf[j++] = '\\';
+        buf[j++] = value[i];
+        break;
+      case '\n':
+        buf[j++] = '\\';
+        buf[j++] = 'n';
+        break;
+      default:
+        buf[j++] = value[i];
+    }
+  }
+
+  buf[j] = '\0';
+}
+
+/* ================================================== */
+
+static void
+add_tracking(void)
+{
+  RPT_TrackingReport report;
+  char name[64];
+
+  REF_GetTrackingReport(&report);
+
+  escape_label_value(report.ip_addr.family != IPADDR_UNSPEC ?
+                       UTI_IPToString(&report.ip_addr) : UTI_RefidToString(report.ref_id),
+                     name, sizeof (name));
+
+  add_family("chrony_tracking_reference", "info", "Current reference");
+  add_text("chrony_tracking_reference_info{reference=\"%s\",ref_id=\"%08"PRIX32"\"} 1\n",
+           name, report.ref_id);
+
+  add_family("chrony_tracking_stratum", "gauge", "Stratum of the local clock");
+  add_text("chrony_tracking_stratum %d\n", report.stratum);
+  add_family("chrony_tracking_leap_status", "gauge",
+             "Leap status (0 normal, 1 insert, 2 delete, 3 unsynchronised)");
+  add_text("chrony_tracking_leap_status %d\n", (int)report.leap_status);
+  add_family("chrony_tracking_reference_time_seconds", "gauge",
+             "Time of the last update of the clock");
+  add_text("chrony_tracking_reference_time_seconds %.9f\n",
+           UTI_TimespecToDouble(&report.ref_time));
+  add_family("chrony_tracking_system_time_offset_seconds", "gauge",
+             "Remaining correction of the system clock");
+  add_text("chrony_tracking_system_time_offset_seconds %.9e\n", report.current_correction);
+  add_family("chrony_tracking_last_offset_seconds", "gauge",
+             "Offset of the last update");
+  add_text("chrony_tracking_last_offset_seconds %.9e\n", report.last_offset);
+  add_family("chrony_tracking_rms_offset_seconds", "gauge",
+             "Long-term average of the offset");
+  add_text("chrony_tracking_rms_offset_seconds %.9e\n", report.rms_offset);
+  add_family("chrony_tracking_frequency_ppm", "gauge",
+             "Frequency offset of the system clock");
+  add_text("chrony_tracking_frequency_ppm %.9e\n", report.freq_ppm);
+  add_family("chrony_tracking_residual_frequency_ppm", "gauge",
+             "Residual frequency of the reference");
+  add_text("chrony_tracking_residual_frequency_ppm %.9e\n", report.resid_freq_ppm);
+  add_family("chrony_tracking_skew_ppm", "gauge",
+             "Estimated error bound of the frequency");
+  add_text("chrony_tracking_skew_ppm %.9e\n", report.skew_ppm);
+  add_family("chrony_tracking_root_delay_seconds", "gauge",
+             "Total network path delay to the stratum-1 server");
+  add_text("chrony_tracking_root_delay_seconds %.9e\n", report.root_delay);
+  add_family("chrony_tracking_root_dispersion_seconds", "gauge",
+             "Total dispersion accumulated to the stratum-1 server");
+  add_text("chrony_tracking_root_dispersion_seconds %.9e\n", report.root_dispersion);
+  add_family("chrony_tracking_update_interval_seconds", "gauge",
+             "Interval between the last two updates of the clock");
+  add_text("chrony_tracking_update_interval_seconds %.9e\n", report.last_update_interval);
+}
+
+/* ================================================== */
+
+static const char *
+get_source_mode(RPT_SourceReport *report)
+{
+  switch (report->mode) {
+    case RPT_NTP_CLIENT:
+      return "client";
+    case RPT_NTP_PEER:
+      return "peer";
+    case RPT_LOCAL_REFERENCE:
+      return "refclock";
+    default:
+      return "unknown";
+  }
+}
+
+/* ================================================== */
+
+static const char *
+get_source_state(RPT_SourceReport *report)
+{
+  switch (report->state) {
+    case RPT_NONSELECTABLE:
+      return "nonselectable";
+    case RPT_FALSETICKER:
+      return "falseticker";
+    case RPT_JITTERY:
+      return "jittery";
+    case RPT_SELECTABLE:
+      return "selectable";
+    case RPT_UNSELECTED:
+      return "unselected";
+    case RPT_SELECTED:
+      return "selected";
+    default:
+      return "unknown";
+  }
+}
+
+
+/* ================================================== */
+
+typedef struct {
+  char name[64];
+  RPT_SourceReport report;
+  RPT_SourcestatsReport stats;
+  int have_stats;
+} SourceData;
+
+static void
+add_sources(void)
+{
+  SourceData *sources, *sd;
+  struct timespec now;
+  int i, j, n_sources;
+
+  SCH_GetLastEventTime(&now, NULL, NULL);
+
+  /* Collect the reports first as the samples are grouped by metric */
+  n_sources = SRC_ReadNumberOfSources();
+  sources = MallocArray(SourceData, n_sources);
+
+  for (i = j = 0; i < n_sources; i++) {
+    sd = &sources[j];
+
+    if (!SRC_ReportSource(i, &sd->report, &now))
+      continue;
+
+    switch (SRC_GetType(i)) {
+      case SRC_NTP:
+        NSR_ReportSource(&sd->report, &now);
+        escape_label_value(UTI_IPToString(&sd->report.ip_addr), sd->name, sizeof (sd->name));
+        break;
+      case SRC_REFCLOCK:
+        RCL_ReportSource(&sd->report, &now);
+        escape_label_value(UTI_RefidToString(sd->report.ip_addr.addr.in4),
+                           sd->name, sizeof (sd->name));
+        break;
+      default:
+        continue;
+    }
+
+    sd->have_stats = SRC_ReportSourcestats(i, &sd->stats, &now);
+    j++;
+  }
+
+  n_sources = j;
+
+  add_family("chrony_source", "info", "Mode and selection state of the source");
+  for (i = 0; i < n_sources; i++)
+    add_text("chrony_source_info{source=\"%s\",mode=\"%s\",state=\"%s\"} 1\n",
+             sources[i].name, get_source_mode(&sources[i].report),
+             get_source_state(&sources[i].report));
+
+  add_family("chrony_source_stratum", "gauge", "Stratum of the source");
+  for (i = 0; i < n_sources; i++)
+    add_text("chrony_source_stratum{source=\"%s\"} %d\n",
+             sources[i].name, sources[i].report.stratum);
+
+  add_family("chrony_source_poll_interval_seconds", "gauge", "Polling interval of the source");
+  for (i = 0; i < n_sources; i++)
+    add_text("chrony_source_poll_interval_seconds{source=\"%s\"} %.9g\n",
+             sources[i].name, UTI_Log2ToDouble(sources[i].report.poll));
+
+  add_family("chrony_source_reachability", "gauge",
+             "Reachability register of the source (8 bits)");
+  for (i = 0; i < n_sources; i++)
+    add_text("chrony_source_reachability{source=\"%s\"} %d\n",
+             sources[i].name, sources[i].report.reachability);
+
+  add_family("chrony_source_last_sample_age_seconds", "gauge",
+             "Time since the last sample of the source");
+  for (i = 0; i < n_sources; i++)
+    add_text("chrony_source_last_sample_age_seconds{source=\"%s\"} %lu\n",
+             sources[i].name, sources[i].report.latest_meas_ago);
+
+  add_family("chrony_source_last_sample_offset_seconds", "gauge",
+             "Offset of the last sample of the source");
+  for (i = 0; i < n_sources; i++)
+    add_text("chrony_source_last_sample_offset_seconds{source=\"%s\"} %.9e\n",
+             sources[i].name, sources[i].report.latest_meas);
+
+  add_family("chrony_source_last_sample_error_seconds", "gauge",
+             "Error bound of the last sample of the source");
+  for (i = 0; i < n_sources; i++)
+    add_text("chrony_source_last_sample_error_seconds{source=\"%s\"} %.9e\n",
+             sources[i].name, sources[i].report.latest_meas_err);
+
+  add_family("chrony_source_samples", "gauge", "Number of samples of the source");
+  for (i = 0; i < n_sources; i++) {
+    if (sources[i].have_stats)
+      add_text("chrony_source_samples{source=\"%s\"} %lu\n",
+               sources[i].name, sources[i].stats.n_samples);
+  }
+
+  add_family("chrony_source_span_seconds", "gauge",
+             "Interval covered by the samples of the source");
+  for (i = 0; i < n_sources; i++) {
+    if (sources[i].have_stats)
+      add_text("chrony_source_span_seconds{source=\"%s\"} %lu\n",
+               sources[i].name, sources[i].stats.span_seconds);
+  }
+
+  add_family("chrony_source_frequency_ppm", "gauge",
+             "Estimated residual frequency of the source");
+  for (i = 0; i < n_sources; i++) {
+    if (sources[i].have_stats)
+      add_text("chrony_source_frequency_ppm{source=\"%s\"} %.9e\n",
+               sources[i].name, sources[i].stats.resid_freq_ppm);
+  }
+
+  add_family("chrony_source_frequency_skew_ppm", "gauge",
+             "Estimated error bound of the frequency of the source");
+  for (i = 0; i < n_sources; i++) {
+    if (sources[i].have_stats)
+      add_text("chrony_source_frequency_skew_ppm{source=\"%s\"} %.9e\n",
+               sources[i].name, sources[i].stats.skew_ppm);
+  }
+
+  add_family("chrony_source_offset_seconds", "gauge", "Estimated offset of the source");
+  for (i = 0; i < n_sources; i++) {
+    if (sources[i].have_stats)
+      add_text("chrony_source_offset_seconds{source=\"%s\"} %.9e\n",
+               sources[i].name, sources[i].stats.est_offset);
+  }
+
+  add_family("chrony_source_std_dev_seconds", "gauge",
+             "Estimated standard deviation of the samples of the source");
+  for (i = 0; i < n_sources; i++) {
+    if (sources[i].have_stats)
+      add_text("chrony_source_std_dev_seconds{source=\"%s\"} %.9e\n",
+               sources[i].name, sources[i].stats.sd);
+  }
+
+  Free(sources);
+}
+
+/* ================================================== */
+
+static void
+add_counter(const char *name, const char *help, uint32_t value)
+{
+  add_family(name, "counter", help);
+  add_text("%s_total %"PRIu32"\n", name, value);
+}
+
+/* ================================================== */
+
+static void
+add_gauge(const char *name, const char *help, const char *format, ...)
+{
+  char buf[64];
+  va_list ap;
+
+  va_start(ap, format);
+  vsnprintf(buf, sizeof (buf), format, ap);
+  va_end(ap);
+
+  add_family(name, "gauge", help);
+  add_text("%s %s\n", name, buf);
+}
+
+/* ================================================== */
+
+static void
+add_server_stats(void)
+{
+  RPT_ServerStatsReport report;
+
+  CLG_GetServerStatsReport(&report);
+  NSD_GetServerStatsReport(&report);
+
+  add_counter("chrony_server_ntp_requests", "NTP requests received", report.ntp_hits);
+  add_counter("chrony_server_ntp_dropped_requests", "NTP requests dropped",
+              report.ntp_drops);
+  add_counter("chrony_server_ntp_authenticated_requests", "Authenticated NTP requests",
+              report.ntp_auth_hits);
+  add_counter("chrony_server_ntp_interleaved_requests", "NTP requests in interleaved mode",
+              report.ntp_interleaved_hits);
+  add_counter("chrony_server_nts_ke_connections", "NTS-KE connections accepted",
+              report.nke_hits);
+  add_counter("chrony_server_nts_ke_dropped_connections", "NTS-KE connections dropped",
+              report.nke_drops);
+  add_counter("chrony_server_command_requests", "Command requests received",
+              report.cmd_hits);
+  add_counter("chrony_server_command_dropped_requests", "Command requests dropped",
+              report.cmd_drops);
+  add_counter("chrony_server_signd_requests", "Requests sent to ntp_signd",
+              report.signd_requests);
+  add_counter("chrony_server_signd_dropped_requests", "Requests dropped before ntp_signd",
+              report.signd_drops);
+  add_counter("chrony_server_signd_timeouts", "Requests to ntp_signd timed out",
+              report.signd_timeouts);
+  add_gauge("chrony_server_ntp_timestamps", "Timestamps saved for interleaved mode",
+            "%"PRIu32, report.ntp_timestamps);
+  add_gauge("chrony_server_ntp_timestamps_span_seconds",
+            "Interval covered by the saved timestamps", "%"PRIu32, report.ntp_span_seconds);
+}
+
+/* ================================================== */
+
+static void
+add_clientlog(void)
+{
+  RPT_ServerStatsReport report;
+  int records;
+
+  CLG_GetServerStatsReport(&report);
+
+  records = CLG_GetNumberOfIndices();
+  if (records >= 0)
+    add_gauge("chrony_clientlog_records", "Records allocated in the client log",
+              "%d", records);
+  add_counter("chrony_clientlog_dropped_records", "Client records dropped from the log",
+              report.log_drops);
+}
+
+/* ================================================== */
+
+static void
+add_memory(void)
+{
+  RPT_MemoryReport report;
+  int i;
+
+  add_family("chrony_memory_bytes", "gauge", "Memory allocated by subsystem");
+  for (i = 0; i < MEM_TAGS; i++) {
+    if (MEM_GetReport(i, &report))
+      add_text("chrony_memory_bytes{subsystem=\"%s\"} %lu\n",
+               report.name, (unsigned long)report.current_bytes);
+  }
+
+  add_family("chrony_memory_objects", "gauge", "Objects allocated by subsystem");
+  for (i = 0; i < MEM_TAGS; i++) {
+    if (MEM_GetReport(i, &report))
+      add_text("chrony_memory_objects{subsystem=\"%s\"} %lu\n",
+               report.name, report.current_objects);
+  }
+}
+
+/* ================================================== */
+
+/* Get the rendered metrics, updating them if the cached copy is older
+   than the configured interval */
+
+static Page *
+get_page(void)
+{
+  double now;
+
+  now = SCH_GetLastEventMonoTime();
+
+  if (page && now - page_time < CNF_GetMetricsInterval() && now >= page_time)
+    return page;
+
+  /* The old page may still be sent to some clients */
+  release_page(page);
+
+  page = MallocNew(Page);
+  page->refs = 1;
+  page->length = 0;
+  page->allocated = 4096;
+  page->data = Malloc(page->allocated);
+  page_time = now;
+
+  add_tracking();
+  add_sources();
+  add_server_stats();
+  add_clientlog();
+  add_memory();
+  add_text("# EOF\n");
+
+  return page;
+}
+
+/* ================================================== */
+
+/* Enable or disable accepting of new connections.  Waiting connections
+   are kept in the backlog of the listening sockets. */
+
+static void
+set_accepting(int enable)
+{
+  if (sock_fd4 != INVALID_SOCK_FD)
+    SCH_SetFileHandlerEvent(sock_fd4, SCH_FILE_INPUT, enable);
+  if (sock_fd6 != INVALID_SOCK_FD)
+    SCH_SetFileHandlerEvent(sock_fd6, SCH_FILE_INPUT, enable);
+  if (sock_fdu != INVALID_SOCK_FD)
+    SCH_SetFileHandlerEvent(sock_fdu, SCH_FILE_INPUT, enable);
+}
+
+/* ================================================== */
+
+static void
+close_connection(Connection *conn)
+{
+  SCH_RemoveFileHandler(conn->sock_fd);
+  SCK_CloseSocket(conn->sock_fd);
+  SCH_RemoveTimeout(conn->timeout_id);
+  release_page(conn->body);
+
+  conn->sock_fd = INVALID_SOCK_FD;
+  conn->timeout_id = 0;
+  conn->body = NULL;
+
+  if (n_connections-- == MAX_CONNECTIONS)
+    set_accepting(1);
+}
+
+/* ================================================== */
+
+static void
+handle_timeout(void *arg)
+{
+  Connection *conn = arg;
+
+  conn->timeout_id = 0;
+
+  DEBUG_LOG("Metrics connection fd=%d timed out", conn->sock_fd);
+  close_connection(conn);
+}
+
+/* ================================================== */
+
+/* Send the response, return 0 if the connection should be closed */
+
+static int
+send_response(Connection *conn)
+{
+  size_t length, body_length;
+  const char *data;
+  int r;
+
+  body_length = conn->body ? conn->body->length : 0;
+
+  while (conn->sent < conn->header_length + body_length) {
+    if (conn->sent < conn->header_length) {
+      data = conn->header + conn->sent;
+      length = conn->header_length - conn->sent;
+    } else {
+      data = conn->body->data + (conn->sent - conn->header_length);
+      length = body_length - (conn->sent - conn->header_length);
+    }
+
+    r = SCK_Send(conn->sock_fd, data, MIN(length, INT_MAX), 0);
+    if (r < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+
+    conn->sent += r;
+  }
+
+  return 0;
+}
+
+/* ================================================== */
+
+static void
+prepare_response(Connection *conn, int status, const char *reason, int head)
+{
+  Page *body = NULL;
+  int r;
+
+  if (status == 200)
+    body = get_page();
+
+  r = snprintf(conn->header, sizeof (conn->header),
+               "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %lu\r\n"
+               "Connection: close\r\n\r\n",
+               status, reason, body ? CONTENT_TYPE : "text/plain",
+               body ? (unsigned long)body->length : 0UL);
+  assert(r > 0 && r < sizeof (conn->header));
+
+  conn->header_length = r;
+  conn->sent = 0;
+
+  if (body && !head) {
+    conn->body = body;
+    body->refs++;
+  }
+}
+
+/* ================================================== */
+
+/* Check if a complete request was received and prepare the response */
+
+static int
+process_request(Connection *conn)
+{
+  char *method, *path, *version, *end;
+
+  conn->request[conn->request_length] = '\0';
+
+  if (!strstr(conn->request, "\r\n\r\n") && !strstr(conn->request, "\n\n")) {
+    if (conn->request_length + 1 < sizeof (conn->request))
+      return 0;
+    prepare_response(conn, 400, "Bad Request", 0);
+    return 1;
+  }
+
+  end = conn->request + strcspn(conn->request, "\r\n");
+  *end = '\0';
+
+  method = conn->request;
+  path = strchr(method, ' ');
+  version = path ? strchr(path + 1, ' ') : NULL;
+
+  if (!path || !version || strncmp(version + 1, "HTTP/1.", 7) != 0) {
+    prepare_response(conn, 400, "Bad Request", 0);
+    return 1;
+  }
+
+  *path++ = '\0';
+  *version = '\0';
+
+  /* Ignore the query */
+  path[strcspn(path, "?")] = '\0';
+
+  DEBUG_LOG("Metrics request %s %s fd=%d", method, path, conn->sock_fd);
+
+  if (strcmp(method, "GET") != 0 && strcmp(method, "HEAD") != 0)
+    prepare_response(conn, 405, "Method Not Allowed", 0);
+  else if (strcmp(path, "/metrics") != 0 && strcmp(path, "/") != 0)
+    prepare_response(conn, 404, "Not Found", 0);
+  else
+    prepare_response(conn, 200, "OK", strcmp(method, "HEAD") == 0);
+
+  return 1;
+}
+
+/* ================================================== */
+
+static void
+handle_connection(int fd, int event, void *arg)
+{
+  Connection *conn = arg;
+  int r;
+
+  if (event == SCH_FILE_INPUT) {
+    r = SCK_Receive(conn->sock_fd, conn->request + conn->request_length,
+                    sizeof (conn->request) - conn->request_length - 1, 0);
+    if (r <= 0) {
+      if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+      close_connection(conn);
+      return;
+    }
+
+    conn->request_length += r;
+
+    if (!process_request(conn))
+      return;
+
+    /* Ignore anything following the request */
+    SCH_SetFileHandlerEvent(conn->sock_fd, SCH_FILE_INPUT, 0);
+  }
+
+  if (!send_response(conn)) {
+    close_connection(conn);
+    return;
+  }
+
+  SCH_SetFileHandlerEvent(conn->sock_fd, SCH_FILE_OUTPUT, 1);
+}
+
+/* ================================================== */
+
+static void
+accept_connection(int listening_fd, int event, void *arg)
+{
+  Connection *conn;
+  IPSockAddr addr;
+  int i, sock_fd;
+
+  sock_fd = SCK_AcceptConnection(listening_fd, &addr);
+  if (sock_fd < 0)
+    return;
+
+  for (i = 0, conn = NULL; i < MAX_CONNECTIONS; i++) {
+    if (connections[i].sock_fd == INVALID_SOCK_FD) {
+      conn = &connections[i];
+      break;
+    }
+  }
+
+  assert(conn);
+
+  if (++n_connections == MAX_CONNECTIONS)
+    set_accepting(0);
+
+  conn->sock_fd = sock_fd;
+  conn->request_length = 0;
+  conn->header_length = 0;
+  conn->body = NULL;
+  conn->sent = 0;
+  conn->timeout_id = SCH_AddTimeoutByDelay(CONNECTION_TIMEOUT, handle_timeout, conn);
+
+  SCH_AddFileHandler(sock_fd, SCH_FILE_INPUT, handle_connection, conn);
+
+  DEBUG_LOG("Accepted metrics connection fd=%d", sock_fd);
+}
+
+/* ================================================== */
+
+void
+MET_Initialise(void)
+{
+  int i;
+
+  for (i = 0; i < MAX_CONNECTIONS; i++) {
+    connections[i].sock_fd = INVALID_SOCK_FD;
+    connections[i].timeout_id = 0;
+    connections[i].body = NULL;
+  }
+
+  n_connections = 0;
+  page = NULL;
+  page_time = 0.0;
+
+  sock_fd4 = open_socket(IPADDR_INET4);
+  sock_fd6 = open_socket(IPADDR_INET6);
+  sock_fdu = open_socket(IPADDR_UNSPEC);
+
+  initialised = 1;
+}
+
+/* ================================================== */
+
+void
+MET_Finalise(void)
+{
+  int i;
+
+  if (!initialised)
+    return;
+
+  for (i = 0; i < MAX_CONNECTIONS; i++) {
+    if (connections[i].sock_fd != INVALID_SOCK_FD)
+      close_connection(&connections[i]);
+  }
+
+  close_socket(sock_fd4, 0);
+  close_socket(sock_fd6, 0);
+  close_socket(sock_fdu, 1);
+
+  release_page(page);
+  page = NULL;
+
+  initialised = 0;
+}
@@ -29,6 +29,7 @@
 #include "sysincl.h"
 
 #include "nameserv_async.h"
+#include "conf.h"
 #include "logging.h"
 #include "memory.h"
 #include "privops.h"
@@ -47,53 +48,235 @@ struct DNS_Async_Instance {
   DNS_NameResolveHandler handler;
   void *arg;
 
-  pthread_t thread;
-  int pipe[2];
+  struct DNS_Async_Instance *next;
 };
 
-static pthread_mutex_t privops_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Cached result of a successful resolving */
+struct CacheEntry {
+  char *name;
+  IPAddr addresses[DNS_MAX_ADDRESSES];
+  double expiry;
+};
+
+/* Number of cached results and how long they can be used.  The system
+   resolver doesn't provide TTL of the records, so a short fixed interval
+   is used to only avoid repeated requests for the same name (e.g. multiple
+   pool directives or refresh of many sources using the same name). */
+#define MAX_CACHE_ENTRIES 16
+#define CACHE_EXPIRY 10.0
+
+/* Time after which an idle thread exits */
+#define IDLE_THREAD_TIMEOUT 30
+
+/* Queue of requests waiting for a thread and a list of results waiting
+   for the main thread, protected by the queue lock */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static struct DNS_Async_Instance *requests_head = NULL;
+static struct DNS_Async_Instance **requests_tail = &requests_head;
+static struct DNS_Async_Instance *results_head = NULL;
+static struct DNS_Async_Instance **results_tail = &results_head;
+static int n_requests = 0;
+static int n_threads = 0;
+static int n_idle_threads = 0;
+static int notified = 0;
+
+/* Pipe used to wake up the main thread when results are ready */
+static int notify_pipe[2] = {-1, -1};
+
+/* Cache accessed only from the main thread */
+static struct CacheEntry cache[MAX_CACHE_ENTRIES];
+
+/* ================================================== */
+
+static void
+queue_result(struct DNS_Async_Instance *inst)
+{
+  inst->next = NULL;
+  *results_tail = inst;
+  results_tail = &inst->next;
+
+  /* Wake up the main thread, one byte in the pipe is enough for
+     any number of results */
+  if (!notified) {
+    notified = 1;
+    if (write(notify_pipe[1], "", 1) < 0)
+      ;
+  }
+}
 
 /* ================================================== */
 
 static void *
-start_resolving(void *anything)
+run_thread(void *anything)
 {
-  struct DNS_Async_Instance *inst = (struct DNS_Async_Instance *)anything;
+  struct DNS_Async_Instance *inst;
+  struct timespec timeout;
+
+  pthread_mutex_lock(&queue_lock);
+
+  while (1) {
+    if (!requests_head) {
+      clock_gettime(CLOCK_REALTIME, &timeout);
+      timeout.tv_sec += IDLE_THREAD_TIMEOUT;
+
+      n_idle_threads++;
+      while (!requests_head) {
+        if (pthread_cond_timedwait(&queue_cond, &queue_lock, &timeout) != 0)
+          break;
+      }
+      n_idle_threads--;
 
-  pthread_mutex_lock(&privops_lock);
-  inst->status = PRV_Name2IPAddress(inst->name, inst->addresses, DNS_MAX_ADDRESSES);
-  pthread_mutex_unlock(&privops_lock);
+      if (!requests_head)
+        break;
+    }
 
-  /* Notify the main thread that the result is ready */
-  if (write(inst->pipe[1], "", 1) < 0)
-    ;
+    inst = requests_head;
+    requests_head = inst->next;
+    if (!requests_head)
+      requests_tail = &requests_head;
+    n_requests--;
+
+    pthread_mutex_unlock(&queue_lock);
+
+    inst->status = PRV_Name2IPAddress(inst->name, inst->addresses, DNS_MAX_ADDRESSES);
+
+    pthread_mutex_lock(&queue_lock);
+
+    queue_result(inst);
+  }
+
+  n_threads--;
+
+  pthread_mutex_unlock(&queue_lock);
 
   return NULL;
 }
 
 /* ================================================== */
 
+static void
+update_cache(struct DNS_Async_Instance *inst)
+{
+  struct CacheEntry *entry;
+  double now;
+  int i;
+
+  now = SCH_GetLastEventMonoTime();
+
+  /* Replace an entry with the same name, or the oldest entry */
+  for (i = 0, entry = &cache[0]; i < MAX_CACHE_ENTRIES; i++) {
+    if (cache[i].name && strcmp(cache[i].name, inst->name) == 0) {
+      entry = &cache[i];
+      break;
+    }
+    if (cache[i].expiry < entry->expiry)
+      entry = &cache[i];
+  }
+
+  if (!entry->name || strcmp(entry->name, inst->name) != 0) {
+    Free(entry->name);
+    entry->name = Strdup(inst->name);
+  }
+
+  memcpy(entry->addresses, inst->addresses, sizeof (entry->addresses));
+  entry->expiry = now + CACHE_EXPIRY;
+}
+
+/* ================================================== */
+
+static int
+lookup_cache(struct DNS_Async_Instance *inst)
+{
+  double now;
+  int i;
+
+  now = SCH_GetLastEventMonoTime();
+
+  for (i = 0; i < MAX_CACHE_ENTRIES; i++) {
+    if (!cache[i].name || cache[i].expiry < now || strcmp(cache[i].name, inst->name) != 0)
+      continue;
+
+    DEBUG_LOG("Using cached addresses of %s", inst->name);
+
+    inst->status = DNS_Success;
+    memcpy(inst->addresses, cache[i].addresses, sizeof (inst->addresses));
+    return 1;
+  }
+
+  return 0;
+}
+
+/* ================================================== */
+
+void
+DNS_FlushAsyncCache(void)
+{
+  int i;
+
+  for (i = 0; i < MAX_CACHE_ENTRIES; i++) {
+    Free(cache[i].name);
+    cache[i].name = NULL;
+    cache[i].expiry = 0.0;
+  }
+}
+
+/* ================================================== */
+
 static void
 end_resolving(int fd, int event, void *anything)
 {
-  struct DNS_Async_Instance *inst = (struct DNS_Async_Instance *)anything;
+  struct DNS_Async_Instance *inst, *next;
+  char c;
   int i;
 
-  if (pthread_join(inst->thread, NULL)) {
-    LOG_FATAL("pthread_join() failed");
+  /* Take all results which are ready */
+  pthread_mutex_lock(&queue_lock);
+
+  if (notified) {
+    if (read(notify_pipe[0], &c, 1) < 0)
+      ;
+    notified = 0;
   }
 
-  SCH_RemoveFileHandler(inst->pipe[0]);
-  close(inst->pipe[0]);
-  close(inst->pipe[1]);
+  inst = results_head;
+  results_head = NULL;
+  results_tail = &results_head;
+
+  pthread_mutex_unlock(&queue_lock);
+
+  for (; inst; inst = next) {
+    next = inst->next;
 
-  for (i = 0; inst->status == DNS_Success && i < DNS_MAX_ADDRESSES &&
-              inst->addresses[i].family != IPADDR_UNSPEC; i++)
-    ;
+    for (i = 0; inst->status == DNS_Success && i < DNS_MAX_ADDRESSES &&
+                inst->addresses[i].family != IPADDR_UNSPEC; i++)
+      ;
 
-  (inst->handler)(inst->status, i, inst->addresses, inst->arg);
+    if (inst->status == DNS_Success && i > 0)
+      update_cache(inst);
 
-  Free(inst);
+    (inst->handler)(inst->status, i, inst->addresses, inst->arg);
+
+    Free(inst);
+  }
+}
+
+/* ================================================== */
+
+static void
+open_notify_pipe(void)
+{
+  if (notify_pipe[0] >= 0)
+    return;
+
+  if (pipe(notify_pipe)) {
+    LOG_FATAL("pipe() failed");
+  }
+
+  UTI_FdSetCloexec(notify_pipe[0]);
+  UTI_FdSetCloexec(notify_pipe[1]);
+
+  SCH_AddFileHandler(notify_pipe[0], SCH_FILE_INPUT, end_resolving, NULL);
 }
 
 /* ================================================== */
@@ -102,25 +285,50 @@ void
 DNS_Name2IPAddressAsync(const char *name, DNS_NameResolveHandler handler, void *anything)
 {
   struct DNS_Async_Instance *inst;
+  pthread_t thread;
+  int cached;
 
   inst = MallocNew(struct DNS_Async_Instance);
   inst->name = name;
   inst->handler = handler;
   inst->arg = anything;
   inst->status = DNS_Failure;
+  inst->next = NULL;
 
-  if (pipe(inst->pipe)) {
-    LOG_FATAL("pipe() failed");
-  }
+  open_notify_pipe();
+
+  cached = lookup_cache(inst);
 
-  UTI_FdSetCloexec(inst->pipe[0]);
-  UTI_FdSetCloexec(inst->pipe[1]);
+  pthread_mutex_lock(&queue_lock);
+
+  /* Even cached results are delivered from the main loop to not call
+     the handler before this function returns */
+  if (cached) {
+    queue_result(inst);
+    pthread_mutex_unlock(&queue_lock);
+    return;
+  }
 
-  if (pthread_create(&inst->thread, NULL, start_resolving, inst)) {
-    LOG_FATAL("pthread_create() failed");
+  *requests_tail = inst;
+  requests_tail = &inst->next;
+  n_requests++;
+
+  /* Wake up an idle thread, and start a new thread if there are more
+     waiting requests than idle threads (including threads which were
+     woken up, but didn't take a request yet) and the limit is not
+     reached */
+  if (n_idle_threads > 0)
+    pthread_cond_signal(&queue_cond);
+
+  if (n_requests > n_idle_threads && n_threads < MAX(1, CNF_GetResolverThreads())) {
+    if (pthread_create(&thread, NULL, run_thread, NULL) ||
+        pthread_detach(thread)) {
+      LOG_FATAL("pthread_create() failed");
+    }
+    n_threads++;
   }
 
-  SCH_AddFileHandler(inst->pipe[0], SCH_FILE_INPUT, end_resolving, inst);
+  pthread_mutex_unlock(&queue_lock);
 }
 
 /* ================================================== */
@@ -37,4 +37,8 @@ typedef void (*DNS_NameResolveHandler)(DNS_Status status, int n_addrs, IPAddr *i
    called when the result is available. */
 extern void DNS_Name2IPAddressAsync(const char *name, DNS_NameResolveHandler handler, void *anything);
 
+/* Drop cached results of previous requests to get new addresses of all
+   names in following requests */
+extern void DNS_FlushAsyncCache(void);
+
 #endif
@@ -47,6 +47,9 @@ struct NAU_Instance_Record {
   NNC_Instance nts;             /* Client NTS state */
 };
 
+/* Cache of instance records */
+static ObjectCache instances = OBJECT_CACHE_INITIALISER(struct NAU_Instance_Record, 64, MEM_SOURCES);
+
 /* ================================================== */
 
 static int
@@ -109,7 +112,7 @@ create_instance(NTP_AuthMode mode)
 {
   NAU_Instance instance;
 
-  instance = MallocNew(struct NAU_Instance_Record);
+  instance = MallocObject(&instances);
   instance->mode = mode;
   instance->key_id = INACTIVE_AUTHKEY;
   instance->nts = NULL;
@@ -164,7 +167,7 @@ NAU_DestroyInstance(NAU_Instance instance)
 {
   if (instance->mode == NTP_AUTH_NTS)
     NNC_DestroyInstance(instance->nts);
-  Free(instance);
+  FreeObject(&instances, instance);
 }
 
 /* ================================================== */
@@ -384,3 +387,11 @@ NAU_GetReport(NAU_Instance instance, RPT_AuthReport *report)
       assert(0);
   }
 }
+
+/* ================================================== */
+
+size_t
+NAU_GetMemorySize(NAU_Instance instance)
+{
+  return sizeof (*instance) + (instance->nts ? NNC_GetMemorySize(instance->nts) : 0);
+}
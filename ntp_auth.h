@@ -81,4 +81,7 @@ extern void NAU_DumpData(NAU_Instance instance);
 /* Provide a report about the current authentication state */
 extern void NAU_GetReport(NAU_Instance instance, RPT_AuthReport *report);
 
+/* Get the number of bytes allocated for the instance */
+extern size_t NAU_GetMemorySize(NAU_Instance instance);
+
 #endif
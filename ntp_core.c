@@ -47,6 +47,7 @@
 #include "logging.h"
 #include "addrfilt.h"
 #include "clientlog.h"
+#include "cmdmon.h"
 
 /* ================================================== */
 
@@ -84,6 +85,7 @@ struct NCR_Instance_Record {
   int auto_burst;               /* If 1, initiate a burst on each poll */
   int auto_offline;             /* If 1, automatically go offline when requests
                                    cannot be sent */
+  int fast_start;               /* If 1, the initial burst uses short intervals */
 
   int local_poll;               /* Log2 of polling interval at our end */
   int remote_poll;              /* Log2 of server/peer's polling interval (recovered
@@ -207,6 +209,10 @@ struct NCR_Instance_Record {
   int burst_good_samples_to_go;
   int burst_total_samples_to_go;
 
+  /* Slew epoch of the local clock to which the local timestamps and
+     samples in the filter correspond */
+  LCL_SlewEpoch slew_epoch;
+
   /* Report from last valid response */
   RPT_NTPReport report;
 };
@@ -221,6 +227,9 @@ typedef struct {
 /* Array of BroadcastDestination */
 static ARR_Instance broadcasts;
 
+/* Cache of instance records */
+static ObjectCache instances = OBJECT_CACHE_INITIALISER(struct NCR_Instance_Record, 16, MEM_SOURCES);
+
 /* ================================================== */
 /* Initial delay period before first packet is transmitted (in seconds) */
 #define INITIAL_DELAY 0.2
@@ -249,6 +258,11 @@ static ARR_Instance broadcasts;
 #define BURST_GOOD_SAMPLES 1
 #define MAX_BURST_TOTAL_SAMPLES 4
 
+/* Intervals between requests in the initial burst of the fast start after
+   a response and without a response */
+#define FAST_START_INTERVAL 0.2
+#define FAST_START_TIMEOUT 1.0
+
 /* Time to wait after sending packet to 'warm up' link */
 #define WARM_UP_DELAY 2.0
 
@@ -305,6 +319,10 @@ static ARR_Instance broadcasts;
 
 /* ================================================== */
 
+/* Flag enabling the fast start of sources added before the first
+   synchronisation of the clock */
+static int fast_start;
+
 /* Server IPv4/IPv6 sockets */
 static int server_sock_fd4;
 static int server_sock_fd6;
@@ -316,6 +334,42 @@ static ADF_AuthTable access_auth_table;
 static double server_mono_offset;
 static uint32_t server_mono_epoch;
 
+/* Types of packets received by the server, which are counted in the profile
+   of the main loop */
+typedef enum {
+  SRV_PKT_INVALID,
+  SRV_PKT_DENIED,
+  SRV_PKT_BAD_MODE,
+  SRV_PKT_RATE_LIMITED,
+  SRV_PKT_AUTH_FAILED,
+  SRV_PKT_CLIENT,
+  SRV_PKT_CLIENT_V1,
+  SRV_PKT_ACTIVE,
+  SRV_PKT_SYMMETRIC_KEY,
+  SRV_PKT_MSSNTP,
+  SRV_PKT_NTS,
+  SRV_PKT_INTERLEAVED,
+  SRV_PKT_TYPES
+} ServerPacketType;
+
+static const char *server_packet_names[SRV_PKT_TYPES] = {
+  "ntp_core.c:srv_invalid",
+  "ntp_core.c:srv_denied",
+  "ntp_core.c:srv_bad_mode",
+  "ntp_core.c:srv_rate_limited",
+  "ntp_core.c:srv_auth_failed",
+  "ntp_core.c:srv_client",
+  "ntp_core.c:srv_client_v1",
+  "ntp_core.c:srv_active",
+  "ntp_core.c:srv_symmetric",
+  "ntp_core.c:srv_mssntp",
+  "ntp_core.c:srv_nts",
+  "ntp_core.c:srv_interleaved",
+};
+
+/* Indices of the packet counters in the profile */
+static int server_packet_counters[SRV_PKT_TYPES];
+
 /* Characters for printing synchronisation status and timestamping source */
 static const char leap_chars[4] = {'N', '+', '-', '?'};
 static const char tss_chars[3] = {'D', 'K', 'H'};
@@ -329,6 +383,7 @@ static double get_separation(int poll);
 static int parse_packet(NTP_Packet *packet, int length, NTP_PacketInfo *info);
 static void process_sample(NCR_Instance inst, NTP_Sample *sample);
 static void set_connectivity(NCR_Instance inst, SRC_Connectivity connectivity);
+static void apply_slew_epoch(NCR_Instance inst);
 
 /* ================================================== */
 
@@ -420,9 +475,14 @@ handle_slew(struct timespec *raw, struct timespec *cooked, double dfreq,
 void
 NCR_Initialise(void)
 {
+  int i;
+
   do_size_checks_updated();
   do_time_checks();
 
+  for (i = 0; i < SRV_PKT_TYPES; i++)
+    server_packet_counters[i] = SCH_AddProfileCounter(server_packet_names[i]);
+
   logfileid = CNF_GetLogMeasurements(&log_raw_measurements) ? LOG_FileOpen("measurements",
       "   Date (UTC) Time     IP Address   L St 123 567 ABCD  LP RP Score    Offset  Peer del. Peer disp.  Root del. Root disp. Refid     MTxRx")
     : -1;
@@ -430,6 +490,8 @@ NCR_Initialise(void)
   access_auth_table = ADF_CreateTable();
   broadcasts = ARR_CreateInstance(sizeof (BroadcastDestination));
 
+  fast_start = CNF_GetFastStart(NULL);
+
   /* Server socket will be opened when access is allowed */
   server_sock_fd4 = INVALID_SOCK_FD;
   server_sock_fd6 = INVALID_SOCK_FD;
@@ -463,6 +525,15 @@ NCR_Finalise(void)
 
 /* ================================================== */
 
+static int
+is_fast_start(NCR_Instance inst)
+{
+  return inst->fast_start &&
+         (inst->opmode == MD_BURST_WAS_ONLINE || inst->opmode == MD_BURST_WAS_OFFLINE);
+}
+
+/* ================================================== */
+
 static void
 restart_timeout(NCR_Instance inst, double delay)
 {
@@ -478,7 +549,9 @@ restart_timeout(NCR_Instance inst, double delay)
   SCH_RemoveTimeout(inst->tx_timeout_id);
 
   /* Start new timer for transmission */
-  inst->tx_timeout_id = SCH_AddTimeoutInClass(delay, get_separation(inst->local_poll),
+  inst->tx_timeout_id = SCH_AddTimeoutInClass(delay, is_fast_start(inst) ?
+                                                MIN_SAMPLING_SEPARATION :
+                                                get_separation(inst->local_poll),
                                               SAMPLING_RANDOMNESS,
                                               inst->mode == MODE_CLIENT ?
                                                 SCH_NtpClientClass : SCH_NtpPeerClass,
@@ -493,6 +566,8 @@ start_initial_timeout(NCR_Instance inst)
   double delay, last_tx;
   struct timespec now;
 
+  apply_slew_epoch(inst);
+
   if (!inst->tx_timeout_id) {
     /* This will be the first transmission after mode change */
 
@@ -513,7 +588,8 @@ start_initial_timeout(NCR_Instance inst)
     delay = 0.0;
   }
 
-  if (delay < INITIAL_DELAY)
+  /* With the fast start send the first request immediately */
+  if (delay < INITIAL_DELAY && !is_fast_start(inst))
     delay = INITIAL_DELAY;
 
   restart_timeout(inst, delay);
@@ -562,7 +638,7 @@ NCR_CreateInstance(NTP_Remote_Address *remote_addr, NTP_Source_Type type,
 {
   NCR_Instance result;
 
-  result = MallocNew(struct NCR_Instance_Record);
+  result = MallocObject(&instances);
 
   result->remote_addr = *remote_addr;
   result->local_addr.ip_addr.family = IPADDR_UNSPEC;
@@ -614,6 +690,8 @@ NCR_CreateInstance(NTP_Remote_Address *remote_addr, NTP_Source_Type type,
   result->auto_iburst = params->iburst;
   result->auto_burst = params->burst;
   result->auto_offline = params->auto_offline;
+  result->fast_start = fast_start && result->mode == MODE_CLIENT &&
+                       REF_GetOurStratum() >= NTP_MAX_STRATUM;
   result->copy = params->copy && result->mode == MODE_CLIENT;
   result->poll_target = params->poll_target;
   result->ext_field_flags = params->ext_fields;
@@ -663,6 +741,9 @@ NCR_CreateInstance(NTP_Remote_Address *remote_addr, NTP_Source_Type type,
   else
     result->filter = NULL;
 
+  MEM_SetTag(result->filter, MEM_SOURCES, 0);
+  MEM_SetTag(result->delay_quant, MEM_SOURCES, 0);
+
   result->rx_timeout_id = 0;
   result->tx_timeout_id = 0;
   result->tx_suspended = 1;
@@ -670,6 +751,7 @@ NCR_CreateInstance(NTP_Remote_Address *remote_addr, NTP_Source_Type type,
   result->local_poll = MAX(result->minpoll, MIN_NONLAN_POLL);
   result->poll_score = 0.0;
   zero_local_timestamp(&result->local_tx);
+  LCL_GetSlewEpoch(&result->slew_epoch);
   result->burst_good_samples_to_go = 0;
   result->burst_total_samples_to_go = 0;
   memset(&result->report, 0, sizeof (result->report));
@@ -706,7 +788,7 @@ NCR_DestroyInstance(NCR_Instance instance)
   SRC_DestroyInstance(instance->source);
 
   /* Free the data structure */
-  Free(instance);
+  FreeObject(&instances, instance);
 }
 
 /* ================================================== */
@@ -724,6 +806,9 @@ NCR_StartInstance(NCR_Instance instance)
 void
 NCR_ResetInstance(NCR_Instance instance)
 {
+  /* Not all timestamps are dropped */
+  apply_slew_epoch(instance);
+
   instance->tx_count = 0;
   instance->presend_done = 0;
 
@@ -947,7 +1032,10 @@ get_transmit_delay(NCR_Instance inst, int on_tx, double last_tx)
     case MD_BURST_WAS_ONLINE:
     case MD_BURST_WAS_OFFLINE:
       /* Burst modes */
-      delay_time = MIN(MAX_BURST_INTERVAL, MAX_BURST_POLL_RATIO * delay_time);
+      if (is_fast_start(inst))
+        delay_time = on_tx ? FAST_START_TIMEOUT : FAST_START_INTERVAL;
+      else
+        delay_time = MIN(MAX_BURST_INTERVAL, MAX_BURST_POLL_RATIO * delay_time);
       break;
     default:
       assert(0);
@@ -1266,6 +1354,8 @@ transmit_timeout(void *arg)
 
   inst->tx_timeout_id = 0;
 
+  apply_slew_epoch(inst);
+
   switch (inst->opmode) {
     case MD_BURST_WAS_ONLINE:
       /* With online burst switch to online before last packet */
@@ -1277,6 +1367,9 @@ transmit_timeout(void *arg)
         take_offline(inst);
       break;
     case MD_ONLINE:
+      /* The initial burst ended, continue with normal polling */
+      inst->fast_start = 0;
+
       /* Start a new burst if the burst option is enabled and the average
          polling interval including the burst will not fall below the
          minimum polling interval */
@@ -2206,12 +2299,13 @@ process_response(NCR_Instance inst, NTP_Local_Address *local_addr,
     inst->report.rx_tss_char = tss_chars[local_receive.source];
 
     inst->report.total_valid_count++;
+
+    CAM_PublishNTPSample(&sample.time, &inst->report);
   }
 
   /* Do measurement logging */
   if (logfileid != -1 && (log_raw_measurements || synced_packet)) {
-    LOG_FileWrite(logfileid, "%s %-15s %1c %2d %1d%1d%1d %1d%1d%1d %1d%1d%1d%d  %2d %2d %4.2f %10.3e %10.3e %10.3e %10.3e %10.3e %08"PRIX32" %1d%1c %1c %1c",
-            UTI_TimeToLogForm(sample.time.tv_sec),
+    LOG_FileWrite(logfileid, &sample.time, " %-15s %1c %2d %1d%1d%1d %1d%1d%1d %1d%1d%1d%d  %2d %2d %4.2f %10.3e %10.3e %10.3e %10.3e %10.3e %08"PRIX32" %1d%1c %1c %1c",
             UTI_IPToString(&inst->remote_addr.ip_addr),
             leap_chars[pkt_leap],
             message->stratum,
@@ -2264,6 +2358,8 @@ NCR_ProcessRxKnown(NCR_Instance inst, NTP_Local_Address *local_addr,
   int proc_packet, proc_as_unknown;
   NTP_PacketInfo info;
 
+  apply_slew_epoch(inst);
+
   inst->report.total_rx_count++;
 
   if (!parse_packet(message, length, &info))
@@ -2374,6 +2470,13 @@ NCR_ProcessRxKnown(NCR_Instance inst, NTP_Local_Address *local_addr,
   }
 }
 
+/* ================================================== */
+static void
+count_server_packet(ServerPacketType type)
+{
+  SCH_IncrementProfileCounter(server_packet_counters[type]);
+}
+
 /* ================================================== */
 /* This routine is called when a new packet arrives off the network,
    and it relates to a source we don't know (not our server or peer) */
@@ -2395,12 +2498,15 @@ NCR_ProcessRxUnknown(NTP_Remote_Address *remote_addr, NTP_Local_Address *local_a
     return;
   }
 
-  if (!parse_packet(message, length, &info))
+  if (!parse_packet(message, length, &info)) {
+    count_server_packet(SRV_PKT_INVALID);
     return;
+  }
 
   if (!ADF_IsAllowed(access_auth_table, &remote_addr->ip_addr)) {
     DEBUG_LOG("NTP packet received from unauthorised host %s",
               UTI_IPToString(&remote_addr->ip_addr));
+    count_server_packet(SRV_PKT_DENIED);
     return;
   }
 
@@ -2408,10 +2514,12 @@ NCR_ProcessRxUnknown(NTP_Remote_Address *remote_addr, NTP_Local_Address *local_a
     case MODE_ACTIVE:
       /* We are symmetric passive, even though we don't ever lock to him */
       my_mode = MODE_PASSIVE;
+      count_server_packet(SRV_PKT_ACTIVE);
       break;
     case MODE_CLIENT:
       /* Reply with server packet */
       my_mode = MODE_SERVER;
+      count_server_packet(SRV_PKT_CLIENT);
       break;
     case MODE_UNDEFINED:
       /* Check if it is an NTPv1 client request (NTPv1 packets have a reserved
@@ -2419,12 +2527,14 @@ NCR_ProcessRxUnknown(NTP_Remote_Address *remote_addr, NTP_Local_Address *local_a
          the port numbers).  Don't ever respond with a mode 0 packet! */
       if (info.version == 1 && remote_addr->port != NTP_PORT) {
         my_mode = MODE_SERVER;
+        count_server_packet(SRV_PKT_CLIENT_V1);
         break;
       }
       /* Fall through */
     default:
       /* Discard */
       DEBUG_LOG("NTP packet discarded mode=%d", (int)info.mode);
+      count_server_packet(SRV_PKT_BAD_MODE);
       return;
   }
 
@@ -2434,18 +2544,36 @@ NCR_ProcessRxUnknown(NTP_Remote_Address *remote_addr, NTP_Local_Address *local_a
   /* Don't reply to all requests if the rate is excessive */
   if (log_index >= 0 && CLG_LimitServiceRate(CLG_NTP, log_index)) {
       DEBUG_LOG("NTP packet discarded to limit response rate");
+      count_server_packet(SRV_PKT_RATE_LIMITED);
       return;
   }
 
   /* Check authentication */
   if (!NAU_CheckRequestAuth(message, &info, &kod)) {
     DEBUG_LOG("NTP packet failed auth mode=%d kod=%"PRIx32, (int)info.auth.mode, kod);
+    count_server_packet(SRV_PKT_AUTH_FAILED);
 
     /* Don't respond unless a non-zero KoD was returned */
     if (kod == 0)
       return;
-  } else if (info.auth.mode != NTP_AUTH_NONE && info.auth.mode != NTP_AUTH_MSSNTP) {
-    CLG_LogAuthNtpRequest();
+  } else {
+    switch (info.auth.mode) {
+      case NTP_AUTH_SYMMETRIC:
+        count_server_packet(SRV_PKT_SYMMETRIC_KEY);
+        break;
+      case NTP_AUTH_MSSNTP:
+      case NTP_AUTH_MSSNTP_EXT:
+        count_server_packet(SRV_PKT_MSSNTP);
+        break;
+      case NTP_AUTH_NTS:
+        count_server_packet(SRV_PKT_NTS);
+        break;
+      default:
+        break;
+    }
+
+    if (info.auth.mode != NTP_AUTH_NONE && info.auth.mode != NTP_AUTH_MSSNTP)
+      CLG_LogAuthNtpRequest();
   }
 
   local_ntp_rx = NULL;
@@ -2469,8 +2597,10 @@ NCR_ProcessRxUnknown(NTP_Remote_Address *remote_addr, NTP_Local_Address *local_a
     interleaved = CLG_GetNtpTxTimestamp(&ntp_rx, &local_tx.ts);
 
     tx_ts = &local_tx;
-    if (interleaved)
+    if (interleaved) {
       CLG_DisableNtpTimestamps(&ntp_rx);
+      count_server_packet(SRV_PKT_INTERLEAVED);
+    }
   }
 
   /* Suggest the client to increase its polling interval if it indicates
@@ -2541,6 +2671,8 @@ NCR_ProcessTxKnown(NCR_Instance inst, NTP_Local_Address *local_addr,
     return;
   }
 
+  apply_slew_epoch(inst);
+
   update_tx_timestamp(&inst->local_tx, tx_ts, &inst->local_ntp_rx, &inst->local_ntp_tx,
                       message);
 }
@@ -2581,8 +2713,8 @@ NCR_ProcessTxUnknown(NTP_Remote_Address *remote_addr, NTP_Local_Address *local_a
 
 /* ================================================== */
 
-void
-NCR_SlewTimes(NCR_Instance inst, struct timespec *when, double dfreq, double doffset)
+static void
+slew_times(NCR_Instance inst, struct timespec *when, double dfreq, double doffset)
 {
   double delta;
 
@@ -2601,6 +2733,20 @@ NCR_SlewTimes(NCR_Instance inst, struct timespec *when, double dfreq, double dof
     SPF_SlewSamples(inst->filter, when, dfreq, doffset);
 }
 
+/* ================================================== */
+/* Correct the timestamps for the changes of the local clock made since
+   the instance was last accessed */
+
+static void
+apply_slew_epoch(NCR_Instance inst)
+{
+  struct timespec when;
+  double dfreq, doffset;
+
+  while (LCL_GetSlewSinceEpoch(&inst->slew_epoch, &when, &dfreq, &doffset))
+    slew_times(inst, &when, dfreq, doffset);
+}
+
 /* ================================================== */
 
 static void
@@ -2619,7 +2765,7 @@ set_connectivity(NCR_Instance inst, SRC_Connectivity connectivity)
           inst->opmode = MD_ONLINE;
           NCR_ResetInstance(inst);
           start_initial_timeout(inst);
-          if (inst->auto_iburst)
+          if (inst->auto_iburst || inst->fast_start)
             NCR_InitiateSampleBurst(inst, IBURST_GOOD_SAMPLES, IBURST_TOTAL_SAMPLES);
           break;
         case MD_BURST_WAS_ONLINE:
@@ -2814,10 +2960,27 @@ NCR_GetAuthReport(NCR_Instance inst, RPT_AuthReport *report)
 
 /* ================================================== */
 
+static size_t
+get_memory_size(NCR_Instance inst)
+{
+  size_t size;
+
+  size = sizeof (*inst) + NAU_GetMemorySize(inst->auth) + SRC_GetMemorySize(inst->source);
+  if (inst->delay_quant)
+    size += QNT_GetMemorySize(inst->delay_quant);
+  if (inst->filter)
+    size += SPF_GetMemorySize(inst->filter);
+
+  return size;
+}
+
+/* ================================================== */
+
 void
 NCR_GetNTPReport(NCR_Instance inst, RPT_NTPReport *report)
 {
   *report = inst->report;
+  report->memory_size = get_memory_size(inst);
 }
 
 /* ================================================== */
@@ -98,8 +98,6 @@ extern void NCR_ProcessTxKnown(NCR_Instance inst, NTP_Local_Address *local_addr,
 extern void NCR_ProcessTxUnknown(NTP_Remote_Address *remote_addr, NTP_Local_Address *local_addr,
                                  NTP_Local_Timestamp *tx_ts, NTP_Packet *message, int length);
 
-/* Slew receive and transmit times in instance records */
-extern void NCR_SlewTimes(NCR_Instance inst, struct timespec *when, double dfreq, double doffset);
 
 /* Take a particular source online (i.e. start sampling it) or offline
    (i.e. stop sampling it) */
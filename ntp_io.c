@@ -30,6 +30,7 @@
 
 #include "sysincl.h"
 
+#include "array.h"
 #include "memory.h"
 #include "ntp_io.h"
 #include "ntp_core.h"
@@ -49,6 +50,10 @@
 
 #define INVALID_SOCK_FD -1
 
+/* Maximum number of batches of messages read from the error queue
+   in one event */
+#define MAX_ERRQUEUE_BATCHES 64
+
 /* The server/peer and client sockets for IPv4 and IPv6 */
 static int server_sock_fd4;
 static int server_sock_fd6;
@@ -63,6 +68,29 @@ static int server_sock_ref6;
    server instead of sharing client_sock_fd4 and client_sock_fd6 */
 static int separate_client_sockets;
 
+/* Unconnected client socket from a pool shared by all sources */
+struct ClientSocket {
+  int sock_fd;
+  int family;
+  /* Number of sources waiting for a response on the socket */
+  int references;
+  /* Number of requests sent from the socket */
+  int requests;
+  /* Flag indicating the socket can be selected for new requests */
+  int active;
+};
+
+/* Maximum number of requests sent from a socket in the pool before it is
+   replaced with a new socket (using a new random port) */
+#define MAX_CLIENT_SOCKET_REQUESTS 16
+
+/* Array of ClientSocket, including replaced sockets waiting for responses */
+static ARR_Instance client_socket_pool;
+
+/* Number of active sockets in the pool per address family, or 0 if the pool
+   is disabled */
+static int client_socket_pool_size;
+
 /* Flag indicating the server sockets are not created dynamically when needed,
    either to have a socket for client requests when separate client sockets
    are disabled and client port is equal to server port, or the server port is
@@ -172,6 +200,102 @@ close_socket(int sock_fd)
 
 /* ================================================== */
 
+static int
+get_pool_socket(int family)
+{
+  struct ClientSocket *cs, *selected;
+  unsigned int i, j, n, r;
+  int index;
+
+  /* Count the active sockets of the family */
+  for (i = n = 0; i < ARR_GetSize(client_socket_pool); i++) {
+    cs = ARR_GetElement(client_socket_pool, i);
+    if (cs->active && cs->family == family)
+      n++;
+  }
+
+  /* Select randomly one of them */
+  index = -1;
+  if (n > 0) {
+    UTI_GetRandomBytes(&r, sizeof (r));
+    r %= n;
+
+    for (i = j = 0; i < ARR_GetSize(client_socket_pool); i++) {
+      cs = ARR_GetElement(client_socket_pool, i);
+      if (!cs->active || cs->family != family)
+        continue;
+      if (j++ == r) {
+        index = i;
+        break;
+      }
+    }
+  }
+
+  /* Open a new socket if the pool is not full.  Its port will be chosen
+     randomly by the operating system. */
+  if (n < client_socket_pool_size) {
+    cs = ARR_GetNewElement(client_socket_pool);
+    cs->sock_fd = open_socket(family, 0, 1, NULL);
+    cs->family = family;
+    cs->references = 0;
+    cs->requests = 0;
+    cs->active = 1;
+
+    if (cs->sock_fd == INVALID_SOCK_FD)
+      ARR_SetSize(client_socket_pool, ARR_GetSize(client_socket_pool) - 1);
+    else
+      index = ARR_GetSize(client_socket_pool) - 1;
+  }
+
+  if (index < 0)
+    return INVALID_SOCK_FD;
+
+  /* Get the pointer after adding the new element, which may have moved
+     the array */
+  selected = ARR_GetElement(client_socket_pool, index);
+
+  selected->references++;
+
+  /* Stop using the socket for new requests after some number of requests
+     in order to not allow an attacker to learn the port and spoof responses,
+     similarly to separate sockets.  It will be closed when no source is
+     waiting for a response on it. */
+  if (++selected->requests >= MAX_CLIENT_SOCKET_REQUESTS)
+    selected->active = 0;
+
+  return selected->sock_fd;
+}
+
+/* ================================================== */
+
+static int
+release_pool_socket(int sock_fd)
+{
+  struct ClientSocket *cs;
+  unsigned int i;
+
+  for (i = 0; i < ARR_GetSize(client_socket_pool); i++) {
+    cs = ARR_GetElement(client_socket_pool, i);
+    if (cs->sock_fd != sock_fd)
+      continue;
+
+    if (--cs->references <= 0 && !cs->active) {
+      close_socket(cs->sock_fd);
+
+      /* Move the last socket to the free slot */
+      *cs = *(struct ClientSocket *)ARR_GetElement(client_socket_pool,
+                                                   ARR_GetSize(client_socket_pool) - 1);
+      ARR_SetSize(client_socket_pool, ARR_GetSize(client_socket_pool) - 1);
+    }
+
+    return 1;
+  }
+
+  return 0;
+}
+
+/* ================================================== */
+
 void
 NIO_Initialise(void)
 {
@@ -197,11 +321,15 @@ NIO_Initialise(void)
   server_port = CNF_GetNTPPort();
   client_port = CNF_GetAcquisitionPort();
 
-  /* Use separate connected sockets if client port is negative */
-  separate_client_sockets = client_port < 0;
+  /* Use separate connected sockets if client port is negative, or a pool
+     of unconnected sockets if its size is specified */
+  client_socket_pool_size = client_port < 0 ? CNF_GetAcquisitionSockets() : 0;
+  separate_client_sockets = client_port < 0 && client_socket_pool_size <= 0;
   if (client_port < 0)
     client_port = 0;
 
+  client_socket_pool = ARR_CreateInstance(sizeof (struct ClientSocket));
+
   permanent_server_sockets = !server_port || (!separate_client_sockets &&
                                               client_port == server_port);
 
@@ -217,7 +345,7 @@ NIO_Initialise(void)
     server_sock_fd6 = open_socket(IPADDR_INET6, server_port, 0, NULL);
   }
 
-  if (!separate_client_sockets) {
+  if (!separate_client_sockets && client_socket_pool_size <= 0) {
     if (client_port != server_port || !server_port) {
       client_sock_fd4 = open_socket(IPADDR_INET4, client_port, 1, NULL);
       client_sock_fd6 = open_socket(IPADDR_INET6, client_port, 1, NULL);
@@ -229,7 +357,7 @@ NIO_Initialise(void)
 
   if ((server_port && permanent_server_sockets &&
        server_sock_fd4 == INVALID_SOCK_FD && server_sock_fd6 == INVALID_SOCK_FD) ||
-      (!separate_client_sockets &&
+      (!separate_client_sockets && client_socket_pool_size <= 0 &&
        client_sock_fd4 == INVALID_SOCK_FD && client_sock_fd6 == INVALID_SOCK_FD)) {
     LOG_FATAL("Could not open NTP sockets");
   }
@@ -251,6 +379,12 @@ NIO_Initialise(void)
 void
 NIO_Finalise(void)
 {
+  unsigned int i;
+
+  for (i = 0; i < ARR_GetSize(client_socket_pool); i++)
+    close_socket(((struct ClientSocket *)ARR_GetElement(client_socket_pool, i))->sock_fd);
+  ARR_DestroyInstance(client_socket_pool);
+
   if (server_sock_fd4 != client_sock_fd4)
     close_socket(client_sock_fd4);
   close_socket(server_sock_fd4);
@@ -284,12 +418,16 @@ NIO_OpenClientSocket(NTP_Remote_Address *remote_addr)
         return ptp_sock_fd4;
       if (separate_client_sockets)
         return open_separate_client_socket(remote_addr);
+      if (client_socket_pool_size > 0)
+        return get_pool_socket(IPADDR_INET4);
       return client_sock_fd4;
     case IPADDR_INET6:
       if (ptp_port > 0 && remote_addr->port == ptp_port)
         return ptp_sock_fd6;
       if (separate_client_sockets)
         return open_separate_client_socket(remote_addr);
+      if (client_socket_pool_size > 0)
+        return get_pool_socket(IPADDR_INET6);
       return client_sock_fd6;
     default:
       return INVALID_SOCK_FD;
@@ -346,6 +484,8 @@ NIO_CloseClientSocket(int sock_fd)
 
   if (separate_client_sockets)
     close_socket(sock_fd);
+  else if (client_socket_pool_size > 0 && !release_pool_socket(sock_fd))
+    assert(0);
 }
 
 /* ================================================== */
@@ -459,7 +599,7 @@ static void
 read_from_socket(int sock_fd, int event, void *anything)
 {
   SCK_Message *messages;
-  int i, received, flags = 0;
+  int i, batch, received, flags = 0;
 
 #ifdef HAVE_LINUX_TIMESTAMPING
   if (NIO_Linux_ProcessEvent(sock_fd, event))
@@ -474,12 +614,23 @@ read_from_socket(int sock_fd, int event, void *anything)
 #endif
   }
 
-  messages = SCK_ReceiveMessages(sock_fd, flags, &received);
-  if (!messages)
-    return;
-
-  for (i = 0; i < received; i++)
-    process_message(&messages[i], sock_fd, event);
+  /* Drain the error queue in one event.  The scheduler doesn't dispatch
+     the input event of a socket which has an exception, so processing only
+     one batch of TX timestamps on a busy server would delay reading of
+     requests until the error queue is empty. */
+  for (batch = 0; batch < MAX_ERRQUEUE_BATCHES; batch++) {
+    messages = SCK_ReceiveMessages(sock_fd, flags, &received);
+    if (!messages)
+      return;
+
+    for (i = 0; i < received; i++)
+      process_message(&messages[i], sock_fd, event);
+
+    /* Stop on a normal event or a partial batch, which means the queue
+       is empty */
+    if (event != SCH_FILE_EXCEPTION || received < SCK_GetMaxReceivedMessages())
+      break;
+  }
 }
 
 /* ================================================== */
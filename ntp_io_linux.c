@@ -63,6 +63,11 @@ struct Interface {
   double tx_comp;
   double rx_comp;
   HCL_Instance clock;
+  /* Interval and timeout of PHC readings, and number of readings since
+     the last HW timestamp */
+  double poll_interval;
+  SCH_TimeoutID poll_timeout;
+  int idle_polls;
 };
 
 /* Number of PHC readings per HW clock sample */
@@ -71,12 +76,20 @@ struct Interface {
 /* Minimum interval between PHC readings */
 #define MIN_PHC_POLL -6
 
+/* Number of PHC readings without any HW timestamp after which the readings
+   are stopped until the next HW timestamp */
+#define MAX_IDLE_PHC_POLLS 16
+
 /* Maximum acceptable offset between SW/HW and daemon timestamp */
 #define MAX_TS_DELAY 1.0
 
 /* Array of Interfaces */
 static ARR_Instance interfaces;
 
+/* Array mapping interface indices to indices in the array of Interfaces
+   (or -1 if HW timestamping is not enabled on the interface) */
+static ARR_Instance interface_map;
+
 /* RX/TX and TX-specific timestamping socket options */
 static int ts_flags;
 static int ts_tx_flags;
@@ -245,9 +258,12 @@ add_interface(CNF_HwTsInterface *conf_iface)
   iface->tx_comp = conf_iface->tx_comp;
   iface->rx_comp = conf_iface->rx_comp;
 
+  iface->poll_interval = UTI_Log2ToDouble(MAX(conf_iface->minpoll, MIN_PHC_POLL));
+  iface->poll_timeout = 0;
+  iface->idle_polls = 0;
+
   iface->clock = HCL_CreateInstance(conf_iface->min_samples, conf_iface->max_samples,
-                                    UTI_Log2ToDouble(MAX(conf_iface->minpoll, MIN_PHC_POLL)),
-                                    conf_iface->precision);
+                                    iface->poll_interval, conf_iface->precision);
 
   LOG(LOGS_INFO, "Enabled HW timestamping %son %s",
       ts_config.rx_filter == HWTSTAMP_FILTER_NONE ? "(TX only) " : "", iface->name);
@@ -321,6 +337,75 @@ update_interface_speed(struct Interface *iface)
 
 /* ================================================== */
 
+static void
+poll_phc(struct Interface *iface)
+{
+  struct timespec sample_phc_ts, sample_sys_ts, sample_local_ts;
+  struct timespec phc_readings[PHC_READINGS][3];
+  double phc_err, local_err;
+  int n_readings;
+
+  n_readings = SYS_Linux_GetPHCReadings(iface->phc_fd, iface->phc_nocrossts,
+                                        &iface->phc_mode, PHC_READINGS, phc_readings);
+  if (n_readings > 0 &&
+      HCL_ProcessReadings(iface->clock, n_readings, phc_readings,
+                           &sample_phc_ts, &sample_sys_ts, &phc_err)) {
+    LCL_CookTime(&sample_sys_ts, &sample_local_ts, &local_err);
+    HCL_AccumulateSample(iface->clock, &sample_phc_ts, &sample_local_ts,
+                         phc_err + local_err);
+
+    update_interface_speed(iface);
+  }
+}
+
+/* ================================================== */
+
+static void
+poll_timeout(void *arg)
+{
+  struct Interface *iface = arg;
+
+  /* Don't read the PHC of an interface which is not timestamping any
+     packets */
+  if (iface->idle_polls >= MAX_IDLE_PHC_POLLS) {
+    DEBUG_LOG("Stopped reading PHC of %s", iface->name);
+    iface->poll_timeout = 0;
+    return;
+  }
+
+  iface->idle_polls++;
+
+  poll_phc(iface);
+
+  iface->poll_timeout = SCH_AddTimeoutByDelay(iface->poll_interval, poll_timeout, iface);
+}
+
+/* ================================================== */
+
+static void
+start_interfaces(void)
+{
+  struct Interface *iface;
+  unsigned int i;
+  int if_index;
+
+  for (i = 0; i < ARR_GetSize(interfaces); i++) {
+    iface = ARR_GetElement(interfaces, i);
+
+    if_index = iface->if_index;
+    while (ARR_GetSize(interface_map) <= if_index)
+      *(int *)ARR_GetNewElement(interface_map) = -1;
+    *(int *)ARR_GetElement(interface_map, if_index) = i;
+
+    /* Read the PHCs from a timeout instead of the processing of timestamped
+       packets to not delay them.  The array of Interfaces is not modified
+       after this point, so the pointers remain valid. */
+    iface->poll_timeout = SCH_AddTimeoutByDelay(0.0, poll_timeout, iface);
+  }
+}
+
+/* ================================================== */
+
 #if defined(HAVE_LINUX_TIMESTAMPING_OPT_PKTINFO) || defined(HAVE_LINUX_TIMESTAMPING_OPT_TX_SWHW)
 static int
 check_timestamping_option(int option)
@@ -370,6 +455,7 @@ NIO_Linux_Initialise(void)
   int hwts;
 
   interfaces = ARR_CreateInstance(sizeof (struct Interface));
+  interface_map = ARR_CreateInstance(sizeof (int));
 
   /* Enable HW timestamping on specified interfaces.  If "*" was specified, try
      all interfaces.  If no interface was specified, enable SW timestamping. */
@@ -412,6 +498,8 @@ NIO_Linux_Initialise(void)
   /* Kernels before 4.7 ignore timestamping flags set in control messages */
   permanent_ts_options = !SYS_Linux_CheckKernelVersion(4, 7);
 
+  start_interfaces();
+
   monitored_socket = INVALID_SOCK_FD;
   suspended_socket = INVALID_SOCK_FD;
   dummy_rxts_socket = INVALID_SOCK_FD;
@@ -430,10 +518,12 @@ NIO_Linux_Finalise(void)
 
   for (i = 0; i < ARR_GetSize(interfaces); i++) {
     iface = ARR_GetElement(interfaces, i);
+    SCH_RemoveTimeout(iface->poll_timeout);
     HCL_DestroyInstance(iface->clock);
     close(iface->phc_fd);
   }
 
+  ARR_DestroyInstance(interface_map);
   ARR_DestroyInstance(interfaces);
 }
 
@@ -542,18 +632,16 @@ NIO_Linux_ProcessEvent(int sock_fd, int event)
 static struct Interface *
 get_interface(int if_index)
 {
-  struct Interface *iface;
-  unsigned int i;
+  int i;
 
-  for (i = 0; i < ARR_GetSize(interfaces); i++) {
-    iface = ARR_GetElement(interfaces, i);
-    if (iface->if_index != if_index)
-      continue;
+  if (if_index < 0 || if_index >= ARR_GetSize(interface_map))
+    return NULL;
 
-    return iface;
-  }
+  i = *(int *)ARR_GetElement(interface_map, if_index);
+  if (i < 0)
+    return NULL;
 
-  return NULL;
+  return ARR_GetElement(interfaces, i);
 }
 
 /* ================================================== */
@@ -563,24 +651,16 @@ process_hw_timestamp(struct Interface *iface, struct timespec *hw_ts,
                      NTP_Local_Timestamp *local_ts, int rx_ntp_length, int family,
                      int l2_length)
 {
-  struct timespec sample_phc_ts, sample_sys_ts, sample_local_ts, ts;
-  struct timespec phc_readings[PHC_READINGS][3];
-  double rx_correction, ts_delay, phc_err, local_err;
-  int n_readings;
+  double rx_correction, ts_delay, local_err;
+  struct timespec ts;
 
-  if (HCL_NeedsNewSample(iface->clock, &local_ts->ts)) {
-    n_readings = SYS_Linux_GetPHCReadings(iface->phc_fd, iface->phc_nocrossts,
-                                          &iface->phc_mode, PHC_READINGS, phc_readings);
-    if (n_readings > 0 &&
-        HCL_ProcessReadings(iface->clock, n_readings, phc_readings,
-                             &sample_phc_ts, &sample_sys_ts, &phc_err)) {
-      LCL_CookTime(&sample_sys_ts, &sample_local_ts, &local_err);
-      HCL_AccumulateSample(iface->clock, &sample_phc_ts, &sample_local_ts,
-                           phc_err + local_err);
-
-      update_interface_speed(iface);
-    }
-  }
+  iface->idle_polls = 0;
+
+  /* Restart the PHC readings if they were stopped.  The PHC is not read
+     in the packet processing, the timestamp is converted with the samples
+     the HW clock already has. */
+  if (!iface->poll_timeout)
+    iface->poll_timeout = SCH_AddTimeoutByDelay(0.0, poll_timeout, iface);
 
   /* We need to transpose RX timestamps as hardware timestamps are normally
      preamble timestamps and RX timestamps in NTP are supposed to be trailer
@@ -56,7 +56,8 @@ typedef struct {
   uint16_t packet_id;
   uint16_t _pad;
   uint32_t key_id;
-  NTP_Packet packet_to_sign;
+  /* Only packets without extension fields can be signed */
+  uint8_t packet_to_sign[NTP_HEADER_LENGTH];
 } SigndRequest;
 
 typedef struct {
@@ -72,24 +73,45 @@ typedef struct {
   NTP_Local_Address local_addr;
 
   int sent;
-  int received;
+  int done;
   int request_length;
-  struct timespec request_ts;
+  double request_time;
   SigndRequest request;
-  SigndResponse response;
 } SignInstance;
 
 /* As the communication with ntp_signd is asynchronous, incoming packets are
-   saved in a queue in order to avoid loss when they come in bursts */
+   saved in a circular queue in order to avoid loss when they come in bursts.
+   Multiple requests can be sent before the first response is received.  The
+   responses are matched to the requests by the ID, which is the index of the
+   request in the queue. */
 
-#define MAX_QUEUE_LENGTH 16U
-#define NEXT_QUEUE_INDEX(index) (((index) + 1) % MAX_QUEUE_LENGTH)
-#define IS_QUEUE_EMPTY() (queue_head == queue_tail)
+#define MAX_QUEUE_LENGTH 65536U
+#define QUEUE_INDEX(offset) ((queue_head + (offset)) % queue_length)
 
-/* Fixed-size array of SignInstance */
+/* Array of SignInstance */
 static ARR_Instance queue;
+static unsigned int queue_length;
+
+/* Index of the oldest request, number of requests in the queue, number
+   of requests from the head which were sent (or completed), and number
+   of requests waiting for a response */
 static unsigned int queue_head;
-static unsigned int queue_tail;
+static unsigned int queue_depth;
+static unsigned int queue_sent;
+static unsigned int requests_in_flight;
+
+/* Maximum number of requests waiting for a response */
+static unsigned int max_in_flight;
+
+/* Time after which requests are dropped */
+static double request_timeout;
+
+/* Timeout of the oldest request */
+static SCH_TimeoutID timeout_id;
+
+/* Buffer for responses, which can be received in one read */
+static char rx_buffer[16 * sizeof (SigndResponse)];
+static unsigned int rx_length;
 
 #define INVALID_SOCK_FD (-6)
 
@@ -99,6 +121,15 @@ static int sock_fd;
 /* Flag indicating if the MS-SNTP authentication is enabled */
 static int enabled;
 
+/* Statistics reported in serverstats */
+static uint32_t total_requests;
+static uint32_t total_drops;
+static uint32_t total_timeouts;
+static uint32_t max_queue_depth;
+static uint32_t total_responses;
+static double total_delay;
+static double max_delay;
+
 /* ================================================== */
 
 static void read_write_socket(int sock_fd, int event, void *anything);
@@ -111,9 +142,34 @@ close_socket(void)
   SCH_RemoveFileHandler(sock_fd);
   SCK_CloseSocket(sock_fd);
   sock_fd = INVALID_SOCK_FD;
+  rx_length = 0;
+}
+
+/* ================================================== */
+
+static void
+drop_requests(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < queue_depth; i++) {
+    if (!((SignInstance *)ARR_GetElement(queue, QUEUE_INDEX(i)))->done)
+      total_drops++;
+  }
+
+  queue_depth = queue_sent = requests_in_flight = 0;
 
-  /* Empty the queue */
-  queue_head = queue_tail = 0;
+  SCH_RemoveTimeout(timeout_id);
+  timeout_id = 0;
+}
+
+/* ================================================== */
+
+static void
+handle_error(void)
+{
+  close_socket();
+  drop_requests();
 }
 
 /* ================================================== */
@@ -145,115 +201,236 @@ open_socket(void)
 /* ================================================== */
 
 static void
-process_response(SignInstance *inst)
+update_output(void)
+{
+  /* Enable output if there is a request to send and ntp_signd can take it */
+  SCH_SetFileHandlerEvent(sock_fd, SCH_FILE_OUTPUT,
+                          queue_sent < queue_depth && requests_in_flight < max_in_flight);
+}
+
+/* ================================================== */
+
+static void
+remove_completed_requests(void)
+{
+  while (queue_depth > 0 && ((SignInstance *)ARR_GetElement(queue, queue_head))->done) {
+    queue_head = QUEUE_INDEX(1);
+    queue_depth--;
+    if (queue_sent > 0)
+      queue_sent--;
+  }
+}
+
+/* ================================================== */
+
+static void handle_timeout(void *arg);
+
+static void
+schedule_timeout(void)
 {
-  struct timespec ts;
+  SignInstance *inst;
   double delay;
 
-  if (ntohs(inst->request.packet_id) != ntohl(inst->response.packet_id)) {
-    DEBUG_LOG("Invalid response ID");
+  if (timeout_id != 0 || queue_depth == 0)
     return;
+
+  inst = ARR_GetElement(queue, queue_head);
+  delay = inst->request_time + request_timeout - SCH_GetLastEventMonoTime();
+  timeout_id = SCH_AddTimeoutByDelay(MAX(delay, 0.0), handle_timeout, NULL);
+}
+
+/* ================================================== */
+
+static void
+handle_timeout(void *arg)
+{
+  SignInstance *inst;
+  unsigned int i, expired;
+  double now;
+
+  timeout_id = 0;
+  now = SCH_GetLastEventMonoTime();
+
+  /* Remove expired requests.  The queue is ordered by time. */
+  for (expired = 0; queue_depth > 0; expired++) {
+    inst = ARR_GetElement(queue, queue_head);
+    if (inst->request_time + request_timeout > now)
+      break;
+    inst->done = 1;
+    remove_completed_requests();
   }
 
-  if (ntohl(inst->response.op) != SIGNING_SUCCESS) {
-    DEBUG_LOG("Signing failed");
-    return;
+  if (expired > 0) {
+    DEBUG_LOG("%u signd requests timed out", expired);
+    total_timeouts += expired;
+
+    /* ntp_signd might be stuck.  Open a new connection and send the
+       remaining requests again. */
+    close_socket();
+
+    for (i = 0; i < queue_depth; i++)
+      ((SignInstance *)ARR_GetElement(queue, QUEUE_INDEX(i)))->sent = 0;
+    queue_sent = requests_in_flight = 0;
+
+    if (queue_depth > 0) {
+      if (open_socket())
+        update_output();
+      else
+        drop_requests();
+    }
   }
 
-  /* Check if the file descriptor is still valid */
-  if (!NIO_IsServerSocket(inst->local_addr.sock_fd)) {
-    DEBUG_LOG("Invalid NTP socket");
-    return;
+  schedule_timeout();
+}
+
+/* ================================================== */
+
+static int
+process_response(SigndResponse *response, int length)
+{
+  SignInstance *inst;
+  uint32_t id;
+  double delay;
+
+  id = ntohl(response->packet_id);
+
+  if (id >= queue_length || (id + queue_length - queue_head) % queue_length >= queue_sent) {
+    DEBUG_LOG("Unexpected signd response");
+    return 0;
   }
 
-  SCH_GetLastEventTime(NULL, NULL, &ts);
-  delay = UTI_DiffTimespecsToDouble(&ts, &inst->request_ts);
+  inst = ARR_GetElement(queue, id);
+  if (inst->done || inst->sent < inst->request_length) {
+    DEBUG_LOG("Unexpected signd response");
+    return 0;
+  }
+
+  inst->done = 1;
+  requests_in_flight--;
+
+  delay = SCH_GetLastEventMonoTime() - inst->request_time;
+  total_responses++;
+  total_delay += delay;
+  max_delay = MAX(max_delay, delay);
 
-  DEBUG_LOG("Signing succeeded (delay %f)", delay);
+  if (ntohl(response->op) != SIGNING_SUCCESS) {
+    DEBUG_LOG("Signing failed");
+  } else if (!NIO_IsServerSocket(inst->local_addr.sock_fd)) {
+    /* The NTP socket was closed in the meantime */
+    DEBUG_LOG("Invalid NTP socket");
+  } else {
+    DEBUG_LOG("Signing succeeded (delay %f)", delay);
+
+    /* Send the signed NTP packet */
+    NIO_SendPacket(&response->signed_packet, &inst->remote_addr, &inst->local_addr,
+                   length - offsetof(SigndResponse, signed_packet), 0);
+  }
 
-  /* Send the signed NTP packet */
-  NIO_SendPacket(&inst->response.signed_packet, &inst->remote_addr, &inst->local_addr,
-                 ntohl(inst->response.length) + sizeof (inst->response.length) -
-                 offsetof(SigndResponse, signed_packet), 0);
+  remove_completed_requests();
+
+  return 1;
 }
 
 /* ================================================== */
 
 static void
-read_write_socket(int sock_fd, int event, void *anything)
+send_request(void)
 {
   SignInstance *inst;
-  uint32_t response_length;
   int s;
 
-  inst = ARR_GetElement(queue, queue_head);
+  /* Skip requests which were completed before a reconnection */
+  while (queue_sent < queue_depth &&
+         ((SignInstance *)ARR_GetElement(queue, QUEUE_INDEX(queue_sent)))->done)
+    queue_sent++;
 
-  if (event == SCH_FILE_OUTPUT) {
-    assert(!IS_QUEUE_EMPTY());
-    assert(inst->sent < inst->request_length);
+  if (queue_sent >= queue_depth || requests_in_flight >= max_in_flight) {
+    update_output();
+    return;
+  }
 
-    if (!inst->sent)
-      SCH_GetLastEventTime(NULL, NULL, &inst->request_ts);
+  inst = ARR_GetElement(queue, QUEUE_INDEX(queue_sent));
 
-    s = SCK_Send(sock_fd, (char *)&inst->request + inst->sent,
-                 inst->request_length - inst->sent, 0);
+  s = SCK_Send(sock_fd, (char *)&inst->request + inst->sent,
+               inst->request_length - inst->sent, 0);
 
-    if (s < 0) {
-      close_socket();
-      return;
-    }
+  if (s < 0) {
+    handle_error();
+    return;
+  }
 
-    inst->sent += s;
+  inst->sent += s;
 
-    /* Try again later if the request is not complete yet */
-    if (inst->sent < inst->request_length)
-      return;
+  /* Try again later if the request is not complete yet */
+  if (inst->sent < inst->request_length)
+    return;
 
-    /* Disable output and wait for a response */
-    SCH_SetFileHandlerEvent(sock_fd, SCH_FILE_OUTPUT, 0);
-  }
+  queue_sent++;
+  requests_in_flight++;
 
-  if (event == SCH_FILE_INPUT) {
-    if (IS_QUEUE_EMPTY()) {
-        DEBUG_LOG("Unexpected signd response");
-        close_socket();
-        return;
-    }
+  update_output();
+}
 
-    assert(inst->received < sizeof (inst->response));
-    s = SCK_Receive(sock_fd, (char *)&inst->response + inst->received,
-                    sizeof (inst->response) - inst->received, 0);
+/* ================================================== */
 
-    if (s <= 0) {
-      close_socket();
-      return;
-    }
+static void
+receive_responses(void)
+{
+  uint32_t response_length;
+  SigndResponse response;
+  unsigned int offset;
+  int s;
 
-    inst->received += s;
+  assert(rx_length < sizeof (rx_buffer));
+  s = SCK_Receive(sock_fd, rx_buffer + rx_length, sizeof (rx_buffer) - rx_length, 0);
 
-    if (inst->received < sizeof (inst->response.length))
-      return;
+  if (s <= 0) {
+    handle_error();
+    return;
+  }
 
-    response_length = ntohl(inst->response.length) + sizeof (inst->response.length);
+  rx_length += s;
+
+  for (offset = 0; rx_length - offset >= sizeof (response.length);
+       offset += response_length) {
+    memcpy(&response.length, rx_buffer + offset, sizeof (response.length));
+    response_length = ntohl(response.length) + sizeof (response.length);
 
     if (response_length < offsetof(SigndResponse, signed_packet) ||
         response_length > sizeof (SigndResponse)) {
       DEBUG_LOG("Invalid response length");
-      close_socket();
+      handle_error();
       return;
     }
 
     /* Wait for more data if not complete yet */
-    if (inst->received < response_length)
-      return;
+    if (rx_length - offset < response_length)
+      break;
 
-    process_response(inst);
+    memcpy(&response, rx_buffer + offset, response_length);
 
-    /* Move the head and enable output for the next packet */
-    queue_head = NEXT_QUEUE_INDEX(queue_head);
-    if (!IS_QUEUE_EMPTY())
-      SCH_SetFileHandlerEvent(sock_fd, SCH_FILE_OUTPUT, 1);
+    if (!process_response(&response, response_length)) {
+      handle_error();
+      return;
+    }
   }
+
+  /* Keep the incomplete response */
+  memmove(rx_buffer, rx_buffer + offset, rx_length - offset);
+  rx_length -= offset;
+
+  update_output();
+}
+
+/* ================================================== */
+
+static void
+read_write_socket(int sock_fd, int event, void *anything)
+{
+  if (event == SCH_FILE_OUTPUT)
+    send_request();
+  else if (event == SCH_FILE_INPUT)
+    receive_responses();
 }
 
 /* ================================================== */
@@ -261,15 +438,22 @@ read_write_socket(int sock_fd, int event, void *anything)
 void
 NSD_Initialise()
 {
+  int length, pipeline;
+
   sock_fd = INVALID_SOCK_FD;
   enabled = CNF_GetNtpSigndSocket() && CNF_GetNtpSigndSocket()[0];
 
   if (!enabled)
     return;
 
+  CNF_GetNtpSigndQueue(&length, &pipeline, &request_timeout);
+  queue_length = CLAMP(1, length, MAX_QUEUE_LENGTH);
+  max_in_flight = CLAMP(1, pipeline, queue_length);
+
   queue = ARR_CreateInstance(sizeof (SignInstance));
-  ARR_SetSize(queue, MAX_QUEUE_LENGTH);
-  queue_head = queue_tail = 0;
+  ARR_SetSize(queue, queue_length);
+  queue_head = queue_depth = queue_sent = requests_in_flight = 0;
+  timeout_id = 0;
 
   LOG(LOGS_INFO, "MS-SNTP authentication enabled");
 }
@@ -283,6 +467,7 @@ NSD_Finalise()
     return;
   if (sock_fd != INVALID_SOCK_FD)
     close_socket();
+  SCH_RemoveTimeout(timeout_id);
   ARR_DestroyInstance(queue);
 }
 
@@ -293,14 +478,16 @@ NSD_SignAndSendPacket(uint32_t key_id, NTP_Packet *packet, NTP_PacketInfo *info,
                       NTP_Remote_Address *remote_addr, NTP_Local_Address *local_addr)
 {
   SignInstance *inst;
+  unsigned int index;
 
   if (!enabled) {
     DEBUG_LOG("signd disabled");
     return 0;
   }
 
-  if (queue_head == NEXT_QUEUE_INDEX(queue_tail)) {
+  if (queue_depth >= queue_length) {
     DEBUG_LOG("signd queue full");
+    total_drops++;
     return 0;
   }
 
@@ -309,33 +496,51 @@ NSD_SignAndSendPacket(uint32_t key_id, NTP_Packet *packet, NTP_PacketInfo *info,
     return 0;
   }
 
-  if (!open_socket())
+  if (!open_socket()) {
+    total_drops++;
     return 0;
+  }
 
-  inst = ARR_GetElement(queue, queue_tail);
+  index = QUEUE_INDEX(queue_depth);
+  inst = ARR_GetElement(queue, index);
   inst->remote_addr = *remote_addr;
   inst->local_addr = *local_addr;
   inst->sent = 0;
-  inst->received = 0;
+  inst->done = 0;
   inst->request_length = offsetof(SigndRequest, packet_to_sign) + info->length;
+  inst->request_time = SCH_GetLastEventMonoTime();
 
   /* The length field doesn't include itself */
   inst->request.length = htonl(inst->request_length - sizeof (inst->request.length));
   inst->request.version = htonl(SIGND_VERSION);
   inst->request.op = htonl(SIGN_TO_CLIENT);
-  inst->request.packet_id = htons(queue_tail);
+  inst->request.packet_id = htons(index);
   inst->request._pad = 0;
   inst->request.key_id = htonl(key_id);
 
-  memcpy(&inst->request.packet_to_sign, packet, info->length);
+  memcpy(inst->request.packet_to_sign, packet, info->length);
 
-  /* Enable output if there was no pending request */
-  if (IS_QUEUE_EMPTY())
-    SCH_SetFileHandlerEvent(sock_fd, SCH_FILE_OUTPUT, 1);
+  queue_depth++;
+  total_requests++;
+  max_queue_depth = MAX(max_queue_depth, queue_depth);
 
-  queue_tail = NEXT_QUEUE_INDEX(queue_tail);
+  update_output();
+  schedule_timeout();
 
-  DEBUG_LOG("Packet added to signd queue (%u:%u)", queue_head, queue_tail);
+  DEBUG_LOG("Packet added to signd queue (%u:%u)", queue_head, queue_depth);
 
   return 1;
 }
+
+/* ================================================== */
+
+void
+NSD_GetServerStatsReport(RPT_ServerStatsReport *report)
+{
+  report->signd_requests = total_requests;
+  report->signd_drops = total_drops;
+  report->signd_timeouts = total_timeouts;
+  report->signd_max_queue = max_queue_depth;
+  report->signd_mean_delay = total_responses > 0 ? total_delay / total_responses : 0.0;
+  report->signd_max_delay = max_delay;
+}
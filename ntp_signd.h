@@ -28,6 +28,7 @@
 
 #include "addressing.h"
 #include "ntp.h"
+#include "reports.h"
 
 /* Initialisation function */
 extern void NSD_Initialise(void);
@@ -39,4 +40,7 @@ extern void NSD_Finalise(void);
 extern int NSD_SignAndSendPacket(uint32_t key_id, NTP_Packet *packet, NTP_PacketInfo *info,
                                  NTP_Remote_Address *remote_addr, NTP_Local_Address *local_addr);
 
+/* Fill the MS-SNTP fields of the server statistics report */
+extern void NSD_GetServerStatsReport(RPT_ServerStatsReport *report);
+
 #endif
@@ -32,6 +32,7 @@
 #include "sysincl.h"
 
 #include "array.h"
+#include "conf.h"
 #include "ntp_sources.h"
 #include "ntp_core.h"
 #include "ntp_io.h"
@@ -96,6 +97,8 @@ struct UnresolvedSource {
   char *name;
   /* Flag indicating addresses should be used in a random order */
   int random_order;
+  /* Flag indicating the name is currently being resolved */
+  int resolving;
   /* Next unresolved source in the list */
   struct UnresolvedSource *next;
 };
@@ -109,7 +112,10 @@ static struct UnresolvedSource *unresolved_sources = NULL;
 static int resolving_interval = 0;
 static int resolving_restart = 0;
 static SCH_TimeoutID resolving_id;
-static struct UnresolvedSource *resolving_source = NULL;
+/* Next source in the list to be resolved in the current round */
+static struct UnresolvedSource *resolving_next = NULL;
+/* Number of names currently being resolved */
+static int n_resolving = 0;
 static NSR_SourceResolvingEndHandler resolving_end_handler = NULL;
 
 #define MAX_POOL_SOURCES 16
@@ -187,6 +193,7 @@ NSR_Initialise(void)
   initialised = 1;
 
   records = ARR_CreateInstance(sizeof (SourceRecord));
+  ARR_SetTag(records, MEM_SOURCES, 0);
   rehash_records();
 
   pools = ARR_CreateInstance(sizeof (struct SourcePool));
@@ -354,6 +361,7 @@ add_source(NTP_Remote_Address *remote_addr, char *name, NTP_Source_Type type,
 
       record = get_record(slot);
       record->name = Strdup(name ? name : UTI_IPToString(&remote_addr->ip_addr));
+      MEM_SetTag(record->name, MEM_SOURCES, 0);
       record->data = NCR_CreateInstance(remote_addr, type, params, record->name);
       record->remote_addr = NCR_GetRemoteAddress(record->data);
       record->pool_id = pool_id;
@@ -547,16 +555,52 @@ resolve_sources_timeout(void *arg)
 
 /* ================================================== */
 
+static void name_resolve_handler(DNS_Status status, int n_addrs, IPAddr *ip_addrs,
+                                 void *anything);
+
+/* ================================================== */
+
+static void
+start_resolving(void)
+{
+  struct UnresolvedSource *us;
+  int max_resolving;
+
+  max_resolving = CNF_GetResolverThreads();
+
+  /* Start resolving of the following names in the list, keeping at most
+     the configured number of requests in progress */
+  while (resolving_next && n_resolving < MAX(1, max_resolving)) {
+    us = resolving_next;
+    resolving_next = us->next;
+
+    /* Skip names still being resolved from a restarted round */
+    if (us->resolving)
+      continue;
+
+    us->resolving = 1;
+    n_resolving++;
+
+    DEBUG_LOG("resolving %s", us->name);
+    DNS_Name2IPAddressAsync(us->name, name_resolve_handler, us);
+  }
+}
+
+/* ================================================== */
+
 static void
 name_resolve_handler(DNS_Status status, int n_addrs, IPAddr *ip_addrs, void *anything)
 {
-  struct UnresolvedSource *us, *next;
+  struct UnresolvedSource *us;
 
   us = (struct UnresolvedSource *)anything;
 
-  assert(us == resolving_source);
+  assert(us->resolving && n_resolving > 0);
   assert(resolving_id == 0);
 
+  us->resolving = 0;
+  n_resolving--;
+
   DEBUG_LOG("%s resolved to %d addrs", us->name, n_addrs);
 
   switch (status) {
@@ -572,42 +616,38 @@ name_resolve_handler(DNS_Status status, int n_addrs, IPAddr *ip_addrs, void *any
       assert(0);
   }
 
-  next = us->next;
-
   /* Don't repeat the resolving if it (permanently) failed, it was a
      replacement of a real address, or all addresses are already resolved */
   if (status == DNS_Failure || UTI_IsIPReal(&us->address.ip_addr) || is_resolved(us))
     remove_unresolved_source(us);
 
-  /* If a restart was requested and this was the last source in the list,
+  /* If a restart was requested and all sources in the list were started,
      start with the first source again (if there still is one) */
-  if (!next && resolving_restart) {
-    next = unresolved_sources;
+  if (!resolving_next && resolving_restart) {
+    resolving_next = unresolved_sources;
     resolving_restart = 0;
   }
 
-  resolving_source = next;
+  /* Continue with the next sources in the list */
+  start_resolving();
 
-  if (next) {
-    /* Continue with the next source in the list */
-    DEBUG_LOG("resolving %s", next->name);
-    DNS_Name2IPAddressAsync(next->name, name_resolve_handler, next);
-  } else {
-    /* This was the last source in the list. If some sources couldn't
-       be resolved, try again in exponentially increasing interval. */
-    if (unresolved_sources) {
-      resolving_interval = CLAMP(MIN_RESOLVE_INTERVAL, resolving_interval + 1,
-                                 MAX_RESOLVE_INTERVAL);
-      resolving_id = SCH_AddTimeoutByDelay(RESOLVE_INTERVAL_UNIT * (1 << resolving_interval),
-                                           resolve_sources_timeout, NULL);
-    } else {
-      resolving_interval = 0;
-    }
+  if (resolving_next || n_resolving > 0)
+    return;
 
-    /* This round of resolving is done */
-    if (resolving_end_handler)
-      (resolving_end_handler)();
+  /* This was the last source in the list. If some sources couldn't
+     be resolved, try again in exponentially increasing interval. */
+  if (unresolved_sources) {
+    resolving_interval = CLAMP(MIN_RESOLVE_INTERVAL, resolving_interval + 1,
+                               MAX_RESOLVE_INTERVAL);
+    resolving_id = SCH_AddTimeoutByDelay(RESOLVE_INTERVAL_UNIT * (1 << resolving_interval),
+                                         resolve_sources_timeout, NULL);
+  } else {
+    resolving_interval = 0;
   }
+
+  /* This round of resolving is done */
+  if (resolving_end_handler)
+    (resolving_end_handler)();
 }
 
 /* ================================================== */
@@ -615,9 +655,9 @@ name_resolve_handler(DNS_Status status, int n_addrs, IPAddr *ip_addrs, void *any
 static void
 resolve_sources(void)
 {
-  struct UnresolvedSource *us, *next, *i;
+  struct UnresolvedSource *next, *i;
 
-  assert(!resolving_source);
+  assert(!resolving_next && n_resolving == 0);
 
   /* Remove sources that don't need to be resolved anymore */
   for (i = unresolved_sources; i; i = next) {
@@ -631,13 +671,10 @@ resolve_sources(void)
 
   PRV_ReloadDNS();
 
-  /* Start with the first source in the list, name_resolve_handler
+  /* Start with the first sources in the list, name_resolve_handler
      will iterate over the rest */
-  us = unresolved_sources;
-
-  resolving_source = us;
-  DEBUG_LOG("resolving %s", us->name);
-  DNS_Name2IPAddressAsync(us->name, name_resolve_handler, us);
+  resolving_next = unresolved_sources;
+  start_resolving();
 }
 
 /* ================================================== */
@@ -662,6 +699,8 @@ remove_unresolved_source(struct UnresolvedSource *us)
 
   for (i = &unresolved_sources; *i; i = &(*i)->next) {
     if (*i == us) {
+      if (resolving_next == us)
+        resolving_next = us->next;
       *i = us->next;
       Free(us->name);
       Free(us);
@@ -746,6 +785,7 @@ NSR_AddSourceByName(char *name, int port, int pool, NTP_Source_Type type,
   us = MallocNew(struct UnresolvedSource);
   us->name = Strdup(name);
   us->random_order = 0;
+  us->resolving = 0;
 
   remote_addr.ip_addr.family = IPADDR_ID;
   remote_addr.ip_addr.addr.id = ++last_address_id;
@@ -802,8 +842,8 @@ NSR_ResolveSources(void)
 {
   /* Try to resolve unresolved sources now */
   if (unresolved_sources) {
-    /* Allow only one resolving to be running at a time */
-    if (!resolving_source) {
+    /* Allow only one round of resolving to be running at a time */
+    if (!resolving_next && n_resolving == 0) {
       if (resolving_id != 0) {
         SCH_RemoveTimeout(resolving_id);
         resolving_id = 0;
@@ -947,6 +987,7 @@ resolve_source_replacement(SourceRecord *record)
      stuck to a pair of addresses if the order doesn't change, or a group of
      IPv4/IPv6 addresses if the resolver prefers inaccessible IP family */
   us->random_order = record->tentative;
+  us->resolving = 0;
   us->pool_id = INVALID_POOL;
   us->address = *record->remote_addr;
 
@@ -997,6 +1038,9 @@ NSR_RefreshAddresses(void)
   SourceRecord *record;
   unsigned int i;
 
+  /* Don't use addresses cached by the resolver */
+  DNS_FlushAsyncCache();
+
   for (i = 0; i < ARR_GetSize(records); i++) {
     record = get_record(i);
     if (!record->remote_addr)
@@ -1166,15 +1210,16 @@ slew_sources(struct timespec *raw,
   SourceRecord *record;
   unsigned int i;
 
+  /* The instances correct their timestamps for slews and known steps
+     lazily using the slew epoch of the local clock */
+  if (change_type != LCL_ChangeUnknownStep)
+    return;
+
   for (i = 0; i < ARR_GetSize(records); i++) {
     record = get_record(i);
     if (record->remote_addr) {
-      if (change_type == LCL_ChangeUnknownStep) {
-        NCR_ResetInstance(record->data);
-        NCR_ResetPoll(record->data);
-      } else {
-        NCR_SlewTimes(record->data, cooked, dfreq, doffset);
-      }
+      NCR_ResetInstance(record->data);
+      NCR_ResetPoll(record->data);
     }
   }
 }
@@ -760,6 +760,7 @@ NKS_Initialise(void)
      or unused (in the helper) */
   for (i = 0; i < MAX_SERVER_KEYS; i++) {
     server_keys[i].siv = SIV_CreateInstance(SERVER_COOKIE_SIV);
+    MEM_SetTag(server_keys[i].siv, MEM_NTS_KEYS, 1);
     generate_key(i);
   }
 
@@ -751,9 +751,11 @@ NKSN_CreateInstance(int server_mode, const char *server_name,
   NKSN_Instance inst;
 
   inst = MallocNew(struct NKSN_Instance_Record);
+  MEM_SetTag(inst, MEM_NTS_KE_SESSIONS, 1);
 
   inst->server = server_mode;
   inst->server_name = server_name ? Strdup(server_name) : NULL;
+  MEM_SetTag(inst->server_name, MEM_NTS_KE_SESSIONS, 0);
   inst->handler = handler;
   inst->handler_arg = handler_arg;
   /* Replace a NULL argument with the session itself */
@@ -799,6 +801,7 @@ NKSN_StartSession(NKSN_Instance inst, int sock_fd, const char *label,
   SCH_AddFileHandler(sock_fd, SCH_FILE_INPUT, read_write_socket, inst);
 
   inst->label = Strdup(label);
+  MEM_SetTag(inst->label, MEM_NTS_KE_SESSIONS, 0);
   inst->timeout_id = SCH_AddTimeoutByDelay(timeout, session_timeout, inst);
   inst->retry_factor = NKE_RETRY_FACTOR2_CONNECT;
 
@@ -121,9 +121,11 @@ NNC_CreateInstance(IPSockAddr *nts_address, const char *name, uint32_t cert_set,
   NNC_Instance inst;
 
   inst = MallocNew(struct NNC_Instance_Record);
+  MEM_SetTag(inst, MEM_NTS_KEYS, 1);
 
   inst->nts_address = *nts_address;
   inst->name = Strdup(name);
+  MEM_SetTag(inst->name, MEM_NTS_KEYS, 0);
   inst->cert_set = cert_set;
   inst->default_ntp_port = ntp_port;
   inst->ntp_address.ip_addr = nts_address->ip_addr;
@@ -303,8 +305,10 @@ NNC_PrepareForAuth(NNC_Instance inst)
 
   inst->nak_response = 0;
 
-  if (!inst->siv)
+  if (!inst->siv) {
     inst->siv = SIV_CreateInstance(inst->context.algorithm);
+    MEM_SetTag(inst->siv, MEM_NTS_KEYS, 0);
+  }
 
   if (!inst->siv ||
       !SIV_SetKey(inst->siv, inst->context.c2s.key, inst->context.c2s.length)) {
@@ -707,3 +711,11 @@ NNC_GetReport(NNC_Instance inst, RPT_AuthReport *report)
   report->cookie_length = inst->num_cookies > 0 ? inst->cookies[inst->cookie_index].length : 0;
   report->nak = inst->nak_response;
 }
+
+/* ================================================== */
+
+size_t
+NNC_GetMemorySize(NNC_Instance inst)
+{
+  return sizeof (*inst);
+}
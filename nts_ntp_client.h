@@ -48,4 +48,6 @@ extern void NNC_DumpData(NNC_Instance inst);
 
 extern void NNC_GetReport(NNC_Instance inst, RPT_AuthReport *report);
 
+extern size_t NNC_GetMemorySize(NNC_Instance inst);
+
 #endif
@@ -47,6 +47,18 @@
 #define RPY_LENGTH_ENTRY(reply_data_field) \
   offsetof(CMD_Reply, data.reply_data_field.EOR)
 
+/* Entries for older versions of replies, which end before the specified
+   field of the current version */
+#define REQ_LENGTH_ENTRY_PART(request_data_field, reply_data_end) \
+  { offsetof(CMD_Request, data.request_data_field.EOR), \
+    PADDING_LENGTH(data.request_data_field.EOR, data.reply_data_end) }
+
+#define RPY_LENGTH_ENTRY_PART(reply_data_end) \
+  offsetof(CMD_Reply, data.reply_data_end)
+
+#define REC_LENGTH_ENTRY(record_data_field) \
+  offsetof(CMD_Record, data.record_data_field.EOR)
+
 /* ================================================== */
 
 struct request_length {
@@ -88,7 +100,8 @@ static const struct request_length request_lengths[] = {
   REQ_LENGTH_ENTRY(null, null),                 /* WRITERTC */
   REQ_LENGTH_ENTRY(dfreq, null),                /* DFREQ */
   { 0, 0 },                                     /* DOFFSET - not supported */
-  REQ_LENGTH_ENTRY(null, tracking),             /* TRACKING */
+  REQ_LENGTH_ENTRY_PART(null,
+                        tracking.first_update_delay), /* TRACKING */
   REQ_LENGTH_ENTRY(sourcestats, sourcestats),   /* SOURCESTATS */
   REQ_LENGTH_ENTRY(null, rtc),                  /* RTCREPORT */
   REQ_LENGTH_ENTRY(null, null),                 /* TRIMRTC */
@@ -109,7 +122,7 @@ static const struct request_length request_lengths[] = {
   REQ_LENGTH_ENTRY(null, smoothing),            /* SMOOTHING */
   REQ_LENGTH_ENTRY(smoothtime, null),           /* SMOOTHTIME */
   REQ_LENGTH_ENTRY(null, null),                 /* REFRESH */
-  REQ_LENGTH_ENTRY(null, server_stats),         /* SERVER_STATS */
+  REQ_LENGTH_ENTRY_PART(null, server_stats.signd_requests), /* SERVER_STATS */
   { 0, 0 },                                     /* CLIENT_ACCESSES_BY_INDEX2 - not supported */
   REQ_LENGTH_ENTRY(local, null),                /* LOCAL2 */
   REQ_LENGTH_ENTRY(ntp_data, ntp_data),         /* NTP_DATA */
@@ -129,6 +142,14 @@ static const struct request_length request_lengths[] = {
   REQ_LENGTH_ENTRY(select_data, select_data),   /* SELECT_DATA */
   REQ_LENGTH_ENTRY(null, null),                 /* RELOAD_SOURCES */
   REQ_LENGTH_ENTRY(doffset, null),              /* DOFFSET2 */
+  REQ_LENGTH_ENTRY(client_accesses_by_index4,
+                   null),                       /* CLIENT_ACCESSES_BY_INDEX4 */
+  REQ_LENGTH_ENTRY(subscribe, null),            /* SUBSCRIBE */
+  REQ_LENGTH_ENTRY(profile_data, profile_data), /* PROFILE_DATA */
+  REQ_LENGTH_ENTRY(null, null),                 /* RESET_PROFILE */
+  REQ_LENGTH_ENTRY(memory_data, memory_data),   /* MEMORY_DATA */
+  REQ_LENGTH_ENTRY(null, tracking),             /* TRACKING2 */
+  REQ_LENGTH_ENTRY(null, server_stats),         /* SERVER_STATS2 */
 };
 
 static const uint16_t reply_lengths[] = {
@@ -137,7 +158,7 @@ static const uint16_t reply_lengths[] = {
   RPY_LENGTH_ENTRY(n_sources),                  /* N_SOURCES */
   RPY_LENGTH_ENTRY(source_data),                /* SOURCE_DATA */
   0,                                            /* MANUAL_TIMESTAMP */
-  RPY_LENGTH_ENTRY(tracking),                   /* TRACKING */
+  RPY_LENGTH_ENTRY_PART(tracking.first_update_delay), /* TRACKING */
   RPY_LENGTH_ENTRY(sourcestats),                /* SOURCESTATS */
   RPY_LENGTH_ENTRY(rtc),                        /* RTC */
   0,                                            /* SUBNETS_ACCESSED - not supported */
@@ -156,7 +177,21 @@ static const uint16_t reply_lengths[] = {
   RPY_LENGTH_ENTRY(client_accesses_by_index),   /* CLIENT_ACCESSES_BY_INDEX3 */
   0,                                            /* SERVER_STATS2 - not supported */
   RPY_LENGTH_ENTRY(select_data),                /* SELECT_DATA */
-  RPY_LENGTH_ENTRY(server_stats),               /* SERVER_STATS3 */
+  RPY_LENGTH_ENTRY_PART(server_stats.signd_requests), /* SERVER_STATS3 */
+  offsetof(CMD_BulkReply,
+           data.client_accesses_by_index4.EOR), /* CLIENT_ACCESSES_BY_INDEX4 */
+  RPY_LENGTH_ENTRY(server_stats),               /* SERVER_STATS4 */
+  RPY_LENGTH_ENTRY(profile_data),               /* PROFILE_DATA */
+  RPY_LENGTH_ENTRY(memory_data),                /* MEMORY_DATA */
+  RPY_LENGTH_ENTRY(tracking),                   /* TRACKING2 */
+};
+
+static const uint16_t record_lengths[] = {
+  REC_LENGTH_ENTRY(ntp_sample),                 /* NTP_SAMPLE */
+  REC_LENGTH_ENTRY(refclock_sample),            /* REFCLOCK_SAMPLE */
+  REC_LENGTH_ENTRY(sourcestats),                /* SOURCESTATS */
+  REC_LENGTH_ENTRY(selection),                  /* SELECTION */
+  REC_LENGTH_ENTRY(tracking),                   /* TRACKING */
 };
 
 /* ================================================== */
@@ -218,3 +253,16 @@ PKL_ReplyLength(CMD_Reply *r)
 
 /* ================================================== */
 
+int
+PKL_RecordLength(CMD_Record *r)
+{
+  uint32_t type;
+
+  assert(sizeof (record_lengths) / sizeof (record_lengths[0]) == N_RECORD_TYPES);
+
+  type = ntohs(r->record);
+  if (type >= N_RECORD_TYPES)
+    return 0;
+
+  return record_lengths[type];
+}
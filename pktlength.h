@@ -37,4 +37,6 @@ extern int PKL_CommandPaddingLength(CMD_Request *r);
 
 extern int PKL_ReplyLength(CMD_Reply *r);
 
+extern int PKL_RecordLength(CMD_Record *r);
+
 #endif /* GOT_PKTLENGTH_H */
@@ -36,6 +36,10 @@
 #include "socket.h"
 #include "util.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #define OP_ADJUSTTIME     1024
 #define OP_ADJUSTTIMEX    1025
 #define OP_SETTIME        1026
@@ -132,6 +136,11 @@ typedef struct {
 static int helper_fd;
 static pid_t helper_pid;
 
+#ifdef HAVE_PTHREAD
+/* Lock serialising requests to the helper */
+static pthread_mutex_t helper_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 static int
 have_helper(void)
 {
@@ -427,8 +436,17 @@ send_request(PrvRequest *req)
 static void
 submit_request(PrvRequest *req, PrvResponse *res)
 {
+#ifdef HAVE_PTHREAD
+  /* Requests can be submitted from the main thread and resolver threads */
+  pthread_mutex_lock(&helper_lock);
+#endif
+
   send_request(req);
   receive_response(res);
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&helper_lock);
+#endif
 }
 
 /* ======================================================================= */
@@ -54,6 +54,14 @@ struct QNT_Instance_Record {
 
 /* ================================================== */
 
+static size_t
+get_instance_size(int n_quants)
+{
+  return sizeof (struct QNT_Instance_Record) + n_quants * sizeof (struct Quantile);
+}
+
+/* ================================================== */
+
 QNT_Instance
 QNT_CreateInstance(int min_k, int max_k, int q, int repeat, double min_step)
 {
@@ -64,9 +72,10 @@ QNT_CreateInstance(int min_k, int max_k, int q, int repeat, double min_step)
       repeat < 1 || repeat > MAX_REPEAT || min_step <= 0.0)
     assert(0);
 
-  inst = MallocNew(struct QNT_Instance_Record);
+  /* Allocate the record and the array of quantiles in one block */
+  inst = Malloc(get_instance_size((max_k - min_k + 1) * repeat));
   inst->n_quants = (max_k - min_k + 1) * repeat;
-  inst->quants = MallocArray(struct Quantile, inst->n_quants);
+  inst->quants = (struct Quantile *)(inst + 1);
   inst->repeat = repeat;
   inst->q = q;
   inst->min_k = min_k;
@@ -87,7 +96,6 @@ QNT_CreateInstance(int min_k, int max_k, int q, int repeat, double min_step)
 void
 QNT_DestroyInstance(QNT_Instance inst)
 {
-  Free(inst->quants);
   Free(inst);
 }
 
@@ -185,6 +193,14 @@ QNT_Accumulate(QNT_Instance inst, double value)
 
 /* ================================================== */
 
+size_t
+QNT_GetMemorySize(QNT_Instance inst)
+{
+  return get_instance_size(inst->n_quants);
+}
+
+/* ================================================== */
+
 int
 QNT_GetMinK(QNT_Instance inst)
 {
@@ -37,5 +37,6 @@ extern void QNT_Reset(QNT_Instance inst);
 extern void QNT_Accumulate(QNT_Instance inst, double value);
 extern int QNT_GetMinK(QNT_Instance inst);
 extern double QNT_GetQuantile(QNT_Instance inst, int k);
+extern size_t QNT_GetMemorySize(QNT_Instance inst);
 
 #endif
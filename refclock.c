@@ -28,6 +28,7 @@
 #include "config.h"
 
 #include "array.h"
+#include "cmdmon.h"
 #include "refclock.h"
 #include "reference.h"
 #include "conf.h"
@@ -661,6 +662,12 @@ RCL_GetDriverPoll(RCL_Instance instance)
   return instance->driver_poll;
 }
 
+uint32_t
+RCL_GetRefId(RCL_Instance instance)
+{
+  return instance->ref_id;
+}
+
 static int
 valid_sample_time(RCL_Instance instance, struct timespec *sample_time)
 {
@@ -836,12 +843,14 @@ log_sample(RCL_Instance instance, struct timespec *sample_time, int filtered, in
 {
   char sync_stats[4] = {'N', '+', '-', '?'};
 
+  CAM_PublishRefclockSample(sample_time, instance->ref_id, filtered, instance->leap_status,
+                            pulse, raw_offset, cooked_offset, dispersion);
+
   if (logfileid == -1)
     return;
 
   if (!filtered) {
-    LOG_FileWrite(logfileid, "%s.%06d %-5s %3d %1c %1d %13.6e %13.6e %10.3e",
-      UTI_TimeToLogForm(sample_time->tv_sec),
+    LOG_FileWrite(logfileid, sample_time, ".%06d %-5s %3d %1c %1d %13.6e %13.6e %10.3e",
       (int)sample_time->tv_nsec / 1000,
       UTI_RefidToString(instance->ref_id),
       instance->driver_polled,
@@ -851,8 +860,7 @@ log_sample(RCL_Instance instance, struct timespec *sample_time, int filtered, in
       cooked_offset,
       dispersion);
   } else {
-    LOG_FileWrite(logfileid, "%s.%06d %-5s   - %1c -       -       %13.6e %10.3e",
-      UTI_TimeToLogForm(sample_time->tv_sec),
+    LOG_FileWrite(logfileid, sample_time, ".%06d %-5s   - %1c -       -       %13.6e %10.3e",
       (int)sample_time->tv_nsec / 1000,
       UTI_RefidToString(instance->ref_id),
       sync_stats[instance->leap_status],
@@ -82,5 +82,6 @@ extern int RCL_AddCookedPulse(RCL_Instance instance, struct timespec *cooked_tim
                               double second, double dispersion, double raw_correction);
 extern double RCL_GetPrecision(RCL_Instance instance);
 extern int RCL_GetDriverPoll(RCL_Instance instance);
+extern uint32_t RCL_GetRefId(RCL_Instance instance);
 
 #endif
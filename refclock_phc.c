@@ -34,6 +34,7 @@
 #include "sysincl.h"
 
 #include "refclock.h"
+#include "conf.h"
 #include "hwclock.h"
 #include "local.h"
 #include "logging.h"
@@ -49,14 +50,30 @@ struct phc_instance {
   int extpps;
   int pin;
   int channel;
+  int readings;
   HCL_Instance clock;
+  /* Statistics of polls since the last report: all polls, polls in which
+     the PHC could not be read, and polls in which all readings were
+     rejected by the filter of the HW clock */
+  int polls;
+  int failed_polls;
+  int rejected_polls;
+  double delay_sum;
+  double min_delay;
 };
 
+#define PHC_READINGS 25
+
+/* Log file with the statistics of the polls */
+static LOG_FileID logfileid;
+static int logfile_opened = 0;
+
 static void read_ext_pulse(int sockfd, int event, void *anything);
 
 static int phc_initialise(RCL_Instance instance)
 {
-  const char *options[] = {"nocrossts", "extpps", "pin", "channel", "clear", NULL};
+  const char *options[] = {"nocrossts", "extpps", "pin", "channel", "clear", "readings",
+                           NULL};
   struct phc_instance *phc;
   int phc_fd, rising_edge;
   char *path, *s;
@@ -75,6 +92,21 @@ static int phc_initialise(RCL_Instance instance)
   phc->nocrossts = RCL_GetDriverOption(instance, "nocrossts") ? 1 : 0;
   phc->extpps = RCL_GetDriverOption(instance, "extpps") ? 1 : 0;
 
+  s = RCL_GetDriverOption(instance, "readings");
+  phc->readings = s ? atoi(s) : PHC_READINGS;
+  if (phc->readings < 1 || phc->readings > PHC_READINGS)
+    LOG_FATAL("Invalid number of PHC readings");
+
+  phc->polls = phc->failed_polls = phc->rejected_polls = 0;
+  phc->delay_sum = phc->min_delay = 0.0;
+
+  if (!logfile_opened) {
+    logfileid = CNF_GetLogPHCStats() ? LOG_FileOpen("phcstats",
+        "   Date (UTC) Time     Refid Polls Fail. Rej.  Mean delay  Min delay")
+      : -1;
+    logfile_opened = 1;
+  }
+
   phc->clock = HCL_CreateInstance(0, 16, UTI_Log2ToDouble(RCL_GetDriverPoll(instance)),
                                   RCL_GetPrecision(instance));
 
@@ -140,23 +172,61 @@ static void read_ext_pulse(int fd, int event, void *anything)
                      UTI_DiffTimespecsToDouble(&phc_ts, &local_ts));
 }
 
-#define PHC_READINGS 25
+static void update_stats(RCL_Instance instance, struct phc_instance *phc, int n_readings,
+                         int accepted, double delay)
+{
+  phc->polls++;
+
+  if (n_readings < 1) {
+    phc->failed_polls++;
+  } else if (!accepted) {
+    phc->rejected_polls++;
+  } else {
+    phc->delay_sum += delay;
+    if (phc->polls - phc->failed_polls - phc->rejected_polls == 1 || phc->min_delay > delay)
+      phc->min_delay = delay;
+  }
+
+  /* Report the statistics about once per second */
+  if (phc->polls < 1 << MAX(0, -RCL_GetDriverPoll(instance)))
+    return;
+
+  if (logfileid != -1) {
+    struct timespec now;
+    int accepted_polls;
+
+    SCH_GetLastEventTime(&now, NULL, NULL);
+    accepted_polls = phc->polls - phc->failed_polls - phc->rejected_polls;
+
+    LOG_FileWrite(logfileid, &now, " %-5s %5d %5d %5d %10.3e %10.3e",
+                  UTI_RefidToString(RCL_GetRefId(instance)),
+                  phc->polls, phc->failed_polls, phc->rejected_polls,
+                  accepted_polls > 0 ? phc->delay_sum / accepted_polls : 0.0,
+                  phc->min_delay);
+  }
+
+  phc->polls = phc->failed_polls = phc->rejected_polls = 0;
+  phc->delay_sum = phc->min_delay = 0.0;
+}
 
 static int phc_poll(RCL_Instance instance)
 {
   struct timespec phc_ts, sys_ts, local_ts, readings[PHC_READINGS][3];
   struct phc_instance *phc;
   double phc_err, local_err;
-  int n_readings;
+  int n_readings, accepted;
 
   phc = (struct phc_instance *)RCL_GetDriverData(instance);
 
   n_readings = SYS_Linux_GetPHCReadings(phc->fd, phc->nocrossts, &phc->mode,
-                                        PHC_READINGS, readings);
-  if (n_readings < 1)
-    return 0;
+                                        phc->readings, readings);
+
+  accepted = n_readings > 0 &&
+             HCL_ProcessReadings(phc->clock, n_readings, readings, &phc_ts, &sys_ts, &phc_err);
+
+  update_stats(instance, phc, n_readings, accepted, accepted ? 2.0 * phc_err : 0.0);
 
-  if (!HCL_ProcessReadings(phc->clock, n_readings, readings, &phc_ts, &sys_ts, &phc_err))
+  if (!accepted)
     return 0;
 
   LCL_CookTime(&sys_ts, &local_ts, &local_err);
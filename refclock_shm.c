@@ -31,10 +31,14 @@
 
 #include "refclock.h"
 #include "logging.h"
+#include "memory.h"
 #include "util.h"
 
 #define SHMKEY 0x4e545030
 
+/* Key of the segments with a ring of samples */
+#define SHMRING_KEY 0x43485230
+
 struct shmTime {
   int    mode; /* 0 - if valid set
                 *       use values, 
@@ -58,45 +62,193 @@ struct shmTime {
   int    dummy[8]; 
 };
 
-static int shm_initialise(RCL_Instance instance) {
-  const char *options[] = {"perm", NULL};
-  int id, param, perm;
-  char *s;
-  struct shmTime *shm;
+/* Layout of the segment with a ring of samples, which is used instead of
+   the NTP SHM segment if the ring option is specified.  The segment is
+   created by chronyd, which sets the header (all fields are in the host
+   byte order).  The producer writes sample number n (counting from the
+   current write_count) to samples[n % size] as follows:
 
-  RCL_CheckDriverOptions(instance, options);
+   1. set seq to 2 * n + 1
+   2. write the fields of the sample
+   3. set seq to 2 * n + 2
+   4. set write_count to n + 1
 
-  param = atoi(RCL_GetDriverParameter(instance));
-  s = RCL_GetDriverOption(instance, "perm");
-  perm = s ? strtol(s, NULL, 8) & 0777 : 0600;
+   with memory barriers between the steps.  chronyd reads all samples written
+   since the last poll.  If more than size samples were written, the oldest
+   samples are lost. */
 
-  id = shmget(SHMKEY + param, sizeof (struct shmTime), IPC_CREAT | perm);
+#define SHMRING_MAGIC 0x53484d52
+#define SHMRING_VERSION 1
+
+struct shmRingSample {
+  volatile uint32_t seq;
+  int32_t leap;
+  int64_t receive_sec;
+  int64_t clock_sec;
+  uint32_t receive_nsec;
+  uint32_t clock_nsec;
+};
+
+struct shmRing {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;
+  uint32_t sample_size;
+  volatile uint32_t write_count;
+  uint32_t pad[3];
+  struct shmRingSample samples[];
+};
+
+/* Maximum number of samples in the ring */
+#define MAX_RING_SIZE 4096
+
+struct ShmInstance {
+  struct shmTime *shm;
+  struct shmRing *ring;
+  uint32_t ring_size;
+  uint32_t read_count;
+};
+
+static void *attach_segment(key_t key, size_t size, int perm)
+{
+  void *shm;
+  int id;
+
+  id = shmget(key, size, IPC_CREAT | perm);
   if (id == -1) {
     LOG_FATAL("shmget() failed : %s", strerror(errno));
-    return 0;
+    return NULL;
   }
    
-  shm = (struct shmTime *)shmat(id, 0, 0);
+  shm = shmat(id, 0, 0);
   if ((long)shm == -1) {
     LOG_FATAL("shmat() failed : %s", strerror(errno));
-    return 0;
+    return NULL;
+  }
+
+  return shm;
+}
+
+static int shm_initialise(RCL_Instance instance) {
+  const char *options[] = {"perm", "ring", NULL};
+  struct ShmInstance *inst;
+  int param, perm, size;
+  char *s;
+
+  RCL_CheckDriverOptions(instance, options);
+
+  param = atoi(RCL_GetDriverParameter(instance));
+  s = RCL_GetDriverOption(instance, "perm");
+  perm = s ? strtol(s, NULL, 8) & 0777 : 0600;
+
+  inst = MallocNew(struct ShmInstance);
+  inst->shm = NULL;
+  inst->ring = NULL;
+  inst->ring_size = 0;
+  inst->read_count = 0;
+
+  s = RCL_GetDriverOption(instance, "ring");
+  if (s) {
+    size = *s ? atoi(s) : 64;
+    if (size < 1 || size > MAX_RING_SIZE)
+      LOG_FATAL("Invalid size of SHM ring");
+
+    inst->ring = attach_segment(SHMRING_KEY + param, sizeof (struct shmRing) +
+                                size * sizeof (struct shmRingSample), perm);
+    inst->ring_size = size;
+
+    /* Don't read samples written before the start */
+    if (inst->ring->magic == SHMRING_MAGIC && inst->ring->version == SHMRING_VERSION &&
+        inst->ring->size == size && inst->ring->sample_size == sizeof (struct shmRingSample)) {
+      inst->read_count = inst->ring->write_count;
+    } else {
+      inst->ring->size = size;
+      inst->ring->sample_size = sizeof (struct shmRingSample);
+      inst->ring->write_count = 0;
+      inst->ring->version = SHMRING_VERSION;
+      UTI_MemoryBarrier();
+      inst->ring->magic = SHMRING_MAGIC;
+    }
+  } else {
+    inst->shm = attach_segment(SHMKEY + param, sizeof (struct shmTime), perm);
   }
 
-  RCL_SetDriverData(instance, shm);
+  RCL_SetDriverData(instance, inst);
   return 1;
 }
 
 static void shm_finalise(RCL_Instance instance)
 {
-  shmdt(RCL_GetDriverData(instance));
+  struct ShmInstance *inst;
+
+  inst = (struct ShmInstance *)RCL_GetDriverData(instance);
+
+  if (inst->ring)
+    shmdt(inst->ring);
+  else
+    shmdt(inst->shm);
+
+  Free(inst);
+}
+
+static int poll_ring(RCL_Instance instance, struct ShmInstance *inst)
+{
+  struct timespec receive_ts, clock_ts;
+  struct shmRingSample sample, *slot;
+  uint32_t write_count, seq;
+  int n;
+
+  write_count = inst->ring->write_count;
+  UTI_MemoryBarrier();
+
+  if (write_count - inst->read_count > inst->ring_size) {
+    DEBUG_LOG("SHM ring overrun lost=%"PRIu32,
+              write_count - inst->read_count - inst->ring_size);
+    inst->read_count = write_count - inst->ring_size;
+  }
+
+  for (n = 0; inst->read_count != write_count; inst->read_count++) {
+    slot = &inst->ring->samples[inst->read_count % inst->ring_size];
+    seq = 2 * inst->read_count + 2;
+
+    if (slot->seq != seq)
+      continue;
+    UTI_MemoryBarrier();
+    sample = *slot;
+    UTI_MemoryBarrier();
+
+    /* Ignore the sample if it was overwritten while copying */
+    if (slot->seq != seq) {
+      DEBUG_LOG("SHM ring sample ignored seq=%"PRIu32, seq);
+      continue;
+    }
+
+    receive_ts.tv_sec = sample.receive_sec;
+    receive_ts.tv_nsec = sample.receive_nsec;
+    clock_ts.tv_sec = sample.clock_sec;
+    clock_ts.tv_nsec = sample.clock_nsec;
+
+    UTI_NormaliseTimespec(&clock_ts);
+    UTI_NormaliseTimespec(&receive_ts);
+
+    n += RCL_AddSample(instance, &receive_ts, &clock_ts, sample.leap);
+  }
+
+  return n;
 }
 
 static int shm_poll(RCL_Instance instance)
 {
   struct timespec receive_ts, clock_ts;
   struct shmTime t, *shm;
+  struct ShmInstance *inst;
+
+  inst = (struct ShmInstance *)RCL_GetDriverData(instance);
+
+  if (inst->ring)
+    return poll_ring(instance, inst);
 
-  shm = (struct shmTime *)RCL_GetDriverData(instance);
+  shm = inst->shm;
 
   t = *shm;
   
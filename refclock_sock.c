@@ -58,46 +58,79 @@ struct sock_sample {
   int magic;
 };
 
-static void read_sample(int sockfd, int event, void *anything)
+/* Maximum number of samples in one message.  Multiple samples can be sent
+   in one message as an array of the sock_sample structures. */
+#define MAX_SAMPLES_PER_MESSAGE 16
+
+/* Maximum number of batches of messages read in one event */
+#define MAX_BATCHES 16
+
+static void process_sample(RCL_Instance instance, struct sock_sample *sample)
 {
   struct timespec sys_ts, ref_ts;
-  struct sock_sample sample;
-  RCL_Instance instance;
-  int s;
 
-  instance = (RCL_Instance)anything;
+  if (sample->magic != SOCK_MAGIC) {
+    DEBUG_LOG("Unexpected magic number in SOCK sample : %x != %x",
+              (unsigned int)sample->magic, (unsigned int)SOCK_MAGIC);
+    return;
+  }
 
-  s = recv(sockfd, &sample, sizeof (sample), 0);
+  UTI_TimevalToTimespec(&sample->tv, &sys_ts);
+  UTI_NormaliseTimespec(&sys_ts);
 
-  if (s < 0) {
-    DEBUG_LOG("Could not read SOCK sample : %s", strerror(errno));
+  if (!UTI_IsTimeOffsetSane(&sys_ts, sample->offset))
     return;
+
+  UTI_AddDoubleToTimespec(&sys_ts, sample->offset, &ref_ts);
+
+  if (sample->pulse) {
+    RCL_AddPulse(instance, &sys_ts, sample->offset);
+  } else {
+    RCL_AddSample(instance, &sys_ts, &ref_ts, sample->leap);
   }
+}
 
-  if (s != sizeof (sample)) {
+static void process_message(RCL_Instance instance, SCK_Message *message)
+{
+  struct sock_sample sample;
+  int i, n;
+
+  n = message->length / sizeof (sample);
+
+  if (message->length % sizeof (sample) != 0 || n < 1 || n > MAX_SAMPLES_PER_MESSAGE) {
     DEBUG_LOG("Unexpected length of SOCK sample : %d != %ld",
-              s, (long)sizeof (sample));
+              message->length, (long)sizeof (sample));
     return;
   }
 
-  if (sample.magic != SOCK_MAGIC) {
-    DEBUG_LOG("Unexpected magic number in SOCK sample : %x != %x",
-              (unsigned int)sample.magic, (unsigned int)SOCK_MAGIC);
-    return;
+  for (i = 0; i < n; i++) {
+    /* Copy the sample to avoid unaligned access */
+    memcpy(&sample, (char *)message->data + i * sizeof (sample), sizeof (sample));
+    process_sample(instance, &sample);
   }
+}
 
-  UTI_TimevalToTimespec(&sample.tv, &sys_ts);
-  UTI_NormaliseTimespec(&sys_ts);
+static void read_sample(int sockfd, int event, void *anything)
+{
+  SCK_Message *messages;
+  RCL_Instance instance;
+  int i, batch, received;
 
-  if (!UTI_IsTimeOffsetSane(&sys_ts, sample.offset))
-    return;
+  instance = (RCL_Instance)anything;
 
-  UTI_AddDoubleToTimespec(&sys_ts, sample.offset, &ref_ts);
+  /* Read all queued messages to not need a separate wakeup of the main loop
+     for each sample sent at a high rate */
+  for (batch = 0; batch < MAX_BATCHES; batch++) {
+    messages = SCK_ReceiveMessages(sockfd, 0, &received);
+    if (!messages)
+      return;
 
-  if (sample.pulse) {
-    RCL_AddPulse(instance, &sys_ts, sample.offset);
-  } else {
-    RCL_AddSample(instance, &sys_ts, &ref_ts, sample.leap);
+    for (i = 0; i < received; i++)
+      process_message(instance, &messages[i]);
+
+    /* Stop on a partial batch, which means the socket is empty */
+    if (received < SCK_GetMaxReceivedMessages())
+      break;
   }
 }
 
@@ -30,6 +30,7 @@
 #include "sysincl.h"
 
 #include "memory.h"
+#include "cmdmon.h"
 #include "reference.h"
 #include "util.h"
 #include "conf.h"
@@ -86,6 +87,16 @@ static REF_Mode mode;
 static int make_step_limit;
 static double make_step_threshold;
 
+/* Flag indicating the first update in the fast start is expected, its
+   step threshold, and the monotonic time of the start */
+static int fast_start;
+static double fast_start_threshold;
+static double start_time;
+
+/* Time from the start to the first update of the clock, or a negative
+   value if the clock was not updated yet */
+static double first_update_delay;
+
 /* Number of updates before offset checking, number of ignored updates
    before exiting and the maximum allowed offset */
 static int max_offset_delay;
@@ -273,6 +284,9 @@ REF_Initialise(void)
   }
 
   CNF_GetMakeStep(&make_step_limit, &make_step_threshold);
+  fast_start = CNF_GetFastStart(&fast_start_threshold);
+  start_time = SCH_GetLastEventMonoTime();
+  first_update_delay = -1.0;
   CNF_GetMaxChange(&max_offset_delay, &max_offset_ignore, &max_offset);
   CNF_GetMailOnChange(&do_mail_change, &mail_change_threshold, &mail_change_user);
   log_change_threshold = CNF_GetLogChange();
@@ -551,6 +565,22 @@ is_step_limit_reached(double offset, double offset_correction)
 
 /* ================================================== */
 
+static int
+is_fast_start_step(double offset, double offset_correction)
+{
+  if (!fast_start)
+    return 0;
+
+  fast_start = 0;
+
+  LOG(LOGS_INFO, "Fast start synchronised in %.3f seconds",
+      SCH_GetLastEventMonoTime() - start_time);
+
+  return fabs(offset - offset_correction) > fast_start_threshold;
+}
+
+/* ================================================== */
+
 static int
 is_offset_ok(double offset)
 {
@@ -840,6 +870,8 @@ write_log(struct timespec *now, int combined_sources, double freq,
   double root_dispersion, max_error;
   static double last_sys_offset = 0.0;
 
+  CAM_PublishTracking(now);
+
   if (logfileid == -1)
     return;
 
@@ -847,9 +879,8 @@ write_log(struct timespec *now, int combined_sources, double freq,
   root_dispersion = get_root_dispersion(now);
   last_sys_offset = offset - uncorrected_offset;
 
-  LOG_FileWrite(logfileid,
-                "%s %-15s %2d %10.3f %10.3f %10.3e %1c %2d %10.3e %10.3e %10.3e %10.3e %10.3e",
-                UTI_TimeToLogForm(now->tv_sec),
+  LOG_FileWrite(logfileid, now,
+                " %-15s %2d %10.3f %10.3f %10.3e %1c %2d %10.3e %10.3e %10.3e %10.3e %10.3e",
                 our_ref_ip.family != IPADDR_UNSPEC ?
                   UTI_IPToString(&our_ref_ip) : UTI_RefidToString(our_ref_id),
                 our_stratum, freq, 1.0e6 * our_skew, offset,
@@ -997,10 +1028,12 @@ REF_SetReference(int stratum, NTP_Leap leap, int combined_sources,
   double residual_frequency, local_abs_frequency;
   double elapsed, mono_now, update_interval, orig_root_distance;
   struct timespec now, raw_now;
-  int manual;
+  int manual, step_limit_reached, fast_start_step;
 
   assert(initialised);
 
+  CAM_UpdateStatusPage();
+
   /* Special modes are implemented elsewhere */
   if (mode != REF_ModeNormal) {
     special_mode_sync(1, offset);
@@ -1050,8 +1083,15 @@ REF_SetReference(int stratum, NTP_Leap leap, int combined_sources,
   last_ref_update_interval = update_interval;
   last_offset = offset;
 
-  /* Check if the clock should be stepped */
-  if (is_step_limit_reached(offset, uncorrected_offset)) {
+  if (first_update_delay < 0.0)
+    first_update_delay = mono_now - start_time;
+
+  /* Check if the clock should be stepped.  Both functions need to be
+     called to update their state. */
+  step_limit_reached = is_step_limit_reached(offset, uncorrected_offset);
+  fast_start_step = is_fast_start_step(offset, uncorrected_offset);
+
+  if (step_limit_reached || fast_start_step) {
     /* Cancel the uncorrected offset and correct the total offset by step */
     accumulate_offset = uncorrected_offset;
     step_offset = offset - uncorrected_offset;
@@ -1159,6 +1199,8 @@ REF_SetUnsynchronised(void)
 
   assert(initialised);
 
+  CAM_UpdateStatusPage();
+
   /* Special modes are implemented elsewhere */
   if (mode != REF_ModeNormal) {
     special_mode_sync(0, 0.0);
@@ -1435,3 +1477,11 @@ REF_GetTrackingReport(RPT_TrackingReport *rep)
     rep->skew_ppm = 1.0e6 * our_skew;
   }
 }
+
+/* ================================================== */
+
+double
+REF_GetFirstUpdateDelay(void)
+{
+  return first_update_delay;
+}
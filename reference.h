@@ -197,4 +197,8 @@ extern int REF_GetTaiOffset(struct timespec *ts);
 
 extern void REF_GetTrackingReport(RPT_TrackingReport *rep);
 
+/* Return the time from the start to the first update of the clock, or
+   a negative value if the clock was not updated yet */
+extern double REF_GetFirstUpdateDelay(void);
+
 #endif /* GOT_REFERENCE_H */
@@ -120,6 +120,12 @@ typedef struct {
   uint32_t ntp_interleaved_hits;
   uint32_t ntp_timestamps;
   uint32_t ntp_span_seconds;
+  uint32_t signd_requests;
+  uint32_t signd_drops;
+  uint32_t signd_timeouts;
+  uint32_t signd_max_queue;
+  double signd_mean_delay;
+  double signd_max_delay;
 } RPT_ServerStatsReport;
 
 typedef struct {
@@ -174,6 +180,7 @@ typedef struct {
   uint32_t total_tx_count;
   uint32_t total_rx_count;
   uint32_t total_valid_count;
+  uint32_t memory_size;
 } RPT_NTPReport;
 
 typedef struct {
@@ -202,4 +209,30 @@ typedef struct {
   double hi_limit;
 } RPT_SelectReport;
 
+typedef enum {
+  RPT_PROFILE_FILE_HANDLER,
+  RPT_PROFILE_TIMEOUT_HANDLER,
+  RPT_PROFILE_WAIT,
+  RPT_PROFILE_COUNTER
+} RPT_ProfileType;
+
+typedef struct {
+  char name[64];
+  RPT_ProfileType type;
+  uint32_t interval;
+  uint32_t count;
+  double total_wall_time;
+  double max_wall_time;
+  double total_cpu_time;
+  double max_cpu_time;
+} RPT_ProfileReport;
+
+typedef struct {
+  char name[32];
+  size_t current_bytes;
+  size_t peak_bytes;
+  unsigned long current_objects;
+  unsigned long peak_objects;
+} RPT_MemoryReport;
+
 #endif /* GOT_REPORTS_H */
@@ -739,8 +739,7 @@ process_reading(time_t rtc_time, struct timespec *system_time)
   if (logfileid != -1) {
     rtc_fast = (rtc_time - system_time->tv_sec) - 1.0e-9 * system_time->tv_nsec;
 
-    LOG_FileWrite(logfileid, "%s %14.6f %1d  %14.6f  %12.3f  %2d  %2d %4d",
-            UTI_TimeToLogForm(system_time->tv_sec),
+    LOG_FileWrite(logfileid, system_time, " %14.6f %1d  %14.6f  %12.3f  %2d  %2d %4d",
             rtc_fast,
             coefs_valid,
             coef_seconds_fast, coef_gain_rate * 1.0e6, n_samples, n_runs, measurement_period);
@@ -56,18 +56,28 @@ struct SPF_Instance_Record {
 
 /* ================================================== */
 
+static size_t
+get_instance_size(int max_samples)
+{
+  return sizeof (struct SPF_Instance_Record) +
+         max_samples * (sizeof (NTP_Sample) + 3 * sizeof (double) + sizeof (int));
+}
+
+/* ================================================== */
+
 SPF_Instance
 SPF_CreateInstance(int min_samples, int max_samples, double max_dispersion, double combine_ratio)
 {
   SPF_Instance filter;
 
-  filter = MallocNew(struct SPF_Instance_Record);
-
   min_samples = CLAMP(MIN_SAMPLES, min_samples, MAX_SAMPLES);
   max_samples = CLAMP(MIN_SAMPLES, max_samples, MAX_SAMPLES);
   max_samples = MAX(min_samples, max_samples);
   combine_ratio = CLAMP(0.0, combine_ratio, 1.0);
 
+  /* Allocate the record and all arrays in one block */
+  filter = Malloc(get_instance_size(max_samples));
+
   filter->min_samples = min_samples;
   filter->max_samples = max_samples;
   filter->index = -1;
@@ -78,11 +88,11 @@ SPF_CreateInstance(int min_samples, int max_samples, double max_dispersion, doub
   filter->avg_var = SQUARE(LCL_GetSysPrecisionAsQuantum());
   filter->max_var = SQUARE(max_dispersion);
   filter->combine_ratio = combine_ratio;
-  filter->samples = MallocArray(NTP_Sample, filter->max_samples);
-  filter->selected = MallocArray(int, filter->max_samples);
-  filter->x_data = MallocArray(double, filter->max_samples);
-  filter->y_data = MallocArray(double, filter->max_samples);
-  filter->w_data = MallocArray(double, filter->max_samples);
+  filter->samples = (NTP_Sample *)(filter + 1);
+  filter->x_data = (double *)(filter->samples + max_samples);
+  filter->y_data = filter->x_data + max_samples;
+  filter->w_data = filter->y_data + max_samples;
+  filter->selected = (int *)(filter->w_data + max_samples);
 
   return filter;
 }
@@ -92,11 +102,6 @@ SPF_CreateInstance(int min_samples, int max_samples, double max_dispersion, doub
 void
 SPF_DestroyInstance(SPF_Instance filter)
 {
-  Free(filter->samples);
-  Free(filter->selected);
-  Free(filter->x_data);
-  Free(filter->y_data);
-  Free(filter->w_data);
   Free(filter);
 }
 
@@ -170,6 +175,14 @@ SPF_GetMaxSamples(SPF_Instance filter)
 
 /* ================================================== */
 
+size_t
+SPF_GetMemorySize(SPF_Instance filter)
+{
+  return get_instance_size(filter->max_samples);
+}
+
+/* ================================================== */
+
 double
 SPF_GetAvgSampleDispersion(SPF_Instance filter)
 {
@@ -57,6 +57,7 @@ typedef struct {
   SCH_FileHandler       handler;
   SCH_ArbitraryArgument arg;
   int                   events;
+  int                   profile;
 } FileHandlerEntry;
 
 static ARR_Instance file_handlers;
@@ -94,6 +95,7 @@ typedef struct _TimerQueueEntry
   SCH_TimeoutClass class;       /* The class that the epoch is in */
   SCH_TimeoutHandler handler;   /* The handler routine to use */
   SCH_ArbitraryArgument arg;    /* The argument to pass to the handler */
+  int profile;                  /* Index of the handler in the profile */
 
 } TimerQueueEntry;
 
@@ -116,6 +118,35 @@ static volatile int need_to_exit;
 
 /* ================================================== */
 
+/* Profile of the main loop.  Entries are identified by the name of the
+   handler (including the source file) and they are never removed, only
+   reset. */
+
+typedef struct {
+  const char *name;
+  RPT_ProfileType type;
+  uint32_t count;
+  double total_wall_time;
+  double max_wall_time;
+  double total_cpu_time;
+  double max_cpu_time;
+} ProfileEntry;
+
+typedef struct {
+  struct timespec wall;
+  struct timespec cpu;
+} ProfileTime;
+
+static ARR_Instance profile;
+
+/* Index of the entry measuring time spent in select() */
+static int wait_profile;
+
+/* Monotonic time of the last reset of the profile */
+static double profile_reset_time;
+
+/* ================================================== */
+
 static void
 handle_slew(struct timespec *raw,
             struct timespec *cooked,
@@ -124,6 +155,8 @@ handle_slew(struct timespec *raw,
             LCL_ChangeType change_type,
             void *anything);
 
+static int get_profile_entry(const char *name, RPT_ProfileType type);
+
 /* ================================================== */
 
 void
@@ -131,6 +164,9 @@ SCH_Initialise(void)
 {
   file_handlers = ARR_CreateInstance(sizeof (FileHandlerEntry));
 
+  profile = ARR_CreateInstance(sizeof (ProfileEntry));
+  wait_profile = get_profile_entry(SCH_HANDLER_NAME(select), RPT_PROFILE_WAIT);
+
   n_timer_queue_entries = 0;
   next_tqe_id = 0;
 
@@ -145,6 +181,7 @@ SCH_Initialise(void)
   last_select_ts = last_select_ts_raw;
   last_select_ts_mono = 0.0;
   last_select_ts_mono_ns = 0;
+  profile_reset_time = 0.0;
 
   initialised = 1;
 }
@@ -155,6 +192,7 @@ SCH_Initialise(void)
 void
 SCH_Finalise(void) {
   ARR_DestroyInstance(file_handlers);
+  ARR_DestroyInstance(profile);
 
   LCL_RemoveParameterChangeHandler(handle_slew, NULL);
 
@@ -163,9 +201,79 @@ SCH_Finalise(void) {
 
 /* ================================================== */
 
+static int
+get_profile_entry(const char *name, RPT_ProfileType type)
+{
+  ProfileEntry *entries;
+  int i, n;
+
+  entries = ARR_GetElements(profile);
+  n = ARR_GetSize(profile);
+
+  /* Handlers registered from the same place normally share the string */
+  for (i = 0; i < n; i++) {
+    if (entries[i].name == name && entries[i].type == type)
+      return i;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (entries[i].type == type && strcmp(entries[i].name, name) == 0)
+      return i;
+  }
+
+  entries = ARR_GetNewElement(profile);
+  memset(entries, 0, sizeof (*entries));
+  entries->name = name;
+  entries->type = type;
+
+  return n;
+}
+
+/* ================================================== */
+
+static void
+read_profile_time(ProfileTime *time)
+{
+#ifdef CLOCK_MONOTONIC
+  if (clock_gettime(CLOCK_MONOTONIC, &time->wall) < 0)
+#endif
+    LCL_ReadRawTime(&time->wall);
+
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time->cpu) < 0)
+#endif
+    UTI_DoubleToTimespec((double)clock() / CLOCKS_PER_SEC, &time->cpu);
+}
+
+/* ================================================== */
+
+static void
+update_profile(int index, ProfileTime *start)
+{
+  ProfileEntry *entry;
+  ProfileTime end;
+  double wall, cpu;
+
+  read_profile_time(&end);
+
+  wall = UTI_DiffTimespecsToDouble(&end.wall, &start->wall);
+  cpu = UTI_DiffTimespecsToDouble(&end.cpu, &start->cpu);
+
+  entry = ARR_GetElement(profile, index);
+  entry->count++;
+  entry->total_wall_time += wall;
+  entry->total_cpu_time += cpu;
+  if (entry->max_wall_time < wall)
+    entry->max_wall_time = wall;
+  if (entry->max_cpu_time < cpu)
+    entry->max_cpu_time = cpu;
+}
+
+/* ================================================== */
+
 void
-SCH_AddFileHandler
-(int fd, int events, SCH_FileHandler handler, SCH_ArbitraryArgument arg)
+SCH_AddNamedFileHandler(int fd, int events, SCH_FileHandler handler,
+                        SCH_ArbitraryArgument arg, const char *name)
 {
   FileHandlerEntry *ptr;
 
@@ -182,6 +290,7 @@ SCH_AddFileHandler
     ptr->handler = NULL;
     ptr->arg = NULL;
     ptr->events = 0;
+    ptr->profile = -1;
   }
 
   ptr = ARR_GetElement(file_handlers, fd);
@@ -194,6 +303,7 @@ SCH_AddFileHandler
   ptr->handler = handler;
   ptr->arg = arg;
   ptr->events = events;
+  ptr->profile = get_profile_entry(name, RPT_PROFILE_FILE_HANDLER);
 
   if (one_highest_fd < fd + 1)
     one_highest_fd = fd + 1;
@@ -217,6 +327,7 @@ SCH_RemoveFileHandler(int fd)
   ptr->handler = NULL;
   ptr->arg = NULL;
   ptr->events = 0;
+  ptr->profile = -1;
 
   /* Find new highest file descriptor */
   while (one_highest_fd > 0) {
@@ -320,7 +431,8 @@ try_again:
 /* ================================================== */
 
 SCH_TimeoutID
-SCH_AddTimeout(struct timespec *ts, SCH_TimeoutHandler handler, SCH_ArbitraryArgument arg)
+SCH_AddNamedTimeout(struct timespec *ts, SCH_TimeoutHandler handler,
+                    SCH_ArbitraryArgument arg, const char *name)
 {
   TimerQueueEntry *new_tqe;
   TimerQueueEntry *ptr;
@@ -334,6 +446,7 @@ SCH_AddTimeout(struct timespec *ts, SCH_TimeoutHandler handler, SCH_ArbitraryArg
   new_tqe->arg = arg;
   new_tqe->ts = *ts;
   new_tqe->class = SCH_ReservedTimeoutValue;
+  new_tqe->profile = get_profile_entry(name, RPT_PROFILE_TIMEOUT_HANDLER);
 
   /* Now work out where to insert the new entry in the list */
   for (ptr = timer_queue.next; ptr != &timer_queue; ptr = ptr->next) {
@@ -362,7 +475,8 @@ SCH_AddTimeout(struct timespec *ts, SCH_TimeoutHandler handler, SCH_ArbitraryArg
    the current (raw) time */
 
 SCH_TimeoutID
-SCH_AddTimeoutByDelay(double delay, SCH_TimeoutHandler handler, SCH_ArbitraryArgument arg)
+SCH_AddNamedTimeoutByDelay(double delay, SCH_TimeoutHandler handler,
+                           SCH_ArbitraryArgument arg, const char *name)
 {
   struct timespec now, then;
 
@@ -375,16 +489,15 @@ SCH_AddTimeoutByDelay(double delay, SCH_TimeoutHandler handler, SCH_ArbitraryArg
     LOG_FATAL("Timeout overflow");
   }
 
-  return SCH_AddTimeout(&then, handler, arg);
-
+  return SCH_AddNamedTimeout(&then, handler, arg, name);
 }
 
 /* ================================================== */
 
 SCH_TimeoutID
-SCH_AddTimeoutInClass(double min_delay, double separation, double randomness,
-                      SCH_TimeoutClass class,
-                      SCH_TimeoutHandler handler, SCH_ArbitraryArgument arg)
+SCH_AddNamedTimeoutInClass(double min_delay, double separation, double randomness,
+                           SCH_TimeoutClass class, SCH_TimeoutHandler handler,
+                           SCH_ArbitraryArgument arg, const char *name)
 {
   TimerQueueEntry *new_tqe;
   TimerQueueEntry *ptr;
@@ -446,6 +559,7 @@ SCH_AddTimeoutInClass(double min_delay, double separation, double randomness,
   new_tqe->arg = arg;
   UTI_AddDoubleToTimespec(&now, new_min_delay, &new_tqe->ts);
   new_tqe->class = class;
+  new_tqe->profile = get_profile_entry(name, RPT_PROFILE_TIMEOUT_HANDLER);
 
   new_tqe->next = ptr;
   new_tqe->prev = ptr->prev;
@@ -503,6 +617,8 @@ dispatch_timeouts(struct timespec *now) {
   TimerQueueEntry *ptr;
   SCH_TimeoutHandler handler;
   SCH_ArbitraryArgument arg;
+  ProfileTime start;
+  int profile_index;
 
   n_entries_on_start = n_timer_queue_entries;
   n_done = 0;
@@ -521,11 +637,14 @@ dispatch_timeouts(struct timespec *now) {
 
     handler = ptr->handler;
     arg = ptr->arg;
+    profile_index = ptr->profile;
 
     SCH_RemoveTimeout(ptr->id);
 
     /* Dispatch the handler */
+    read_profile_time(&start);
     (handler)(arg);
+    update_profile(profile_index, &start);
 
     /* Increment count of timeouts handled */
     ++n_done;
@@ -549,20 +668,37 @@ dispatch_timeouts(struct timespec *now) {
 
 /* ================================================== */
 
+static void
+dispatch_filehandler(int fd, int event)
+{
+  FileHandlerEntry *ptr;
+  ProfileTime start;
+  int profile_index;
+
+  ptr = (FileHandlerEntry *)ARR_GetElement(file_handlers, fd);
+  if (!ptr->handler)
+    return;
+
+  profile_index = ptr->profile;
+
+  read_profile_time(&start);
+  (ptr->handler)(fd, event, ptr->arg);
+  update_profile(profile_index, &start);
+}
+
+/* ================================================== */
+
 /* nfd is the number of bits set in all fd_sets */
 
 static void
 dispatch_filehandlers(int nfd, fd_set *read_fds, fd_set *write_fds, fd_set *except_fds)
 {
-  FileHandlerEntry *ptr;
   int fd;
-  
+
   for (fd = 0; nfd && fd < one_highest_fd; fd++) {
     if (except_fds && FD_ISSET(fd, except_fds)) {
       /* This descriptor has an exception, dispatch its handler */
-      ptr = (FileHandlerEntry *)ARR_GetElement(file_handlers, fd);
-      if (ptr->handler)
-        (ptr->handler)(fd, SCH_FILE_EXCEPTION, ptr->arg);
+      dispatch_filehandler(fd, SCH_FILE_EXCEPTION);
       nfd--;
 
       /* Don't try to read from it now */
@@ -574,17 +710,13 @@ dispatch_filehandlers(int nfd, fd_set *read_fds, fd_set *write_fds, fd_set *exce
 
     if (read_fds && FD_ISSET(fd, read_fds)) {
       /* This descriptor can be read from, dispatch its handler */
-      ptr = (FileHandlerEntry *)ARR_GetElement(file_handlers, fd);
-      if (ptr->handler)
-        (ptr->handler)(fd, SCH_FILE_INPUT, ptr->arg);
+      dispatch_filehandler(fd, SCH_FILE_INPUT);
       nfd--;
     }
 
     if (write_fds && FD_ISSET(fd, write_fds)) {
       /* This descriptor can be written to, dispatch its handler */
-      ptr = (FileHandlerEntry *)ARR_GetElement(file_handlers, fd);
-      if (ptr->handler)
-        (ptr->handler)(fd, SCH_FILE_OUTPUT, ptr->arg);
+      dispatch_filehandler(fd, SCH_FILE_OUTPUT);
       nfd--;
     }
   }
@@ -766,6 +898,7 @@ SCH_MainLoop(void)
   int status, errsv;
   struct timeval tv, saved_tv, *ptv;
   struct timespec ts, now, saved_now, cooked;
+  ProfileTime wait_start;
   double err;
 
   assert(initialised);
@@ -802,8 +935,10 @@ SCH_MainLoop(void)
     if (!ptv && !p_read_fds && !p_write_fds)
       LOG_FATAL("Nothing to do");
 
+    read_profile_time(&wait_start);
     status = select(one_highest_fd, p_read_fds, p_write_fds, p_except_fds, ptv);
     errsv = errno;
+    update_profile(wait_profile, &wait_start);
 
     LCL_ReadRawTime(&now);
     LCL_CookTime(&now, &cooked, &err);
@@ -850,3 +985,71 @@ SCH_QuitProgram(void)
 
 /* ================================================== */
 
+int
+SCH_AddProfileCounter(const char *name)
+{
+  assert(initialised);
+
+  return get_profile_entry(name, RPT_PROFILE_COUNTER);
+}
+
+/* ================================================== */
+
+void
+SCH_IncrementProfileCounter(int counter)
+{
+  ((ProfileEntry *)ARR_GetElement(profile, counter))->count++;
+}
+
+/* ================================================== */
+
+int
+SCH_GetNumberOfProfileEntries(void)
+{
+  return ARR_GetSize(profile);
+}
+
+/* ================================================== */
+
+int
+SCH_GetProfileReport(int index, RPT_ProfileReport *report)
+{
+  ProfileEntry *entry;
+
+  if (index < 0 || index >= ARR_GetSize(profile))
+    return 0;
+
+  entry = ARR_GetElement(profile, index);
+
+  snprintf(report->name, sizeof (report->name), "%s", entry->name);
+  report->type = entry->type;
+  report->interval = last_select_ts_mono - profile_reset_time;
+  report->count = entry->count;
+  report->total_wall_time = entry->total_wall_time;
+  report->max_wall_time = entry->max_wall_time;
+  report->total_cpu_time = entry->total_cpu_time;
+  report->max_cpu_time = entry->max_cpu_time;
+
+  return 1;
+}
+
+/* ================================================== */
+
+void
+SCH_ResetProfile(void)
+{
+  ProfileEntry *entry;
+  unsigned int i;
+
+  for (i = 0; i < ARR_GetSize(profile); i++) {
+    entry = ARR_GetElement(profile, i);
+    entry->count = 0;
+    entry->total_wall_time = entry->max_wall_time = 0.0;
+    entry->total_cpu_time = entry->max_cpu_time = 0.0;
+  }
+
+  profile_reset_time = last_select_ts_mono;
+}
+
+/* ================================================== */
+
@@ -29,6 +29,8 @@
 
 #include "sysincl.h"
 
+#include "reports.h"
+
 /* Type for timeout IDs, valid IDs are always greater than zero */
 typedef unsigned int SCH_TimeoutID;
 
@@ -57,8 +59,14 @@ extern void SCH_Finalise(void);
 #define SCH_FILE_OUTPUT 2
 #define SCH_FILE_EXCEPTION 4
 
+/* Name identifying a handler in the profile */
+#define SCH_HANDLER_NAME(handler) (__FILE__ ":" #handler)
+
 /* Register a handler for when select goes true on a file descriptor */
-extern void SCH_AddFileHandler(int fd, int events, SCH_FileHandler handler, SCH_ArbitraryArgument arg);
+#define SCH_AddFileHandler(fd, events, handler, arg) \
+  SCH_AddNamedFileHandler(fd, events, handler, arg, SCH_HANDLER_NAME(handler))
+extern void SCH_AddNamedFileHandler(int fd, int events, SCH_FileHandler handler,
+                                    SCH_ArbitraryArgument arg, const char *name);
 extern void SCH_RemoveFileHandler(int fd);
 extern void SCH_SetFileHandlerEvent(int fd, int event, int enable);
 
@@ -69,18 +77,28 @@ extern void SCH_GetLastEventTime(struct timespec *cooked, double *err, struct ti
 extern double SCH_GetLastEventMonoTime(void);
 
 /* This queues a timeout to elapse at a given (raw) local time */
-extern SCH_TimeoutID SCH_AddTimeout(struct timespec *ts, SCH_TimeoutHandler handler, SCH_ArbitraryArgument arg);
+#define SCH_AddTimeout(ts, handler, arg) \
+  SCH_AddNamedTimeout(ts, handler, arg, SCH_HANDLER_NAME(handler))
+extern SCH_TimeoutID SCH_AddNamedTimeout(struct timespec *ts, SCH_TimeoutHandler handler,
+                                         SCH_ArbitraryArgument arg, const char *name);
 
 /* This queues a timeout to elapse at a given delta time relative to the current (raw) time */
-extern SCH_TimeoutID SCH_AddTimeoutByDelay(double delay, SCH_TimeoutHandler, SCH_ArbitraryArgument);
+#define SCH_AddTimeoutByDelay(delay, handler, arg) \
+  SCH_AddNamedTimeoutByDelay(delay, handler, arg, SCH_HANDLER_NAME(handler))
+extern SCH_TimeoutID SCH_AddNamedTimeoutByDelay(double delay, SCH_TimeoutHandler,
+                                                SCH_ArbitraryArgument, const char *name);
 
 /* This queues a timeout in a particular class, ensuring that the
    expiry time is at least a given separation away from any other
    timeout in the same class, given randomness is added to the delay
    and separation */
-extern SCH_TimeoutID SCH_AddTimeoutInClass(double min_delay, double separation, double randomness,
-                                           SCH_TimeoutClass class,
-                                           SCH_TimeoutHandler handler, SCH_ArbitraryArgument);
+#define SCH_AddTimeoutInClass(min_delay, separation, randomness, class, handler, arg) \
+  SCH_AddNamedTimeoutInClass(min_delay, separation, randomness, class, handler, arg, \
+                             SCH_HANDLER_NAME(handler))
+extern SCH_TimeoutID SCH_AddNamedTimeoutInClass(double min_delay, double separation,
+                                                double randomness, SCH_TimeoutClass class,
+                                                SCH_TimeoutHandler handler,
+                                                SCH_ArbitraryArgument, const char *name);
 
 /* The next one probably ought to return a status code */
 extern void SCH_RemoveTimeout(SCH_TimeoutID);
@@ -89,4 +107,20 @@ extern void SCH_MainLoop(void);
 
 extern void SCH_QuitProgram(void);
 
+/* Add a counter of events to the profile and return its index */
+extern int SCH_AddProfileCounter(const char *name);
+
+/* Increment a counter in the profile */
+extern void SCH_IncrementProfileCounter(int counter);
+
+/* Get the number of entries in the profile (handlers, time spent waiting
+   for events, and counters) */
+extern int SCH_GetNumberOfProfileEntries(void);
+
+/* Get a report for an entry of the profile */
+extern int SCH_GetProfileReport(int index, RPT_ProfileReport *report);
+
+/* Reset all entries of the profile */
+extern void SCH_ResetProfile(void);
+
 #endif /* GOT_SCHED_H */
@@ -1037,6 +1037,7 @@ send_message(int sock_fd, SCK_Message *message, int flags)
   socklen_t saddr_len;
   struct msghdr msg;
   struct iovec iov;
+  int saved_errno;
 
   switch (message->addr_type) {
     case SCK_ADDR_UNSPEC:
@@ -1154,7 +1155,10 @@ send_message(int sock_fd, SCK_Message *message, int flags)
     msg.msg_control = NULL;
 
   if (sendmsg(sock_fd, &msg, 0) < 0) {
+    saved_errno = errno;
     log_message(sock_fd, -1, message, "Could not send", strerror(errno));
+    /* Allow the caller to check the error */
+    errno = saved_errno;
     return 0;
   }
 
@@ -1514,6 +1518,14 @@ SCK_ReceiveMessages(int sock_fd, int flags, int *num_messages)
 
 /* ================================================== */
 
+int
+SCK_GetMaxReceivedMessages(void)
+{
+  return MAX_RECV_MESSAGES;
+}
+
+/* ================================================== */
+
 void
 SCK_InitMessage(SCK_Message *message, SCK_AddressType addr_type)
 {
@@ -128,6 +128,9 @@ extern int SCK_Send(int sock_fd, const void *buffer, int length, int flags);
 extern SCK_Message *SCK_ReceiveMessage(int sock_fd, int flags);
 extern SCK_Message *SCK_ReceiveMessages(int sock_fd, int flags, int *num_messages);
 
+/* Get the maximum number of messages received by SCK_ReceiveMessages() */
+extern int SCK_GetMaxReceivedMessages(void);
+
 /* Initialise a new message (e.g. before sending) */
 extern void SCK_InitMessage(SCK_Message *message, SCK_AddressType addr_type);
 
@@ -34,6 +34,7 @@
 
 #include "sources.h"
 #include "sourcestats.h"
+#include "cmdmon.h"
 #include "memory.h"
 #include "ntp.h" /* For NTP_Leap */
 #include "ntp_sources.h"
@@ -161,6 +162,9 @@ static int *sel_sources;
 static int n_sources; /* Number of sources currently in the table */
 static int max_n_sources; /* Capacity of the table */
 
+/* Cache of instance records */
+static ObjectCache instances = OBJECT_CACHE_INITIALISER(struct SRC_Instance_Record, 16, MEM_SOURCES);
+
 #define INVALID_SOURCE (-1)
 static int selected_source_index; /* Which source index is currently
                                      selected (set to INVALID_SOURCE
@@ -183,6 +187,44 @@ static LOG_FileID logfileid;
 /* Identifier of the dump file */
 #define DUMP_IDENTIFIER "SRC0\n"
 
+/* Name of the binary snapshot of all sources */
+#define SNAPSHOT_FILENAME "sources"
+#define SNAPSHOT_SUFFIX ".bin"
+
+/* Identifier of the snapshot and value used to detect a different
+   byte order.  The snapshot is not portable between different systems. */
+#define SNAPSHOT_IDENTIFIER "SRCBIN1\n"
+#define SNAPSHOT_BYTE_ORDER 0x01020304U
+
+#define SNAPSHOT_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+#define MAX_SNAPSHOT_NAME 256
+
+/* Header of the snapshot */
+struct SnapshotHeader {
+  char identifier[8];
+  uint32_t byte_order;
+  uint32_t record_size;
+  uint32_t sample_size;
+  uint32_t n_records;
+};
+
+/* Record of one source in the snapshot, followed by its samples
+   (in the SST_DumpSample format) aligned to 8 bytes */
+struct SnapshotRecord {
+  int32_t type;
+  uint32_t ref_id;
+  IPAddr ip_addr;
+  int32_t authenticated;
+  uint32_t reachability;
+  int32_t reachability_size;
+  int32_t stratum;
+  int32_t leap;
+  int32_t asymmetry_run;
+  int32_t n_samples;
+  char name[MAX_SNAPSHOT_NAME];
+};
+
 /* ================================================== */
 /* Forward prototype */
 
@@ -248,7 +290,7 @@ SRC_Instance SRC_CreateNewInstance(uint32_t ref_id, SRC_Type type, int authentic
   if (max_samples == SRC_DEFAULT_MAXSAMPLES)
     max_samples = CNF_GetMaxSamples();
 
-  result = MallocNew(struct SRC_Instance_Record);
+  result = MallocObject(&instances);
   result->stats = SST_CreateInstance(ref_id, addr, min_samples, max_samples,
                                      min_delay, asymmetry);
 
@@ -304,7 +346,7 @@ void SRC_DestroyInstance(SRC_Instance instance)
     sources[i]->index = i;
   }
   --n_sources;
-  Free(instance);
+  FreeObject(&instances, instance);
 
   update_sel_options();
 
@@ -313,6 +355,8 @@ void SRC_DestroyInstance(SRC_Instance instance)
     SRC_ReselectSource();
   else if (selected_source_index > dead_index)
     --selected_source_index;
+
+  CAM_UpdateStatusPage();
 }
 
 /* ================================================== */
@@ -356,6 +400,14 @@ SRC_GetSourcestats(SRC_Instance instance)
 
 /* ================================================== */
 
+size_t
+SRC_GetMemorySize(SRC_Instance instance)
+{
+  return sizeof (*instance) + SST_GetMemorySize(instance->stats);
+}
+
+/* ================================================== */
+
 static NTP_Leap
 get_leap_status(void)
 {
@@ -663,9 +715,9 @@ mark_source(SRC_Instance inst, SRC_Status status)
 
   SCH_GetLastEventTime(&now, NULL, NULL);
 
-  LOG_FileWrite(logfileid,
-                "%s %-15s %c -%c%c%c%c %4o %5.2f %10.3e %10.3e %10.3e",
-                UTI_TimeToLogForm(now.tv_sec), source_to_string(inst),
+  LOG_FileWrite(logfileid, &now,
+                " %-15s %c -%c%c%c%c %4o %5.2f %10.3e %10.3e %10.3e",
+                source_to_string(inst),
                 get_status_char(inst->status),
                 inst->sel_options & SRC_SELECT_NOSELECT ? 'N' : '-',
                 inst->sel_options & SRC_SELECT_PREFER ? 'P' : '-',
@@ -784,8 +836,8 @@ combine_sources(int n_sel_sources, struct timespec *ref_time, double *offset,
 /* This function selects the current reference from amongst the pool
    of sources we are holding and updates the local reference */
 
-void
-SRC_SelectSource(SRC_Instance updated_inst)
+static void
+select_source(SRC_Instance updated_inst)
 {
   struct SelectInfo *si;
   struct timespec now, ref_time;
@@ -804,6 +856,9 @@ SRC_SelectSource(SRC_Instance updated_inst)
   if (updated_inst)
     updated_inst->updates++;
 
+  /* Publish the new state of sources and reference */
+  CAM_UpdateStatusPage();
+
   if (n_sources == 0) {
     /* In this case, we clearly cannot synchronise to anything */
     if (selected_source_index != INVALID_SOURCE) {
@@ -1298,6 +1353,35 @@ SRC_SelectSource(SRC_Instance updated_inst)
                    src_root_delay, src_root_dispersion);
 }
 
+/* ================================================== */
+
+void
+SRC_SelectSource(SRC_Instance updated_inst)
+{
+  SRC_Instance last_selected, selected;
+  struct timespec now;
+  IPAddr ip_addr;
+
+  last_selected = selected_source_index != INVALID_SOURCE ?
+                  sources[selected_source_index] : NULL;
+
+  select_source(updated_inst);
+
+  selected = selected_source_index != INVALID_SOURCE ?
+             sources[selected_source_index] : NULL;
+
+  /* Push the change of the selected source to subscribers of the command
+     socket */
+  if (selected != last_selected) {
+    SCH_GetLastEventTime(&now, NULL, NULL);
+    if (selected && selected->ip_addr)
+      ip_addr = *selected->ip_addr;
+    else
+      ip_addr.family = IPADDR_UNSPEC;
+    CAM_PublishSelection(&now, selected ? selected->ref_id : 0, &ip_addr);
+  }
+}
+
 /* ================================================== */
 /* Force reselecting the best source */
 
@@ -1322,9 +1406,9 @@ SRC_SetReselectDistance(double distance)
 /* ================================================== */
 /* This routine is registered as a callback with the local clock
    module, to be called whenever the local clock changes frequency or
-   is slewed.  It runs through all the existing source statistics, and
-   adjusts them to make them look as though they were sampled under
-   the new regime. */
+   is slewed.  Slews and known steps don't need any processing here as
+   the source statistics correct their samples lazily using the slew
+   epoch of the local clock.  An unknown step resets all statistics. */
 
 static void
 slew_sources(struct timespec *raw, struct timespec *cooked, double dfreq,
@@ -1332,18 +1416,14 @@ slew_sources(struct timespec *raw, struct timespec *cooked, double dfreq,
 {
   int i;
 
-  for (i=0; i<n_sources; i++) {
-    if (change_type == LCL_ChangeUnknownStep) {
-      SST_ResetInstance(sources[i]->stats);
-    } else {
-      SST_SlewSamples(sources[i]->stats, cooked, dfreq, doffset);
-    }
-  }
+  if (change_type != LCL_ChangeUnknownStep)
+    return;
 
-  if (change_type == LCL_ChangeUnknownStep) {
-    /* Update selection status */
-    SRC_SelectSource(NULL);
-  }
+  for (i = 0; i < n_sources; i++)
+    SST_ResetInstance(sources[i]->stats);
+
+  /* Update selection status */
+  SRC_SelectSource(NULL);
 }
 
 /* ================================================== */
@@ -1418,6 +1498,113 @@ save_source(SRC_Instance inst)
   fclose(f);
 }
 
+/* ================================================== */
+
+static int
+write_aligned(const void *data, size_t length, FILE *f)
+{
+  static const char padding[8] = {0};
+  size_t padding_length = SNAPSHOT_ALIGN(length) - length;
+
+  return fwrite(data, length, 1, f) == 1 &&
+         (padding_length == 0 || fwrite(padding, padding_length, 1, f) == 1);
+}
+
+/* ================================================== */
+
+static void
+save_snapshot(void)
+{
+  SST_DumpSample samples[SST_MAX_SAMPLES];
+  struct SnapshotHeader header;
+  struct SnapshotRecord record;
+  char *dumpdir, *ntp_name;
+  int i, n_samples, asymmetry_run;
+  SRC_Instance inst;
+  FILE *f;
+
+  dumpdir = CNF_GetDumpDir();
+  if (!dumpdir)
+    return;
+
+  f = UTI_OpenFile(dumpdir, SNAPSHOT_FILENAME, ".tmp", 'w', 0644);
+  if (!f)
+    return;
+
+  memset(&header, 0, sizeof (header));
+  memcpy(header.identifier, SNAPSHOT_IDENTIFIER, sizeof (header.identifier));
+  header.byte_order = SNAPSHOT_BYTE_ORDER;
+  header.record_size = sizeof (record);
+  header.sample_size = sizeof (samples[0]);
+  header.n_records = 0;
+
+  /* The header is rewritten with the final number of records at the end */
+  if (!write_aligned(&header, sizeof (header), f))
+    goto error;
+
+  for (i = 0; i < n_sources; i++) {
+    inst = sources[i];
+
+    if (inst->type == SRC_NTP && !UTI_IsIPReal(inst->ip_addr))
+      continue;
+
+    n_samples = SST_SaveToBuffer(inst->stats, samples, &asymmetry_run);
+    if (n_samples < 1)
+      continue;
+
+    memset(&record, 0, sizeof (record));
+    record.type = inst->type;
+    record.ref_id = inst->ref_id;
+    if (inst->type == SRC_NTP)
+      record.ip_addr = *inst->ip_addr;
+    else
+      record.ip_addr.family = IPADDR_UNSPEC;
+
+    ntp_name = inst->type == SRC_NTP ? NSR_GetName(inst->ip_addr) : ".";
+    if (!ntp_name || snprintf(record.name, sizeof (record.name), "%s", ntp_name) >=
+                     sizeof (record.name))
+      continue;
+
+    record.authenticated = inst->authenticated;
+    record.reachability = inst->reachability;
+    record.reachability_size = inst->reachability_size;
+    record.stratum = inst->stratum;
+    record.leap = inst->leap;
+    record.asymmetry_run = asymmetry_run;
+    record.n_samples = n_samples;
+
+    if (!write_aligned(&record, sizeof (record), f) ||
+        fwrite(samples, sizeof (samples[0]), n_samples, f) != n_samples)
+      goto error;
+
+    header.n_records++;
+  }
+
+  if (fseek(f, 0, SEEK_SET) < 0 || fwrite(&header, sizeof (header), 1, f) != 1)
+    goto error;
+
+  if (fclose(f)) {
+    f = NULL;
+    goto error;
+  }
+
+  /* Rename the temporary file, or remove it if that fails */
+  if (!UTI_RenameTempFile(dumpdir, SNAPSHOT_FILENAME, ".tmp", SNAPSHOT_SUFFIX))
+    ;
+
+  DEBUG_LOG("Saved %"PRIu32" sources to snapshot", header.n_records);
+
+  return;
+
+error:
+  LOG(LOGS_ERR, "Could not save snapshot of sources");
+  if (f)
+    fclose(f);
+
+  if (!UTI_RemoveFile(dumpdir, SNAPSHOT_FILENAME, ".tmp"))
+    ;
+}
+
 /* ================================================== */
 /* This is called to dump out the source measurement registers */
 
@@ -1426,12 +1613,194 @@ SRC_DumpSources(void)
 {
   int i;
 
+  if (CNF_GetDumpFormat() == SRC_DUMP_BINARY) {
+    save_snapshot();
+    return;
+  }
+
   for (i = 0; i < n_sources; i++)
     save_source(sources[i]);
 }
 
 /* ================================================== */
 
+static int
+check_dumped_state(SRC_Instance inst, int auth, int stratum, int leap)
+{
+  return (auth || !inst->authenticated) &&
+         stratum >= 0 && stratum < NTP_MAX_STRATUM &&
+         leap >= LEAP_Normal && leap < LEAP_Unsynchronised;
+}
+
+/* ================================================== */
+
+static void
+set_dumped_state(SRC_Instance inst, unsigned int reach, int reach_size, int stratum, int leap)
+{
+  inst->reachability = reach & ((1U << SOURCE_REACH_BITS) - 1);
+  inst->reachability_size = CLAMP(0, reach_size, SOURCE_REACH_BITS);
+  inst->stratum = stratum;
+  inst->leap = leap;
+}
+
+/* ================================================== */
+
+static int
+compare_snapshot_keys(int type, uint32_t ref_id, const IPAddr *ip_addr,
+                      const struct SnapshotRecord *record)
+{
+  if (type != record->type)
+    return type < record->type ? -1 : 1;
+
+  if (type == SRC_NTP)
+    return UTI_CompareIPs(ip_addr, &record->ip_addr, NULL);
+
+  if (ref_id != record->ref_id)
+    return ref_id < record->ref_id ? -1 : 1;
+
+  return 0;
+}
+
+/* ================================================== */
+
+static int
+compare_snapshot_records(const void *a, const void *b)
+{
+  const struct SnapshotRecord *r1 = *(const struct SnapshotRecord **)a;
+  const struct SnapshotRecord *r2 = *(const struct SnapshotRecord **)b;
+
+  return compare_snapshot_keys(r1->type, r1->ref_id, &r1->ip_addr, r2);
+}
+
+/* ================================================== */
+
+static int
+find_snapshot_record(const void *a, const void *b)
+{
+  SRC_Instance inst = (SRC_Instance)a;
+  const struct SnapshotRecord *record = *(const struct SnapshotRecord **)b;
+
+  return compare_snapshot_keys(inst->type, inst->ref_id, inst->ip_addr, record);
+}
+
+/* ================================================== */
+
+static void
+load_snapshot_record(SRC_Instance inst, const struct SnapshotRecord *record)
+{
+  const SST_DumpSample *samples;
+  char *ntp_name;
+
+  ntp_name = inst->type == SRC_NTP ? NSR_GetName(inst->ip_addr) : ".";
+  samples = (const SST_DumpSample *)((const char *)record + SNAPSHOT_ALIGN(sizeof (*record)));
+
+  if (!ntp_name || strncmp(record->name, ntp_name, sizeof (record->name)) != 0 ||
+      !check_dumped_state(inst, record->authenticated, record->stratum, record->leap) ||
+      !SST_LoadFromBuffer(inst->stats, samples, record->n_samples, record->asymmetry_run)) {
+    LOG(LOGS_WARN, "Could not load snapshot record for %s", source_to_string(inst));
+    return;
+  }
+
+  set_dumped_state(inst, record->reachability, record->reachability_size,
+                   record->stratum, record->leap);
+}
+
+/* ================================================== */
+/* Load sources from the binary snapshot, setting flags of sources
+   which were found in the snapshot */
+
+static void
+load_snapshot(char *loaded)
+{
+  const struct SnapshotRecord **records, **record;
+  const struct SnapshotHeader *header;
+  char path[PATH_MAX], *dumpdir;
+  size_t offset, length;
+  struct stat st;
+  uint32_t i, n;
+  void *map;
+  int fd;
+
+  dumpdir = CNF_GetDumpDir();
+  if (!dumpdir ||
+      snprintf(path, sizeof (path), "%s/%s%s", dumpdir, SNAPSHOT_FILENAME,
+               SNAPSHOT_SUFFIX) >= sizeof (path))
+    return;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return;
+
+  if (fstat(fd, &st) < 0 || st.st_size < SNAPSHOT_ALIGN(sizeof (*header)) ||
+      st.st_size > (off_t)INT_MAX) {
+    close(fd);
+    return;
+  }
+
+  length = st.st_size;
+  map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    LOG(LOGS_ERR, "Could not map %s : %s", path, strerror(errno));
+    return;
+  }
+
+  header = map;
+
+  if (memcmp(header->identifier, SNAPSHOT_IDENTIFIER, sizeof (header->identifier)) != 0 ||
+      header->byte_order != SNAPSHOT_BYTE_ORDER ||
+      header->record_size != sizeof (struct SnapshotRecord) ||
+      header->sample_size != sizeof (SST_DumpSample) ||
+      header->n_records > length / SNAPSHOT_ALIGN(sizeof (struct SnapshotRecord))) {
+    LOG(LOGS_WARN, "Could not load %s", path);
+    munmap(map, length);
+    return;
+  }
+
+  /* Index the records to avoid a linear search for each source */
+  records = MallocArray(const struct SnapshotRecord *, MAX(1, header->n_records));
+
+  for (i = n = 0, offset = SNAPSHOT_ALIGN(sizeof (*header)); i < header->n_records; i++) {
+    if (length - offset < SNAPSHOT_ALIGN(sizeof (**records)))
+      break;
+
+    records[n] = (const struct SnapshotRecord *)((const char *)map + offset);
+    offset += SNAPSHOT_ALIGN(sizeof (**records));
+
+    if (records[n]->n_samples < 1 || records[n]->n_samples > SST_MAX_SAMPLES ||
+        (length - offset) / sizeof (SST_DumpSample) < records[n]->n_samples)
+      break;
+
+    offset += records[n]->n_samples * sizeof (SST_DumpSample);
+    n++;
+  }
+
+  if (i < header->n_records)
+    LOG(LOGS_WARN, "Truncated snapshot %s", path);
+
+  qsort(records, n, sizeof (records[0]), compare_snapshot_records);
+
+  for (i = 0; i < n_sources; i++) {
+    if (sources[i]->type == SRC_NTP && !UTI_IsIPReal(sources[i]->ip_addr))
+      continue;
+
+    record = bsearch(sources[i], records, n, sizeof (records[0]), find_snapshot_record);
+    if (!record)
+      continue;
+
+    load_snapshot_record(sources[i], *record);
+    loaded[i] = 1;
+  }
+
+  LOG(LOGS_INFO, "Loaded snapshot of %"PRIu32" sources", n);
+
+  Free(records);
+  munmap(map, length);
+}
+
+/* ================================================== */
+
 #define MAX_WORDS 1
 
 static void
@@ -1461,19 +1830,14 @@ load_source(SRC_Instance inst)
       !fgets(line, sizeof (line), f) ||
         sscanf(words[0], "%d %o %d %d %d",
                &auth, &reach, &reach_size, &stratum, &leap) != 5 ||
-        (!auth && inst->authenticated) ||
-        stratum < 0 || stratum >= NTP_MAX_STRATUM ||
-        leap < LEAP_Normal || leap >= LEAP_Unsynchronised ||
+        !check_dumped_state(inst, auth, stratum, leap) ||
       !SST_LoadFromFile(inst->stats, f)) {
     LOG(LOGS_WARN, "Could not load dump file for %s", source_to_string(inst));
     fclose(f);
     return;
   }
 
-  inst->reachability = reach & ((1U << SOURCE_REACH_BITS) - 1);
-  inst->reachability_size = CLAMP(0, reach_size, SOURCE_REACH_BITS);
-  inst->stratum = stratum;
-  inst->leap = leap;
+  set_dumped_state(inst, reach, reach_size, stratum, leap);
 
   LOG(LOGS_INFO, "Loaded dump file for %s", source_to_string(inst));
 
@@ -1485,15 +1849,25 @@ load_source(SRC_Instance inst)
 void
 SRC_ReloadSources(void)
 {
+  char *loaded;
   int i;
 
+  /* Prefer the snapshot and load the other sources from their files */
+  loaded = Malloc(MAX(1, n_sources));
+  memset(loaded, 0, MAX(1, n_sources));
+
+  load_snapshot(loaded);
+
   for (i = 0; i < n_sources; i++) {
-    load_source(sources[i]);
+    if (!loaded[i])
+      load_source(sources[i]);
 
     /* Allow an immediate update of the reference */
     sources[i]->updates++;
   }
 
+  Free(loaded);
+
   /* Select sources and set the reference */
   SRC_SelectSource(NULL);
 }
@@ -1509,8 +1883,13 @@ SRC_RemoveDumpFiles(void)
   size_t i;
 
   dumpdir = CNF_GetDumpDir();
-  if (!dumpdir ||
-      snprintf(pattern, sizeof (pattern), "%s/*.dat", dumpdir) >= sizeof (pattern))
+  if (!dumpdir)
+    return;
+
+  if (!UTI_RemoveFile(dumpdir, SNAPSHOT_FILENAME, SNAPSHOT_SUFFIX))
+    ;
+
+  if (snprintf(pattern, sizeof (pattern), "%s/*.dat", dumpdir) >= sizeof (pattern))
     return;
 
   if (glob(pattern, 0, NULL, &gl))
@@ -59,6 +59,12 @@ typedef enum {
   SRC_AUTHSELECT_REQUIRE,
 } SRC_AuthSelectMode;
 
+/* Formats of files with saved measurement history */
+typedef enum {
+  SRC_DUMP_TEXT,
+  SRC_DUMP_BINARY,
+} SRC_DumpFormat;
+
 typedef enum {
   SRC_NTP,                      /* NTP client/peer */
   SRC_REFCLOCK                  /* Rerefence clock */
@@ -87,6 +93,10 @@ extern void SRC_SetRefid(SRC_Instance instance, uint32_t ref_id, IPAddr *addr);
 /* Function to get access to the sourcestats instance */
 extern SST_Stats SRC_GetSourcestats(SRC_Instance instance);
 
+/* Function to get the number of bytes allocated for the instance,
+   including its sourcestats instance */
+extern size_t SRC_GetMemorySize(SRC_Instance instance);
+
 /* Function to update the stratum and leap status of the source */
 extern void SRC_UpdateStatus(SRC_Instance instance, int stratum, NTP_Leap leap);
 
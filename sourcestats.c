@@ -37,11 +37,12 @@
 #include "conf.h"
 #include "logging.h"
 #include "local.h"
+#include "cmdmon.h"
 
 /* ================================================== */
 /* Define the maxumum number of samples that we want
    to store per source */
-#define MAX_SAMPLES 64
+#define MAX_SAMPLES SST_MAX_SAMPLES
 
 /* This is the assumed worst case bound on an unknown frequency,
    2000ppm, which would be pretty bad */
@@ -177,12 +178,21 @@ struct SST_Stats_Record {
   /* This array contains the root dispersions of each sample at the
      time of the measurements */
   double root_dispersions[MAX_SAMPLES];
+
+  /* Slew epoch of the local clock to which the sample times and
+     the regression estimates correspond */
+  LCL_SlewEpoch slew_epoch;
 };
 
+/* Cache of the records, which are large, so only a few are put in one
+   block */
+static ObjectCache instances = OBJECT_CACHE_INITIALISER(struct SST_Stats_Record, 4, MEM_SOURCESTATS);
+
 /* ================================================== */
 
 static void find_min_delay_sample(SST_Stats inst);
 static int get_buf_index(SST_Stats inst, int i);
+static void apply_slew_epoch(SST_Stats inst);
 
 /* ================================================== */
 
@@ -209,7 +219,7 @@ SST_CreateInstance(uint32_t refid, IPAddr *addr, int min_samples, int max_sample
                    double min_delay, double asymmetry)
 {
   SST_Stats inst;
-  inst = MallocNew(struct SST_Stats_Record);
+  inst = MallocObject(&instances);
 
   inst->max_samples = max_samples > 0 ? CLAMP(1, max_samples, MAX_SAMPLES) : MAX_SAMPLES;
   inst->min_samples = CLAMP(1, min_samples, inst->max_samples);
@@ -228,7 +238,7 @@ SST_CreateInstance(uint32_t refid, IPAddr *addr, int min_samples, int max_sample
 void
 SST_DeleteInstance(SST_Stats inst)
 {
-  Free(inst);
+  FreeObject(&instances, inst);
 }
 
 /* ================================================== */
@@ -252,6 +262,7 @@ SST_ResetInstance(SST_Stats inst)
   inst->nruns = 0;
   inst->asymmetry_run = 0;
   inst->asymmetry = 0.0;
+  LCL_GetSlewEpoch(&inst->slew_epoch);
 }
 
 /* ================================================== */
@@ -291,6 +302,8 @@ SST_AccumulateSample(SST_Stats inst, NTP_Sample *sample)
 {
   int n, m;
 
+  apply_slew_epoch(inst);
+
   /* Make room for the new sample */
   if (inst->n_samples > 0 &&
       (inst->n_samples == MAX_SAMPLES || inst->n_samples == inst->max_samples)) {
@@ -517,6 +530,9 @@ SST_DoNewRegression(SST_Stats inst)
   double sd_weight, sd;
   double old_skew, old_freq, stress;
   double precision;
+  RPT_SourcestatsReport report;
+
+  apply_slew_epoch(inst);
 
   convert_to_intervals(inst, times_back + inst->runs_samples);
 
@@ -584,8 +600,7 @@ SST_DoNewRegression(SST_Stats inst)
               inst->asymmetry, inst->asymmetry_run);
 
     if (logfileid != -1) {
-      LOG_FileWrite(logfileid, "%s %-15s %10.3e %10.3e %10.3e %10.3e %10.3e %7.1e %3d %3d %3d %5.2f",
-              UTI_TimeToLogForm(inst->offset_time.tv_sec),
+      LOG_FileWrite(logfileid, &inst->offset_time, " %-15s %10.3e %10.3e %10.3e %10.3e %10.3e %7.1e %3d %3d %3d %5.2f",
               inst->ip_addr ? UTI_IPToString(inst->ip_addr) : UTI_RefidToString(inst->refid),
               inst->std_dev,
               inst->estimated_offset, inst->estimated_offset_sd,
@@ -616,6 +631,16 @@ SST_DoNewRegression(SST_Stats inst)
 
   find_best_sample_index(inst, times_back + times_back_start);
 
+  /* Push the new estimates to subscribers of the command socket */
+  if (inst->regression_ok && CAM_IsSubscribed(REC_SOURCESTATS)) {
+    report.ref_id = inst->refid;
+    if (inst->ip_addr)
+      report.ip_addr = *inst->ip_addr;
+    else
+      report.ip_addr.family = IPADDR_UNSPEC;
+    SST_DoSourcestatsReport(inst, &report, &inst->offset_time);
+    CAM_PublishSourcestats(&inst->offset_time, &report);
+  }
 }
 
 /* ================================================== */
@@ -628,6 +653,9 @@ SST_GetFrequencyRange(SST_Stats inst,
                       double *lo, double *hi)
 {
   double freq, skew;
+
+  apply_slew_epoch(inst);
+
   freq = inst->estimated_frequency;
   skew = inst->skew;
   *lo = freq - skew;
@@ -656,7 +684,9 @@ SST_GetSelectionData(SST_Stats inst, struct timespec *now,
 {
   double offset, sample_elapsed;
   int i, j;
-  
+
+  apply_slew_epoch(inst);
+
   if (!inst->n_samples) {
     *select_ok = 0;
     return;
@@ -720,6 +750,8 @@ SST_GetTrackingData(SST_Stats inst, struct timespec *ref_time,
   int i, j;
   double elapsed_sample;
 
+  apply_slew_epoch(inst);
+
   assert(inst->n_samples > 0);
 
   i = get_runsbuf_index(inst, inst->best_single_sample);
@@ -743,8 +775,8 @@ SST_GetTrackingData(SST_Stats inst, struct timespec *ref_time,
 
 /* ================================================== */
 
-void
-SST_SlewSamples(SST_Stats inst, struct timespec *when, double dfreq, double doffset)
+static void
+slew_samples(SST_Stats inst, struct timespec *when, double dfreq, double doffset)
 {
   int m, i;
   double delta_time;
@@ -778,6 +810,29 @@ SST_SlewSamples(SST_Stats inst, struct timespec *when, double dfreq, double doff
             1.0e6 * prev_freq, 1.0e6 * inst->estimated_frequency);
 }
 
+/* ================================================== */
+/* Correct the samples for the changes of the local clock made since
+   the samples were last accessed */
+
+static void
+apply_slew_epoch(SST_Stats inst)
+{
+  struct timespec when;
+  double dfreq, doffset;
+
+  while (LCL_GetSlewSinceEpoch(&inst->slew_epoch, &when, &dfreq, &doffset))
+    slew_samples(inst, &when, dfreq, doffset);
+}
+
+/* ================================================== */
+
+void
+SST_SlewSamples(SST_Stats inst, struct timespec *when, double dfreq, double doffset)
+{
+  apply_slew_epoch(inst);
+  slew_samples(inst, when, dfreq, doffset);
+}
+
 /* ================================================== */
 
 void
@@ -785,6 +840,8 @@ SST_CorrectOffset(SST_Stats inst, double doffset)
 {
   int i;
 
+  apply_slew_epoch(inst);
+
   if (!inst->n_samples)
     return;
 
@@ -814,7 +871,9 @@ double
 SST_PredictOffset(SST_Stats inst, struct timespec *when)
 {
   double elapsed;
-  
+
+  apply_slew_epoch(inst);
+
   if (inst->n_samples < MIN_SAMPLES_FOR_REGRESS) {
     /* We don't have any useful statistics, and presumably the poll
        interval is minimal.  We can't do any useful prediction other
@@ -852,6 +911,8 @@ SST_GetDelayTestData(SST_Stats inst, struct timespec *sample_time,
                      double *last_sample_ago, double *predicted_offset,
                      double *min_delay, double *skew, double *std_dev)
 {
+  apply_slew_epoch(inst);
+
   if (inst->n_samples < 6)
     return 0;
 
@@ -874,6 +935,8 @@ SST_SaveToFile(SST_Stats inst, FILE *out)
 {
   int m, i, j;
 
+  apply_slew_epoch(inst);
+
   if (inst->n_samples < 1)
     return 0;
 
@@ -901,6 +964,7 @@ SST_SaveToFile(SST_Stats inst, FILE *out)
 int
 SST_LoadFromFile(SST_Stats inst, FILE *in)
 {
+  SST_DumpSample samples[MAX_SAMPLES];
   int i, n_samples, arun;
   struct timespec now;
   double sample_time;
@@ -911,37 +975,99 @@ SST_LoadFromFile(SST_Stats inst, FILE *in)
       n_samples < 1 || n_samples > MAX_SAMPLES)
     return 0;
 
-  SST_ResetInstance(inst);
-
   LCL_ReadCookedTime(&now, NULL);
 
   for (i = 0; i < n_samples; i++) {
     if (!fgets(line, sizeof (line), in) ||
         sscanf(line, "%lf %lf %lf %lf %lf %lf %lf",
-               &sample_time, &inst->offsets[i], &inst->orig_offsets[i],
-               &inst->peer_delays[i], &inst->peer_dispersions[i],
-               &inst->root_delays[i], &inst->root_dispersions[i]) != 7)
+               &sample_time, &samples[i].offset, &samples[i].orig_offset,
+               &samples[i].peer_delay, &samples[i].peer_dispersion,
+               &samples[i].root_delay, &samples[i].root_dispersion) != 7)
       return 0;
 
     if (!UTI_IsTimeOffsetSane(&now, sample_time - UTI_TimespecToDouble(&now)))
       return 0;
 
     /* Some resolution is lost in the double format, but that's ok */
-    UTI_DoubleToTimespec(sample_time, &inst->sample_times[i]);
-
-    /* Make sure the samples are sane and they are in order */
-    if (!UTI_IsTimeOffsetSane(&inst->sample_times[i], -inst->offsets[i]) ||
-        UTI_CompareTimespecs(&now, &inst->sample_times[i]) < 0 ||
-        !(fabs(inst->peer_delays[i]) < 1.0e6 && fabs(inst->peer_dispersions[i]) < 1.0e6 &&
-          fabs(inst->root_delays[i]) < 1.0e6 && fabs(inst->root_dispersions[i]) < 1.0e6) ||
-        (i > 0 && UTI_CompareTimespecs(&inst->sample_times[i],
-                                       &inst->sample_times[i - 1]) <= 0))
+    UTI_DoubleToTimespec(sample_time, &samples[i].time);
+  }
+
+  return SST_LoadFromBuffer(inst, samples, n_samples, arun);
+}
+
+/* ================================================== */
+
+int
+SST_SaveToBuffer(SST_Stats inst, SST_DumpSample *samples, int *asymmetry_run)
+{
+  int m, i, j;
+
+  apply_slew_epoch(inst);
+
+  for (m = 0; m < inst->n_samples; m++) {
+    i = get_runsbuf_index(inst, m);
+    j = get_buf_index(inst, m);
+
+    samples[m].time = inst->sample_times[i];
+    samples[m].offset = inst->offsets[i];
+    samples[m].orig_offset = inst->orig_offsets[j];
+    samples[m].peer_delay = inst->peer_delays[i];
+    samples[m].peer_dispersion = inst->peer_dispersions[j];
+    samples[m].root_delay = inst->root_delays[j];
+    samples[m].root_dispersion = inst->root_dispersions[j];
+  }
+
+  *asymmetry_run = inst->asymmetry_run;
+
+  return inst->n_samples;
+}
+
+/* ================================================== */
+
+int
+SST_LoadFromBuffer(SST_Stats inst, const SST_DumpSample *samples, int n_samples,
+                   int asymmetry_run)
+{
+  const SST_DumpSample *sample;
+  struct timespec now;
+  int i;
+
+  apply_slew_epoch(inst);
+
+  if (n_samples < 1 || n_samples > MAX_SAMPLES)
+    return 0;
+
+  LCL_ReadCookedTime(&now, NULL);
+
+  /* Make sure the samples are sane and they are in order */
+  for (i = 0; i < n_samples; i++) {
+    sample = &samples[i];
+
+    if (sample->time.tv_nsec < 0 || sample->time.tv_nsec >= 1000000000 ||
+        !UTI_IsTimeOffsetSane(&now, UTI_DiffTimespecsToDouble(&sample->time, &now)) ||
+        !UTI_IsTimeOffsetSane(&sample->time, -sample->offset) ||
+        UTI_CompareTimespecs(&now, &sample->time) < 0 ||
+        !(fabs(sample->peer_delay) < 1.0e6 && fabs(sample->peer_dispersion) < 1.0e6 &&
+          fabs(sample->root_delay) < 1.0e6 && fabs(sample->root_dispersion) < 1.0e6) ||
+        (i > 0 && UTI_CompareTimespecs(&sample->time, &samples[i - 1].time) <= 0))
       return 0;
   }
 
+  SST_ResetInstance(inst);
+
+  for (i = 0; i < n_samples; i++) {
+    inst->sample_times[i] = samples[i].time;
+    inst->offsets[i] = samples[i].offset;
+    inst->orig_offsets[i] = samples[i].orig_offset;
+    inst->peer_delays[i] = samples[i].peer_delay;
+    inst->peer_dispersions[i] = samples[i].peer_dispersion;
+    inst->root_delays[i] = samples[i].root_delay;
+    inst->root_dispersions[i] = samples[i].root_dispersion;
+  }
+
   inst->n_samples = n_samples;
   inst->last_sample = inst->n_samples - 1;
-  inst->asymmetry_run = CLAMP(-MAX_ASYMMETRY_RUN, arun, MAX_ASYMMETRY_RUN);
+  inst->asymmetry_run = CLAMP(-MAX_ASYMMETRY_RUN, asymmetry_run, MAX_ASYMMETRY_RUN);
 
   find_min_delay_sample(inst);
   SST_DoNewRegression(inst);
@@ -957,6 +1083,8 @@ SST_DoSourceReport(SST_Stats inst, RPT_SourceReport *report, struct timespec *no
   int i, j;
   struct timespec last_sample_time;
 
+  apply_slew_epoch(inst);
+
   if (inst->n_samples > 0) {
     i = get_runsbuf_index(inst, inst->n_samples - 1);
     j = get_buf_index(inst, inst->n_samples - 1);
@@ -995,6 +1123,14 @@ SST_GetMinSamples(SST_Stats inst)
 
 /* ================================================== */
 
+size_t
+SST_GetMemorySize(SST_Stats inst)
+{
+  return sizeof (*inst);
+}
+
+/* ================================================== */
+
 void
 SST_DoSourcestatsReport(SST_Stats inst, RPT_SourcestatsReport *report, struct timespec *now)
 {
@@ -1002,6 +1138,8 @@ SST_DoSourcestatsReport(SST_Stats inst, RPT_SourcestatsReport *report, struct ti
   double elapsed, sample_elapsed;
   int bi, bj;
 
+  apply_slew_epoch(inst);
+
   report->n_samples = inst->n_samples;
   report->n_runs = inst->nruns;
 
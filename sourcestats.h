@@ -33,6 +33,20 @@
 
 typedef struct SST_Stats_Record *SST_Stats;
 
+/* Maximum number of samples held by an instance */
+#define SST_MAX_SAMPLES 64
+
+/* Sample in the binary dump format */
+typedef struct {
+  struct timespec time;
+  double offset;
+  double orig_offset;
+  double peer_delay;
+  double peer_dispersion;
+  double root_delay;
+  double root_dispersion;
+} SST_DumpSample;
+
 /* Init and fini functions */
 extern void SST_Initialise(void);
 extern void SST_Finalise(void);
@@ -84,10 +98,12 @@ SST_GetTrackingData(SST_Stats inst, struct timespec *ref_time,
                     double *frequency, double *frequency_sd, double *skew,
                     double *root_delay, double *root_dispersion);
 
-/* This routine is called when the local machine clock parameters are
-   changed.  It adjusts all existing samples that we are holding for
-   each peer so that it looks like they were made under the new clock
-   regime rather than the old one.
+/* This routine adjusts all existing samples that we are holding for
+   each peer so that it looks like they were made under a new clock
+   regime rather than the old one.  Changes of the local clock
+   dispatched to the parameter change handlers (except unknown steps)
+   don't need to be passed here, the samples are corrected for them
+   lazily on next access.
 
    when = cooked local time when the change occurs
 
@@ -127,6 +143,15 @@ extern int SST_SaveToFile(SST_Stats inst, FILE *out);
 
 extern int SST_LoadFromFile(SST_Stats inst, FILE *in);
 
+/* Copy the samples (oldest first) to a buffer with space for SST_MAX_SAMPLES
+   samples in the binary dump format.  Returns the number of samples. */
+extern int SST_SaveToBuffer(SST_Stats inst, SST_DumpSample *samples, int *asymmetry_run);
+
+/* Replace the samples with samples in the binary dump format.  Returns zero
+   if the samples are not valid. */
+extern int SST_LoadFromBuffer(SST_Stats inst, const SST_DumpSample *samples, int n_samples,
+                              int asymmetry_run);
+
 extern void SST_DoSourceReport(SST_Stats inst, RPT_SourceReport *report, struct timespec *now);
 
 extern void SST_DoSourcestatsReport(SST_Stats inst, RPT_SourcestatsReport *report, struct timespec *now);
@@ -135,6 +160,8 @@ extern int SST_Samples(SST_Stats inst);
 
 extern int SST_GetMinSamples(SST_Stats inst);
 
+extern size_t SST_GetMemorySize(SST_Stats inst);
+
 extern double SST_GetJitterAsymmetry(SST_Stats inst);
 
 #endif /* GOT_SOURCESTATS_H */
@@ -0,0 +1,207 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * 
+ **********************************************************************
+
+  =======================================================================
+
+  Reader of the status page published by chronyd
+  */
+
+#include "config.h"
+
+#include "sysincl.h"
+
+#include "statuspage.h"
+#include "util.h"
+
+/* Maximum number of attempts to get a consistent copy of the data */
+#define MAX_READ_ATTEMPTS 1000
+
+typedef enum {
+  READ_N_SOURCES,
+  READ_SOURCE,
+  READ_TRACKING,
+  READ_FIRST_UPDATE_DELAY,
+  READ_SERVER_STATS,
+} ReadType;
+
+/* ================================================== */
+
+void
+STP_InitReader(STP_Reader *reader, const char *path)
+{
+  reader->path = path;
+  reader->page = NULL;
+  reader->size = 0;
+}
+
+/* ================================================== */
+
+void
+STP_FinaliseReader(STP_Reader *reader)
+{
+  if (!reader->page)
+    return;
+
+  munmap(reader->page, reader->size);
+  reader->page = NULL;
+  reader->size = 0;
+}
+
+/* ================================================== */
+
+static int
+open_page(STP_Reader *reader)
+{
+  CMD_StatusPage *page;
+  struct stat st;
+  int fd;
+
+  fd = open(reader->path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+
+  if (fstat(fd, &st) < 0 || st.st_size < sizeof (CMD_StatusPage)) {
+    close(fd);
+    return 0;
+  }
+
+  page = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (page == MAP_FAILED)
+    return 0;
+
+  if (page->magic != STATUS_PAGE_MAGIC || page->version != STATUS_PAGE_VERSION ||
+      page->size < sizeof (*page) || page->size > st.st_size ||
+      page->max_sources > (page->size - sizeof (*page)) / sizeof (CMD_StatusPageSource)) {
+    munmap(page, st.st_size);
+    return 0;
+  }
+
+  reader->page = page;
+  reader->size = st.st_size;
+
+  return 1;
+}
+
+/* ================================================== */
+
+static STP_Status
+read_page(STP_Reader *reader, ReadType type, uint32_t index, void *data)
+{
+  CMD_StatusPage *page;
+  STP_Status status;
+  uint32_t sequence;
+  int attempt;
+
+#ifndef HAVE_SYNC_SYNCHRONIZE
+  /* A consistent copy cannot be made without memory barriers */
+  return STP_UNAVAILABLE;
+#endif
+
+  for (attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+    if (!reader->page || reader->page->flags & STATUS_PAGE_FLAG_STALE) {
+      STP_FinaliseReader(reader);
+      if (!open_page(reader))
+        return STP_UNAVAILABLE;
+    }
+
+    page = reader->page;
+
+    sequence = page->sequence;
+    UTI_MemoryBarrier();
+
+    /* Wait for the daemon to finish the update */
+    if (sequence % 2 != 0)
+      continue;
+
+    status = STP_OK;
+
+    switch (type) {
+      case READ_N_SOURCES:
+        *(uint32_t *)data = page->n_sources;
+        break;
+      case READ_SOURCE:
+        if (index >= page->n_sources || index >= page->max_sources)
+          status = STP_NO_SUCH_SOURCE;
+        else
+          *(CMD_StatusPageSource *)data = ((CMD_StatusPageSource *)(page + 1))[index];
+        break;
+      case READ_TRACKING:
+        *(RPY_Tracking *)data = page->tracking;
+        break;
+      case READ_FIRST_UPDATE_DELAY:
+        *(Float *)data = page->first_update_delay;
+        break;
+      case READ_SERVER_STATS:
+        *(RPY_ServerStats *)data = page->server_stats;
+        break;
+      default:
+        assert(0);
+    }
+
+    UTI_MemoryBarrier();
+
+    if (sequence == page->sequence && !(page->flags & STATUS_PAGE_FLAG_STALE))
+      return status;
+  }
+
+  return STP_UNAVAILABLE;
+}
+
+/* ================================================== */
+
+STP_Status
+STP_ReadNumberOfSources(STP_Reader *reader, uint32_t *n_sources)
+{
+  return read_page(reader, READ_N_SOURCES, 0, n_sources);
+}
+
+/* ================================================== */
+
+STP_Status
+STP_ReadSource(STP_Reader *reader, uint32_t index, CMD_StatusPageSource *source)
+{
+  return read_page(reader, READ_SOURCE, index, source);
+}
+
+/* ================================================== */
+
+STP_Status
+STP_ReadTracking(STP_Reader *reader, RPY_Tracking *tracking)
+{
+  return read_page(reader, READ_TRACKING, 0, tracking);
+}
+
+/* ================================================== */
+
+STP_Status
+STP_ReadFirstUpdateDelay(STP_Reader *reader, Float *delay)
+{
+  return read_page(reader, READ_FIRST_UPDATE_DELAY, 0, delay);
+}
+
+/* ================================================== */
+
+STP_Status
+STP_ReadServerStats(STP_Reader *reader, RPY_ServerStats *stats)
+{
+  return read_page(reader, READ_SERVER_STATS, 0, stats);
+}
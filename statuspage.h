@@ -0,0 +1,61 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * 
+ **********************************************************************
+
+  =======================================================================
+
+  Header file for the reader of the status page published by chronyd.
+  The data are copied from the page in the network byte order, as they
+  would be received in replies to the corresponding requests.
+  */
+
+#ifndef GOT_STATUSPAGE_H
+#define GOT_STATUSPAGE_H
+
+#include "candm.h"
+
+typedef struct {
+  const char *path;
+  CMD_StatusPage *page;
+  size_t size;
+} STP_Reader;
+
+/* Return values of the read functions */
+typedef enum {
+  STP_OK,
+  STP_UNAVAILABLE,      /* The page could not be opened or read */
+  STP_NO_SUCH_SOURCE,   /* The source index is out of range */
+} STP_Status;
+
+/* Initialise a reader of the page in the specified file.  The file is
+   opened on the first read and again when it was replaced by chronyd. */
+extern void STP_InitReader(STP_Reader *reader, const char *path);
+
+/* Unmap the page */
+extern void STP_FinaliseReader(STP_Reader *reader);
+
+/* Read a consistent copy of the data from the page */
+extern STP_Status STP_ReadNumberOfSources(STP_Reader *reader, uint32_t *n_sources);
+extern STP_Status STP_ReadSource(STP_Reader *reader, uint32_t index,
+                                 CMD_StatusPageSource *source);
+extern STP_Status STP_ReadTracking(STP_Reader *reader, RPY_Tracking *tracking);
+extern STP_Status STP_ReadFirstUpdateDelay(STP_Reader *reader, Float *delay);
+extern STP_Status STP_ReadServerStats(STP_Reader *reader, RPY_ServerStats *stats);
+
+#endif
@@ -34,6 +34,7 @@
 #include "logging.h"
 #include "manual.h"
 #include "memory.h"
+#include "metrics.h"
 #include "nameserv.h"
 #include "nameserv_async.h"
 #include "ntp_core.h"
@@ -107,6 +108,11 @@ DNS_Name2IPAddressAsync(const char *name, DNS_NameResolveHandler handler, void *
     ;
 }
 
+void
+DNS_FlushAsyncCache(void)
+{
+}
+
 #endif /* !FEAT_ASYNCDNS */
 
 #ifndef FEAT_CMDMON
@@ -126,6 +132,54 @@ CAM_OpenUnixSocket(void)
 {
 }
 
+void
+CAM_UpdateStatusPage(void)
+{
+}
+
+void
+MET_Initialise(void)
+{
+}
+
+void
+MET_Finalise(void)
+{
+}
+
+int
+CAM_IsSubscribed(int record_type)
+{
+  return 0;
+}
+
+void
+CAM_PublishNTPSample(struct timespec *time, RPT_NTPReport *report)
+{
+}
+
+void
+CAM_PublishRefclockSample(struct timespec *time, uint32_t ref_id, int filtered,
+                          NTP_Leap leap, int pulse, double raw_offset,
+                          double cooked_offset, double dispersion)
+{
+}
+
+void
+CAM_PublishSourcestats(struct timespec *time, RPT_SourcestatsReport *report)
+{
+}
+
+void
+CAM_PublishSelection(struct timespec *time, uint32_t ref_id, IPAddr *ip_addr)
+{
+}
+
+void
+CAM_PublishTracking(struct timespec *time)
+{
+}
+
 int
 CAM_AddAccessRestriction(IPAddr *ip_addr, int subnet_bits, int allow, int all)
 {
@@ -434,6 +488,17 @@ NSD_SignAndSendPacket(uint32_t key_id, NTP_Packet *packet, NTP_PacketInfo *info,
   return 0;
 }
 
+void
+NSD_GetServerStatsReport(RPT_ServerStatsReport *report)
+{
+  report->signd_requests = 0;
+  report->signd_drops = 0;
+  report->signd_timeouts = 0;
+  report->signd_max_queue = 0;
+  report->signd_mean_delay = 0.0;
+  report->signd_max_delay = 0.0;
+}
+
 #endif /* !FEAT_SIGND */
 
 #ifndef HAVE_CMAC
@@ -539,6 +604,12 @@ NNC_GetReport(NNC_Instance inst, RPT_AuthReport *report)
 {
 }
 
+size_t
+NNC_GetMemorySize(NNC_Instance inst)
+{
+  return 0;
+}
+
 void
 NKS_PreInitialise(uid_t uid, gid_t gid, int scfilter_level)
 {
@@ -530,8 +530,12 @@ SYS_Linux_EnableSystemCallFilter(int level, SYS_ProcessContext context)
     SCMP_SYS(fstat),
     SCMP_SYS(fstat64),
     SCMP_SYS(fstatat64),
+    SCMP_SYS(ftruncate),
     SCMP_SYS(getdents),
     SCMP_SYS(getdents64),
+    SCMP_SYS(inotify_add_watch),
+    SCMP_SYS(inotify_init1),
+    SCMP_SYS(inotify_rm_watch),
     SCMP_SYS(lseek),
     SCMP_SYS(lstat),
     SCMP_SYS(lstat64),
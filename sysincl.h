@@ -48,6 +48,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -66,4 +67,8 @@
 #include <sys/random.h>
 #endif
 
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
 #endif /* GOT_SYSINCL_H */
@@ -98,8 +98,7 @@ read_timeout(void *arg)
         struct timespec now;
 
         LCL_ReadCookedTime(&now, NULL);
-        LOG_FileWrite(logfileid, "%s %11.4e %11.4e",
-            UTI_TimeToLogForm(now.tv_sec), temp, comp);
+        LOG_FileWrite(logfileid, &now, " %11.4e %11.4e", temp, comp);
       }
     } else {
       LOG(LOGS_WARN, "Temperature compensation of %.3f ppm exceeds sanity limit of %.1f",
@@ -0,0 +1,216 @@
+/*
+ **********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+ */
+
+#include <binlog.c>
+#include <util.h>
+#include "test.h"
+
+#define FORMAT1 " %-15s %1c %2d %1d%1d%1d %4.2f %10.3e %08"PRIX32" %1d%1c"
+#define FORMAT2 ".%06d %-5s %3d %13.6e %% %lu %lld %zu %hhx"
+
+static int
+get_fields(BLG_Field *fields, const char *format, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start(ap, format);
+  n = BLG_GetFields(format, ap, fields, BLG_MAX_FIELDS);
+  va_end(ap);
+
+  return n;
+}
+
+static int
+encode(void *buf, int size, int index, const struct timespec *ts, const char *format, ...)
+{
+  BLG_Field fields[BLG_MAX_FIELDS];
+  int n_fields;
+  va_list ap;
+
+  va_start(ap, format);
+  n_fields = BLG_GetFields(format, ap, fields, BLG_MAX_FIELDS);
+  va_end(ap);
+
+  if (n_fields < 0)
+    return 0;
+
+  return BLG_EncodeDataRecord(buf, size, index, ts, fields, n_fields);
+}
+
+static void
+expect_line(char *line, int size, const struct timespec *ts, const char *format, ...)
+{
+  va_list ap;
+  int length;
+
+  length = snprintf(line, size, "%s", UTI_TimeToLogForm(ts->tv_sec));
+  va_start(ap, format);
+  vsnprintf(line + length, size - length, format, ap);
+  va_end(ap);
+}
+
+static void
+write_record(FILE *file, const void *buf, int length)
+{
+  TEST_CHECK(length > 0);
+  TEST_CHECK(fwrite(buf, length, 1, file) == 1);
+}
+
+#define RECORDS 10
+
+void
+test_unit(void)
+{
+  char buf[BLG_MAX_RECORD_LENGTH], line[BLG_MAX_LINE_LENGTH];
+  char expected[RECORDS][BLG_MAX_LINE_LENGTH];
+  BLG_Field fields[BLG_MAX_FIELDS];
+  struct timespec ts[RECORDS];
+  static BLG_Reader reader;
+  BLG_Record record;
+  int i, j, length, banners;
+  FILE *file, *text;
+
+  TEST_CHECK(BLG_EncodeStartRecord(buf, 10, "test", "Banner", 4) == 0);
+  TEST_CHECK(BLG_EncodeFormatRecord(buf, sizeof (buf), BLG_MAX_FORMATS, FORMAT1) == 0);
+  TEST_CHECK(get_fields(fields, "%*d", 1, 1) < 0);
+  TEST_CHECK(get_fields(fields, "%n", NULL) < 0);
+  TEST_CHECK(get_fields(fields, "%lf", 1.0) < 0);
+  TEST_CHECK(get_fields(fields, "%% %%") == 0);
+  TEST_CHECK(get_fields(fields, "%d %s", 1, "a") == 2);
+
+  for (i = 0; i < 100; i++) {
+    file = tmpfile();
+    TEST_CHECK(file);
+
+    for (j = 0; j < RECORDS; j++) {
+      ts[j].tv_sec = random() % 2 ? random() : -(random() % 1000000000);
+      ts[j].tv_nsec = random() % 1000000000;
+
+      /* Start again as after reopening the file */
+      if (j % 5 == 0) {
+        write_record(file, buf, BLG_EncodeStartRecord(buf, sizeof (buf), "test", "Banner",
+                                                      j / 5 + 1));
+        write_record(file, buf, BLG_EncodeFormatRecord(buf, sizeof (buf), 1, FORMAT1));
+        write_record(file, buf, BLG_EncodeFormatRecord(buf, sizeof (buf), 3, FORMAT2));
+      }
+
+      if (random() % 2) {
+        double d1 = TST_GetRandomDouble(-1.0, 1.0), d2 = TST_GetRandomDouble(-1e-3, 1e9);
+        int a = random() % 200 - 100, b = random() % 2;
+        uint32_t r = random();
+        char addr[16];
+
+        snprintf(addr, sizeof (addr), "%d.%d", a, b);
+        length = encode(buf, sizeof (buf), 1, &ts[j], FORMAT1, addr, 'N', a, b, 1, 0,
+                        d1, d2, r, b, 'I');
+        expect_line(expected[j], sizeof (expected[j]), &ts[j], FORMAT1, addr, 'N', a, b, 1, 0,
+                    d1, d2, r, b, 'I');
+      } else {
+        long long ll = -(long long)random() * random();
+        unsigned long ul = random() * 1000UL;
+        int usec = ts[j].tv_nsec / 1000, c = random();
+        double d = TST_GetRandomDouble(-1e10, 1e10);
+        size_t z = random();
+
+        length = encode(buf, sizeof (buf), 3, &ts[j], FORMAT2, usec, "", c % 1000, d,
+                        ul, ll, z, c);
+        expect_line(expected[j], sizeof (expected[j]), &ts[j], FORMAT2, usec, "", c % 1000, d,
+                    ul, ll, z, (unsigned char)c);
+      }
+
+      write_record(file, buf, length);
+    }
+
+    /* Records of unknown types are ignored */
+    memset(buf, 0, 8);
+    buf[0] = 8;
+    buf[2] = 100;
+    write_record(file, buf, 8);
+
+    rewind(file);
+    BLG_InitReader(&reader, file);
+    text = tmpfile();
+    TEST_CHECK(text);
+
+    for (j = 0; j < RECORDS; j++) {
+      TEST_CHECK(BLG_ReadRecord(&reader, &record) == BLG_OK);
+      TEST_CHECK(strcmp(record.name, "test") == 0);
+      TEST_CHECK(record.index == j % 5);
+      TEST_CHECK(record.time.tv_sec == ts[j].tv_sec);
+      TEST_CHECK(record.time.tv_nsec == ts[j].tv_nsec);
+      TEST_CHECK(record.n_fields == (strcmp(record.format, FORMAT1) == 0 ? 11 : 8));
+
+      length = BLG_PrintRecord(&record, line, sizeof (line));
+      TEST_CHECK(length == strlen(line));
+      TEST_CHECK(strcmp(line, expected[j]) == 0);
+
+      /* Long lines are truncated */
+      TEST_CHECK(BLG_PrintRecord(&record, line, 20) == 19);
+      TEST_CHECK(strncmp(line, expected[j], 19) == 0 && line[19] == '\0');
+      TEST_CHECK(BLG_PrintRecord(&record, line, 1) == 0);
+
+      TEST_CHECK(BLG_WriteText(&reader, &record, text));
+    }
+
+    TEST_CHECK(BLG_ReadRecord(&reader, &record) == BLG_END);
+
+    /* The banner is printed every record after the first start record and
+       every other record after the second start record */
+    rewind(text);
+    for (j = banners = 0; fgets(line, sizeof (line), text); ) {
+      if (strcmp(line, "Banner\n") == 0) {
+        banners++;
+        continue;
+      }
+      if (strcmp(line, "======\n") == 0)
+        continue;
+      line[strlen(line) - 1] = '\0';
+      TEST_CHECK(j < RECORDS && strcmp(line, expected[j]) == 0);
+      j++;
+    }
+    TEST_CHECK(j == RECORDS);
+    TEST_CHECK(banners == 5 + 3);
+
+    fclose(text);
+    fclose(file);
+
+    /* A truncated record is invalid */
+    file = tmpfile();
+    TEST_CHECK(file);
+    write_record(file, buf, BLG_EncodeStartRecord(buf, sizeof (buf), "test", "Banner", 1));
+    write_record(file, buf, BLG_EncodeFormatRecord(buf, sizeof (buf), 0, FORMAT1));
+    length = encode(buf, sizeof (buf), 0, &ts[0], FORMAT1, "a", 'N', 1, 1, 1, 0, 1.0, 2.0,
+                    (uint32_t)3, 1, 'I');
+    write_record(file, buf, 1 + random() % (length - 1));
+    rewind(file);
+    BLG_InitReader(&reader, file);
+    TEST_CHECK(BLG_ReadRecord(&reader, &record) == BLG_INVALID);
+    fclose(file);
+
+    /* Data records need a start record */
+    file = tmpfile();
+    TEST_CHECK(file);
+    write_record(file, buf, length);
+    rewind(file);
+    BLG_InitReader(&reader, file);
+    TEST_CHECK(BLG_ReadRecord(&reader, &record) == BLG_INVALID);
+    fclose(file);
+  }
+}
@@ -0,0 +1,196 @@
+/*
+ **********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+ */
+
+#include <memory.c>
+#include <array.h>
+#include "test.h"
+
+#define MAX_OBJECTS 1000
+
+struct Object {
+  double x;
+  char data[13];
+};
+
+/* Check that the object was not overwritten by other objects */
+static void
+check_object(struct Object *object, char tag)
+{
+  unsigned int i;
+
+  for (i = 0; i < sizeof (*object); i++)
+    TEST_CHECK(((char *)object)[i] == tag);
+}
+
+static void
+check_usage(MEM_Tag tag, size_t bytes, unsigned long objects)
+{
+  RPT_MemoryReport report;
+
+  TEST_CHECK(MEM_GetReport(tag, &report));
+  TEST_CHECK(report.current_bytes == bytes);
+  TEST_CHECK(report.current_objects == objects);
+  TEST_CHECK(report.peak_bytes >= bytes);
+  TEST_CHECK(report.peak_objects >= objects);
+}
+
+static void
+test_accounting(void)
+{
+  size_t sizes[MAX_OBJECTS], bytes[MEM_TAGS + 1], b;
+  unsigned long objects[MEM_TAGS + 1], o;
+  MEM_Tag tags[MAX_OBJECTS];
+  RPT_MemoryReport report;
+  void *ptrs[MAX_OBJECTS];
+  ARR_Instance array;
+  int i, j, k, n;
+
+  TEST_CHECK(!MEM_GetReport(-1, &report));
+  TEST_CHECK(!MEM_GetReport(MEM_TAGS + 1, &report));
+  TEST_CHECK(MEM_GetReport(MEM_TAGS, &report));
+  TEST_CHECK(strcmp(report.name, "total") == 0);
+
+  for (i = 0; i <= MEM_TAGS; i++) {
+    TEST_CHECK(MEM_GetReport(i, &report));
+    bytes[i] = report.current_bytes;
+    objects[i] = report.current_objects;
+  }
+
+  for (i = n = 0; i < 10000; i++) {
+    j = n > 0 ? random() % n : 0;
+
+    switch (n > 0 ? random() % 4 : 0) {
+      case 0:
+        if (n >= MAX_OBJECTS)
+          break;
+        sizes[n] = random() % 1000;
+        ptrs[n] = random() % 2 ? Malloc(sizes[n]) : Malloc2(sizes[n], 1);
+        memset(ptrs[n], 0, sizes[n]);
+        tags[n] = MEM_OTHER;
+        n++;
+        break;
+      case 1:
+        sizes[j] = random() % 1000;
+        ptrs[j] = Realloc(ptrs[j], sizes[j]);
+        memset(ptrs[j], 0, sizes[j]);
+        break;
+      case 2:
+        tags[j] = random() % MEM_TAGS;
+        MEM_SetTag(ptrs[j], tags[j], 1);
+        break;
+      case 3:
+        Free(ptrs[j]);
+        n--;
+        ptrs[j] = ptrs[n];
+        sizes[j] = sizes[n];
+        tags[j] = tags[n];
+        break;
+    }
+
+    if (random() % 100)
+      continue;
+
+    for (j = 0; j < MEM_TAGS; j++) {
+      b = bytes[j];
+      o = objects[j];
+
+      for (k = 0; k < n; k++) {
+        if (tags[k] != j)
+          continue;
+        b += sizeof (AllocHeader) + sizes[k];
+        o++;
+      }
+
+      check_usage(j, b, o);
+    }
+  }
+
+  for (; n > 0; n--)
+    Free(ptrs[n - 1]);
+
+  for (i = 0; i <= MEM_TAGS; i++)
+    check_usage(i, bytes[i], objects[i]);
+
+  Free(NULL);
+  ptrs[0] = Strdup("test");
+  TEST_CHECK(strcmp(ptrs[0], "test") == 0);
+  check_usage(MEM_OTHER, bytes[MEM_OTHER] + sizeof (AllocHeader) + 5, objects[MEM_OTHER] + 1);
+  Free(ptrs[0]);
+
+  array = ARR_CreateInstance(sizeof (int));
+  ARR_SetTag(array, MEM_KEYS, 1);
+  TEST_CHECK(MEM_GetReport(MEM_KEYS, &report));
+  TEST_CHECK(report.current_bytes > bytes[MEM_KEYS]);
+  TEST_CHECK(report.current_objects == objects[MEM_KEYS]);
+  b = report.current_bytes;
+
+  for (i = 0; i < 100; i++) {
+    ARR_GetNewElement(array);
+    TEST_CHECK(MEM_GetReport(MEM_KEYS, &report));
+    TEST_CHECK(report.current_objects == objects[MEM_KEYS] + i + 1);
+    TEST_CHECK(report.current_bytes >= bytes[MEM_KEYS] + (i + 1) * sizeof (int));
+  }
+  ARR_SetSize(array, 10);
+  check_usage(MEM_KEYS, b + sizeof (AllocHeader) + 10 * sizeof (int), objects[MEM_KEYS] + 10);
+  ARR_DestroyInstance(array);
+  check_usage(MEM_KEYS, bytes[MEM_KEYS], objects[MEM_KEYS]);
+}
+
+void
+test_unit(void)
+{
+  ObjectCache cache = OBJECT_CACHE_INITIALISER(struct Object, 7, MEM_OTHER);
+  struct Object *objects[MAX_OBJECTS];
+  char tags[MAX_OBJECTS];
+  int i, j, n;
+
+  for (i = 0; i < 100; i++) {
+    for (n = 0; n < MAX_OBJECTS && random() % 100; ) {
+      if (n > 0 && random() % 3 == 0) {
+        j = random() % n;
+        check_object(objects[j], tags[j]);
+        FreeObject(&cache, objects[j]);
+        n--;
+        objects[j] = objects[n];
+        tags[j] = tags[n];
+      } else {
+        objects[n] = MallocObject(&cache);
+        TEST_CHECK((uintptr_t)objects[n] % sizeof (double) == 0);
+        tags[n] = random();
+        memset(objects[n], tags[n], sizeof (*objects[n]));
+        n++;
+      }
+
+      TEST_CHECK(cache.objects == n);
+      TEST_CHECK(cache.blocks * cache.objects_per_block >= n);
+      TEST_CHECK(GetObjectCacheSize(&cache) >= n * sizeof (struct Object));
+    }
+
+    for (; n > 0; n--) {
+      check_object(objects[n - 1], tags[n - 1]);
+      FreeObject(&cache, objects[n - 1]);
+    }
+
+    TEST_CHECK(cache.objects == 0);
+    TEST_CHECK(cache.blocks == 0);
+    TEST_CHECK(GetObjectCacheSize(&cache) == 0);
+  }
+
+  test_accounting();
+}
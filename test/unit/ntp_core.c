@@ -42,6 +42,8 @@ static int req_length, res_length;
 #define NIO_IsServerSocket(fd) (fd == 100)
 #define NIO_IsServerSocketOpen() 1
 #define NIO_SendPacket(msg, to, from, len, process_tx) (memcpy(&req_buffer, msg, len), req_length = len, 1)
+#undef SCH_AddTimeoutByDelay
+#undef SCH_AddTimeoutInClass
 #define SCH_AddTimeoutByDelay(delay, handler, arg) (1 ? 102 : (handler(arg), 1))
 #define SCH_AddTimeoutInClass(delay, separation, randomness, class, handler, arg) \
   add_timeout_in_class(delay, separation, randomness, class, handler, arg)
@@ -398,6 +400,7 @@ test_unit(void)
   NCR_Instance inst1, inst2;
   NTP_Packet packet_queue[PACKET_QUEUE_LENGTH], packet;
   NTP_PacketInfo info;
+  RPT_ProfileReport profile;
 
   CNF_Initialise(0, 0);
   for (i = 0; i < sizeof conf / sizeof conf[0]; i++)
@@ -602,6 +605,21 @@ test_unit(void)
   TEST_CHECK(info.auth.mac.length == 72);
   TEST_CHECK(info.auth.mac.key_id == 300);
 
+  for (i = 0; i < SRV_PKT_TYPES; i++) {
+    TEST_CHECK(SCH_GetProfileReport(server_packet_counters[i], &profile));
+    TEST_CHECK(profile.type == RPT_PROFILE_COUNTER);
+    TEST_CHECK(strcmp(profile.name, server_packet_names[i]) == 0);
+    if (i == SRV_PKT_CLIENT || i == SRV_PKT_ACTIVE || i == SRV_PKT_SYMMETRIC_KEY)
+      TEST_CHECK(profile.count > 0);
+  }
+
+  SCH_ResetProfile();
+  for (i = 0; i < SCH_GetNumberOfProfileEntries(); i++) {
+    TEST_CHECK(SCH_GetProfileReport(i, &profile));
+    TEST_CHECK(profile.count == 0);
+  }
+  TEST_CHECK(!SCH_GetProfileReport(i, &profile));
+
   CLG_Finalise();
   KEY_Finalise();
   REF_Finalise();
@@ -0,0 +1,236 @@
+/*
+ **********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+ */
+
+#include <config.h>
+#include "test.h"
+
+#ifdef FEAT_SIGND
+
+#include <ntp_signd.c>
+#include <local.h>
+#include <poll.h>
+
+#define SIGNER_BUFFER_LENGTH 65536
+
+/* Stand-in for the ntp_signd daemon on the other end of a socket pair */
+static int signer_fd;
+static char signer_buffer[SIGNER_BUFFER_LENGTH];
+static unsigned int signer_received;
+static uint16_t signer_ids[MAX_QUEUE_LENGTH];
+static unsigned int signer_pending;
+static unsigned int signer_max_pending;
+
+static void
+signer_receive(void)
+{
+  SigndRequest request;
+  unsigned int offset, length;
+  int r;
+
+  r = recv(signer_fd, signer_buffer + signer_received,
+           sizeof (signer_buffer) - signer_received, MSG_DONTWAIT);
+  if (r <= 0)
+    return;
+  signer_received += r;
+
+  for (offset = 0; signer_received - offset >= sizeof (request); offset += length) {
+    memcpy(&request, signer_buffer + offset, sizeof (request));
+    length = ntohl(request.length) + sizeof (request.length);
+    TEST_CHECK(length == sizeof (request));
+    TEST_CHECK(ntohl(request.op) == SIGN_TO_CLIENT);
+    TEST_CHECK(ntohl(request.key_id) == ntohs(request.packet_id) + 1);
+
+    signer_ids[signer_pending++] = ntohs(request.packet_id);
+    signer_max_pending = MAX(signer_max_pending, signer_pending);
+  }
+
+  memmove(signer_buffer, signer_buffer + offset, signer_received - offset);
+  signer_received -= offset;
+}
+
+static void
+signer_respond(void)
+{
+  char buffer[4 * sizeof (SigndResponse)];
+  SigndResponse response;
+  unsigned int i, n, length, sent;
+
+  /* Respond to a random subset of the requests in a random order */
+  for (n = random() % (signer_pending + 1), length = 0; n > 0; n--) {
+    i = random() % signer_pending;
+
+    memset(&response, 0, sizeof (response));
+    response.length = htonl(offsetof(SigndResponse, signed_packet) + NTP_HEADER_LENGTH + 20 -
+                            sizeof (response.length));
+    response.version = htonl(SIGND_VERSION);
+    response.op = htonl(random() % 10 ? SIGNING_SUCCESS : SIGNING_FAILURE);
+    response.packet_id = htonl(signer_ids[i]);
+
+    signer_ids[i] = signer_ids[--signer_pending];
+
+    /* Write the responses in random chunks */
+    memcpy(buffer + length, &response, ntohl(response.length) + sizeof (response.length));
+    length += ntohl(response.length) + sizeof (response.length);
+
+    if (length > sizeof (buffer) - sizeof (response) || n == 1) {
+      for (sent = 0; sent < length; sent += i) {
+        i = 1 + random() % length;
+        i = MIN(i, length - sent);
+        TEST_CHECK(send(signer_fd, buffer + sent, i, 0) == i);
+      }
+      length = 0;
+    }
+  }
+}
+
+static int
+has_input(int fd)
+{
+  struct pollfd pfd;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+
+  return poll(&pfd, 1, 0) > 0;
+}
+
+static void
+add_requests(int n, uint32_t *accepted, uint32_t *rejected)
+{
+  NTP_Remote_Address remote_addr;
+  NTP_Local_Address local_addr;
+  NTP_PacketInfo info;
+  NTP_Packet packet;
+  unsigned int index;
+
+  TST_GetRandomAddress(&remote_addr.ip_addr, IPADDR_INET4, 32);
+  remote_addr.port = 123;
+  local_addr.ip_addr.family = IPADDR_UNSPEC;
+  local_addr.if_index = INVALID_IF_INDEX;
+  local_addr.sock_fd = -1;
+
+  memset(&packet, 0, sizeof (packet));
+  memset(&info, 0, sizeof (info));
+  info.length = NTP_HEADER_LENGTH;
+
+  for (; n > 0; n--) {
+    index = QUEUE_INDEX(queue_depth);
+    if (NSD_SignAndSendPacket(index + 1, &packet, &info, &remote_addr, &local_addr))
+      (*accepted)++;
+    else
+      (*rejected)++;
+  }
+}
+
+void
+test_unit(void)
+{
+  char conf[][100] = {
+    "ntpsigndsocket /nonexistent queue 100 pipeline 8 timeout 1.0",
+  };
+  uint32_t accepted, rejected;
+  RPT_ServerStatsReport report;
+  int i, j, fds[2];
+
+  CNF_Initialise(0, 0);
+  for (i = 0; i < sizeof conf / sizeof conf[0]; i++)
+    CNF_ParseLine(NULL, i + 1, conf[i]);
+
+  LCL_Initialise();
+  SCH_Initialise();
+  NSD_Initialise();
+
+  TEST_CHECK(queue_length == 100);
+  TEST_CHECK(max_in_flight == 8);
+  TEST_CHECK(request_timeout == 1.0);
+
+  TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  signer_fd = fds[1];
+  sock_fd = fds[0];
+  SCH_AddFileHandler(sock_fd, SCH_FILE_INPUT, read_write_socket, NULL);
+
+  accepted = rejected = 0;
+
+  for (i = 0; i < 10000; i++) {
+    add_requests(random() % 30, &accepted, &rejected);
+    TEST_CHECK(queue_depth <= queue_length);
+
+    for (j = random() % 20; j > 0; j--)
+      read_write_socket(sock_fd, SCH_FILE_OUTPUT, NULL);
+    TEST_CHECK(requests_in_flight <= max_in_flight);
+
+    signer_receive();
+    signer_respond();
+
+    while (has_input(sock_fd))
+      read_write_socket(sock_fd, SCH_FILE_INPUT, NULL);
+
+    TEST_CHECK(sock_fd == fds[0]);
+    TEST_CHECK(requests_in_flight == signer_pending);
+  }
+
+  /* Complete all requests */
+  while (queue_depth > 0) {
+    read_write_socket(sock_fd, SCH_FILE_OUTPUT, NULL);
+    signer_receive();
+    signer_respond();
+    while (has_input(sock_fd))
+      read_write_socket(sock_fd, SCH_FILE_INPUT, NULL);
+  }
+
+  NSD_GetServerStatsReport(&report);
+  TEST_CHECK(rejected > 0);
+  TEST_CHECK(report.signd_requests == accepted);
+  TEST_CHECK(report.signd_drops == rejected);
+  TEST_CHECK(report.signd_timeouts == 0);
+  TEST_CHECK(report.signd_max_queue == queue_length);
+  TEST_CHECK(total_responses == accepted);
+  TEST_CHECK(signer_max_pending == max_in_flight);
+
+  /* Expire half of the requests, the rest is dropped as the socket cannot
+     be opened again */
+  add_requests(50, &accepted, &rejected);
+  for (i = 0; i < 10; i++)
+    read_write_socket(sock_fd, SCH_FILE_OUTPUT, NULL);
+  for (i = 0; i < 25; i++)
+    ((SignInstance *)ARR_GetElement(queue, QUEUE_INDEX(i)))->request_time -= 2.0;
+
+  SCH_RemoveTimeout(timeout_id);
+  handle_timeout(NULL);
+
+  NSD_GetServerStatsReport(&report);
+  TEST_CHECK(report.signd_timeouts == 25);
+  TEST_CHECK(report.signd_drops == rejected + 25);
+  TEST_CHECK(queue_depth == 0);
+  TEST_CHECK(sock_fd == INVALID_SOCK_FD);
+
+  close(signer_fd);
+
+  NSD_Finalise();
+  SCH_Finalise();
+  LCL_Finalise();
+  CNF_Finalise();
+}
+#else
+void
+test_unit(void)
+{
+  TEST_REQUIRE(0);
+}
+#endif
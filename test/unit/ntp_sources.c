@@ -29,14 +29,20 @@
 #include <ntp_core.h>
 #include <ntp_io.h>
 
-static char *requested_name = NULL;
-static DNS_NameResolveHandler resolve_handler = NULL;
-static void *resolve_handler_arg = NULL;
-
-#define DNS_Name2IPAddressAsync(name, handler, arg) \
-  requested_name = (name), \
-  resolve_handler = (handler), \
-  resolve_handler_arg = (arg)
+#define MAX_REQUESTS 16
+
+struct Request {
+  const char *name;
+  DNS_NameResolveHandler handler;
+  void *arg;
+};
+
+static struct Request requests[MAX_REQUESTS];
+static int n_requests = 0;
+
+static void add_request(const char *name, DNS_NameResolveHandler handler, void *arg);
+
+#define DNS_Name2IPAddressAsync(name, handler, arg) add_request(name, handler, arg)
 #define NCR_ChangeRemoteAddress(inst, remote_addr, ntp_only) \
   change_remote_address(inst, remote_addr, ntp_only)
 #define NCR_ProcessRxKnown(remote_addr, local_addr, ts, msg, len) (random() % 2)
@@ -49,14 +55,34 @@ static void change_remote_address(NCR_Instance inst, NTP_Remote_Address *remote_
 
 #undef NCR_ChangeRemoteAddress
 
+static void
+add_request(const char *name, DNS_NameResolveHandler handler, void *arg)
+{
+  TEST_CHECK(n_requests < MAX_REQUESTS);
+  TEST_CHECK(n_requests < CNF_GetResolverThreads());
+  TEST_CHECK(((struct UnresolvedSource *)arg)->resolving);
+
+  requests[n_requests].name = name;
+  requests[n_requests].handler = handler;
+  requests[n_requests].arg = arg;
+  n_requests++;
+}
+
 static void
 resolve_random_address(DNS_Status status, int rand_bits)
 {
   IPAddr ip_addrs[DNS_MAX_ADDRESSES];
+  struct Request request;
   int i, n_addrs;
 
-  TEST_CHECK(requested_name);
-  requested_name = NULL;
+  TEST_CHECK(n_requests > 0);
+  TEST_CHECK(n_requests == n_resolving);
+
+  i = random() % n_requests;
+  request = requests[i];
+  requests[i] = requests[--n_requests];
+
+  TEST_CHECK(strcmp(request.name, ((struct UnresolvedSource *)request.arg)->name) == 0);
 
   if (status == DNS_Success) {
     n_addrs = random() % DNS_MAX_ADDRESSES + 1;
@@ -66,7 +92,7 @@ resolve_random_address(DNS_Status status, int rand_bits)
     n_addrs = 0;
   }
 
-  (resolve_handler)(status, n_addrs, ip_addrs, resolve_handler_arg);
+  (request.handler)(status, n_addrs, ip_addrs, request.arg);
 }
 
 static int
@@ -242,15 +268,13 @@ test_unit(void)
           SCH_RemoveTimeout(resolving_id);
           resolve_sources_timeout(NULL);
           TEST_CHECK(resolving_id == 0);
-          TEST_CHECK(requested_name);
+          TEST_CHECK(n_requests > 0);
         }
 
-        TEST_CHECK(!!unresolved_sources == (resolving_id != 0) || requested_name);
+        TEST_CHECK(!!unresolved_sources == (resolving_id != 0) || n_requests > 0);
       }
 
-      while (requested_name && random() % 2) {
-        TEST_CHECK(resolving_source);
-        TEST_CHECK(strcmp(requested_name, resolving_source->name) == 0);
+      while (n_requests > 0 && random() % 2) {
         TEST_CHECK(!record_lock);
 
         switch (random() % 3) {
@@ -323,10 +347,8 @@ test_unit(void)
       TEST_CHECK(get_pool(j)->max_sources == 0);
     }
 
-    while (requested_name) {
-      TEST_CHECK(resolving_source);
+    while (n_requests > 0)
       resolve_random_address(random() % 2 ? DNS_Success : DNS_TryAgain, 4);
-    }
 
     if (unresolved_sources && resolving_id == 0)
       NSR_ResolveSources();
@@ -339,7 +361,7 @@ test_unit(void)
     }
 
     TEST_CHECK(resolving_id == 0);
-    TEST_CHECK(!requested_name);
+    TEST_CHECK(n_requests == 0 && n_resolving == 0);
     TEST_CHECK(!unresolved_sources);
   }
 
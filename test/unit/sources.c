@@ -31,6 +31,163 @@ create_source(SRC_Type type, IPAddr *addr, int authenticated, int sel_options)
                                SRC_DEFAULT_MINSAMPLES, SRC_DEFAULT_MAXSAMPLES, 0.0, 1.0);
 }
 
+static void
+add_samples(SRC_Instance inst, int samples)
+{
+  NTP_Sample sample;
+  int i;
+
+  sample.offset = TST_GetRandomDouble(-1.0, 1.0);
+
+  for (i = 0; i < samples; i++) {
+    SCH_GetLastEventTime(&sample.time, NULL, NULL);
+    UTI_AddDoubleToTimespec(&sample.time, i - samples, &sample.time);
+
+    sample.offset += TST_GetRandomDouble(-1.0e-3, 1.0e-3);
+    sample.peer_delay = sample.root_delay = TST_GetRandomDouble(1.0e-6, 1.0e-3);
+    sample.peer_dispersion = sample.root_dispersion = TST_GetRandomDouble(1.0e-6, 1.0e-3);
+
+    SRC_AccumulateSample(inst, &sample);
+    SRC_UpdateStatus(inst, 1, LEAP_Normal);
+  }
+}
+
+static void
+reload_snapshot(uint32_t *ref_ids, int n, unsigned long *n_samples)
+{
+  RPT_SourcestatsReport report;
+  SRC_Instance srcs[16];
+  struct timespec now;
+  int i;
+
+  assert(n <= sizeof (srcs) / sizeof (srcs[0]));
+
+  for (i = 0; i < n; i++)
+    srcs[i] = SRC_CreateNewInstance(ref_ids[i], SRC_REFCLOCK, 0, 0, NULL,
+                                    SRC_DEFAULT_MINSAMPLES, SRC_DEFAULT_MAXSAMPLES, 0.0, 1.0);
+
+  SRC_ReloadSources();
+
+  SCH_GetLastEventTime(&now, NULL, NULL);
+
+  for (i = 0; i < n; i++) {
+    TEST_CHECK(SRC_ReportSourcestats(i, &report, &now));
+    n_samples[i] = report.n_samples;
+  }
+
+  for (i = n - 1; i >= 0; i--)
+    SRC_DestroyInstance(srcs[i]);
+}
+
+static void
+test_snapshot(void)
+{
+  unsigned long n_samples[16], loaded_samples[16];
+  RPT_SourcestatsReport report;
+  uint32_t ref_ids[16];
+  SRC_Instance srcs[16];
+  char conf[64], *data;
+  struct timespec now;
+  int i, j, n, length;
+  FILE *f;
+
+  snprintf(conf, sizeof (conf), "dumpdir .");
+  CNF_ParseLine(NULL, 0, conf);
+  snprintf(conf, sizeof (conf), "dumpformat binary");
+  CNF_ParseLine(NULL, 0, conf);
+
+  n = sizeof (srcs) / sizeof (srcs[0]);
+
+  for (i = 0; i < n; i++) {
+    ref_ids[i] = 0x50000000 + i;
+    srcs[i] = SRC_CreateNewInstance(ref_ids[i], SRC_REFCLOCK, 0, 0, NULL,
+                                    SRC_DEFAULT_MINSAMPLES, SRC_DEFAULT_MAXSAMPLES, 0.0, 1.0);
+    add_samples(srcs[i], i % 8 + 1);
+  }
+
+  SRC_DumpSources();
+
+  SCH_GetLastEventTime(&now, NULL, NULL);
+
+  for (i = 0; i < n; i++) {
+    TEST_CHECK(SRC_ReportSourcestats(i, &report, &now));
+    n_samples[i] = report.n_samples;
+    TEST_CHECK(n_samples[i] > 0);
+  }
+
+  for (i = n - 1; i >= 0; i--)
+    SRC_DestroyInstance(srcs[i]);
+
+  /* Read the snapshot to modify it in the following tests */
+  f = fopen("sources.bin", "r");
+  TEST_CHECK(f);
+  TEST_CHECK(fseek(f, 0, SEEK_END) == 0);
+  length = ftell(f);
+  TEST_CHECK(length > 0 && length % 8 == 0);
+  rewind(f);
+  data = Malloc(length);
+  TEST_CHECK(fread(data, length, 1, f) == 1);
+  fclose(f);
+
+  DEBUG_LOG("snapshot length %d", length);
+
+  /* All sources are restored in reversed order */
+  for (i = 0; i < n / 2; i++) {
+    uint32_t ref_id = ref_ids[i];
+    unsigned long samples = n_samples[i];
+
+    ref_ids[i] = ref_ids[n - 1 - i];
+    ref_ids[n - 1 - i] = ref_id;
+    n_samples[i] = n_samples[n - 1 - i];
+    n_samples[n - 1 - i] = samples;
+  }
+
+  reload_snapshot(ref_ids, n, loaded_samples);
+  for (i = 0; i < n; i++)
+    TEST_CHECK(loaded_samples[i] == n_samples[i]);
+
+  /* A source missing in the snapshot is not loaded */
+  ref_ids[0] = 0x60000000;
+  reload_snapshot(ref_ids, n, loaded_samples);
+  TEST_CHECK(loaded_samples[0] == 0);
+  for (i = 1; i < n; i++)
+    TEST_CHECK(loaded_samples[i] == n_samples[i]);
+
+  /* Truncated snapshots are loaded only partially */
+  for (i = 0; i < 100; i++) {
+    f = fopen("sources.bin", "w");
+    TEST_CHECK(f);
+    TEST_CHECK(fwrite(data, random() % length, 1, f) <= 1);
+    fclose(f);
+
+    reload_snapshot(ref_ids, n, loaded_samples);
+    for (j = 0; j < n; j++)
+      TEST_CHECK(loaded_samples[j] == 0 || loaded_samples[j] == n_samples[j]);
+  }
+
+  /* Corrupted snapshots must not crash */
+  for (i = 0; i < 1000; i++) {
+    f = fopen("sources.bin", "w");
+    TEST_CHECK(f);
+    for (j = random() % 4 + 1; j > 0; j--)
+      data[random() % length] ^= 1 << (random() % 8);
+    TEST_CHECK(fwrite(data, length, 1, f) == 1);
+    fclose(f);
+
+    reload_snapshot(ref_ids, n, loaded_samples);
+    for (j = 0; j < n; j++)
+      TEST_CHECK(loaded_samples[j] <= SST_MAX_SAMPLES);
+  }
+
+  Free(data);
+
+  SRC_RemoveDumpFiles();
+  TEST_CHECK(access("sources.bin", F_OK) < 0);
+
+  snprintf(conf, sizeof (conf), "dumpformat text");
+  CNF_ParseLine(NULL, 0, conf);
+}
+
 void
 test_unit(void)
 {
@@ -278,6 +435,8 @@ test_unit(void)
     }
   }
 
+  test_snapshot();
+
   NSR_Finalise();
   REF_Finalise();
   SRC_Finalise();
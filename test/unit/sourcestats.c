@@ -0,0 +1,166 @@
+/*
+ **********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+ */
+
+#include <sourcestats.c>
+#include <localp.h>
+#include "test.h"
+
+static double
+read_frequency(void)
+{
+  return 0.0;
+}
+
+static double
+set_frequency(double freq_ppm)
+{
+  return freq_ppm;
+}
+
+static void
+accrue_offset(double offset, double corr_rate)
+{
+}
+
+static int
+apply_step_offset(double offset)
+{
+  return 1;
+}
+
+static void
+offset_convert(struct timespec *raw, double *corr, double *err)
+{
+  *corr = 0.0;
+  if (err)
+    *err = 0.0;
+}
+
+/* Slew the reference instance immediately on every change */
+static void
+slew_reference(struct timespec *raw, struct timespec *cooked, double dfreq,
+               double doffset, LCL_ChangeType change_type, void *anything)
+{
+  SST_Stats inst = anything;
+
+  slew_samples(inst, cooked, dfreq, doffset);
+  LCL_GetSlewEpoch(&inst->slew_epoch);
+}
+
+static void
+compare_instances(SST_Stats lazy, SST_Stats ref)
+{
+  int i, j, k;
+
+  apply_slew_epoch(lazy);
+
+  TEST_CHECK(lazy->n_samples == ref->n_samples);
+  TEST_CHECK(lazy->runs_samples == ref->runs_samples);
+
+  /* The times in the reference are truncated to nanoseconds in each slew,
+     which has some effect on the regression */
+  for (i = -ref->runs_samples; i < ref->n_samples; i++) {
+    j = get_runsbuf_index(lazy, i);
+    k = get_runsbuf_index(ref, i);
+    TEST_CHECK(fabs(UTI_DiffTimespecsToDouble(&lazy->sample_times[j],
+                                              &ref->sample_times[k])) < 1.0e-6);
+    TEST_CHECK(fabs(lazy->offsets[j] - ref->offsets[k]) < 1.0e-9);
+  }
+
+  TEST_CHECK(fabs(UTI_DiffTimespecsToDouble(&lazy->offset_time, &ref->offset_time)) < 1.0e-6);
+  TEST_CHECK(fabs(lazy->estimated_offset - ref->estimated_offset) < 1.0e-6);
+  TEST_CHECK(fabs(lazy->estimated_frequency - ref->estimated_frequency) < 1.0e-9);
+}
+
+void
+test_unit(void)
+{
+  SST_Stats lazy, ref;
+  NTP_Sample sample;
+  double step;
+  int i, j, k;
+
+  CNF_Initialise(0, 0);
+  LCL_Initialise();
+  lcl_RegisterSystemDrivers(read_frequency, set_frequency, accrue_offset, apply_step_offset,
+                            offset_convert, NULL, NULL);
+  SST_Initialise();
+
+  for (i = 0; i < 100; i++) {
+    lazy = SST_CreateInstance(1, NULL, 1, 0, 0.0, 0.0);
+    ref = SST_CreateInstance(1, NULL, 1, 0, 0.0, 0.0);
+    LCL_AddParameterChangeHandler(slew_reference, ref);
+    TEST_CHECK(LCL_IsFirstParameterChangeHandler(slew_reference));
+
+    for (j = 0; j < 100; j++) {
+      memset(&sample, 0, sizeof (sample));
+      LCL_ReadCookedTime(&sample.time, NULL);
+      UTI_AddDoubleToTimespec(&sample.time, -TST_GetRandomDouble(0.0, 10.0) - 100.0 * (100 - j),
+                              &sample.time);
+      sample.offset = TST_GetRandomDouble(-1.0e-6, 1.0e-6);
+      sample.peer_delay = TST_GetRandomDouble(1.0e-3, 1.0e-2);
+      sample.peer_dispersion = TST_GetRandomDouble(1.0e-6, 1.0e-3);
+      sample.root_delay = sample.peer_delay;
+      sample.root_dispersion = sample.peer_dispersion;
+
+      SST_AccumulateSample(lazy, &sample);
+      SST_DoNewRegression(lazy);
+      SST_AccumulateSample(ref, &sample);
+      SST_DoNewRegression(ref);
+
+      for (k = random() % 10; k > 0; k--) {
+        if (random() % 10)
+          TEST_CHECK(LCL_AccumulateFrequencyAndOffset(TST_GetRandomDouble(-1.0e-5, 1.0e-5),
+                                                      TST_GetRandomDouble(-1.0e-3, 1.0e-3),
+                                                      1.0));
+        else
+          TEST_CHECK(LCL_ApplyStepOffset(TST_GetRandomDouble(-1.0, 1.0)));
+      }
+
+      /* Large steps shouldn't have an effect on the precision of later
+         corrections */
+      if (random() % 20 == 0) {
+        step = TST_GetRandomDouble(-1.0e9, 1.0e9);
+        TEST_CHECK(LCL_ApplyStepOffset(step));
+        TEST_CHECK(LCL_AccumulateFrequencyAndOffset(TST_GetRandomDouble(-1.0e-5, 1.0e-5),
+                                                    TST_GetRandomDouble(-1.0e-3, 1.0e-3),
+                                                    1.0));
+        TEST_CHECK(LCL_ApplyStepOffset(-step));
+      }
+
+      if (random() % 4 == 0)
+        compare_instances(lazy, ref);
+    }
+
+    compare_instances(lazy, ref);
+
+    /* Changes made without the handlers don't move the epoch */
+    TEST_CHECK(LCL_AccumulateFrequencyAndOffsetNoHandlers(1.0e-6, 1.0e-3, 1.0));
+    TEST_CHECK(!LCL_GetSlewSinceEpoch(&lazy->slew_epoch, &sample.time, &sample.offset,
+                                      &sample.peer_delay));
+
+    LCL_RemoveParameterChangeHandler(slew_reference, ref);
+    SST_DeleteInstance(lazy);
+    SST_DeleteInstance(ref);
+  }
+
+  SST_Finalise();
+  LCL_Finalise();
+  CNF_Finalise();
+}
@@ -1477,6 +1477,17 @@ UTI_ResetGetRandomFunctions(void)
 
 /* ================================================== */
 
+void
+UTI_MemoryBarrier(void)
+{
+  /* The call itself prevents the compiler from reordering the accesses */
+#ifdef HAVE_SYNC_SYNCHRONIZE
+  __sync_synchronize();
+#endif
+}
+
+/* ================================================== */
+
 int
 UTI_BytesToHex(const void *buf, unsigned int buf_len, char *hex, unsigned int hex_len)
 {
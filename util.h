@@ -228,6 +228,10 @@ extern void UTI_GetRandomBytes(void *buf, unsigned int len);
    to prevent forked processes getting the same sequence of random numbers */
 extern void UTI_ResetGetRandomFunctions(void);
 
+/* Order memory accesses before and after the call, e.g. in updates of data
+   shared with other processes or threads */
+extern void UTI_MemoryBarrier(void);
+
 /* Print data in hexadecimal format */
 extern int UTI_BytesToHex(const void *buf, unsigned int buf_len, char *hex, unsigned int hex_len);
 